@@ -182,24 +182,6 @@ static inline void pio_set_x_register(PIO pio, int sm, uint32_t value) {
     pio_sm_exec(pio, sm, pio_encode_mov(pio_x, pio_osr));
 }
 
-// Spread 8 bits of a byte into positions 0,4,8,...28
-static inline uint32_t spread8(uint32_t plane) {
-    plane = (plane | (plane << 12)) & 0x000F000Fu;
-    plane = (plane | (plane <<  6)) & 0x03030303u;
-    plane = (plane | (plane <<  3)) & 0x11111111u;
-    return plane;
-}
-
-// Merge 4 plane bytes [P3|P2|P1|P0] into 8 nibbles (pixel color indices).
-static inline uint32_t ega_pack8_from_planes(const uint32_t ega_planes) {
-    const uint32_t pixel1 = spread8(ega_planes        & 0xFFu);
-    const uint32_t pixel2 = spread8((ega_planes >> 8) & 0xFFu);
-    const uint32_t pixel3 = spread8((ega_planes >>16) & 0xFFu);
-    const uint32_t pixel4 = spread8(ega_planes >>24);
-
-    return pixel1 | pixel2 << 1 | pixel3 << 2 | pixel4 << 3;
-}
-
 static void __time_critical_func() hdmi_scanline_interrupt_handler() {
     static uint8_t buffer_index = 0;
     static uint16_t current_scanline = 0;
@@ -321,25 +303,7 @@ static void __time_critical_func() hdmi_scanline_interrupt_handler() {
                 break;
             }
             case EGA_320x200x16x4: {
-                const register uint32_t *ega_row = &VIDEORAM[__fast_mul(y, 40)];
-
-                // Process 40 dwords (320 pixels) in groups
-                for (int x = 0; x < 40; x++) {
-                    const uint32_t ega_planes = *ega_row++;
-
-                    // Build 8 color nibbles packed into a 32-bit word
-                    const uint32_t eight_pixels = ega_pack8_from_planes(ega_planes);
-
-                    // Unroll writing 8 pixels, duplicating horizontally
-                    *output_buffer++ = eight_pixels >> 28;
-                    *output_buffer++ = eight_pixels >> 24 & 0xF;
-                    *output_buffer++ = eight_pixels >> 20 & 0xF;
-                    *output_buffer++ = eight_pixels >> 16 & 0xF;
-                    *output_buffer++ = eight_pixels >> 12 & 0xF;
-                    *output_buffer++ = eight_pixels >> 8 & 0xF;
-                    *output_buffer++ = eight_pixels >> 4 & 0xF;
-                    *output_buffer++ = eight_pixels & 0xF;
-                }
+                planar_to_indexed(&VIDEORAM[__fast_mul(y, 40)], output_buffer, 40);
                 break;
             }
             case VGA_320x200x256x4: {
@@ -74,23 +74,8 @@ static int txt_palette_init = 0;
 enum graphics_mode_t graphics_mode;
 
 extern uint8_t __aligned(4) DEBUG_VRAM[80 * 10];
-// Spread 8 bits of a byte into positions 0,4,8,...28
-static inline uint32_t spread8(uint32_t plane) {
-    plane = (plane | (plane << 12)) & 0x000F000Fu;
-    plane = (plane | (plane <<  6)) & 0x03030303u;
-    plane = (plane | (plane <<  3)) & 0x11111111u;
-    return plane;
-}
-
-// Merge 4 plane bytes [P3|P2|P1|P0] into 8 nibbles (pixel color indices).
-static inline uint32_t ega_pack8_from_planes(const uint32_t ega_planes) {
-    const uint32_t pixel1 = spread8(ega_planes        & 0xFFu);
-    const uint32_t pixel2 = spread8((ega_planes >> 8) & 0xFFu);
-    const uint32_t pixel3 = spread8((ega_planes >>16) & 0xFFu);
-    const uint32_t pixel4 = spread8(ega_planes >>24);
-
-    return pixel1 | pixel2 << 1 | pixel3 << 2 | pixel4 << 3;
-}
+// One scanline of planar EGA/VGA pixels as colour indices
+static uint8_t __aligned(4) planar_line[640];
 
 void __time_critical_func() dma_handler_VGA() {
     dma_hw->ints0 = 1u << dma_channel_control;
@@ -411,68 +396,26 @@ void __time_critical_func() dma_handler_VGA() {
             break;
         }
         case EGA_320x200x16x4: {
-            const register uint32_t *ega_row = &VIDEORAM[__fast_mul(y, 40)];
-
-            // Process 40 dwords (320 pixels) in groups
-            for (int x = 0; x < 40; x++) {
-                uint32_t ega_planes = *ega_row++;
-
-                // Build 8 color nibbles packed into a 32-bit word
-                uint32_t eight_pixels = ega_pack8_from_planes(ega_planes);
-
-                // Unroll writing 8 pixels, duplicating horizontally
-                *output_buffer_16bit++ = current_palette[eight_pixels >> 28];
-                *output_buffer_16bit++ = current_palette[eight_pixels >> 24 & 0xF];
-                *output_buffer_16bit++ = current_palette[eight_pixels >> 20 & 0xF];
-                *output_buffer_16bit++ = current_palette[eight_pixels >> 16 & 0xF];
-                *output_buffer_16bit++ = current_palette[eight_pixels >> 12 & 0xF];
-                *output_buffer_16bit++ = current_palette[eight_pixels >> 8 & 0xF];
-                *output_buffer_16bit++ = current_palette[eight_pixels >> 4 & 0xF];
-                *output_buffer_16bit++ = current_palette[eight_pixels & 0xF];
+            planar_to_indexed(&VIDEORAM[__fast_mul(y, 40)], planar_line, 40);
+            for (int x = 0; x < 320; x++) {
+                *output_buffer_16bit++ = current_palette[planar_line[x]];
             }
             break;
         }
         case EGA_640x200x16x4: {
-            const register uint32_t *ega_row = &VIDEORAM[__fast_mul(y, 80)];
             output_buffer_8bit = (uint8_t *) output_buffer_16bit;
-            for (int i = 0; i < 80; ++i) {
-                uint32_t ega_planes = *ega_row++;
-
-                // Build 8 color nibbles packed into a 32-bit word
-                uint32_t eight_pixels = ega_pack8_from_planes(ega_planes);
-
-                // Unroll writing 8 pixels, duplicating horizontally
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 28];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 24 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 20 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 16 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 12 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 8 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 4 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels & 0xF];
+            planar_to_indexed(&VIDEORAM[__fast_mul(y, 80)], planar_line, 80);
+            for (int x = 0; x < 640; x++) {
+                *output_buffer_8bit++ = current_palette[planar_line[x]];
             }
             break;
         }
         case VGA_640x480x16: /* VGA 640x480 16-color */
         case EGA_640x350x16x4: /* EGA 640x350 16-color */ {
-            const register uint32_t *ega_row = &VIDEORAM[__fast_mul(screen_line, 80)];
             output_buffer_8bit = (uint8_t *) output_buffer_16bit;
-
-            for (int i = 0; i < 80; ++i) {
-                uint32_t ega_planes = *ega_row++;
-
-                // Build 8 color nibbles packed into a 32-bit word
-                uint32_t eight_pixels = ega_pack8_from_planes(ega_planes);
-
-                // Unroll writing 8 pixels, duplicating horizontally
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 28];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 24 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 20 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 16 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 12 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 8 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels >> 4 & 0xF];
-                *output_buffer_8bit++ = current_palette[eight_pixels & 0xF];
+            planar_to_indexed(&VIDEORAM[__fast_mul(screen_line, 80)], planar_line, 80);
+            for (int x = 0; x < 640; x++) {
+                *output_buffer_8bit++ = current_palette[planar_line[x]];
             }
             break;
         }
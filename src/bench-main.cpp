@@ -0,0 +1,383 @@
+// Headless benchmark runner: boots the configured disk images without a window or audio device,
+// runs unthrottled for a number of instructions or emulated seconds and prints the counters as JSON
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "emulator/emulator.h"
+#include "emu8950.h"
+#include "linux-audio.h"
+#include "host-renderer.cpp.inl"
+
+uint8_t log_debug = 0;
+
+extern OPL *emu8950_opl;
+extern "C" uint64_t sb_samplerate;
+
+// Guest output goes to stderr so stdout stays valid JSON
+extern "C" void _putchar(char character) {
+    fputc(character, stderr);
+}
+
+static scheduler_event_t dss_event, sb_event, sound_event, blink_event, frame_event;
+static int16_t last_dss_sample = 0;
+static int16_t last_sb_sample = 0;
+static int16_t dss_samples[SOUND_BLOCK_SAMPLES];
+static int16_t sb_samples[SOUND_BLOCK_SAMPLES];
+static int16_t speaker_samples[SOUND_BLOCK_SAMPLES];
+static int16_t sound_samples[SOUND_BLOCK_SAMPLES * 2];
+static int16_t stem_samples[SOUND_STEMS][SOUND_BLOCK_SAMPLES * 2];
+static int16_t *stems[SOUND_STEMS];
+static int other_count = 0;
+static bool capture = false;
+static bool capture_stems = false;
+static uint64_t sb_event_rate = 0;
+static volatile int frame_ready = 0;
+
+static uint64_t frames = 0;
+static uint64_t frame_time_ns = 0;
+static uint64_t frame_time_max_ns = 0;
+static uint64_t snapshot_time_ns = 0;
+
+static void dss_tick() {
+    last_dss_sample = dss_sample();
+}
+
+static void sb_tick() {
+    last_sb_sample = blaster_sample();
+    if (sb_event_rate != sb_samplerate) {
+        sb_event_rate = sb_samplerate;
+        scheduler_start_hz(&sb_event, sb_tick, sb_event_rate);
+    }
+}
+
+static void sound_tick() {
+    dss_samples[other_count] = last_dss_sample + covox_sample;
+    sb_samples[other_count] = last_sb_sample;
+    speaker_samples[other_count++] = speaker_sample();
+    if (other_count == SOUND_BLOCK_SAMPLES) {
+        get_sound_stems(dss_samples, sb_samples, speaker_samples, sound_samples, capture_stems ? stems : NULL,
+                        other_count);
+        if (capture) {
+            linux_audio_write(sound_samples, other_count);
+        }
+        for (int stem = 0; capture_stems && stem < SOUND_STEMS; stem++) {
+            linux_audio_write_stem(stem, stems[stem], other_count);
+        }
+        other_count = 0;
+    }
+}
+
+static void blink_tick() {
+    cursor_blink_state ^= 1;
+}
+
+static void frame_tick() {
+    frame_ready = 1;
+}
+
+static uint64_t host_time_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+static const char *overlay_drive_names[4] = { "fdd0", "fdd1", "hdd", "hdd2" };
+
+// Copy of the drive's overlay for --overlay-snapshot and --overlay-restore
+static void overlay_copy_path(char *path, const size_t size, const char *file, const uint8_t drivenum) {
+    snprintf(path, size, "%s.%s", file, overlay_drive_names[drivenum]);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [--fdd0 image] [--fdd1 image] [--hdd image] [--hdd2 image]\n"
+            "          [--instructions N] [--seconds S] [--clock 4.77|8|12|unlimited]\n"
+            "          [--disk-backend stdio|mmap|overlay] [--output file.json]\n"
+            "          [--fdd0-overlay file] [--fdd1-overlay file] [--hdd-overlay file] [--hdd2-overlay file]\n"
+            "          [--overlay-exit keep|merge|discard] [--overlay-snapshot file] [--overlay-restore file]\n"
+            "          [--load-state file] [--save-state file]\n"
+            "          [--snapshot-every FRAMES] [--snapshot-slots N] [--rewind STEPS] [--map X=directory]...\n"
+            "          [--audio-capture file.wav|file.raw] [--audio-stems yes|no]\n"
+            "Runs until N instructions have been executed or S seconds of emulated time have passed (default 10 s).\n"
+            "A loaded state replaces the boot, the state is saved when the run ends.\n"
+            "--overlay-snapshot copies every overlay to file.fdd0, file.hdd... when the run ends, before --overlay-exit,\n"
+            "--overlay-restore puts such copies back before the run, so they go with a saved state.\n"
+            "Rewind snapshots are taken every FRAMES frames into N slots (default 64), --rewind goes back\n"
+            "STEPS snapshots from the latest one when the run ends, before the state is saved.\n"
+            "--map makes a host directory network drive X: of the guest, once MAPDRIVE.COM has registered it.\n"
+            "--audio-capture writes the mixed sound, 16-bit stereo at the output rate, and --audio-stems yes each\n"
+            "source next to it as file-opl.wav, file-sb.wav... The capture follows emulated time, not the host.\n"
+            "The unlimited clock is not fitted to the host here, it keeps the 12 MHz scale so runs are reproducible.\n",
+            name);
+}
+
+static void write_json(FILE *out, const uint64_t instructions, const double host_seconds, const double emulated_seconds) {
+    static const char *memory_handlers[STATS_MEMORY_HANDLERS] = {
+        "read8", "read16", "read32", "write8", "write16", "write32"
+    };
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long) instructions);
+    fprintf(out, "  \"host_seconds\": %.6f,\n", host_seconds);
+    fprintf(out, "  \"emulated_seconds\": %.6f,\n", emulated_seconds);
+    fprintf(out, "  \"clock\": \"%s\",\n", cpu_clock_name(cpu_clock));
+    fprintf(out, "  \"cycles\": %llu,\n", (unsigned long long) cpu_cycles_total);
+    fprintf(out, "  \"instructions_per_second\": %.0f,\n", host_seconds > 0 ? instructions / host_seconds : 0);
+    fprintf(out, "  \"guest_mips\": %.3f,\n", emulated_seconds > 0 ? instructions / emulated_seconds / 1e6 : 0);
+    fprintf(out, "  \"realtime_factor\": %.3f,\n", host_seconds > 0 ? emulated_seconds / host_seconds : 0);
+    fprintf(out, "  \"frames\": {\"count\": %llu, \"total_ms\": %.3f, \"average_us\": %.3f, \"max_us\": %.3f},\n",
+            (unsigned long long) frames, frame_time_ns / 1e6,
+            frames ? frame_time_ns / 1e3 / frames : 0, frame_time_max_ns / 1e3);
+    fprintf(out, "  \"snapshots\": {\"count\": %u, \"total_ms\": %.3f},\n", snapshot_count(), snapshot_time_ns / 1e6);
+    fprintf(out, "  \"decode_cache\": {\"hits\": %llu, \"misses\": %llu},\n",
+            (unsigned long long) stats_decode_cache[0], (unsigned long long) stats_decode_cache[1]);
+    fprintf(out, "  \"disk_cache\": {\"hits\": %llu, \"misses\": %llu},\n",
+            (unsigned long long) stats_disk_cache[0], (unsigned long long) stats_disk_cache[1]);
+
+    fprintf(out, "  \"memory\": {");
+    for (int handler = 0; handler < STATS_MEMORY_HANDLERS; handler++) {
+        fprintf(out, "%s\n    \"%s\": {\"page\": %llu, \"slow\": %llu}", handler ? "," : "", memory_handlers[handler],
+                (unsigned long long) stats_memory[handler][STATS_PAGE],
+                (unsigned long long) stats_memory[handler][STATS_SLOW]);
+    }
+    fprintf(out, "\n  },\n");
+
+    fprintf(out, "  \"opcodes\": {");
+    bool first = true;
+    for (int opcode = 0; opcode < 256; opcode++) {
+        if (!stats_opcodes[opcode]) continue;
+        fprintf(out, "%s\n    \"0x%02X\": %llu", first ? "" : ",", opcode, (unsigned long long) stats_opcodes[opcode]);
+        first = false;
+    }
+    fprintf(out, "\n  }\n");
+    fprintf(out, "}\n");
+}
+
+int main(int argc, char **argv) {
+    uint64_t instruction_limit = 0;
+    double seconds_limit = 0;
+    const char *output = NULL;
+    const char *overlay_exit = "keep";
+    const char *overlay_snapshot = NULL, *overlay_restore = NULL;
+    const char *load_state = NULL;
+    const char *save_state = NULL;
+    uint32_t snapshot_every = 0;
+    uint32_t snapshot_slots = 64;
+    int64_t rewind_steps = -1;
+    const char *audio_capture = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!value) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (!strcmp(arg, "--fdd0")) {
+            host_disk_images[0] = value;
+        } else if (!strcmp(arg, "--fdd1")) {
+            host_disk_images[1] = value;
+        } else if (!strcmp(arg, "--hdd")) {
+            host_disk_images[2] = value;
+        } else if (!strcmp(arg, "--hdd2")) {
+            host_disk_images[3] = value;
+        } else if (!strcmp(arg, "--fdd0-overlay")) {
+            host_disk_overlays[0] = value;
+        } else if (!strcmp(arg, "--fdd1-overlay")) {
+            host_disk_overlays[1] = value;
+        } else if (!strcmp(arg, "--hdd-overlay")) {
+            host_disk_overlays[2] = value;
+        } else if (!strcmp(arg, "--hdd2-overlay")) {
+            host_disk_overlays[3] = value;
+        } else if (!strcmp(arg, "--overlay-exit")) {
+            overlay_exit = value;
+        } else if (!strcmp(arg, "--overlay-snapshot")) {
+            overlay_snapshot = value;
+        } else if (!strcmp(arg, "--overlay-restore")) {
+            overlay_restore = value;
+        } else if (!strcmp(arg, "--instructions")) {
+            instruction_limit = strtoull(value, NULL, 0);
+        } else if (!strcmp(arg, "--seconds")) {
+            seconds_limit = atof(value);
+        } else if (!strcmp(arg, "--clock")) {
+            if (!strcmp(value, "4.77")) {
+                cpu_set_clock(CPU_CLOCK_4_77MHZ);
+            } else if (!strcmp(value, "8")) {
+                cpu_set_clock(CPU_CLOCK_8MHZ);
+            } else if (!strcmp(value, "12")) {
+                cpu_set_clock(CPU_CLOCK_12MHZ);
+            } else if (!strcmp(value, "unlimited")) {
+                cpu_set_clock(CPU_CLOCK_UNLIMITED);
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(arg, "--disk-backend")) {
+            if (!strcmp(value, "stdio")) {
+                host_disk_backend = DISK_BACKEND_STDIO;
+            } else if (!strcmp(value, "mmap")) {
+                host_disk_backend = DISK_BACKEND_MMAP;
+            } else if (!strcmp(value, "overlay")) {
+                host_disk_backend = DISK_BACKEND_MMAP_OVERLAY;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(arg, "--load-state")) {
+            load_state = value;
+        } else if (!strcmp(arg, "--save-state")) {
+            save_state = value;
+        } else if (!strcmp(arg, "--snapshot-every")) {
+            snapshot_every = strtoul(value, NULL, 0);
+        } else if (!strcmp(arg, "--snapshot-slots")) {
+            snapshot_slots = strtoul(value, NULL, 0);
+        } else if (!strcmp(arg, "--rewind")) {
+            rewind_steps = strtoul(value, NULL, 0);
+        } else if (!strcmp(arg, "--map")) {
+            if (!value[0] || value[1] != '=' || !redirector_map(value[0], value + 2)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(arg, "--audio-capture")) {
+            audio_capture = value;
+        } else if (!strcmp(arg, "--audio-stems")) {
+            capture_stems = !strcmp(value, "yes");
+        } else if (!strcmp(arg, "--output")) {
+            output = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (!instruction_limit && seconds_limit <= 0) {
+        seconds_limit = 10;
+    }
+
+    write86 = write86_ob;
+    writew86 = writew86_ob;
+    writedw86 = writedw86_ob;
+    read86 = read86_ob;
+    readw86 = readw86_ob;
+    readdw86 = readdw86_ob;
+    memset(SCREEN, 0, sizeof(SCREEN));
+    emu8950_opl = OPL_new(3579552, SOUND_FREQUENCY);
+    blaster_reset();
+    sn76489_reset();
+    reset86();
+
+    if (audio_capture) {
+        linux_audio_configure(LINUX_AUDIO_FILE, audio_capture, 0);
+        if (linux_audio_init(SOUND_FREQUENCY, 2, SOUND_FREQUENCY / 25) != 0 || linux_audio_start() != 0) {
+            fprintf(stderr, "Cannot capture audio to %s\n", audio_capture);
+            return 1;
+        }
+        capture = true;
+        for (int stem = 0; stem < SOUND_STEMS; stem++) {
+            stems[stem] = stem_samples[stem];
+        }
+        if (capture_stems && linux_audio_open_stems(sound_stem_names, SOUND_STEMS) != 0) {
+            fprintf(stderr, "Cannot capture audio stems next to %s\n", audio_capture);
+            return 1;
+        }
+    } else {
+        capture_stems = false;
+    }
+
+    scheduler_start_hz(&dss_event, dss_tick, 7000); // Disney Sound Source frequency ~7KHz
+    sb_event_rate = sb_samplerate;
+    scheduler_start_hz(&sb_event, sb_tick, sb_event_rate);
+    scheduler_start_hz(&sound_event, sound_tick, SOUND_FREQUENCY);
+    scheduler_start_hz(&blink_event, blink_tick, 3); // Cursor blink ~3Hz
+    scheduler_start_hz(&frame_event, frame_tick, 60);
+    if (load_state && !savestate_load(load_state)) {
+        fprintf(stderr, "Cannot load state %s\n", load_state);
+        return 1;
+    }
+    if (overlay_restore) {
+        for (uint8_t drivenum = 0; drivenum < 4; drivenum++) {
+            if (!host_disk_overlays[drivenum]) continue;
+            char path[4096];
+            overlay_copy_path(path, sizeof(path), overlay_restore, drivenum);
+            if (!disk_overlay_restore(drivenum, path)) {
+                fprintf(stderr, "Cannot restore the %s overlay from %s\n", overlay_drive_names[drivenum], path);
+                return 1;
+            }
+        }
+    }
+    if (snapshot_every) {
+        snapshot_configure(snapshot_slots, snapshot_every);
+    }
+
+    const uint64_t emulated_limit_us = (uint64_t) (seconds_limit * 1e6);
+    const uint64_t start_ns = host_time_ns();
+    const uint64_t start_us = scheduler_elapsed_us();
+    uint64_t instructions = 0;
+
+    while (true) {
+        uint32_t chunk = 32768;
+        if (instruction_limit && instruction_limit - instructions < chunk) {
+            chunk = (uint32_t) (instruction_limit - instructions);
+        }
+        exec86(chunk);
+
+        if (frame_ready) {
+            frame_ready = 0;
+            const uint64_t frame_start_ns = host_time_ns();
+            renderer();
+            const uint64_t frame_ns = host_time_ns() - frame_start_ns;
+            frame_time_ns += frame_ns;
+            if (frame_ns > frame_time_max_ns) frame_time_max_ns = frame_ns;
+            frames++;
+
+            const uint64_t snapshot_start_ns = host_time_ns();
+            snapshot_frame();
+            snapshot_time_ns += host_time_ns() - snapshot_start_ns;
+        }
+
+        instructions = 0;
+        for (int opcode = 0; opcode < 256; opcode++) {
+            instructions += stats_opcodes[opcode];
+        }
+        if (instruction_limit && instructions >= instruction_limit) break;
+        if (emulated_limit_us && scheduler_elapsed_us() - start_us >= emulated_limit_us) break;
+    }
+
+    const double host_seconds = (host_time_ns() - start_ns) / 1e9;
+    const double emulated_seconds = (scheduler_elapsed_us() - start_us) / 1e6;
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Cannot open %s\n", output);
+        return 1;
+    }
+    write_json(out, instructions, host_seconds, emulated_seconds);
+    if (out != stdout) fclose(out);
+    profiler_dump();
+    if (rewind_steps >= 0 && !snapshot_rewind((uint32_t) rewind_steps)) {
+        fprintf(stderr, "Cannot rewind %lld snapshots, %u taken\n", (long long) rewind_steps, snapshot_count());
+    }
+    if (save_state && !savestate_save(save_state)) {
+        fprintf(stderr, "Cannot save state %s\n", save_state);
+    }
+    linux_audio_close();
+    disk_flush();
+    for (uint8_t drivenum = 0; drivenum < 4; drivenum++) {
+        if (!host_disk_overlays[drivenum]) continue;
+        if (overlay_snapshot) {
+            char path[4096];
+            overlay_copy_path(path, sizeof(path), overlay_snapshot, drivenum);
+            if (!disk_overlay_snapshot(drivenum, path)) {
+                fprintf(stderr, "Cannot copy the %s overlay to %s\n", overlay_drive_names[drivenum], path);
+            }
+        }
+        if (!strcmp(overlay_exit, "merge")) {
+            disk_overlay_merge(drivenum);
+        } else if (!strcmp(overlay_exit, "discard")) {
+            disk_overlay_discard(drivenum);
+        }
+    }
+    return 0;
+}
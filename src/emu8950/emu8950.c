@@ -14,8 +14,6 @@
 #include <string.h>
 #include <assert.h>
 
-#define SAMPLE_BUF_SIZE 1024
-
 #ifndef INLINE
 #if defined(_MSC_VER)
 #define INLINE __inline
@@ -381,6 +379,9 @@ static void initializeTables() {
     makeTllTable();
     makeRksTable();
     makeSinTable();
+#if EMU8950_SLOT_RENDER
+    slot_render_init();
+#endif
     table_initialized = 1;
 }
 
@@ -1692,23 +1693,25 @@ void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
     // kind of a nit pick, but so cheap - saves a bug every 24 hours due to an optimization
     // (we require that incrementing eg_counter is never zero during the rendering loop)
     opl->eg_counter = (opl->eg_counter & 0x3fffffffu) | 0x80000000u;
-    static uint8_t lfo_am_buffer_lsl3;
+    static uint8_t lfo_am_buffer_lsl3[SAMPLE_BUF_SIZE];
     assert(nsamples <= sizeof(lfo_am_buffer_lsl3));
-    opl->lfo_am_buffer_lsl3 = &lfo_am_buffer_lsl3;
+    opl->lfo_am_buffer_lsl3 = lfo_am_buffer_lsl3;
 #else
     static uint8_t lfo_am_buffer[SAMPLE_BUF_SIZE];
     assert(nsamples <= sizeof(lfo_am_buffer));
     opl->lfo_am_buffer = lfo_am_buffer;
 #endif
     static int16_t mod_buffer[SAMPLE_BUF_SIZE];
+#if EMU8950_LINEAR_SKIP
+    // modulator state before the block, in case its carrier mutes part way through
+    OPL_SLOT mod_slot;
+    uint8_t mod_rendered = 0;
+#endif
 
     opl->mod_buffer = mod_buffer;
     opl->buffer = buffer;
 
-    // todo achievable by memcpy
-//    for(uint32_t s = 0; s<nsamples; s++)
-    const uint32_t sample_index = 0;
-    {
+    for (uint32_t s = 0; s < nsamples; s++) {
         // generate amplitude modulation same for all channels
         // need am_phase and lfo_am
         opl->am_phase_index++;
@@ -1717,12 +1720,12 @@ void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
 
 #if EMU8950_SLOT_RENDER
         // note <<3 still fits within 8 bits
-        lfo_am_buffer_lsl3 = (am_table[opl->am_phase_index] >> (opl->am_mode ? 0 : 2)) << 3;
+        lfo_am_buffer_lsl3[s] = (am_table[opl->am_phase_index] >> (opl->am_mode ? 0 : 2)) << 3;
 #else
         lfo_am_buffer[s] = (am_table[opl->am_phase_index] >> (opl->am_mode ? 0 : 2));
 #endif
-        buffer[sample_index]=0;
     }
+    memset(buffer, 0, nsamples * sizeof(int32_t));
 
     for (i = 0; i < 18; i++) {
         OPL_SLOT *slot = &opl->slot[i];
@@ -1756,6 +1759,7 @@ void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
 #if EMU8950_LINEAR_SKIP // todo consider disabling as almost unnecessary with EMU8950_LINEAR_END_OF_NOTE_OPTIMIZATION
             if (slot->eg_out >= EG_MUTE && slot->eg_state != ATTACK) {
                 s_mod = 0;
+                mod_rendered = 0;
             } else
 #endif
             {
@@ -1763,6 +1767,10 @@ void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
 //                if (bc == 7 && i == 14) {
 //                    printf("WAM\n");
 //                }
+#if EMU8950_LINEAR_SKIP
+                mod_rendered = !opl->ch_alg[ch];
+                if (mod_rendered) mod_slot = *slot;
+#endif
                 s_mod = slot_mod_linear(opl, slot, nsamples, opl->eg_counter, opl->pm_phase);
             }
             if (s_mod != nsamples) {
@@ -1798,6 +1806,11 @@ void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
                     for (uint32_t s = s_alg; s < nsamples; s++) {
                         opl->buffer[s] += opl->mod_buffer[s];
                     }
+                } else if (mod_rendered) {
+                    // the carrier muted mid-block. Rendering a sample at a time skips the whole channel from the
+                    // next sample on, so the modulator must not advance past the carrier either
+                    *(slot - 1) = mod_slot;
+                    slot_mod_linear(opl, slot - 1, s_alg, opl->eg_counter, opl->pm_phase);
                 }
             }
 #if DUMPO
@@ -180,6 +180,20 @@ static uint16_t wav_or_table_lookup[4][4] = {
 };
 #endif
 
+static INLINE int16_t attenuate(uint16_t att) {
+    int16_t t = exp_table[att&0xff];
+    // note we're really just bit clearing the original top bit 15 ..
+    // shifts of 16 and up (reachable with the 0x0fff wave attenuation) give 0 as they do on ARM
+    uint32_t shift = (att>>8)&127;
+    int16_t res = shift < 16 ? t >> shift : 0;
+    if (!res) return res; // maybe make things more compatible
+#if EMU8950_LINEAR_NEG_NOT_NOT
+    return ((att & 0x8000) ? -res : res) << 1;
+#else
+    return ((att & 0x8000) ? ~res : res) << 1;
+#endif
+}
+
 static INLINE int16_t calc_sample(const SLOT_RENDER *slot, uint32_t index, int16_t am) {
 
 #if !EMU8950_NO_WAVE_TABLE_MAP
@@ -192,17 +206,7 @@ static INLINE int16_t calc_sample(const SLOT_RENDER *slot, uint32_t index, int16
     uint16_t h =  slot->wav_or_table[(index >> (PG_BITS - 2)) & 3] | slot->logsin_table[(index & (PG_WIDTH / 2 - 1))];
 #endif
 #endif
-    uint16_t att = h + slot->eg_out_tll_lsl3 + am;
-    int16_t t = exp_table[att&0xff];
-    // note we're really just bit clearing the original top bit 15 ..
-    // todo presumably the & is ignored on ARM?
-    int16_t res = t >> ((att>>8)&127);
-    if (!res) return res; // maybe make things more compatible
-#if EMU8950_LINEAR_NEG_NOT_NOT
-    return ((att & 0x8000) ? -res : res) << 1;
-#else
-    return ((att & 0x8000) ? ~res : res) << 1;
-#endif
+    return attenuate(h + slot->eg_out_tll_lsl3 + am);
 }
 
 #if 0
@@ -398,6 +402,196 @@ template <bool PM> void alg1_am0_fn(SLOT_RENDER *slot, uint32_t& pm_phase, uint3
     slot->buffer[s] += val + slot->mod_buffer[s];
 }
 
+#if !PICO_ON_DEVICE && EMU8950_NO_WAVE_TABLE_MAP
+// Host batch path for every slot without feedback: the envelope loop only records the phase index and the
+// attenuation of each sample, the waveform and exp lookups then run over the whole block at once
+#define SLOT_RENDER_BATCH 1
+// The x86 kernels are built whatever the compiler flags and picked by what the CPU runs when the first OPL is made
+#if __GNUC__ && (defined(__x86_64__) || defined(__i386__))
+#define SLOT_RENDER_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static uint32_t batch_index[SAMPLE_BUF_SIZE];
+static int32_t batch_att[SAMPLE_BUF_SIZE];
+static int32_t batch_out[SAMPLE_BUF_SIZE];
+
+// a distinct type per variant, so slot_envelope_loop inlines the call rather than going through a pointer
+template <bool PM, bool AM, bool FM> struct batch_fn {
+    void operator()(SLOT_RENDER *slot, uint32_t& pm_phase, uint32_t s) const {
+        uint32_t pg_out = advance_phase<PM>(slot, pm_phase);
+        batch_index[s] = FM ? pg_out + slot->mod_buffer[s] : pg_out;
+        batch_att[s] = slot->eg_out_tll_lsl3 + (AM ? slot->lfo_am_buffer_lsl3[s] : 0);
+    }
+};
+
+// the samples the vector kernels leave over, or all of them without one
+static INLINE void calc_batch_scalar(const SLOT_RENDER *slot, uint32_t s, uint32_t nsamples) {
+    for (; s < nsamples; s++) {
+        uint32_t index = batch_index[s];
+        uint16_t h = slot->wav_or_table[(index >> (PG_BITS - 2)) & 3] | slot->logsin_table[(index & (PG_WIDTH / 2 - 1))];
+        batch_out[s] = attenuate(h + batch_att[s]);
+    }
+}
+
+// Keeps the lookups out of the serial envelope code even without a vector unit
+static void calc_batch_scalar_all(const SLOT_RENDER *slot, uint32_t nsamples) {
+    calc_batch_scalar(slot, 0, nsamples);
+}
+
+#if SLOT_RENDER_X86
+// 32-bit copies of the tables for the gathers, made by slot_render_init
+static uint32_t logsin_table32[LOGSIN_TABLE_SIZE];
+static uint32_t exp_table32[256];
+
+// Eight samples at a time, matching calc_sample lane for lane
+__attribute__((target("avx2")))
+static void calc_batch_avx2(const SLOT_RENDER *slot, uint32_t nsamples) {
+    const uint16_t *wav_or = slot->wav_or_table;
+    const __m256i wav_or_table = _mm256_setr_epi32(wav_or[0], wav_or[1], wav_or[2], wav_or[3],
+                                                   wav_or[0], wav_or[1], wav_or[2], wav_or[3]);
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t s = 0;
+    for (; s + 8 <= nsamples; s += 8) {
+        __m256i index = _mm256_loadu_si256((const __m256i *) (batch_index + s));
+        __m256i h = _mm256_or_si256(
+                _mm256_permutevar8x32_epi32(wav_or_table, _mm256_and_si256(_mm256_srli_epi32(index, PG_BITS - 2), _mm256_set1_epi32(3))),
+                _mm256_i32gather_epi32((const int *) logsin_table32, _mm256_and_si256(index, _mm256_set1_epi32(PG_WIDTH / 2 - 1)), 4));
+        __m256i att = _mm256_and_si256(_mm256_add_epi32(h, _mm256_loadu_si256((const __m256i *) (batch_att + s))), _mm256_set1_epi32(0xffff));
+        __m256i t = _mm256_i32gather_epi32((const int *) exp_table32, _mm256_and_si256(att, _mm256_set1_epi32(0xff)), 4);
+        // srlv gives 0 for shifts of 32 and up, like attenuate()
+        __m256i res = _mm256_srlv_epi32(t, _mm256_and_si256(_mm256_srli_epi32(att, 8), _mm256_set1_epi32(127)));
+        __m256i neg = _mm256_andnot_si256(_mm256_cmpeq_epi32(res, zero),
+                                          _mm256_cmpgt_epi32(_mm256_and_si256(att, _mm256_set1_epi32(0x8000)), zero));
+#if EMU8950_LINEAR_NEG_NOT_NOT
+        res = _mm256_sub_epi32(_mm256_xor_si256(res, neg), neg);
+#else
+        res = _mm256_xor_si256(res, neg);
+#endif
+        _mm256_storeu_si256((__m256i *) (batch_out + s), _mm256_slli_epi32(res, 1));
+    }
+    calc_batch_scalar(slot, s, nsamples);
+}
+
+// Four samples at a time. Without a gather each lane does its own table loads, the rest runs four wide
+__attribute__((target("sse4.1")))
+static void calc_batch_sse41(const SLOT_RENDER *slot, uint32_t nsamples) {
+    // the four 16-bit wav_or_table entries, picked per lane with a byte shuffle
+    const __m128i wav_or_table = _mm_loadl_epi64((const __m128i *) slot->wav_or_table);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t s = 0;
+    for (; s + 4 <= nsamples; s += 4) {
+        __m128i index = _mm_loadu_si128((const __m128i *) (batch_index + s));
+        __m128i wav = _mm_and_si128(_mm_srli_epi32(index, PG_BITS - 2), _mm_set1_epi32(3));
+        // bytes 2 * wav and 2 * wav + 1 into the low half of the lane, zero into the high half
+        __m128i wav_select = _mm_or_si128(_mm_mullo_epi32(wav, _mm_set1_epi32(0x0202)), _mm_set1_epi32((int) 0x80800100));
+        __m128i sin_index = _mm_and_si128(index, _mm_set1_epi32(PG_WIDTH / 2 - 1));
+        __m128i h = _mm_or_si128(_mm_shuffle_epi8(wav_or_table, wav_select),
+                                 _mm_setr_epi32(logsin_table[_mm_cvtsi128_si32(sin_index)], logsin_table[_mm_extract_epi32(sin_index, 1)],
+                                                logsin_table[_mm_extract_epi32(sin_index, 2)], logsin_table[_mm_extract_epi32(sin_index, 3)]));
+        __m128i att = _mm_and_si128(_mm_add_epi32(h, _mm_loadu_si128((const __m128i *) (batch_att + s))), _mm_set1_epi32(0xffff));
+        __m128i exp_index = _mm_and_si128(att, _mm_set1_epi32(0xff));
+        __m128i t = _mm_setr_epi32(exp_table[_mm_cvtsi128_si32(exp_index)], exp_table[_mm_extract_epi32(exp_index, 1)],
+                                   exp_table[_mm_extract_epi32(exp_index, 2)], exp_table[_mm_extract_epi32(exp_index, 3)]);
+        // no per lane shift before AVX2: t >> shift is t * 2^-shift truncated, exact in single precision for these
+        // 10-bit values. A shift of 127 makes the exponent 0, so it gives 0 like attenuate()
+        __m128i shift = _mm_and_si128(_mm_srli_epi32(att, 8), _mm_set1_epi32(127));
+        __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(127), shift), 23));
+        __m128i res = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(t), scale));
+        __m128i neg = _mm_andnot_si128(_mm_cmpeq_epi32(res, zero),
+                                       _mm_cmpgt_epi32(_mm_and_si128(att, _mm_set1_epi32(0x8000)), zero));
+#if EMU8950_LINEAR_NEG_NOT_NOT
+        res = _mm_sub_epi32(_mm_xor_si128(res, neg), neg);
+#else
+        res = _mm_xor_si128(res, neg);
+#endif
+        _mm_storeu_si128((__m128i *) (batch_out + s), _mm_slli_epi32(res, 1));
+    }
+    calc_batch_scalar(slot, s, nsamples);
+}
+#elif defined(__ARM_NEON)
+// Four samples at a time. Without a gather each lane does its own table loads, the rest runs four wide
+static void calc_batch_neon(const SLOT_RENDER *slot, uint32_t nsamples) {
+    const uint16_t *wav_or = slot->wav_or_table;
+    uint32_t s = 0;
+    for (; s + 4 <= nsamples; s += 4) {
+        uint32x4_t index = vld1q_u32(batch_index + s);
+        uint32x4_t wav = vandq_u32(vshrq_n_u32(index, PG_BITS - 2), vdupq_n_u32(3));
+        uint32x4_t sin_index = vandq_u32(index, vdupq_n_u32(PG_WIDTH / 2 - 1));
+        uint32x4_t h = vdupq_n_u32(0);
+        h = vsetq_lane_u32(wav_or[vgetq_lane_u32(wav, 0)] | logsin_table[vgetq_lane_u32(sin_index, 0)], h, 0);
+        h = vsetq_lane_u32(wav_or[vgetq_lane_u32(wav, 1)] | logsin_table[vgetq_lane_u32(sin_index, 1)], h, 1);
+        h = vsetq_lane_u32(wav_or[vgetq_lane_u32(wav, 2)] | logsin_table[vgetq_lane_u32(sin_index, 2)], h, 2);
+        h = vsetq_lane_u32(wav_or[vgetq_lane_u32(wav, 3)] | logsin_table[vgetq_lane_u32(sin_index, 3)], h, 3);
+        uint32x4_t att = vandq_u32(vaddq_u32(h, vreinterpretq_u32_s32(vld1q_s32(batch_att + s))), vdupq_n_u32(0xffff));
+        uint32x4_t exp_index = vandq_u32(att, vdupq_n_u32(0xff));
+        uint32x4_t t = vdupq_n_u32(0);
+        t = vsetq_lane_u32(exp_table[vgetq_lane_u32(exp_index, 0)], t, 0);
+        t = vsetq_lane_u32(exp_table[vgetq_lane_u32(exp_index, 1)], t, 1);
+        t = vsetq_lane_u32(exp_table[vgetq_lane_u32(exp_index, 2)], t, 2);
+        t = vsetq_lane_u32(exp_table[vgetq_lane_u32(exp_index, 3)], t, 3);
+        // a negative count shifts right, and right shifts of 32 and up give 0 like attenuate()
+        int32x4_t shift = vnegq_s32(vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(att, 8), vdupq_n_u32(127))));
+        uint32x4_t res = vshlq_u32(t, shift);
+        uint32x4_t neg = vbicq_u32(vtstq_u32(att, vdupq_n_u32(0x8000)), vceqq_u32(res, vdupq_n_u32(0)));
+#if EMU8950_LINEAR_NEG_NOT_NOT
+        res = vsubq_u32(veorq_u32(res, neg), neg);
+#else
+        res = veorq_u32(res, neg);
+#endif
+        vst1q_s32(batch_out + s, vreinterpretq_s32_u32(vshlq_n_u32(res, 1)));
+    }
+    calc_batch_scalar(slot, s, nsamples);
+}
+#endif
+
+static void (*calc_batch)(const SLOT_RENDER *slot, uint32_t nsamples) = calc_batch_scalar_all;
+
+extern "C" int slot_render_select(int kernel) {
+    switch (kernel) {
+        case SLOT_RENDER_KERNEL_SCALAR:
+            calc_batch = calc_batch_scalar_all;
+            return 1;
+#if SLOT_RENDER_X86
+        case SLOT_RENDER_KERNEL_SSE41:
+            if (!__builtin_cpu_supports("sse4.1")) return 0;
+            calc_batch = calc_batch_sse41;
+            return 1;
+        case SLOT_RENDER_KERNEL_AVX2:
+            if (!__builtin_cpu_supports("avx2")) return 0;
+            calc_batch = calc_batch_avx2;
+            return 1;
+#elif defined(__ARM_NEON)
+        case SLOT_RENDER_KERNEL_NEON:
+            calc_batch = calc_batch_neon;
+            return 1;
+#endif
+        default:
+            return 0;
+    }
+}
+
+extern "C" void slot_render_init(void) {
+#if SLOT_RENDER_X86
+    __builtin_cpu_init();
+    for (int i = 0; i < LOGSIN_TABLE_SIZE; i++) logsin_table32[i] = logsin_table[i];
+    for (int i = 0; i < 256; i++) exp_table32[i] = exp_table[i];
+    if (!slot_render_select(SLOT_RENDER_KERNEL_AVX2)) slot_render_select(SLOT_RENDER_KERNEL_SSE41);
+#elif defined(__ARM_NEON)
+    slot_render_select(SLOT_RENDER_KERNEL_NEON);
+#endif
+}
+#else
+extern "C" int slot_render_select(int kernel) {
+    return kernel == SLOT_RENDER_KERNEL_SCALAR;
+}
+
+extern "C" void slot_render_init(void) {
+}
+#endif
+
 #if PICO_ON_DEVICE
 extern "C" uint32_t test_slot_asm(SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint fn);
 #endif
@@ -601,6 +795,22 @@ template <int F_NUM, typename F> uint32_t slot_envelope_loop(F&& fn, SLOT_RENDER
 typedef void OPL;
 
 template<bool PM> uint32_t slot_mod_linear(OPL *opl, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase) {
+#if SLOT_RENDER_BATCH
+    // feedback makes every sample depend on the previous one, so only those stay on the per sample path
+    if (!slot->patch->FB) {
+        uint32_t s = slot->patch->AM ? slot_envelope_loop<2+PM>(batch_fn<PM, true, false>(), slot, nsamples, eg_counter, pm_phase)
+                                     : slot_envelope_loop<0+PM>(batch_fn<PM, false, false>(), slot, nsamples, eg_counter, pm_phase);
+        calc_batch(slot, s);
+        for (uint32_t i = 0; i < s; i++) slot->mod_buffer[i] = batch_out[i];
+        return s;
+    }
+    slot->nine_minus_FB = 9 - slot->patch->FB;
+    if (slot->patch->AM) {
+        return slot_envelope_loop<6+PM>(mod_am1_fb1_fn<PM>, slot, nsamples, eg_counter, pm_phase);
+    } else {
+        return slot_envelope_loop<4+PM>(mod_am0_fb1_fn<PM>, slot, nsamples, eg_counter, pm_phase);
+    }
+#else
     if (slot->patch->AM) {
         if (slot->patch->FB) {
             slot->nine_minus_FB = 9 - slot->patch->FB;
@@ -616,6 +826,7 @@ template<bool PM> uint32_t slot_mod_linear(OPL *opl, SLOT_RENDER *slot, uint32_t
             return slot_envelope_loop<0+PM>(mod_am0_fb0_fn<PM>, slot, nsamples, eg_counter, pm_phase);
         }
     }
+#endif
 }
 
 extern "C" uint32_t slot_mod_linear(OPL *opl, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase) {
@@ -626,11 +837,19 @@ extern "C" uint32_t slot_mod_linear(OPL *opl, SLOT_RENDER *slot, uint32_t nsampl
 }
 
 template<bool PM> uint32_t slot_car_linear_alg0(OPL *opl, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase) {
+#if SLOT_RENDER_BATCH
+    uint32_t s = slot->patch->AM ? slot_envelope_loop<10+PM>(batch_fn<PM, true, true>(), slot, nsamples, eg_counter, pm_phase)
+                                 : slot_envelope_loop<8+PM>(batch_fn<PM, false, true>(), slot, nsamples, eg_counter, pm_phase);
+    calc_batch(slot, s);
+    for (uint32_t i = 0; i < s; i++) slot->buffer[i] += batch_out[i];
+    return s;
+#else
     if (slot->patch->AM) {
         return slot_envelope_loop<10+PM>(alg0_am1_fn<PM>, slot, nsamples, eg_counter, pm_phase);
     } else {
         return slot_envelope_loop<8+PM>(alg0_am0_fn<PM>, slot, nsamples, eg_counter, pm_phase);
     }
+#endif
 }
 
 extern "C" uint32_t slot_car_linear_alg0(OPL *opl, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase) {
@@ -641,12 +860,19 @@ extern "C" uint32_t slot_car_linear_alg0(OPL *opl, SLOT_RENDER *slot, uint32_t n
 }
 
 template<bool PM> uint32_t slot_car_linear_alg1(OPL *opl, SLOT_RENDER *slot, uint32_t nsamples, uint32_t eg_counter, uint32_t pm_phase) {
-
+#if SLOT_RENDER_BATCH
+    uint32_t s = slot->patch->AM ? slot_envelope_loop<14+PM>(batch_fn<PM, true, false>(), slot, nsamples, eg_counter, pm_phase)
+                                 : slot_envelope_loop<12+PM>(batch_fn<PM, false, false>(), slot, nsamples, eg_counter, pm_phase);
+    calc_batch(slot, s);
+    for (uint32_t i = 0; i < s; i++) slot->buffer[i] += batch_out[i] + slot->mod_buffer[i];
+    return s;
+#else
     if (slot->patch->AM) {
         return slot_envelope_loop<14+PM>(alg1_am1_fn<PM>, slot, nsamples, eg_counter, pm_phase);
     } else {
         return slot_envelope_loop<12+PM>(alg1_am0_fn<PM>, slot, nsamples, eg_counter, pm_phase);
     }
+#endif
 }
 
 
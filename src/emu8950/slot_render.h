@@ -12,6 +12,9 @@ extern "C" {
 #define EG_MUTE ((1 << EG_BITS) - 1)
 #define EG_MAX (0x1f0) // 93dB
 
+/* largest block rendered by one OPL_calc_buffer_linear call */
+#define SAMPLE_BUF_SIZE 1024
+
 /* sine table */
 #define PG_BITS 10 /* 2^10 = 1024 length sine table */
 #define PG_WIDTH (1 << PG_BITS)
@@ -134,6 +137,18 @@ struct SLOT_RENDER {
 #endif
 };
 
+/* block kernels of the host batch path, the others only have the scalar one */
+enum {
+    SLOT_RENDER_KERNEL_SCALAR,
+    SLOT_RENDER_KERNEL_SSE41,
+    SLOT_RENDER_KERNEL_AVX2,
+    SLOT_RENDER_KERNEL_NEON,
+};
+
+/* builds the kernel tables and picks the fastest kernel the CPU runs, once before the first render */
+void slot_render_init(void);
+/* switches to kernel, 0 when it is not built in or the CPU lacks it */
+int slot_render_select(int kernel);
 
 #ifdef __cplusplus
 }
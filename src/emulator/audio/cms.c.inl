@@ -47,7 +47,9 @@ static uint8_t latched_data;
 
 //} cms_t;
 // static int16_t out_l = 0, out_r = 0;
-static INLINE void cms_samples(int16_t *output) {
+// Adds count stereo samples to mix. Rates, volumes and enables only change on port writes,
+// so they are read once per block and each chip runs its own tight loop.
+static INLINE void cms_samples(int32_t (*mix)[2], const int count) {
     for (int channel = 0; channel < 4; channel++) {
         const uint8_t chip_index = channel >> 1;
         const uint8_t noise_index = channel & 1;
@@ -57,27 +59,36 @@ static INLINE void cms_samples(int16_t *output) {
         } else {
             cms_noise_frequency[chip_index][noise_index] = voice_frequency[chip_index][noise_index ? 3 : 0];
         }
+    }
 
-        if (channel < 2 && (cms_registers[channel][0x1C] & 1)) {
-            for (int voice_index = 0; voice_index < 6; voice_index++) {
-                // Use volume LUT for optimized volume calculation
-                const int16_t volume_left = volume_lut[voice_volume[channel][voice_index][0]];
-                const int16_t volume_right = volume_lut[voice_volume[channel][voice_index][1]];
+    for (int channel = 0; channel < 2; channel++) {
+        if (!(cms_registers[channel][0x1C] & 1)) continue;
+
+        const uint8_t tone_enable = cms_registers[channel][0x14];
+        const uint8_t noise_enable = cms_registers[channel][0x15];
+        int16_t volume_left[6], volume_right[6];
+        for (int voice_index = 0; voice_index < 6; voice_index++) {
+            // Use volume LUT for optimized volume calculation
+            volume_left[voice_index] = volume_lut[voice_volume[channel][voice_index][0]];
+            volume_right[voice_index] = volume_lut[voice_volume[channel][voice_index][1]];
+        }
 
-                if (cms_registers[channel][0x14] & (1 << voice_index)) {
+        for (int i = 0; i < count; i++) {
+            for (int voice_index = 0; voice_index < 6; voice_index++) {
+                if (tone_enable & (1 << voice_index)) {
                     if (voice_state[channel][voice_index]) {
-                        output[0] += volume_left;
-                        output[1] += volume_right;
+                        mix[i][0] += volume_left[voice_index];
+                        mix[i][1] += volume_right[voice_index];
                     }
                     voice_counter[channel][voice_index] += voice_frequency[channel][voice_index];
                     if (voice_counter[channel][voice_index] >= 24000) {
                         voice_counter[channel][voice_index] -= 24000;
                         voice_state[channel][voice_index] ^= 1;
                     }
-                } else if (cms_registers[channel][0x15] & (1 << voice_index)) {
+                } else if (noise_enable & (1 << voice_index)) {
                     if (noise_shift_register[channel][voice_index / 3] & 1) {
-                        output[0] += volume_left;
-                        output[1] += volume_right;
+                        mix[i][0] += volume_left[voice_index];
+                        mix[i][1] += volume_right[voice_index];
                     }
                 }
 
@@ -154,4 +165,21 @@ static INLINE uint8_t cms_in(const uint16_t address) {
         case 0xb: return latched_data;
     }
     return 0xff;
-}
\ No newline at end of file
+}
+
+#if !PICO_ON_DEVICE
+static void cms_savestate(savestate_t *state) {
+    savestate_chunk(state, "CMRA", register_addresses, sizeof(register_addresses));
+    savestate_chunk(state, "CMRG", cms_registers, sizeof(cms_registers));
+    savestate_chunk(state, "CMFL", frequency_latch, sizeof(frequency_latch));
+    savestate_chunk(state, "CMVF", voice_frequency, sizeof(voice_frequency));
+    savestate_chunk(state, "CMVC", voice_counter, sizeof(voice_counter));
+    savestate_chunk(state, "CMVV", voice_volume, sizeof(voice_volume));
+    savestate_chunk(state, "CMVS", voice_state, sizeof(voice_state));
+    savestate_chunk(state, "CMNS", noise_shift_register, sizeof(noise_shift_register));
+    savestate_chunk(state, "CMNF", cms_noise_frequency, sizeof(cms_noise_frequency));
+    savestate_chunk(state, "CMNC", cms_noise_counter, sizeof(cms_noise_counter));
+    savestate_chunk(state, "CMNT", noise_type, sizeof(noise_type));
+    savestate_chunk(state, "CMLD", &latched_data, sizeof(latched_data));
+}
+#endif
@@ -91,4 +91,15 @@ static INLINE void dss_out(const uint16_t portnum, const uint8_t value) {
         }
         control = value;
     }
-}
\ No newline at end of file
+}
+
+#if !PICO_ON_DEVICE
+static void dss_savestate(savestate_t *state) {
+    savestate_chunk(state, "DSSF", fifo_buffer, sizeof(fifo_buffer));
+    savestate_chunk(state, "DSSH", &fifo_head, sizeof(fifo_head));
+    savestate_chunk(state, "DSST", &fifo_tail, sizeof(fifo_tail));
+    savestate_chunk(state, "DSSC", &fifo_count, sizeof(fifo_count));
+    savestate_chunk(state, "DSSD", &dss_data, sizeof(dss_data));
+    savestate_chunk(state, "COVX", &covox_sample, sizeof(covox_sample));
+}
+#endif
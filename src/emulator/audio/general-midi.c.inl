@@ -268,11 +268,11 @@ static INLINE int16_t generate_drum_sample(const midi_voice_t *voice, const uint
     return sample >> 2; // Scale down to prevent clipping
 }
 
-// Modified midi_sample function
-static INLINE int16_t midi_sample() {
-    if (__builtin_expect(!active_voice_bitmask, 0)) return 0;
+// Adds count (at most SOUND_BLOCK_SAMPLES) samples to mix, one voice at a time so its state stays in registers
+static INLINE void midi_samples(int32_t *mix, const int count) {
+    if (__builtin_expect(!active_voice_bitmask, 0)) return;
 
-    int32_t sample = 0;
+    int32_t voices_mix[SOUND_BLOCK_SAMPLES] = { 0 };
     uint32_t active_voices = active_voice_bitmask;
 
     do {
@@ -281,13 +281,18 @@ static INLINE int16_t midi_sample() {
         active_voices ^= voice_bit;
 
         midi_voice_t *__restrict voice = &midi_voices[voice_index];
-        const uint16_t sample_position = voice->sample_position++;
 
         // Check if this is a drum channel (channel 9)
         if (voice->channel == 9) {
-            sample += generate_drum_sample(voice, sample_position);
-        } else {
-            // Melodic synthesis with exponential envelope
+            for (int i = 0; i < count; i++) {
+                voices_mix[i] += generate_drum_sample(voice, voice->sample_position++);
+            }
+            continue;
+        }
+
+        // Melodic synthesis with exponential envelope
+        for (int i = 0; i < count; i++) {
+            const uint16_t sample_position = voice->sample_position++;
 
             // Envelope update every 256 samples (~172 Hz update rate)
             if (__builtin_expect((sample_position & 255) == 0 && sample_position > 0, 0)) {
@@ -307,18 +312,20 @@ static INLINE int16_t midi_sample() {
                         voice->velocity -= ((voice->velocity - target) >> voice->decay_shift) | 1;
                         if (voice->velocity <= 1 && target == 0) {
                             active_voice_bitmask &= ~voice_bit;
-                            continue;
+                            break;
                         }
                     }
                 }
             }
 
             const int32_t sine_val = sine_lookup(__fast_mul(voice->frequency_m100, sample_position));
-            sample += __fast_mul(voice->velocity, sine_val);
+            voices_mix[i] += __fast_mul(voice->velocity, sine_val);
         }
     } while (active_voices);
 
-    return sample >> 2;
+    for (int i = 0; i < count; i++) {
+        mix[i] += (int16_t) (voices_mix[i] >> 2);
+    }
 }
 
 // Optimized pitch bend calculation with lookup table or approximation
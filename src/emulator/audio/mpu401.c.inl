@@ -91,7 +91,7 @@ static INLINE void midi_send_sysex() {
     // Reset the SysEx state
     midi_insysex = 0;
 }
-int16_t midi_sample() { return 0; }
+static INLINE void midi_samples(int32_t *mix, const int count) { }
 
 
 #endif
@@ -166,3 +166,29 @@ static INLINE int16_t sn76489_sample() {
     // Final mixing and scaling (single operation instead of per-channel)
     return (int16_t) (mixed_sample >> 2); // Divide by 4 for proper scaling
 }
+
+static INLINE void sn76489_samples(int32_t *mix, const int count) {
+    for (int i = 0; i < count; i++) {
+        mix[i] += sn76489_sample();
+    }
+}
+
+#if !PICO_ON_DEVICE
+static void sn76489_savestate(savestate_t *state) {
+    savestate_chunk(state, "SNTC", tone_counter, sizeof(tone_counter));
+    savestate_chunk(state, "SNTV", tone_volume, sizeof(tone_volume));
+    savestate_chunk(state, "SNTF", tone_frequency, sizeof(tone_frequency));
+    savestate_chunk(state, "SNTO", tone_output_state, sizeof(tone_output_state));
+    savestate_chunk(state, "SNMU", channel_mute, sizeof(channel_mute));
+    savestate_chunk(state, "SNNL", &noise_lfsr_seed, sizeof(noise_lfsr_seed));
+    savestate_chunk(state, "SNNC", &noise_counter, sizeof(noise_counter));
+    savestate_chunk(state, "SNNF", &noise_frequency, sizeof(noise_frequency));
+    savestate_chunk(state, "SNNV", &noise_volume, sizeof(noise_volume));
+    savestate_chunk(state, "SNNT", &noise_type_mode, sizeof(noise_type_mode));
+    savestate_chunk(state, "SNN2", &noise_uses_tone2_freq, sizeof(noise_uses_tone2_freq));
+    savestate_chunk(state, "SNMC", &master_counter, sizeof(master_counter));
+    savestate_chunk(state, "SNET", &emulator_time, sizeof(emulator_time));
+    savestate_chunk(state, "SNRA", &register_address, sizeof(register_address));
+    savestate_chunk(state, "SNST", &stereo_mask, sizeof(stereo_mask));
+}
+#endif
@@ -28,6 +28,8 @@
 
 #include "../emulator.h"
 #define SB_READ_BUFFER 16
+// Bytes taken from the DMA controller at once
+#define SB_DMA_FIFO 64
 
 // Sound Blaster DSP I/O port offsets
 #define DSP_RESET           0x6
@@ -79,6 +81,11 @@ typedef  struct sound_blaster_s {
     uint8_t recording_mode_active;
     uint8_t dma_transfer_enabled;
     uint8_t dsp_read_buffer[SB_READ_BUFFER];
+    uint8_t dma_fifo[SB_DMA_FIFO];
+    uint8_t dma_fifo_length;
+    uint8_t dma_fifo_position;
+    uint32_t dma_fifo_address; // channel address and count the next FIFO byte belongs to
+    uint16_t dma_fifo_count;
 } sound_blaster_s;
 
 static sound_blaster_s sound_blaster = { 0 };
@@ -112,6 +119,34 @@ static INLINE uint8_t blaster_read_buffer() {
     return first_byte;
 }
 
+// A new transfer does not play what was fetched for the previous one
+static INLINE void blaster_flush_fifo() {
+    sound_blaster.dma_fifo_length = sound_blaster.dma_fifo_position = 0;
+}
+
+// Next byte of the DMA transfer. The FIFO is filled a block at a time, never past the end of the DSP block, but
+// the DMA controller moves on a byte at a time as they are played, so a guest polling its address or count sees
+// what single transfers would show. A channel programmed anew in between starts the FIFO over. Guest writes to
+// the up to SB_DMA_FIFO bytes fetched ahead are not heard. Without a DSP block left, as for an auto-init transfer
+// started before any block size or a block size set below what was already played, it goes a byte at a time
+static INLINE uint8_t blaster_dma_byte() {
+    dma_channel_s *dma = &dma_channels[SB_DMA_CHANNEL];
+    if (dma->masked) return 0;
+    if (sound_blaster.dma_fifo_position >= sound_blaster.dma_fifo_length ||
+        sound_blaster.dma_fifo_address != dma->page + dma->address || sound_blaster.dma_fifo_count != dma->count) {
+        uint32_t length = sound_blaster.dma_transfer_length > sound_blaster.dma_bytes_processed
+                              ? sound_blaster.dma_transfer_length - sound_blaster.dma_bytes_processed
+                              : 1;
+        if (length > SB_DMA_FIFO) length = SB_DMA_FIFO;
+        sound_blaster.dma_fifo_length = (uint8_t) i8237_peek_block(SB_DMA_CHANNEL, sound_blaster.dma_fifo, length);
+        sound_blaster.dma_fifo_position = 0;
+    }
+    i8237_update_count(dma, 1);
+    sound_blaster.dma_fifo_address = dma->page + dma->address;
+    sound_blaster.dma_fifo_count = dma->count;
+    return sound_blaster.dma_fifo[sound_blaster.dma_fifo_position++];
+}
+
 INLINE void blaster_reset() {
     memset(&sound_blaster, 0, sizeof(sound_blaster_s));
     sound_blaster.current_audio_sample = 0;
@@ -141,6 +176,7 @@ static INLINE void blaster_command(const uint8_t command_byte) {
                 sound_blaster.auto_init_mode_enabled = 0;
                 sound_blaster.recording_mode_active = (sound_blaster.current_dsp_command == 0x24) ? 1 : 0;
                 sound_blaster.dma_transfer_enabled = 1;
+                blaster_flush_fifo();
 #ifdef DEBUG_BLASTER
                 printf("[BLASTER] Begin DMA transfer mode with 0x%04X  byte blocks\r\n", sb.dmalen);
 #endif
@@ -217,6 +253,7 @@ static INLINE void blaster_command(const uint8_t command_byte) {
             sound_blaster.auto_init_mode_enabled = 1;
             sound_blaster.recording_mode_active = (command_byte == 0x2C) ? 1 : 0;
             sound_blaster.dma_transfer_enabled = 1;
+            blaster_flush_fifo();
 #ifdef DEBUG_BLASTER
             printf("[BLASTER] Begin auto-init DMA transfer mode with %d byte blocks\r\n", sb.dmacount);
 #endif
@@ -316,7 +353,7 @@ inline int16_t blaster_sample() { //for DMA mode
     if (!sound_blaster.dma_transfer_enabled) return sound_blaster.speaker_enabled ? sound_blaster.current_audio_sample : 0;
     if (sound_blaster.silence_mode_active == 0) {
         if (sound_blaster.recording_mode_active == 0) {
-            generated_sample = (i8237_read(SB_DMA_CHANNEL) - 128) << 6;
+            generated_sample = (blaster_dma_byte() - 128) << 6;
         } else {
             i8237_write(SB_DMA_CHANNEL, 128); //silence
         }
@@ -329,4 +366,13 @@ inline int16_t blaster_sample() { //for DMA mode
     }
 
     return sound_blaster.speaker_enabled ? generated_sample : 0;
-}
\ No newline at end of file
+}
+
+#if !PICO_ON_DEVICE
+// The front-ends follow sb_samplerate on their next sample tick
+static void blaster_savestate(savestate_t *state) {
+    savestate_chunk(state, "SB  ", &sound_blaster, sizeof(sound_blaster));
+    savestate_chunk(state, "SBTC", &timeconst, sizeof(timeconst));
+    savestate_chunk(state, "SBSR", &sb_samplerate, sizeof(sb_samplerate));
+}
+#endif
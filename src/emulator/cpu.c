@@ -21,6 +21,11 @@
 
 #endif
 
+#ifdef EMULATOR_STATS
+uint64_t stats_opcodes[256];
+uint64_t stats_decode_cache[2];
+#endif
+
 #ifdef TOTAL_VIRTUAL_MEMORY_KBS
 #undef __not_in_flash
 #define __not_in_flash(group)
@@ -31,7 +36,7 @@ uint8_t segoverride, reptype;
 uint32_t segregs32[6];
 uint16_t useseg, oldsp;
 uint32_t ip32;
-uint8_t tempcf, oldcf, mode, reg, rm, sib;
+uint8_t mode, reg, rm, sib;
 x86_flags_t x86_flags;
 bool operandSizeOverride = false;
 bool addressSizeOverride = false;
@@ -59,7 +64,93 @@ static const bool __not_in_flash("cpu.pf") parity[0x100] = {
     0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0, 1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1
 };
 
+#ifndef CPU_NO_DECODE_CACHE
+// Pre-decoded instructions: prefixes, opcode and ModR/M with displacement.
+// Entries are validated against a per-256-byte-block generation, bumped on every write to a block holding cached code.
+#define DECODE_CACHE_BITS 12
+#define DECODE_CACHE_SIZE (1 << DECODE_CACHE_BITS)
+#define DECODE_NO_SEGMENT 0xFF
+
+typedef struct {
+    uint32_t linear; // CS:IP of the first prefix byte, ~0 for empty entry
+    uint16_t generation;
+    uint8_t opcode;
+    uint8_t length; // prefixes + opcode
+    uint8_t reptype;
+    uint8_t segment; // segment override register or DECODE_NO_SEGMENT
+    uint8_t modrm_length; // ModR/M + displacement, 0 if not decoded yet
+    uint8_t addrbyte;
+    uint16_t displacement;
+} decoded_insn_t;
+
+static decoded_insn_t __not_in_flash("cpu.dc") decode_cache[DECODE_CACHE_SIZE];
+static uint16_t __not_in_flash("cpu.dc") decode_cache_generation[DECODE_CACHE_BLOCKS];
+uint8_t __not_in_flash("cpu.dc") decode_cache_code_blocks[DECODE_CACHE_BLOCKS];
+// Entry of the instruction being executed, consumed by the first modregrm() call
+static decoded_insn_t *decode_current;
+
+void decode_cache_flush() {
+    memset(decode_cache, 0xFF, sizeof(decode_cache));
+    memset(decode_cache_generation, 0, sizeof(decode_cache_generation));
+    memset(decode_cache_code_blocks, 0, sizeof(decode_cache_code_blocks));
+    decode_current = NULL;
+}
+
+__not_in_flash() void decode_cache_invalidate_block(const uint32_t block) {
+    decode_cache_code_blocks[block] = 0;
+    if (unlikely(++decode_cache_generation[block] == 0)) {
+        // generation wrapped around, stale entries could match again
+        decode_cache_flush();
+    }
+}
+
+void decode_cache_invalidate(uint32_t address, uint32_t length) {
+    if (!length) return;
+    if (address < HMA_START && address + length > HMA_START && !a20_enabled) {
+        // the part above 1 MB wraps around to the start of memory
+        decode_cache_invalidate(HMA_START, address + length - HMA_START);
+        length = HMA_START - address;
+    }
+    address = memory_a20_alias(address);
+    uint32_t block = address >> DECODE_CACHE_BLOCK_SHIFT;
+    uint32_t last = (address + length - 1) >> DECODE_CACHE_BLOCK_SHIFT;
+    if (last >= DECODE_CACHE_BLOCKS) last = DECODE_CACHE_BLOCKS - 1;
+    for (; block <= last; block++) {
+        if (decode_cache_code_blocks[block]) {
+            decode_cache_invalidate_block(block);
+        }
+    }
+}
+
+// Only plain memory can be cached: VRAM and EMS window contents are not stable for a given linear address
+static INLINE bool decode_cacheable(const uint32_t linear) {
+    if (linear < VIDEORAM_START) return true;
+    if (linear >= UMB_START && linear < UMB_END) return true;
+    if (linear >= BIOS_START && linear < HMA_START) return true;
+    return a20_enabled && linear < HMA_END;
+}
+#endif
+
 __not_in_flash() void modregrm() {
+#ifndef CPU_NO_DECODE_CACHE
+    decoded_insn_t *decoded = decode_current;
+    decode_current = NULL;
+#ifdef CPU_386_EXTENDED_OPS
+    if (addressSizeOverride) decoded = NULL;
+#endif
+    if (decoded && decoded->modrm_length) {
+        mode = decoded->addrbyte >> 6;
+        reg = (decoded->addrbyte >> 3) & 7;
+        rm = decoded->addrbyte & 7;
+        disp16 = decoded->displacement;
+        StepIP(decoded->modrm_length);
+        if (mode < 3 && !segoverride && (rm == 2 || rm == 3 || (rm == 6 && mode))) {
+            useseg = CPU_SS;
+        }
+        return;
+    }
+    const uint16_t modrm_ip = CPU_IP;
+#endif
     register uint8_t addrbyte = getmem8(CPU_CS, CPU_IP);
     StepIP(1);
     mode = addrbyte >> 6;
@@ -125,6 +216,13 @@ __not_in_flash() void modregrm() {
         default:
             disp16 = 0;
     }
+#ifndef CPU_NO_DECODE_CACHE
+    if (decoded) {
+        decoded->addrbyte = addrbyte;
+        decoded->displacement = disp16;
+        decoded->modrm_length = (uint8_t) (CPU_IP - modrm_ip);
+    }
+#endif
 }
 
 __not_in_flash() void getea(uint8_t rmval) {
@@ -463,17 +561,20 @@ static INLINE void writerm8(uint8_t rmval, uint8_t value) {
 
 static INLINE uint16_t makeflagsword(void) {
 #if CPU_386_EXTENDED_OPS
-    return 2 | x86_flags.value;
+    return 2 | flags_resolved()->value;
 #else
-    return 2 | (x86_flags.value & 0b111111010101);
+    return 2 | (flags_resolved()->value & 0b111111010101);
 #endif
 }
 
 static INLINE void decodeflagsword(uint16_t x) {
+#ifndef CPU_NO_LAZY_FLAGS
+    lazy_flags_op = 0;
+#endif
     x86_flags.value = x;
 }
 
-void intcall86(uint8_t intnum) {
+static void intcall86_dispatch(uint8_t intnum) {
     switch (intnum) {
         case 0x10: {
             switch (CPU_AH) {
@@ -498,6 +599,7 @@ void intcall86(uint8_t intnum) {
 
                     videomode = CPU_AL & 0x7F;
 
+                    memory_write_track(0x449, 0x484 - 0x449 + 1);
                     FIRST_RAM_PAGE[0x449] = CPU_AL;
                     FIRST_RAM_PAGE[0x44A] = videomode <= 2 || (videomode >= 0x8 && videomode <= 0xa) ? 40 : 80;
                     FIRST_RAM_PAGE[0x44B] = 0;
@@ -505,6 +607,7 @@ void intcall86(uint8_t intnum) {
 
                     if ((CPU_AL & 0x80) == 0x00) {
                         memset(VIDEORAM, 0x0, sizeof(VIDEORAM));
+                        videoram_mark_all_dirty();
                     }
                     vga_plane_offset = 0;
                     vga_planar_mode = 0;
@@ -529,6 +632,7 @@ void intcall86(uint8_t intnum) {
                                 break;
                         }
                         tga_portout(0x3df, CRTCPU);
+                        memory_write_track(BIOS_CRTCPU_PAGE, 1);
                         FIRST_RAM_PAGE[BIOS_CRTCPU_PAGE] = CRTCPU;
                         return;
                     }
@@ -655,10 +759,10 @@ void intcall86(uint8_t intnum) {
             insertdisk(128, "\\XT\\hdd.img");
             insertdisk(129, "\\XT\\hdd2.img");
 #else
-            insertdisk(0, "../fdd0.img");
-            insertdisk(1, "../fdd1.img");
-            insertdisk(128, "../hdd.img");
-            insertdisk(129, "../hdd2.img");
+            insertdisk(0, host_disk_images[0]);
+            insertdisk(1, host_disk_images[1]);
+            insertdisk(128, host_disk_images[2]);
+            insertdisk(129, host_disk_images[3]);
 #endif
             if (1) {
                 /* PCjr reserves the top of its internal 128KB of RAM for video RAM.  * Sidecars can extend it past 128KB but it
@@ -724,6 +828,12 @@ void intcall86(uint8_t intnum) {
     tf = 0;
 }
 
+void intcall86(uint8_t intnum) {
+    const uint64_t start = profiler_start();
+    intcall86_dispatch(intnum);
+    profiler_interrupt(intnum, start);
+}
+
 static inline void flag_szp8(uint8_t value) {
     zf = value == 0;
     sf = value >> 7;
@@ -742,17 +852,17 @@ static inline void flag_szp32(uint32_t value) {
     pf = parity[value & 255];
 }
 
-static inline void flag_log8(uint8_t value) {
+static inline void flag_log8_eval(uint8_t value) {
     flag_szp8(value);
-    x86_flags.value &= ~FLAG_CF_OF_MASK;
+    flags_resolved()->value &= ~FLAG_CF_OF_MASK;
 }
 
-static inline void flag_log16(uint16_t value) {
+static inline void flag_log16_eval(uint16_t value) {
     flag_szp16(value);
-    x86_flags.value &= ~FLAG_CF_OF_MASK;
+    flags_resolved()->value &= ~FLAG_CF_OF_MASK;
 }
 
-static inline void flag_adc8(uint8_t v1, uint8_t v2, uint8_t v3) {
+static inline void flag_adc8_eval(uint8_t v1, uint8_t v2, uint8_t v3) {
     /* v1 = destination operand, v2 = source operand, v3 = carry flag */
     uint32_t dst = (uint32_t) v1 + (uint32_t) v2 + (uint32_t) v3;
     flag_szp8((uint8_t) dst);
@@ -761,7 +871,7 @@ static inline void flag_adc8(uint8_t v1, uint8_t v2, uint8_t v3) {
     af = (((uint32_t)v1 ^ (uint32_t)v2 ^ dst) & 0x10) != 0;
 }
 
-static inline void flag_adc16(uint16_t v1, uint16_t v2, uint16_t v3) {
+static inline void flag_adc16_eval(uint16_t v1, uint16_t v2, uint16_t v3) {
     register uint32_t dst = (uint32_t) v1 + (uint32_t) v2 + (uint32_t) v3;
     flag_szp16((uint16_t) dst);
     of = (((dst ^ (uint32_t)v1) & (dst ^ (uint32_t)v2)) & 0x8000) != 0;
@@ -769,7 +879,7 @@ static inline void flag_adc16(uint16_t v1, uint16_t v2, uint16_t v3) {
     af = (((uint32_t)v1 ^ (uint32_t)v2 ^ dst) & 0x10) != 0;
 }
 
-static inline void flag_add8(uint8_t v1, uint8_t v2) {
+static inline void flag_add8_eval(uint8_t v1, uint8_t v2) {
     /* v1 = destination operand, v2 = source operand */
     register uint32_t dst = (uint32_t) v1 + (uint32_t) v2;
     flag_szp8((uint8_t) dst);
@@ -778,6 +888,15 @@ static inline void flag_add8(uint8_t v1, uint8_t v2) {
     af = (((uint32_t)v1 ^ (uint32_t)v2 ^ dst) & 0x10) != 0;
 }
 
+static inline void flag_add16_eval(uint16_t v1, uint16_t v2) {
+    /* v1 = destination operand, v2 = source operand */
+    register uint32_t dst = (uint32_t) v1 + (uint32_t) v2;
+    flag_szp16((uint16_t) dst);
+    cf = (dst & 0xFFFF0000) != 0;
+    of = (((dst ^ (uint32_t)v1) & (dst ^ (uint32_t)v2) & 0x8000) != 0);
+    af = ((((uint32_t)v1 ^ (uint32_t)v2 ^ dst) & 0x10) != 0);
+}
+
 static inline void flag_add32(uint32_t v1, uint32_t v2, uint32_t res32) {
     /* v1 = destination operand, v2 = source operand */
     flag_szp32(res32);
@@ -786,24 +905,22 @@ static inline void flag_add32(uint32_t v1, uint32_t v2, uint32_t res32) {
     af = ((v1 ^ v2 ^ res32) & 0x10) != 0;
 }
 
-static inline uint8_t sbb8(uint8_t v1, uint8_t v2, uint8_t v3) {
+static inline void flag_sbb8_eval(uint8_t v1, uint8_t v2, uint8_t v3) {
     /* v1 = destination operand, v2 = source operand, v3 = carry flag */
     register uint32_t dst = (uint32_t)v1 - (uint32_t)v2 - (uint32_t)v3;
     flag_szp8((uint8_t) dst);
     cf = ((dst >> 8) & 1) != 0;
     of = ((dst ^ v1) & (v1 ^ v2) & 0x80) != 0;
     af = ((v1 ^ v2 ^ dst ^ v3) & 0x10) != 0;
-    return (uint8_t)dst;
 }
 
-static inline uint16_t sbb16(uint16_t v1, uint16_t v2, uint8_t v3) {
+static inline void flag_sbb16_eval(uint16_t v1, uint16_t v2, uint8_t v3) {
     /* v1 = destination operand, v2 = source operand, v3 = carry flag */
     register uint32_t dst = (uint32_t)v1 - (uint32_t)v2 - (uint32_t)v3;
     flag_szp16((uint16_t) dst);
     cf = ((dst >> 16) & 1) != 0;
     of = ((dst ^ (uint32_t)v1) & (v1 ^ (uint32_t)v2) & 0x8000) != 0;
     af = ((v1 ^ v2 ^ dst ^ v3) & 0x10) != 0;
-    return (uint16_t)dst;
 }
 
 static inline uint32_t sbb32(uint32_t v1, uint32_t v2, uint8_t v3) {
@@ -816,7 +933,7 @@ static inline uint32_t sbb32(uint32_t v1, uint32_t v2, uint8_t v3) {
     return (uint32_t)dst;
 }
 
-static inline void flag_sub8(uint8_t v1, uint8_t v2) {
+static inline void flag_sub8_eval(uint8_t v1, uint8_t v2) {
     /* v1 = destination operand, v2 = source operand */
     uint32_t dst = (uint32_t) v1 - (uint32_t) v2;
     flag_szp8((uint8_t) dst);
@@ -825,7 +942,7 @@ static inline void flag_sub8(uint8_t v1, uint8_t v2) {
     af = ((v1 ^ v2 ^ dst) & 0x10) != 0;
 }
 
-static inline void flag_sub16(uint16_t v1, uint16_t v2) {
+static inline void flag_sub16_eval(uint16_t v1, uint16_t v2) {
     /* v1 = destination operand, v2 = source operand */
     register uint32_t dst = (uint32_t) v1 - (uint32_t) v2;
     flag_szp16((uint16_t) dst);
@@ -834,25 +951,108 @@ static inline void flag_sub16(uint16_t v1, uint16_t v2) {
     af = (((uint32_t)v1 ^ (uint32_t)v2 ^ dst) & 0x10) != 0;
 }
 
+#ifndef CPU_NO_LAZY_FLAGS
+enum {
+    LAZY_NONE,
+    LAZY_ADD8, LAZY_ADD16, LAZY_ADC8, LAZY_ADC16,
+    LAZY_SUB8, LAZY_SUB16, LAZY_SBB8, LAZY_SBB16,
+    LAZY_LOG8, LAZY_LOG16,
+    LAZY_INC8, LAZY_INC16, LAZY_DEC8, LAZY_DEC16,
+};
+
+uint8_t lazy_flags_op = LAZY_NONE;
+static uint8_t lazy_flags_carry; // carry in for ADC/SBB, kept CF for INC/DEC, kept AF for logic ops
+static uint16_t lazy_flags_v1, lazy_flags_v2;
+
+#define flags_defer(op, eval, v1, v2, carry) { \
+    const uint8_t _carry = (carry); /* may resolve the previous op, so read it first */ \
+    lazy_flags_v1 = (v1); \
+    lazy_flags_v2 = (v2); \
+    lazy_flags_carry = _carry; \
+    lazy_flags_op = (op); \
+}
+
+// CF and AF of the pending op without resolving the rest, for INC/DEC and logic ops which pass them on
+static INLINE uint8_t lazy_flags_cf() {
+    const uint32_t v1 = lazy_flags_v1, v2 = lazy_flags_v2, carry = lazy_flags_carry;
+    switch (lazy_flags_op) {
+        case LAZY_NONE: return x86_flags.bits.CF;
+        case LAZY_ADD8: case LAZY_ADC8: return (v1 + v2 + carry) >> 8 & 1;
+        case LAZY_ADD16: case LAZY_ADC16: return (v1 + v2 + carry) >> 16 & 1;
+        case LAZY_SUB8: case LAZY_SBB8: return (v1 - v2 - carry) >> 8 & 1;
+        case LAZY_SUB16: case LAZY_SBB16: return (v1 - v2 - carry) >> 16 & 1;
+        case LAZY_LOG8: case LAZY_LOG16: return 0;
+        default: return carry;
+    }
+}
+
+static INLINE uint8_t lazy_flags_af() {
+    const uint32_t v1 = lazy_flags_v1, v2 = lazy_flags_v2, carry = lazy_flags_carry;
+    switch (lazy_flags_op) {
+        case LAZY_NONE: return x86_flags.bits.AF;
+        case LAZY_ADD8: case LAZY_ADD16: case LAZY_ADC8: case LAZY_ADC16: return (v1 ^ v2 ^ (v1 + v2 + carry)) >> 4 & 1;
+        case LAZY_SUB8: case LAZY_SUB16: case LAZY_SBB8: case LAZY_SBB16: return (v1 ^ v2 ^ (v1 - v2 - carry)) >> 4 & 1;
+        case LAZY_INC8: case LAZY_INC16: return (v1 ^ (v1 + 1)) >> 4 & 1;
+        case LAZY_DEC8: case LAZY_DEC16: return (v1 ^ (v1 - 1)) >> 4 & 1;
+        default: return carry;
+    }
+}
+
+__not_in_flash() void lazy_flags_materialize() {
+    const uint8_t op = lazy_flags_op;
+    const uint8_t carry = lazy_flags_carry;
+    lazy_flags_op = LAZY_NONE;
+    switch (op) {
+        case LAZY_ADD8: flag_add8_eval(lazy_flags_v1, lazy_flags_v2); break;
+        case LAZY_ADD16: flag_add16_eval(lazy_flags_v1, lazy_flags_v2); break;
+        case LAZY_ADC8: flag_adc8_eval(lazy_flags_v1, lazy_flags_v2, carry); break;
+        case LAZY_ADC16: flag_adc16_eval(lazy_flags_v1, lazy_flags_v2, carry); break;
+        case LAZY_SUB8: flag_sub8_eval(lazy_flags_v1, lazy_flags_v2); break;
+        case LAZY_SUB16: flag_sub16_eval(lazy_flags_v1, lazy_flags_v2); break;
+        case LAZY_SBB8: flag_sbb8_eval(lazy_flags_v1, lazy_flags_v2, carry); break;
+        case LAZY_SBB16: flag_sbb16_eval(lazy_flags_v1, lazy_flags_v2, carry); break;
+        case LAZY_LOG8: flag_log8_eval(lazy_flags_v1); af = carry; break;
+        case LAZY_LOG16: flag_log16_eval(lazy_flags_v1); af = carry; break;
+        case LAZY_INC8: flag_add8_eval(lazy_flags_v1, 1); cf = carry; break;
+        case LAZY_INC16: flag_add16_eval(lazy_flags_v1, 1); cf = carry; break;
+        case LAZY_DEC8: flag_sub8_eval(lazy_flags_v1, 1); cf = carry; break;
+        case LAZY_DEC16: flag_sub16_eval(lazy_flags_v1, 1); cf = carry; break;
+        default: break;
+    }
+}
+#else
+#define flags_defer(op, eval, v1, v2, carry) { eval; }
+#endif
+
+static inline void flag_log8(uint8_t value) { flags_defer(LAZY_LOG8, flag_log8_eval(value), value, 0, lazy_flags_af()); }
+static inline void flag_log16(uint16_t value) { flags_defer(LAZY_LOG16, flag_log16_eval(value), value, 0, lazy_flags_af()); }
+static inline void flag_add8(uint8_t v1, uint8_t v2) { flags_defer(LAZY_ADD8, flag_add8_eval(v1, v2), v1, v2, 0); }
+static inline void flag_add16(uint16_t v1, uint16_t v2) { flags_defer(LAZY_ADD16, flag_add16_eval(v1, v2), v1, v2, 0); }
+static inline void flag_adc8(uint8_t v1, uint8_t v2, uint8_t v3) { flags_defer(LAZY_ADC8, flag_adc8_eval(v1, v2, v3), v1, v2, v3); }
+static inline void flag_adc16(uint16_t v1, uint16_t v2, uint16_t v3) { flags_defer(LAZY_ADC16, flag_adc16_eval(v1, v2, v3), v1, v2, v3); }
+static inline void flag_sub8(uint8_t v1, uint8_t v2) { flags_defer(LAZY_SUB8, flag_sub8_eval(v1, v2), v1, v2, 0); }
+static inline void flag_sub16(uint16_t v1, uint16_t v2) { flags_defer(LAZY_SUB16, flag_sub16_eval(v1, v2), v1, v2, 0); }
+// INC/DEC leave CF untouched, the pending op's CF is carried over without resolving it
+static inline void flag_inc8(uint8_t v1) { flags_defer(LAZY_INC8, { uint8_t carry = cf; flag_add8_eval(v1, 1); cf = carry; }, v1, 0, lazy_flags_cf()); }
+static inline void flag_inc16(uint16_t v1) { flags_defer(LAZY_INC16, { uint8_t carry = cf; flag_add16_eval(v1, 1); cf = carry; }, v1, 0, lazy_flags_cf()); }
+static inline void flag_dec8(uint8_t v1) { flags_defer(LAZY_DEC8, { uint8_t carry = cf; flag_sub8_eval(v1, 1); cf = carry; }, v1, 0, lazy_flags_cf()); }
+static inline void flag_dec16(uint16_t v1) { flags_defer(LAZY_DEC16, { uint8_t carry = cf; flag_sub16_eval(v1, 1); cf = carry; }, v1, 0, lazy_flags_cf()); }
+
+static inline uint8_t sbb8(uint8_t v1, uint8_t v2, uint8_t v3) {
+    flags_defer(LAZY_SBB8, flag_sbb8_eval(v1, v2, v3), v1, v2, v3);
+    return (uint8_t) (v1 - v2 - v3);
+}
+
+static inline uint16_t sbb16(uint16_t v1, uint16_t v2, uint8_t v3) {
+    flags_defer(LAZY_SBB16, flag_sbb16_eval(v1, v2, v3), v1, v2, v3);
+    return (uint16_t) (v1 - v2 - v3);
+}
+
 #define op_adc8() { res8 = oper1b + oper2b + cf; flag_adc8(oper1b, oper2b, cf); }
 #define op_adc16() { res16 = oper1 + oper2 + cf; flag_adc16(oper1, oper2, cf); }
 #define op_adc32() { res32 = oper1 + oper2 + cf; flag_adc32(oper1, oper2, cf); }
-#define op_add8() { \
-    register uint32_t dst = (uint32_t)oper1b + (uint32_t)oper2b; \
-    res8 = dst; \
-    flag_szp8(res8); \
-    cf = (dst & 0xFF00) != 0; \
-    of = ((dst ^ (uint32_t)oper1b) & (dst ^ (uint32_t)oper2b) & 0x80) != 0; \
-    af = ((oper1b ^ oper2b ^ dst) & 0x10) != 0; \
-}
-#define op_add16() { \
-    register uint32_t dst = (uint32_t)oper1 + (uint32_t)oper2; \
-    res16 = dst; \
-    flag_szp16(dst); \
-    cf = (dst & 0xFFFF0000) != 0; \
-    of = (((dst ^ (uint32_t)oper1) & (dst ^ (uint32_t)oper2) & 0x8000) != 0); \
-    af = (((oper1 ^ oper2 ^ dst) & 0x10) != 0); \
-}
+#define op_add8() { res8 = oper1b + oper2b; flag_add8(oper1b, oper2b); }
+#define op_add16() { res16 = oper1 + oper2; flag_add16(oper1, oper2); }
 #define op_add32() { res32 = oper1 + oper2; flag_add32(oper1, oper2, res32); }
 #define op_and8() { res8 = oper1b & oper2b; flag_log8(res8); }
 #define op_and16() { res16 = oper1 & oper2; flag_log16(res16); }
@@ -864,14 +1064,7 @@ static inline void flag_sub16(uint16_t v1, uint16_t v2) {
 #define op_xor16() { res16 = oper1 ^ oper2; flag_log16(res16); }
 #define op_xor32() { res32 = oper1 ^ oper2; flag_log32(res32); }
 #define op_sub8() { res8 = oper1b - oper2b; flag_sub8(oper1b, oper2b); }
-#define op_sub16() { \
-    register uint32_t dst = (uint32_t) oper1 - (uint32_t) oper2; \
-    flag_szp16((uint16_t) dst); \
-    cf = (dst & 0xFFFF0000) != 0; \
-    of = ((dst ^ (uint32_t)oper1) & (oper1 ^ oper2) & 0x8000) != 0; \
-    af = ((oper1 ^ oper2 ^ dst) & 0x10) != 0; \
-    res16 = (uint16_t) dst; \
-}
+#define op_sub16() { res16 = oper1 - oper2; flag_sub16(oper1, oper2); }
 #define op_sub32() { res32 = oper1 - oper2; flag_sub32(oper1, oper2); }
 #define op_sbb8() { res8 = sbb8(oper1b, oper2b, cf); }
 #define op_sbb16() { res16 = sbb16(oper1, oper2, cf); }
@@ -1203,9 +1396,9 @@ static __not_in_flash() void op_grp3_16() {
             CPU_DX = temp1 >> 16;
             flag_szp16((uint16_t) temp1);
             if (CPU_DX) {
-                x86_flags.value |= FLAG_CF_OF_MASK;
+                flags_resolved()->value |= FLAG_CF_OF_MASK;
             } else {
-                x86_flags.value &= ~FLAG_CF_OF_MASK;
+                flags_resolved()->value &= ~FLAG_CF_OF_MASK;
             }
 #ifdef CPU_CLEAR_ZF_ON_MUL
             zf = 0;
@@ -1219,9 +1412,9 @@ static __not_in_flash() void op_grp3_16() {
             CPU_AX = truncated; /* into register ax */
             CPU_DX = (uint16_t)(temp1 >> 16); /* into register dx */
             if (temp1 != (int32_t)truncated) {
-                x86_flags.value |= FLAG_CF_OF_MASK;
+                flags_resolved()->value |= FLAG_CF_OF_MASK;
             } else {
-                x86_flags.value &= ~FLAG_CF_OF_MASK;
+                flags_resolved()->value &= ~FLAG_CF_OF_MASK;
             }
 #ifdef CPU_CLEAR_ZF_ON_MUL
             zf = 0;
@@ -1241,19 +1434,13 @@ static __not_in_flash() void op_grp3_16() {
 static __not_in_flash() void op_grp5() {
     switch (reg) {
         case 0: /* INC Ev */
-            oper2 = 1;
-            tempcf = cf;
-            op_add16();
-            cf = tempcf;
-            writerm16(rm, res16);
+            flag_inc16(oper1);
+            writerm16(rm, oper1 + 1);
             break;
 
         case 1: /* DEC Ev */
-            oper2 = 1;
-            tempcf = cf;
-            op_sub16();
-            cf = tempcf;
-            writerm16(rm, res16);
+            flag_dec16(oper1);
+            writerm16(rm, oper1 - 1);
             break;
 
         case 2: /* CALL Ev */
@@ -1291,6 +1478,7 @@ void reset86() {
     CPU_SP = 0x0000;
 
     memset(VIDEORAM, 0x00, sizeof(VIDEORAM));
+    videoram_mark_all_dirty();
     if (butter_psram_size) {
         memset(RAM, 0, sizeof(RAM));
         memset(UMB, 0, sizeof(UMB));
@@ -1307,11 +1495,296 @@ void reset86() {
     }
 #endif
     init_umb();
+    memory_map_rebuild();
+    decode_cache_flush();
     ip = 0x0000;
     i8237_reset();
+#if !PICO_ON_DEVICE
+    i8253_irq0_reload(i8253_divisor(&i8253.channels[0]));
+#endif
     vga_init();
+    profiler_attach();
+}
+
+#if !PICO_ON_DEVICE
+// Lazy flags are resolved first, so the state only holds x86_flags
+void cpu_savestate(savestate_t *state) {
+    (void) flags_resolved();
+    savestate_chunk(state, "REGS", dwordregs, sizeof(dwordregs));
+    savestate_chunk(state, "SREG", segregs32, sizeof(segregs32));
+    savestate_chunk(state, "IP  ", &ip32, sizeof(ip32));
+    savestate_chunk(state, "FLAG", &x86_flags, sizeof(x86_flags));
+    savestate_chunk(state, "VMOD", &videomode, sizeof(videomode));
+    if (savestate_loading(state)) {
+        // A state saved after boot expects the images INT 19h attached
+        for (uint8_t drivenum = 0; drivenum < 4; drivenum++) {
+            if (!disk[drivenum].inserted) insertdisk(drivenum < 2 ? drivenum : drivenum + 126, host_disk_images[drivenum]);
+        }
+    }
+}
+#endif
+
+// REP string instructions run up to REP_CHUNK elements per dispatch, pending interrupts are served between chunks
+#define REP_CHUNK 1024
+
+static INLINE uint32_t rep_chunk() {
+    return CPU_CX < REP_CHUNK ? CPU_CX : REP_CHUNK;
+}
+
+// Elements that fit before the offset wraps its segment or the linear address leaves its 4 KB page
+static INLINE uint32_t rep_room(const uint16_t offset, const uint32_t linear, const uint8_t size) {
+    const uint32_t segment_room = 0x10000 - offset;
+    const uint32_t page_room = MEMORY_PAGE_SIZE - (linear & MEMORY_PAGE_MASK);
+    return (segment_room < page_room ? segment_room : page_room) / size;
+}
+
+// Every element is charged its REP cycles, the instruction itself only pays the setup
+static INLINE uint32_t rep_charge(const uint8_t opcode, const uint32_t count) {
+    timing_rep(opcode, count);
+    return count;
+}
+
+static INLINE uint16_t rep_element(const uint8_t *host, const uint32_t index, const uint8_t size) {
+    return size == 1 ? host[index] : host[index * 2] | host[index * 2 + 1] << 8;
+}
+
+static uint32_t __not_in_flash() rep_movs(const uint8_t size) {
+    uint32_t count = rep_chunk();
+    if (!df) {
+        const uint32_t src_linear = segbase(useseg) + CPU_SI;
+        const uint32_t dst_linear = segbase(CPU_ES) + CPU_DI;
+        const uint8_t *src_page = memory_read_page(src_linear);
+        uint8_t *dst_page = memory_write_page(dst_linear);
+        uint32_t room = rep_room(CPU_SI, src_linear, size);
+        const uint32_t dst_room = rep_room(CPU_DI, dst_linear, size);
+        if (dst_room < room) room = dst_room;
+        if (src_page && dst_page && room) {
+            if (count > room) count = room;
+            const uint32_t bytes = count * size;
+            const uint8_t *src = &src_page[src_linear & MEMORY_PAGE_MASK];
+            uint8_t *dst = &dst_page[dst_linear & MEMORY_PAGE_MASK];
+            if ((uintptr_t) dst > (uintptr_t) src && (uintptr_t) dst < (uintptr_t) src + bytes) {
+                // destination overlaps the source ahead of it: copy element by element, the way the CPU repeats the pattern
+                for (uint32_t i = 0; i < bytes; i += size) {
+                    const uint16_t value = rep_element(&src[i], 0, size);
+                    dst[i] = (uint8_t) value;
+                    if (size == 2) dst[i + 1] = (uint8_t) (value >> 8);
+                }
+            } else {
+                memmove(dst, src, bytes);
+            }
+            decode_cache_invalidate(dst_linear, bytes);
+            CPU_SI += bytes;
+            CPU_DI += bytes;
+            CPU_CX -= count;
+            return count;
+        }
+        const uint8_t src_vram = !src_page && src_linear >= VIDEORAM_START && src_linear < VIDEORAM_END;
+        if (!dst_page && dst_linear >= VIDEORAM_START && dst_linear < VIDEORAM_END && (src_page || src_vram) && room) {
+            // 4 KB pages never straddle the end of VRAM
+            if (count > room) count = room;
+            const uint32_t bytes = count * size;
+            if (src_page) {
+                vga_mem_copy(dst_linear, &src_page[src_linear & MEMORY_PAGE_MASK], bytes);
+            } else {
+                vga_mem_move(dst_linear, src_linear, bytes, size);
+            }
+            CPU_SI += bytes;
+            CPU_DI += bytes;
+            CPU_CX -= count;
+            return count;
+        }
+    }
+
+    const uint16_t step = df ? (uint16_t) -size : size;
+    for (uint32_t i = 0; i < count; i++) {
+        if (size == 1) {
+            putmem8(CPU_ES, CPU_DI, getmem8(useseg, CPU_SI));
+        } else {
+            putmem16(CPU_ES, CPU_DI, getmem16(useseg, CPU_SI));
+        }
+        CPU_SI += step;
+        CPU_DI += step;
+    }
+    CPU_CX -= count;
+    return count;
 }
 
+static uint32_t __not_in_flash() rep_stos(const uint8_t size) {
+    uint32_t count = rep_chunk();
+    if (!df) {
+        const uint32_t linear = segbase(CPU_ES) + CPU_DI;
+        uint8_t *page = memory_write_page(linear);
+        const uint32_t room = rep_room(CPU_DI, linear, size);
+        if (room && (page || (linear >= VIDEORAM_START && linear < VIDEORAM_END))) {
+            if (count > room) count = room;
+            const uint32_t bytes = count * size;
+            if (page) {
+                uint8_t *dst = &page[linear & MEMORY_PAGE_MASK];
+                if (size == 1) {
+                    memset(dst, CPU_AL, bytes);
+                } else {
+                    for (uint32_t i = 0; i < bytes; i += 2) {
+                        dst[i] = CPU_AL;
+                        dst[i + 1] = CPU_AH;
+                    }
+                }
+                decode_cache_invalidate(linear, bytes);
+            } else {
+                // 4 KB pages never straddle the end of VRAM
+                vga_mem_fill(linear, size == 1 ? CPU_AL * 0x0101 : CPU_AX, bytes);
+            }
+            CPU_DI += bytes;
+            CPU_CX -= count;
+            return count;
+        }
+    }
+
+    const uint16_t step = df ? (uint16_t) -size : size;
+    for (uint32_t i = 0; i < count; i++) {
+        if (size == 1) {
+            putmem8(CPU_ES, CPU_DI, CPU_AL);
+        } else {
+            putmem16(CPU_ES, CPU_DI, CPU_AX);
+        }
+        CPU_DI += step;
+    }
+    CPU_CX -= count;
+    return count;
+}
+
+// Only the last element survives in the accumulator, and reads have no side effects besides the VGA latch it also sets
+static uint32_t __not_in_flash() rep_lods(const uint8_t size) {
+    const uint32_t count = rep_chunk();
+    const uint16_t step = df ? (uint16_t) -size : size;
+    CPU_SI += (uint16_t) (step * (count - 1));
+    if (size == 1) {
+        CPU_AL = getmem8(useseg, CPU_SI);
+    } else {
+        CPU_AX = getmem16(useseg, CPU_SI);
+    }
+    CPU_SI += step;
+    CPU_CX -= count;
+    return count;
+}
+
+// REPE/REPNE compares: stops at the element that ends the repeat, flags come from the last compared pair
+static uint32_t __not_in_flash() rep_cmps(const uint8_t size) {
+    uint32_t count = rep_chunk();
+    uint32_t done = 0;
+    uint16_t src_value, dst_value;
+    if (!df) {
+        const uint32_t src_linear = segbase(useseg) + CPU_SI;
+        const uint32_t dst_linear = segbase(CPU_ES) + CPU_DI;
+        const uint8_t *src_page = memory_read_page(src_linear);
+        const uint8_t *dst_page = memory_read_page(dst_linear);
+        uint32_t room = rep_room(CPU_SI, src_linear, size);
+        const uint32_t dst_room = rep_room(CPU_DI, dst_linear, size);
+        if (dst_room < room) room = dst_room;
+        if (src_page && dst_page && room) {
+            if (count > room) count = room;
+            const uint8_t *src = &src_page[src_linear & MEMORY_PAGE_MASK];
+            const uint8_t *dst = &dst_page[dst_linear & MEMORY_PAGE_MASK];
+            do {
+                src_value = rep_element(src, done, size);
+                dst_value = rep_element(dst, done, size);
+                done++;
+            } while (done < count && (src_value == dst_value) == (reptype == 1));
+            CPU_SI += done * size;
+            CPU_DI += done * size;
+        }
+    }
+
+    if (!done) {
+        const uint16_t step = df ? (uint16_t) -size : size;
+        do {
+            src_value = size == 1 ? getmem8(useseg, CPU_SI) : getmem16(useseg, CPU_SI);
+            dst_value = size == 1 ? getmem8(CPU_ES, CPU_DI) : getmem16(CPU_ES, CPU_DI);
+            CPU_SI += step;
+            CPU_DI += step;
+            done++;
+        } while (done < count && (src_value == dst_value) == (reptype == 1));
+    }
+
+    if (size == 1) {
+        flag_sub8((uint8_t) src_value, (uint8_t) dst_value);
+    } else {
+        flag_sub16(src_value, dst_value);
+    }
+    CPU_CX -= done;
+    return done;
+}
+
+static uint32_t __not_in_flash() rep_scas(const uint8_t size) {
+    uint32_t count = rep_chunk();
+    uint32_t done = 0;
+    const uint16_t accumulator = size == 1 ? CPU_AL : CPU_AX;
+    uint16_t value;
+    if (!df) {
+        const uint32_t linear = segbase(CPU_ES) + CPU_DI;
+        const uint8_t *page = memory_read_page(linear);
+        const uint32_t room = rep_room(CPU_DI, linear, size);
+        if (page && room) {
+            if (count > room) count = room;
+            const uint8_t *dst = &page[linear & MEMORY_PAGE_MASK];
+            do {
+                value = rep_element(dst, done++, size);
+            } while (done < count && (accumulator == value) == (reptype == 1));
+            CPU_DI += done * size;
+        }
+    }
+
+    if (!done) {
+        const uint16_t step = df ? (uint16_t) -size : size;
+        do {
+            value = size == 1 ? getmem8(CPU_ES, CPU_DI) : getmem16(CPU_ES, CPU_DI);
+            CPU_DI += step;
+            done++;
+        } while (done < count && (accumulator == value) == (reptype == 1));
+    }
+
+    if (size == 1) {
+        flag_sub8((uint8_t) accumulator, (uint8_t) value);
+    } else {
+        flag_sub16(accumulator, value);
+    }
+    CPU_CX -= done;
+    return done;
+}
+
+#if !PICO_ON_DEVICE
+static uint64_t cpu_cycles_limit = UINT64_MAX;
+static uint32_t cpu_ticks_fraction = 0;
+
+// Charges the instruction just executed and advances virtual time by its cycles on the target clock.
+// `next_ip` is where a short branch falls through to.
+static INLINE void timing_charge(const uint8_t opcode, const uint8_t prefixes, const uint16_t next_ip) {
+    const cpu_timing_t *timing = cpu_timing;
+    uint32_t cycles = (opcode & 0xF6) == 0xF6 ? timing->group[(opcode >> 2 & 2) | (opcode & 1)][reg]
+                                              : timing->base[opcode];
+    cycles += prefixes * timing->prefix;
+    if (timing_has_modrm(opcode) && mode < 3) {
+        cycles += timing->memory[opcode] + timing->ea[mode][rm];
+    }
+    if ((opcode & 0xFE) == 0xD2) {
+        cycles += CPU_CL * timing->shift_bit;
+    } else if (((opcode & 0xF0) == 0x70 || (opcode & 0xFC) == 0xE0) && CPU_IP != next_ip) {
+        cycles += timing->branch_taken;
+    }
+    cpu_cycles += cycles;
+    cpu_cycles_total += cpu_cycles;
+    const uint64_t ticks = (uint64_t) cpu_cycles * cpu_cycle_ticks + cpu_ticks_fraction;
+    cpu_ticks_fraction = ticks & 0xFFFF;
+    scheduler_advance(ticks >> 16);
+}
+
+void exec86_cycles(const uint32_t cycles) {
+    cpu_cycles_limit = cpu_cycles_total + cycles;
+    exec86(UINT32_MAX);
+    cpu_cycles_limit = UINT64_MAX;
+}
+#endif
+
 /// @brief  W/A for SWAP mode (avoid using core#1)
 extern volatile int16_t last_sb_sample;
 extern volatile bool ask_to_blast;
@@ -1323,7 +1796,11 @@ void __not_in_flash() exec86(uint32_t execloops) {
     //counterticks = (uint64_t) ( (double) timerfreq / (double) 65536.0);
     //tickssource();
     for (uint32_t loopcount = 0; loopcount < execloops; loopcount++) {
+#if !PICO_ON_DEVICE
+        cpu_cycles = 0;
+#endif
         if (unlikely(ifl && i8259_get_pending_irqs())) {
+            timing_interrupt();
             intcall86(i8259_nextirq()); // get next interrupt from the i8259, if any d
         }
 #if PICO_ON_DEVICE
@@ -1338,6 +1815,28 @@ void __not_in_flash() exec86(uint32_t execloops) {
         uint8_t docontinue = 0;
         firstip = CPU_IP;
         register uint8_t opcode;
+#ifndef CPU_NO_DECODE_CACHE
+        decoded_insn_t *decoded = NULL;
+        uint8_t segment = DECODE_NO_SEGMENT;
+        const uint32_t linear = segbase(CPU_CS) + CPU_IP;
+        // Instruction must not wrap the segment or cross a generation block
+        if (likely(CPU_IP <= 0xFFF0 && (linear & 0xFF) <= 0xF0 && decode_cacheable(linear) &&
+                   !(CPU_CS == XMS_FN_CS && ip == XMS_FN_IP))) {
+            decoded = &decode_cache[linear & (DECODE_CACHE_SIZE - 1)];
+            if (decoded->linear == linear &&
+                decoded->generation == decode_cache_generation[linear >> DECODE_CACHE_BLOCK_SHIFT]) {
+                stats_decode_cache_hit(true);
+                opcode = decoded->opcode;
+                reptype = decoded->reptype;
+                if (decoded->segment != DECODE_NO_SEGMENT) {
+                    useseg = getsegreg(decoded->segment);
+                    segoverride = 1;
+                }
+                StepIP(decoded->length);
+                docontinue = 1;
+            }
+        }
+#endif
 
         while (!docontinue) {
             ///         CPU_CS &= 0xFFFF;
@@ -1359,31 +1858,49 @@ void __not_in_flash() exec86(uint32_t execloops) {
                 case 0x2E: /* segment CPU_CS */
                     useseg = CPU_CS;
                     segoverride = 1;
+#ifndef CPU_NO_DECODE_CACHE
+                    segment = regcs;
+#endif
                     break;
 
                 case 0x3E: /* segment CPU_DS */
                     useseg = CPU_DS;
                     segoverride = 1;
+#ifndef CPU_NO_DECODE_CACHE
+                    segment = regds;
+#endif
                     break;
 
                 case 0x26: /* segment CPU_ES */
                     useseg = CPU_ES;
                     segoverride = 1;
+#ifndef CPU_NO_DECODE_CACHE
+                    segment = reges;
+#endif
                     break;
 
                 case 0x36: /* segment CPU_SS */
                     useseg = CPU_SS;
                     segoverride = 1;
+#ifndef CPU_NO_DECODE_CACHE
+                    segment = regss;
+#endif
                     break;
 
                 case 0x64: /* segment CPU_FS */
                     useseg = CPU_FS;
                     segoverride = 1;
+#ifndef CPU_NO_DECODE_CACHE
+                    segment = regfs;
+#endif
                     break;
 
                 case 0x65: /* segment CPU_GS */
                     useseg = CPU_GS;
                     segoverride = 1;
+#ifndef CPU_NO_DECODE_CACHE
+                    segment = reggs;
+#endif
                     break;
 
                 case 0xF0: /* LOCK (блокировка шины, для атомарных операций) */
@@ -1404,6 +1921,28 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
             }
         }
+#ifndef CPU_NO_DECODE_CACHE
+        if (decoded && (decoded->linear != linear ||
+                        decoded->generation != decode_cache_generation[linear >> DECODE_CACHE_BLOCK_SHIFT])) {
+            // Miss: store what the prefix loop has just decoded, ModR/M is filled in by modregrm()
+            stats_decode_cache_hit(false);
+            decoded->linear = linear;
+            decoded->generation = decode_cache_generation[linear >> DECODE_CACHE_BLOCK_SHIFT];
+            decoded->opcode = opcode;
+            decoded->length = (uint8_t) (CPU_IP - firstip);
+            decoded->reptype = reptype;
+            decoded->segment = segment;
+            decoded->modrm_length = 0;
+            decode_cache_code_blocks[linear >> DECODE_CACHE_BLOCK_SHIFT] = 1;
+        }
+        decode_current = decoded;
+#endif
+
+        stats_opcode(opcode);
+        const uint64_t profiler_started = profiler_start();
+#if !PICO_ON_DEVICE
+        const uint16_t opcode_ip = CPU_IP;
+#endif
 
         register uint32_t res32;
         register uint8_t res8;
@@ -1889,9 +2428,9 @@ void __not_in_flash() exec86(uint32_t execloops) {
             case 0x37: /* 37 AAA ASCII */
                 if (((CPU_AL & 0xF) > 9) || (af == 1)) {
                     CPU_AX = CPU_AX + 0x106;
-                    x86_flags.value |= FLAG_CF_AF_MASK;
+                    flags_resolved()->value |= FLAG_CF_AF_MASK;
                 } else {
-                    x86_flags.value &= ~FLAG_CF_AF_MASK;
+                    flags_resolved()->value &= ~FLAG_CF_AF_MASK;
                 }
 
                 CPU_AL = CPU_AL & 0xF;
@@ -1953,9 +2492,9 @@ void __not_in_flash() exec86(uint32_t execloops) {
                 if (((CPU_AL & 0xF) > 9) || (af == 1)) {
                     CPU_AX = CPU_AX - 6;
                     CPU_AH = CPU_AH - 1;
-                    x86_flags.value |= FLAG_CF_AF_MASK;
+                    flags_resolved()->value |= FLAG_CF_AF_MASK;
                 } else {
-                    x86_flags.value &= ~FLAG_CF_AF_MASK;
+                    flags_resolved()->value &= ~FLAG_CF_AF_MASK;
                 }
 
                 CPU_AL = CPU_AL & 0xF;
@@ -1963,154 +2502,90 @@ void __not_in_flash() exec86(uint32_t execloops) {
 
             case 0x40: {
                 /* 40 INC eAX */
-                register uint32_t oper1 = CPU_AX;
-                register uint32_t dst = oper1 + 1;
-                flag_szp16(dst);
-                of = (((dst ^ oper1) & (dst ^ 1) & 0x8000) != 0);
-                af = (((oper1 ^ 1 ^ dst) & 0x10) != 0);
-                CPU_AX = (uint16_t) dst;
+                flag_inc16(CPU_AX);
+                CPU_AX = CPU_AX + 1;
                 break;
             }
             case 0x41: {
                 /* 41 INC eCX */
-                register uint32_t oper1 = CPU_CX;
-                register uint32_t dst = oper1 + 1;
-                flag_szp16(dst);
-                of = (((dst ^ oper1) & (dst ^ 1) & 0x8000) != 0);
-                af = (((oper1 ^ 1 ^ dst) & 0x10) != 0);
-                CPU_CX = (uint16_t) dst;
+                flag_inc16(CPU_CX);
+                CPU_CX = CPU_CX + 1;
                 break;
             }
             case 0x42: {
                 /* 42 INC eDX */
-                register uint32_t oper1 = CPU_DX;
-                register uint32_t dst = oper1 + 1;
-                flag_szp16(dst);
-                of = (((dst ^ oper1) & (dst ^ 1) & 0x8000) != 0);
-                af = (((oper1 ^ 1 ^ dst) & 0x10) != 0);
-                CPU_DX = (uint16_t) dst;
+                flag_inc16(CPU_DX);
+                CPU_DX = CPU_DX + 1;
                 break;
             }
             case 0x43: {
                 /* 43 INC eBX */
-                register uint32_t oper1 = CPU_BX;
-                register uint32_t dst = oper1 + 1;
-                flag_szp16(dst);
-                of = (((dst ^ oper1) & (dst ^ 1) & 0x8000) != 0);
-                af = (((oper1 ^ 1 ^ dst) & 0x10) != 0);
-                CPU_BX = (uint16_t) dst;
+                flag_inc16(CPU_BX);
+                CPU_BX = CPU_BX + 1;
                 break;
             }
             case 0x44: {
                 /* 44 INC eSP */
-                register uint32_t oper1 = CPU_SP;
-                register uint32_t dst = oper1 + 1;
-                flag_szp16(dst);
-                of = (((dst ^ oper1) & (dst ^ 1) & 0x8000) != 0);
-                af = (((oper1 ^ 1 ^ dst) & 0x10) != 0);
-                CPU_SP = (uint16_t) dst;
+                flag_inc16(CPU_SP);
+                CPU_SP = CPU_SP + 1;
                 break;
             }
             case 0x45: {
                 /* 45 INC eBP */
-                register uint32_t oper1 = CPU_BP;
-                register uint32_t dst = oper1 + 1;
-                flag_szp16(dst);
-                of = (((dst ^ oper1) & (dst ^ 1) & 0x8000) != 0);
-                af = (((oper1 ^ 1 ^ dst) & 0x10) != 0);
-                CPU_BP = (uint16_t) dst;
+                flag_inc16(CPU_BP);
+                CPU_BP = CPU_BP + 1;
                 break;
             }
             case 0x46: {
                 /* 46 INC eSI */
-                register uint32_t oper1 = CPU_SI;
-                register uint32_t dst = oper1 + 1;
-                flag_szp16(dst);
-                of = (((dst ^ oper1) & (dst ^ 1) & 0x8000) != 0);
-                af = (((oper1 ^ 1 ^ dst) & 0x10) != 0);
-                CPU_SI = (uint16_t) dst;
+                flag_inc16(CPU_SI);
+                CPU_SI = CPU_SI + 1;
                 break;
             }
             case 0x47: {
                 /* 47 INC eDI */
-                register uint32_t oper1 = CPU_DI;
-                register uint32_t dst = oper1 + 1;
-                flag_szp16(dst);
-                of = (((dst ^ oper1) & (dst ^ 1) & 0x8000) != 0);
-                af = (((oper1 ^ 1 ^ dst) & 0x10) != 0);
-                CPU_DI = (uint16_t) dst;
+                flag_inc16(CPU_DI);
+                CPU_DI = CPU_DI + 1;
                 break;
             }
             case 0x48: /* 48 DEC eAX */
-                oldcf = cf;
-                oper1 = CPU_AX;
-                oper2 = 1;
-                op_sub16();
-                cf = oldcf;
-                CPU_AX = res16;
+                flag_dec16(CPU_AX);
+                CPU_AX = CPU_AX - 1;
                 break;
 
             case 0x49: /* 49 DEC eCX */
-                oldcf = cf;
-                oper1 = CPU_CX;
-                oper2 = 1;
-                op_sub16();
-                cf = oldcf;
-                CPU_CX = res16;
+                flag_dec16(CPU_CX);
+                CPU_CX = CPU_CX - 1;
                 break;
 
             case 0x4A: /* 4A DEC eDX */
-                oldcf = cf;
-                oper1 = CPU_DX;
-                oper2 = 1;
-                op_sub16();
-                cf = oldcf;
-                CPU_DX = res16;
+                flag_dec16(CPU_DX);
+                CPU_DX = CPU_DX - 1;
                 break;
 
             case 0x4B: /* 4B DEC eBX */
-                oldcf = cf;
-                oper1 = CPU_BX;
-                oper2 = 1;
-                op_sub16();
-                cf = oldcf;
-                CPU_BX = res16;
+                flag_dec16(CPU_BX);
+                CPU_BX = CPU_BX - 1;
                 break;
 
             case 0x4C: /* 4C DEC eSP */
-                oldcf = cf;
-                oper1 = CPU_SP;
-                oper2 = 1;
-                op_sub16();
-                cf = oldcf;
-                CPU_SP = res16;
+                flag_dec16(CPU_SP);
+                CPU_SP = CPU_SP - 1;
                 break;
 
             case 0x4D: /* 4D DEC eBP */
-                oldcf = cf;
-                oper1 = CPU_BP;
-                oper2 = 1;
-                op_sub16();
-                cf = oldcf;
-                CPU_BP = res16;
+                flag_dec16(CPU_BP);
+                CPU_BP = CPU_BP - 1;
                 break;
 
             case 0x4E: /* 4E DEC eSI */
-                oldcf = cf;
-                oper1 = CPU_SI;
-                oper2 = 1;
-                op_sub16();
-                cf = oldcf;
-                CPU_SI = res16;
+                flag_dec16(CPU_SI);
+                CPU_SI = CPU_SI - 1;
                 break;
 
             case 0x4F: /* 4F DEC eDI */
-                oldcf = cf;
-                oper1 = CPU_DI;
-                oper2 = 1;
-                op_sub16();
-                cf = oldcf;
-                CPU_DI = res16;
+                flag_dec16(CPU_DI);
+                CPU_DI = CPU_DI - 1;
                 break;
 
             case 0x50: /* 50 PUSH eAX */
@@ -2249,9 +2724,9 @@ void __not_in_flash() exec86(uint32_t execloops) {
                 temp1 *= temp2;
                 putreg16(reg, (int16_t)temp1);
                 if (temp1 != (int32_t)(int16_t)temp1) {
-                    x86_flags.value |= FLAG_CF_OF_MASK;
+                    flags_resolved()->value |= FLAG_CF_OF_MASK;
                 } else {
-                    x86_flags.value &= ~FLAG_CF_OF_MASK;
+                    flags_resolved()->value &= ~FLAG_CF_OF_MASK;
                 }
                 break;
             }
@@ -2269,9 +2744,9 @@ void __not_in_flash() exec86(uint32_t execloops) {
                 temp1 *= temp2;
 				putreg16(reg, (int16_t)temp1);
                 if (temp1 != (int32_t)(int16_t)temp1) {
-                    x86_flags.value |= FLAG_CF_OF_MASK;
+                    flags_resolved()->value |= FLAG_CF_OF_MASK;
                 } else {
-                    x86_flags.value &= ~FLAG_CF_OF_MASK;
+                    flags_resolved()->value &= ~FLAG_CF_OF_MASK;
                 }
                 break;
             }
@@ -2823,6 +3298,12 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
                 }
 
+                if (reptype && !tf) {
+                    loopcount += rep_charge(opcode, rep_movs(1));
+                    CPU_IP = firstip;
+                    break;
+                }
+
                 putmem8(CPU_ES, CPU_DI, getmem8(useseg, CPU_SI)
                 );
                 if (df) {
@@ -2852,6 +3333,12 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
                 }
 
+                if (reptype && !tf) {
+                    loopcount += rep_charge(opcode, rep_movs(2));
+                    CPU_IP = firstip;
+                    break;
+                }
+
                 putmem16(CPU_ES, CPU_DI, getmem16(useseg, CPU_SI)
                 );
                 if (df) {
@@ -2881,6 +3368,15 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
                 }
 
+                if (reptype && !tf) {
+                    loopcount += rep_charge(opcode, rep_cmps(1));
+                    if ((reptype == 1 && !zf) || (reptype == 2 && zf)) {
+                        break;
+                    }
+                    CPU_IP = firstip;
+                    break;
+                }
+
                 oper1b = getmem8(useseg, CPU_SI);
                 oper2b = getmem8(CPU_ES, CPU_DI);
                 if (df) {
@@ -2918,6 +3414,15 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
                 }
 
+                if (reptype && !tf) {
+                    loopcount += rep_charge(opcode, rep_cmps(2));
+                    if ((reptype == 1 && !zf) || (reptype == 2 && zf)) {
+                        break;
+                    }
+                    CPU_IP = firstip;
+                    break;
+                }
+
                 oper1 = getmem16(useseg, CPU_SI);
                 oper2 = getmem16(CPU_ES, CPU_DI);
                 if (df) {
@@ -2973,6 +3478,12 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
                 }
 
+                if (reptype && !tf) {
+                    loopcount += rep_charge(opcode, rep_stos(1));
+                    CPU_IP = firstip;
+                    break;
+                }
+
                 putmem8(CPU_ES, CPU_DI, CPU_AL
                 );
                 if (df) {
@@ -3000,6 +3511,12 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
                 }
 
+                if (reptype && !tf) {
+                    loopcount += rep_charge(opcode, rep_stos(2));
+                    CPU_IP = firstip;
+                    break;
+                }
+
                 putmem16(CPU_ES, CPU_DI, CPU_AX
                 );
                 if (df) {
@@ -3027,6 +3544,12 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
                 }
 
+                if (reptype && !tf) {
+                    loopcount += rep_charge(opcode, rep_lods(1));
+                    CPU_IP = firstip;
+                    break;
+                }
+
                 CPU_AL = getmem8(useseg, CPU_SI);
                 if (df) {
                     CPU_SI = CPU_SI - 1;
@@ -3053,6 +3576,12 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
                 }
 
+                if (reptype && !tf) {
+                    loopcount += rep_charge(opcode, rep_lods(2));
+                    CPU_IP = firstip;
+                    break;
+                }
+
                 oper1 = getmem16(useseg, CPU_SI);
                 CPU_AX = oper1;
                 if (df) {
@@ -3080,6 +3609,15 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
                 }
 
+                if (reptype && !tf) {
+                    loopcount += rep_charge(opcode, rep_scas(1));
+                    if ((reptype == 1 && !zf) || (reptype == 2 && zf)) {
+                        break;
+                    }
+                    CPU_IP = firstip;
+                    break;
+                }
+
                 oper1b = CPU_AL;
                 oper2b = getmem8(CPU_ES, CPU_DI);
                 flag_sub8(oper1b, oper2b
@@ -3115,6 +3653,15 @@ void __not_in_flash() exec86(uint32_t execloops) {
                     break;
                 }
 
+                if (reptype && !tf) {
+                    loopcount += rep_charge(opcode, rep_scas(2));
+                    if ((reptype == 1 && !zf) || (reptype == 2 && zf)) {
+                        break;
+                    }
+                    CPU_IP = firstip;
+                    break;
+                }
+
                 oper1 = CPU_AX;
                 oper2 = getmem16(CPU_ES, CPU_DI);
                 flag_sub16(oper1, oper2
@@ -3590,9 +4137,9 @@ void __not_in_flash() exec86(uint32_t execloops) {
                         CPU_AX = temp1 & 0xFFFF;
                         flag_szp8((uint8_t) temp1);
                         if (CPU_AH) {
-                            x86_flags.value |= FLAG_CF_OF_MASK;
+                            flags_resolved()->value |= FLAG_CF_OF_MASK;
                         } else {
-                            x86_flags.value &= ~FLAG_CF_OF_MASK;
+                            flags_resolved()->value &= ~FLAG_CF_OF_MASK;
                         }
 #ifdef CPU_CLEAR_ZF_ON_MUL
                         zf = 0;
@@ -3608,9 +4155,9 @@ void __not_in_flash() exec86(uint32_t execloops) {
 						int16_t result = (int16_t)temp1;
 						int8_t truncated = (int8_t)result;
 						if (result != (int16_t)truncated) {
-							x86_flags.value |= FLAG_CF_OF_MASK; // CF=OF=1
+							flags_resolved()->value |= FLAG_CF_OF_MASK; // CF=OF=1
 						} else {
-							x86_flags.value &= ~FLAG_CF_OF_MASK; // CF=OF=0
+							flags_resolved()->value &= ~FLAG_CF_OF_MASK; // CF=OF=0
 						}
 						CPU_AL = truncated;
 						CPU_AH = (uint8_t)(result >> 8);
@@ -3672,18 +4219,12 @@ void __not_in_flash() exec86(uint32_t execloops) {
             case 0xFE: /* FE GRP4 Eb */
                 modregrm();
                 oper1b = readrm8(rm);
-                oper2b = 1;
                 if (!reg) {
-                    tempcf = cf;
-                    op_add8();
-                    cf = tempcf;
-                    writerm8(rm, res8);
+                    flag_inc8(oper1b);
+                    writerm8(rm, oper1b + 1);
                 } else {
-                    tempcf = cf;
-                    res8 = oper1b - oper2b;
-                    flag_sub8(oper1b, oper2b);
-                    cf = tempcf;
-                    writerm8(rm, res8);
+                    flag_dec8(oper1b);
+                    writerm8(rm, oper1b - 1);
                 }
                 break;
 
@@ -3702,6 +4243,10 @@ void __not_in_flash() exec86(uint32_t execloops) {
 #endif
                 break;
         }
+        profiler_opcode(opcode, reg, profiler_started);
+#if !PICO_ON_DEVICE
+        timing_charge(opcode, (uint8_t) (opcode_ip - firstip - 1), opcode_ip + 1);
+#endif
         if (was_TF) {
             was_TF = false;
             intcall86(1);
@@ -3709,5 +4254,8 @@ void __not_in_flash() exec86(uint32_t execloops) {
         if (tf) {
             was_TF = true;
         }
+#if !PICO_ON_DEVICE
+        if (cpu_cycles_total >= cpu_cycles_limit) break;
+#endif
     }
 }
@@ -63,15 +63,24 @@ void init_umb();
 #define putsegreg(regid, writeval)  segregs[(regid) << 1] = writeval
 #define segbase(x)  ((uint32_t) (x) << 4)
 
-#define cf  x86_flags.bits.CF
-#define pf  x86_flags.bits.PF
-#define af  x86_flags.bits.AF
-#define zf  x86_flags.bits.ZF
-#define sf  x86_flags.bits.SF
+#ifndef CPU_NO_LAZY_FLAGS
+// ALU ops only record their operands, CF/PF/AF/ZF/SF/OF are computed on the first access that follows
+extern uint8_t lazy_flags_op;
+void lazy_flags_materialize();
+#define flags_resolved() ((lazy_flags_op ? lazy_flags_materialize() : (void) 0), &x86_flags)
+#else
+#define flags_resolved() (&x86_flags)
+#endif
+
+#define cf  flags_resolved()->bits.CF
+#define pf  flags_resolved()->bits.PF
+#define af  flags_resolved()->bits.AF
+#define zf  flags_resolved()->bits.ZF
+#define sf  flags_resolved()->bits.SF
 #define tf  x86_flags.bits.TF
 #define ifl x86_flags.bits.IF
 #define df  x86_flags.bits.DF
-#define of  x86_flags.bits.OF
+#define of  flags_resolved()->bits.OF
 
 #define CPU_FL_CF    cf
 #define CPU_FL_PF    pf
@@ -1,10 +1,12 @@
 #pragma once
 
 #include "emulator.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 int hdcount = 0, fdcount = 0;
 
-static uint8_t sectorbuffer[512];
 typedef struct _IO_FILE FILE;
 typedef unsigned long DWORD;
 
@@ -16,6 +18,15 @@ extern int	fflush (FILE *);
 extern int fseek(FILE *stream, long offset, int whence);
 extern long ftell(FILE *stream);
 extern void rewind(FILE *stream);
+extern int fileno(FILE *stream);
+// 64-bit offsets, long is 32 bits on Windows
+#ifdef _WIN32
+extern int _fseeki64(FILE *stream, long long offset, int whence);
+#define disk_fseek64(stream, offset) _fseeki64(stream, (long long) (offset), SEEK_SET)
+#else
+extern int fseeko(FILE *stream, off_t offset, int whence);
+#define disk_fseek64(stream, offset) fseeko(stream, (off_t) (offset), SEEK_SET)
+#endif
 
 
 #define SEEK_CUR    1
@@ -30,13 +41,565 @@ struct struct_drive {
     uint16_t heads;
     uint8_t inserted;
     uint8_t readonly;
+    uint8_t *mapping; // whole image for the mapped backends, NULL when it goes through the block cache
+    disk_backend_t backend; // host_disk_backend when the image was inserted
+    const char *path;
+    const char *overlay_path;
+    FILE *overlayfile;
+    uint32_t *overlay_index; // slot of every image block, 0 while the base image holds it
+    uint32_t overlay_used;
+    uint8_t write_error; // a block evicted from the cache could not be written, reported on the next write or reset
 } disk[4];
 
+const char *host_disk_images[4] = { "../fdd0.img", "../fdd1.img", "../hdd.img", "../hdd2.img" };
+const char *host_disk_overlays[4] = { NULL, NULL, NULL, NULL };
+#ifndef _WIN32
+disk_backend_t host_disk_backend = DISK_BACKEND_MMAP;
+#else
+disk_backend_t host_disk_backend = DISK_BACKEND_STDIO;
+#endif
+
+#ifdef EMULATOR_STATS
+uint64_t stats_disk_cache[2];
+#endif
+
+// Block cache in front of the image files: LRU with write-back, a miss reads ahead to the end of the track.
+// Dirty blocks reach the image on eviction, INT 13h reset, eject and disk_flush().
+#ifndef DISK_CACHE_SIZE_KB
+#define DISK_CACHE_SIZE_KB 4096
+#endif
+#define DISK_CACHE_BLOCK_SHIFT 12
+#define DISK_CACHE_BLOCK_SIZE (1 << DISK_CACHE_BLOCK_SHIFT)
+#define DISK_CACHE_BLOCK_MASK (DISK_CACHE_BLOCK_SIZE - 1)
+#define DISK_CACHE_BLOCKS (DISK_CACHE_SIZE_KB >> (DISK_CACHE_BLOCK_SHIFT - 10))
+#define DISK_CACHE_HASH_BITS 12
+#define DISK_CACHE_READ_AHEAD 16 // blocks, a 63 sector hard disk track spans 8
+#define DISK_CACHE_FREE 0xFFFFFFFF
+#define disk_cache_key(drivenum, block) ((uint32_t) (drivenum) << 24 | (block))
+
+typedef struct {
+    uint32_t key; // drive << 24 | block, DISK_CACHE_FREE when unused
+    int32_t hash_next;
+    int32_t lru_prev;
+    int32_t lru_next;
+    uint16_t length; // the last block of an image can be short
+    uint8_t dirty;
+    uint8_t data[DISK_CACHE_BLOCK_SIZE];
+} disk_cache_block_t;
+
+static disk_cache_block_t disk_cache[DISK_CACHE_BLOCKS];
+static int32_t disk_cache_hash[1 << DISK_CACHE_HASH_BITS];
+static int32_t disk_cache_lru_head = -1, disk_cache_lru_tail = -1; // most and least recently used
+static uint8_t disk_cache_read_ahead[DISK_CACHE_READ_AHEAD * DISK_CACHE_BLOCK_SIZE];
+static uint8_t disk_cache_ready = 0;
+
+static INLINE uint32_t disk_cache_bucket(const uint32_t key) {
+    return key * 2654435761u >> (32 - DISK_CACHE_HASH_BITS);
+}
+
+static INLINE void disk_cache_unlink(const int32_t index) {
+    disk_cache_block_t *block = &disk_cache[index];
+    if (block->lru_prev >= 0) disk_cache[block->lru_prev].lru_next = block->lru_next;
+    else disk_cache_lru_head = block->lru_next;
+    if (block->lru_next >= 0) disk_cache[block->lru_next].lru_prev = block->lru_prev;
+    else disk_cache_lru_tail = block->lru_prev;
+}
+
+static INLINE void disk_cache_push_head(const int32_t index) {
+    disk_cache[index].lru_prev = -1;
+    disk_cache[index].lru_next = disk_cache_lru_head;
+    if (disk_cache_lru_head >= 0) disk_cache[disk_cache_lru_head].lru_prev = index;
+    else disk_cache_lru_tail = index;
+    disk_cache_lru_head = index;
+}
+
+static INLINE void disk_cache_push_tail(const int32_t index) {
+    disk_cache[index].lru_next = -1;
+    disk_cache[index].lru_prev = disk_cache_lru_tail;
+    if (disk_cache_lru_tail >= 0) disk_cache[disk_cache_lru_tail].lru_next = index;
+    else disk_cache_lru_head = index;
+    disk_cache_lru_tail = index;
+}
+
+static void disk_cache_init() {
+    for (int32_t i = 0; i < 1 << DISK_CACHE_HASH_BITS; i++) {
+        disk_cache_hash[i] = -1;
+    }
+    for (int32_t i = 0; i < DISK_CACHE_BLOCKS; i++) {
+        disk_cache[i].key = DISK_CACHE_FREE;
+        disk_cache[i].dirty = 0;
+        disk_cache_push_tail(i);
+    }
+    disk_cache_ready = 1;
+}
+
+static int32_t disk_cache_find(const uint32_t key) {
+    for (int32_t i = disk_cache_hash[disk_cache_bucket(key)]; i >= 0; i = disk_cache[i].hash_next) {
+        if (disk_cache[i].key == key) return i;
+    }
+    return -1;
+}
+
+static void disk_cache_unhash(const int32_t index) {
+    int32_t *link = &disk_cache_hash[disk_cache_bucket(disk_cache[index].key)];
+    while (*link != index) {
+        link = &disk_cache[*link].hash_next;
+    }
+    *link = disk_cache[index].hash_next;
+    disk_cache[index].key = DISK_CACHE_FREE;
+}
+
+// Copy-on-write overlay: a sparse delta file of the blocks written since it was created, the base image is opened
+// read-only. A header, one index entry per image block (0 while unchanged, else a 1-based slot), then the slots.
+#define DISK_OVERLAY_MAGIC "286OVL1"
+
+typedef struct {
+    char magic[8];
+    uint32_t block_size;
+    uint32_t blocks; // image blocks covered by the index
+    uint32_t used; // slots
+    uint32_t reserved;
+} disk_overlay_header_t;
+
+static INLINE uint32_t disk_overlay_blocks(const size_t filesize) {
+    return (uint32_t) ((filesize + DISK_CACHE_BLOCK_MASK) >> DISK_CACHE_BLOCK_SHIFT);
+}
+
+static INLINE uint64_t disk_overlay_slot_offset(const uint8_t drivenum, const uint32_t slot) {
+    const uint64_t index_end = sizeof(disk_overlay_header_t) + disk_overlay_blocks(disk[drivenum].filesize) * 4ull;
+    return ((index_end + DISK_CACHE_BLOCK_MASK) & ~(uint64_t) DISK_CACHE_BLOCK_MASK) +
+           ((uint64_t) (slot - 1) << DISK_CACHE_BLOCK_SHIFT);
+}
+
+static void disk_overlay_write_header(FILE *file, const uint32_t blocks, const uint32_t used) {
+    disk_overlay_header_t header = { DISK_OVERLAY_MAGIC, DISK_CACHE_BLOCK_SIZE, blocks, used, 0 };
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+}
+
+// Empty overlay: header and a zeroed index
+static void disk_overlay_format(FILE *file, const uint32_t blocks) {
+    static const uint32_t zeroes[256] = { 0 };
+    disk_overlay_write_header(file, blocks, 0);
+    for (uint32_t written = 0; written < blocks; written += 256) {
+        fwrite(zeroes, 4, blocks - written < 256 ? blocks - written : 256, file);
+    }
+    fflush(file);
+}
+
+static uint8_t disk_overlay_open(const uint8_t drivenum, const char *path) {
+    const uint32_t blocks = disk_overlay_blocks(disk[drivenum].filesize);
+    FILE *file = fopen(path, "rb+");
+    if (!file) {
+        file = fopen(path, "wb+");
+        if (!file) {
+            printf("DISK: ERROR: cannot create overlay %s\n", path);
+            return 0;
+        }
+        disk_overlay_format(file, blocks);
+    }
+
+    disk_overlay_header_t header;
+    fseek(file, 0, SEEK_SET);
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, DISK_OVERLAY_MAGIC, 8) != 0 ||
+        header.block_size != DISK_CACHE_BLOCK_SIZE || header.blocks != blocks) {
+        printf("DISK: ERROR: overlay %s does not belong to a %lu byte image\n", path,
+               (unsigned long) disk[drivenum].filesize);
+        fclose(file);
+        return 0;
+    }
+    uint32_t *index = calloc(blocks, 4);
+    if (!index || fread(index, 4, blocks, file) != blocks) {
+        free(index);
+        fclose(file);
+        return 0;
+    }
+    // header.used is only written on sync, the index entries reach the file with every new slot
+    uint32_t used = 0;
+    for (uint32_t block = 0; block < blocks; block++) {
+        if (index[block] > used) used = index[block];
+    }
+
+    disk[drivenum].overlay_path = path;
+    disk[drivenum].overlayfile = file;
+    disk[drivenum].overlay_index = index;
+    disk[drivenum].overlay_used = used;
+    return 1;
+}
+
+static void disk_overlay_sync(const uint8_t drivenum) {
+    disk_overlay_write_header(disk[drivenum].overlayfile, disk_overlay_blocks(disk[drivenum].filesize),
+                              disk[drivenum].overlay_used);
+    fflush(disk[drivenum].overlayfile);
+}
+
+static void disk_overlay_close(const uint8_t drivenum) {
+    if (!disk[drivenum].overlayfile) return;
+    disk_overlay_sync(drivenum);
+    fclose(disk[drivenum].overlayfile);
+    free(disk[drivenum].overlay_index);
+    disk[drivenum].overlayfile = NULL;
+    disk[drivenum].overlay_index = NULL;
+}
+
+// Reads `count` blocks from the image, blocks held by the overlay are taken from there
+static size_t disk_store_read(const uint8_t drivenum, const uint32_t first, const uint32_t count, uint8_t *buffer) {
+    if (disk_fseek64(disk[drivenum].diskfile, (uint64_t) first << DISK_CACHE_BLOCK_SHIFT) != 0) return 0;
+    const size_t bytes = fread(buffer, 1, (size_t) count << DISK_CACHE_BLOCK_SHIFT, disk[drivenum].diskfile);
+    if (disk[drivenum].overlayfile) {
+        for (uint32_t i = 0; i < count; i++) {
+            const size_t start = (size_t) i << DISK_CACHE_BLOCK_SHIFT;
+            const uint32_t slot = disk[drivenum].overlay_index[first + i];
+            if (!slot || start >= bytes) continue;
+            disk_fseek64(disk[drivenum].overlayfile, disk_overlay_slot_offset(drivenum, slot));
+            fread(&buffer[start], 1, bytes - start < DISK_CACHE_BLOCK_SIZE ? bytes - start : DISK_CACHE_BLOCK_SIZE,
+                  disk[drivenum].overlayfile);
+        }
+    }
+    return bytes;
+}
+
+// Writes a block to the overlay when there is one, otherwise to the image. 0 when the host write failed
+static uint8_t disk_store_write(const uint8_t drivenum, const uint32_t block, const uint8_t *data, const uint16_t length) {
+    FILE *overlay = disk[drivenum].overlayfile;
+    if (!overlay) {
+        return disk_fseek64(disk[drivenum].diskfile, (uint64_t) block << DISK_CACHE_BLOCK_SHIFT) == 0 &&
+               fwrite(data, length, 1, disk[drivenum].diskfile) == 1;
+    }
+    // The data goes in before the index entry that points at it, a slot cut short by a crash is never referenced
+    const uint32_t slot = disk[drivenum].overlay_index[block];
+    const uint32_t target = slot ? slot : disk[drivenum].overlay_used + 1;
+    if (disk_fseek64(overlay, disk_overlay_slot_offset(drivenum, target)) != 0 || fwrite(data, length, 1, overlay) != 1) {
+        return 0;
+    }
+    if (!slot) {
+        if (disk_fseek64(overlay, sizeof(disk_overlay_header_t) + block * 4ull) != 0 || fwrite(&target, 4, 1, overlay) != 1) {
+            return 0;
+        }
+        disk[drivenum].overlay_index[block] = target;
+        disk[drivenum].overlay_used = target;
+    }
+    return 1;
+}
+
+// A block that could not be written stays dirty, so a later flush tries again
+static uint8_t disk_cache_write_back(disk_cache_block_t *block) {
+    const uint8_t drivenum = block->key >> 24;
+    if (!disk_store_write(drivenum, block->key & 0xFFFFFF, block->data, block->length)) {
+        disk[drivenum].write_error = 1;
+        return 0;
+    }
+    block->dirty = 0;
+    return 1;
+}
+
+// Recycles the least recently used block for `key`
+static int32_t disk_cache_claim(const uint32_t key) {
+    const int32_t index = disk_cache_lru_tail;
+    disk_cache_block_t *block = &disk_cache[index];
+    if (block->key != DISK_CACHE_FREE) {
+        if (block->dirty) disk_cache_write_back(block);
+        disk_cache_unhash(index);
+    }
+    const uint32_t bucket = disk_cache_bucket(key);
+    block->key = key;
+    block->hash_next = disk_cache_hash[bucket];
+    disk_cache_hash[bucket] = index;
+    disk_cache_unlink(index);
+    disk_cache_push_head(index);
+    return index;
+}
+
+// Block holding `offset`, read from the image together with the rest of its track on a miss
+static disk_cache_block_t *disk_cache_get(const uint8_t drivenum, const size_t offset) {
+    if (!disk_cache_ready) disk_cache_init();
+    const uint32_t first = (uint32_t) (offset >> DISK_CACHE_BLOCK_SHIFT);
+    int32_t index = disk_cache_find(disk_cache_key(drivenum, first));
+    if (index >= 0) {
+        stats_disk_cache_hit(true);
+        disk_cache_unlink(index);
+        disk_cache_push_head(index);
+        return &disk_cache[index];
+    }
+    stats_disk_cache_hit(false);
+
+    const size_t track_bytes = (size_t) disk[drivenum].sects * 512;
+    size_t end = (offset / track_bytes + 1) * track_bytes;
+    if (end > disk[drivenum].filesize) end = disk[drivenum].filesize;
+    uint32_t count = (uint32_t) (((end + DISK_CACHE_BLOCK_MASK) >> DISK_CACHE_BLOCK_SHIFT) - first);
+    if (count > DISK_CACHE_READ_AHEAD) count = DISK_CACHE_READ_AHEAD;
+    if (count > DISK_CACHE_BLOCKS / 4) count = DISK_CACHE_BLOCKS / 4;
+    if (count < 1) count = 1;
+    for (uint32_t i = 1; i < count; i++) {
+        if (disk_cache_find(disk_cache_key(drivenum, first + i)) >= 0) {
+            count = i;
+            break;
+        }
+    }
+
+    const size_t bytes = disk_store_read(drivenum, first, count, disk_cache_read_ahead);
+    if (!bytes) return NULL;
+    // Read ahead blocks go in first, so the requested one ends up most recently used
+    for (uint32_t i = count; i-- > 0;) {
+        const size_t start = (size_t) i << DISK_CACHE_BLOCK_SHIFT;
+        if (start >= bytes) continue;
+        index = disk_cache_claim(disk_cache_key(drivenum, first + i));
+        disk_cache_block_t *block = &disk_cache[index];
+        block->length = (uint16_t) (bytes - start < DISK_CACHE_BLOCK_SIZE ? bytes - start : DISK_CACHE_BLOCK_SIZE);
+        block->dirty = 0;
+        memcpy(block->data, &disk_cache_read_ahead[start], block->length);
+    }
+    return &disk_cache[index];
+}
+
+// 0 when some of the drive's writes, including evictions since the last flush, did not reach the host file
+static uint8_t disk_cache_flush(const uint8_t drivenum) {
+#ifndef _WIN32
+    if (disk[drivenum].mapping) {
+        if (disk[drivenum].backend != DISK_BACKEND_MMAP_OVERLAY) {
+            return msync(disk[drivenum].mapping, disk[drivenum].filesize, MS_SYNC) == 0;
+        }
+        return 1;
+    }
+#endif
+    if (!disk_cache_ready || !disk[drivenum].diskfile) return 1;
+    for (int32_t i = 0; i < DISK_CACHE_BLOCKS; i++) {
+        if (disk_cache[i].dirty && disk_cache[i].key >> 24 == drivenum) {
+            disk_cache_write_back(&disk_cache[i]);
+        }
+    }
+    if (disk[drivenum].overlayfile) {
+        disk_overlay_sync(drivenum);
+    }
+    if (fflush(disk[drivenum].overlayfile ? disk[drivenum].overlayfile : disk[drivenum].diskfile) != 0) {
+        disk[drivenum].write_error = 1;
+    }
+    const uint8_t result = !disk[drivenum].write_error;
+    disk[drivenum].write_error = 0;
+    return result;
+}
+
+// Forgets every block of the drive, after writing back the dirty ones if asked to
+static void disk_cache_drop(const uint8_t drivenum, const bool write_back) {
+    if (write_back && !disk_cache_flush(drivenum)) {
+        printf("DISK: ERROR: cannot write back %s\n", disk[drivenum].path);
+    }
+    if (!disk_cache_ready) return;
+    for (int32_t i = 0; i < DISK_CACHE_BLOCKS; i++) {
+        if (disk_cache[i].key != DISK_CACHE_FREE && disk_cache[i].key >> 24 == drivenum) {
+            disk_cache_unhash(i);
+            disk_cache_unlink(i);
+            disk_cache_push_tail(i);
+        }
+    }
+}
+
+// Files the host redirector (network-redirector.c.inl) has open are written out along with the images
+static void redirector_commit_all();
+
+void disk_flush() {
+    for (uint8_t drivenum = 0; drivenum < 4; drivenum++) {
+        if (disk[drivenum].inserted && !disk_cache_flush(drivenum)) {
+            printf("DISK: ERROR: cannot write back %s\n", disk[drivenum].path);
+        }
+    }
+    redirector_commit_all();
+}
+
+static uint8_t disk_copy_file(FILE *from, FILE *to) {
+    size_t bytes;
+    fseek(from, 0, SEEK_SET);
+    fseek(to, 0, SEEK_SET);
+    while ((bytes = fread(disk_cache_read_ahead, 1, sizeof(disk_cache_read_ahead), from)) > 0) {
+        if (fwrite(disk_cache_read_ahead, bytes, 1, to) != 1) return 0;
+    }
+    fflush(to);
+    return 1;
+}
+
+// Empties the overlay, the cache must not hold blocks that differ from the base image
+static uint8_t disk_overlay_reset(const uint8_t drivenum) {
+    fclose(disk[drivenum].overlayfile);
+    disk[drivenum].overlayfile = fopen(disk[drivenum].overlay_path, "wb+");
+    if (!disk[drivenum].overlayfile) {
+        disk[drivenum].readonly = 1;
+        return 0;
+    }
+    const uint32_t blocks = disk_overlay_blocks(disk[drivenum].filesize);
+    disk_overlay_format(disk[drivenum].overlayfile, blocks);
+    memset(disk[drivenum].overlay_index, 0, blocks * 4ul);
+    disk[drivenum].overlay_used = 0;
+    return 1;
+}
+
+uint8_t disk_overlay_discard(const uint8_t drivenum) {
+    if (!disk[drivenum].overlayfile) return 0;
+    disk_cache_drop(drivenum, false);
+    return disk_overlay_reset(drivenum);
+}
+
+static inline void ejectdisk(uint8_t drivenum);
+
+uint8_t disk_overlay_merge(const uint8_t drivenum) {
+    if (!disk[drivenum].overlayfile) return 0;
+    disk_cache_flush(drivenum);
+    FILE *base = fopen(disk[drivenum].path, "rb+");
+    if (!base) return 0;
+    uint8_t written = 1;
+    const uint32_t blocks = disk_overlay_blocks(disk[drivenum].filesize);
+    for (uint32_t block = 0; block < blocks; block++) {
+        const uint32_t slot = disk[drivenum].overlay_index[block];
+        if (!slot) continue;
+        const size_t start = (size_t) block << DISK_CACHE_BLOCK_SHIFT;
+        const size_t length = disk[drivenum].filesize - start < DISK_CACHE_BLOCK_SIZE
+                                  ? disk[drivenum].filesize - start
+                                  : DISK_CACHE_BLOCK_SIZE;
+        disk_fseek64(disk[drivenum].overlayfile, disk_overlay_slot_offset(drivenum, slot));
+        if (fread(disk_cache_read_ahead, 1, length, disk[drivenum].overlayfile) != length ||
+            disk_fseek64(base, (uint64_t) start) != 0 || fwrite(disk_cache_read_ahead, length, 1, base) != 1) {
+            written = 0;
+            break;
+        }
+    }
+    if (fclose(base) != 0) written = 0;
+    // The overlay is kept when the base image did not take all of it
+    if (!written) {
+        printf("DISK: ERROR: cannot merge %s into %s\n", disk[drivenum].overlay_path, disk[drivenum].path);
+        return 0;
+    }
+    // Reopened so no stale read buffer survives, the cached blocks already match the merged image
+    fclose(disk[drivenum].diskfile);
+    disk[drivenum].diskfile = fopen(disk[drivenum].path, "rb");
+    if (!disk[drivenum].diskfile) {
+        // Nothing left to read the drive from, the overlay still holds the merged blocks for the next insert
+        printf("DISK: ERROR: cannot reopen %s, drive %u ejected\n", disk[drivenum].path, drivenum);
+        ejectdisk(drivenum);
+        return 0;
+    }
+    return disk_overlay_reset(drivenum);
+}
+
+uint8_t disk_overlay_snapshot(const uint8_t drivenum, const char *path) {
+    if (!disk[drivenum].overlayfile) return 0;
+    disk_cache_flush(drivenum);
+    FILE *snapshot = fopen(path, "wb");
+    if (!snapshot) return 0;
+    const uint8_t result = disk_copy_file(disk[drivenum].overlayfile, snapshot);
+    fclose(snapshot);
+    return result;
+}
+
+uint8_t disk_overlay_restore(const uint8_t drivenum, const char *path) {
+    FILE *snapshot;
+    if (!disk[drivenum].inserted && host_disk_overlays[drivenum]) {
+        // Before the image is attached the snapshot only has to become the overlay file, insertdisk checks it
+        snapshot = fopen(path, "rb");
+        if (!snapshot) return 0;
+        FILE *overlay = fopen(host_disk_overlays[drivenum], "wb");
+        uint8_t copied = overlay && disk_copy_file(snapshot, overlay);
+        if (overlay && fclose(overlay) != 0) copied = 0;
+        fclose(snapshot);
+        return copied;
+    }
+    if (!disk[drivenum].overlayfile) return 0;
+    snapshot = fopen(path, "rb");
+    if (!snapshot) return 0;
+    disk_cache_drop(drivenum, false);
+    fclose(disk[drivenum].overlayfile);
+    free(disk[drivenum].overlay_index);
+    disk[drivenum].overlayfile = NULL;
+    disk[drivenum].overlay_index = NULL;
+    FILE *overlay = fopen(disk[drivenum].overlay_path, "wb");
+    const uint8_t copied = overlay && disk_copy_file(snapshot, overlay);
+    if (overlay) fclose(overlay);
+    fclose(snapshot);
+    if (!copied || !disk_overlay_open(drivenum, disk[drivenum].overlay_path)) {
+        disk[drivenum].readonly = 1;
+        return 0;
+    }
+    return 1;
+}
+
+// Sector at `offset` in the mapping or the block cache, NULL past the end of the image
+static uint8_t *disk_sector(const uint8_t drivenum, const size_t offset, const bool write) {
+    if (offset + 512 > disk[drivenum].filesize) return NULL;
+    if (disk[drivenum].mapping) return &disk[drivenum].mapping[offset];
+    disk_cache_block_t *block = disk_cache_get(drivenum, offset);
+    if (!block || (offset & DISK_CACHE_BLOCK_MASK) + 512 > block->length) return NULL;
+    if (write) block->dirty = 1;
+    return &block->data[offset & DISK_CACHE_BLOCK_MASK];
+}
+
+// Guest memory side of a transfer: whole pages are copied directly, anything else goes through read86/write86
+static void disk_to_guest(uint32_t address, const uint8_t *source, uint32_t length) {
+    while (length) {
+        uint32_t chunk = MEMORY_PAGE_SIZE - (address & MEMORY_PAGE_MASK);
+        if (chunk > length) chunk = length;
+        memory_write_track(address, chunk);
+        uint8_t *page = memory_write_page(address);
+        if (page) {
+            memcpy(&page[address & MEMORY_PAGE_MASK], source, chunk);
+            decode_cache_invalidate(address, chunk);
+        } else {
+            for (uint32_t i = 0; i < chunk; i++) {
+                write86(address + i, source[i]);
+            }
+        }
+        address += chunk;
+        source += chunk;
+        length -= chunk;
+    }
+}
+
+static void disk_from_guest(uint32_t address, uint8_t *destination, uint32_t length) {
+    while (length) {
+        uint32_t chunk = MEMORY_PAGE_SIZE - (address & MEMORY_PAGE_MASK);
+        if (chunk > length) chunk = length;
+        const uint8_t *page = memory_read_page(address);
+        if (page) {
+            memcpy(destination, &page[address & MEMORY_PAGE_MASK], chunk);
+        } else {
+            for (uint32_t i = 0; i < chunk; i++) {
+                destination[i] = read86(address + i);
+            }
+        }
+        address += chunk;
+        destination += chunk;
+        length -= chunk;
+    }
+}
+
+static bool disk_equals_guest(uint32_t address, const uint8_t *source, uint32_t length) {
+    while (length) {
+        uint32_t chunk = MEMORY_PAGE_SIZE - (address & MEMORY_PAGE_MASK);
+        if (chunk > length) chunk = length;
+        const uint8_t *page = memory_read_page(address);
+        if (page) {
+            if (memcmp(&page[address & MEMORY_PAGE_MASK], source, chunk) != 0) return false;
+        } else {
+            for (uint32_t i = 0; i < chunk; i++) {
+                if (read86(address + i) != source[i]) return false;
+            }
+        }
+        address += chunk;
+        source += chunk;
+        length -= chunk;
+    }
+    return true;
+}
 
 static inline void ejectdisk(uint8_t drivenum) {
     if (drivenum & 0x80) drivenum -= 126;
 
     if (disk[drivenum].inserted) {
+        disk_cache_drop(drivenum, true);
+        disk_overlay_close(drivenum);
+#ifndef _WIN32
+        if (disk[drivenum].mapping) {
+            munmap(disk[drivenum].mapping, disk[drivenum].filesize);
+            disk[drivenum].mapping = NULL;
+        }
+#endif
         disk[drivenum].inserted = 0;
         if (drivenum >= 0x80)
             hdcount--;
@@ -48,7 +611,9 @@ static inline void ejectdisk(uint8_t drivenum) {
 uint8_t insertdisk(uint8_t drivenum, const char *pathname) {
     if (drivenum & 0x80) drivenum -= 126;  // Normalize hard drive numbers
 
-    FILE *file = fopen(pathname, "rb+");
+    // Overlays keep the writes elsewhere, so the image is never written to
+    const char *overlay = host_disk_overlays[drivenum];
+    FILE *file = fopen(pathname, overlay || host_disk_backend == DISK_BACKEND_MMAP_OVERLAY ? "rb" : "rb+");
     if (!file) {
         printf( "DISK: ERROR: cannot open disk file %s for drive %02Xh\n", pathname, drivenum);
         return 0;
@@ -99,10 +664,30 @@ uint8_t insertdisk(uint8_t drivenum, const char *pathname) {
     // Eject any existing disk and insert the new one
     ejectdisk(drivenum);
 
+    uint8_t *mapping = NULL;
+#ifndef _WIN32
+    if (host_disk_backend != DISK_BACKEND_STDIO && !overlay) {
+        const int shared = host_disk_backend == DISK_BACKEND_MMAP;
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, fileno(file), 0);
+        if (mapping == MAP_FAILED) {
+            printf("DISK: cannot map %s, falling back to buffered access\n", pathname);
+            mapping = NULL;
+        }
+    }
+#endif
+
     disk[drivenum].diskfile = file;
+    disk[drivenum].mapping = mapping;
+    disk[drivenum].backend = host_disk_backend;
+    disk[drivenum].path = pathname;
     disk[drivenum].filesize = size;
+    if (overlay && !disk_overlay_open(drivenum, overlay)) {
+        fclose(file);
+        return 0;
+    }
     disk[drivenum].inserted = 1;  // Using 1 instead of true for consistency with uint8_t
-    disk[drivenum].readonly = 0;  // Default to read-write
+    // Default to read-write, an overlay that could not be mapped has nowhere to keep writes
+    disk[drivenum].readonly = !mapping && !overlay && host_disk_backend == DISK_BACKEND_MMAP_OVERLAY;
     disk[drivenum].cyls = cyls;
     disk[drivenum].heads = heads;
     disk[drivenum].sects = sects;
@@ -166,13 +751,10 @@ static void readdisk(uint8_t drivenum,
         return;
     }
 
-    // Set file position
-    fseek(disk[drivenum].diskfile, fileoffset, SEEK_SET);
-
     // Process sectors
     for (cursect = 0; cursect < sectcount; cursect++) {
-        // Read the sector into buffer
-        if (fread(&sectorbuffer[0], 512, 1, disk[drivenum].diskfile) != 1) {
+        const uint8_t *sector = disk_sector(drivenum, fileoffset, false);
+        if (!sector) {
 //            printf("Disk read error on drive %i\r\n", drivenum);
             CPU_AH = 0x04;    // sector not found
             CPU_AL = 0;
@@ -181,22 +763,17 @@ static void readdisk(uint8_t drivenum,
         }
 
         if (is_verify) {
-            for (int sectoffset = 0; sectoffset < 512; sectoffset++) {
-                // Verify sector data
-                if (read86(memdest++) != sectorbuffer[sectoffset]) {
-                    // Sector verify failed
-                    CPU_AL = cursect;
-                    CPU_FL_CF = 1;
-                    CPU_AH = 0xBB;    // sector verify failed error code
-                    return;
-                }
+            if (!disk_equals_guest(memdest, sector, 512)) {
+                // Sector verify failed
+                CPU_AL = cursect;
+                CPU_FL_CF = 1;
+                CPU_AH = 0xBB;    // sector verify failed error code
+                return;
             }
         } else {
-            for (int sectoffset = 0; sectoffset < 512; sectoffset++) {
-                // Write sector data
-                write86(memdest++, sectorbuffer[sectoffset]);
-            }
+            disk_to_guest(memdest, sector, 512);
         }
+        memdest += 512;
 
         // Update file offset for next sector
         fileoffset += 512;
@@ -255,20 +832,16 @@ static void writedisk(uint8_t drivenum,
         return;
     }
 
-    // Set file position
-    fseek(disk[drivenum].diskfile, fileoffset, SEEK_SET);
-
-
-    // Write each sector
+    // Write each sector into the mapping or the cache, the image is updated on flush
     for (cursect = 0; cursect < sectcount; cursect++) {
-        // Read from memory and store in sector buffer
-        for (int sectoffset = 0; sectoffset < 512; sectoffset++) {
-            // FIXME: segment overflow condition?
-            sectorbuffer[sectoffset] = read86(memdest++);
+        uint8_t *sector = disk_sector(drivenum, fileoffset, true);
+        if (!sector) {
+            break;
         }
-
-        // Write the buffer to the file
-        fwrite(sectorbuffer, 512, 1, disk[drivenum].diskfile);
+        // FIXME: segment overflow condition?
+        disk_from_guest(memdest, sector, 512);
+        memdest += 512;
+        fileoffset += 512;
     }
 
     // Handle the case where no sectors were written
@@ -279,6 +852,15 @@ static void writedisk(uint8_t drivenum,
         return;
     }
 
+    // A block evicted to make room for these sectors did not reach the host file
+    if (disk[drivenum].write_error) {
+        disk[drivenum].write_error = 0;
+        CPU_AH = 0xCC;    // write fault
+        CPU_AL = cursect;
+        CPU_FL_CF = 1;
+        return;
+    }
+
     // Set success flags
     CPU_AL = cursect;
     CPU_FL_CF = 0;
@@ -297,8 +879,13 @@ static INLINE void diskhandler() {
     switch (CPU_AH) {
         case 0x00:  // Reset disk system
             if (disk[drivenum].inserted) {
-                CPU_AH = 0;
-                CPU_FL_CF = 0;  // Successful reset (no-op in emulator)
+                if (disk_cache_flush(drivenum)) {
+                    CPU_AH = 0;
+                    CPU_FL_CF = 0;  // Successful reset (no-op in emulator)
+                } else {
+                    CPU_AH = 0xCC;  // write fault, the host file did not take the cached writes
+                    CPU_FL_CF = 1;
+                }
             } else {
 
                 CPU_FL_CF = 1;  // Disk not inserted
@@ -374,6 +961,7 @@ static INLINE void diskhandler() {
 
     // Set the last status in BIOS Data Area (for hard drives)
     if (CPU_DL & 0x80) {
+        memory_write_track(0x474, 1);
         RAM[0x474] = CPU_AH;
     }
 }
@@ -11,6 +11,7 @@ uint8_t __attribute__((aligned (4), section(".psram"))) EMS[EMS_MEMORY_SIZE] = {
 
 inline void out_ems(const uint16_t port, const uint8_t data) {
     ems_pages[port & 3] = data;
+    memory_map_ems();
 }
 
 static INLINE uint32_t physical_address(const uint32_t address) {
@@ -36,6 +36,27 @@ extern bool PSRAM_AVAILABLE;
 #define RAM_SIZE (640 << 10)
 #define butter_psram_size 1
 #define PSRAM_AVAILABLE 1
+// Images attached on INT 19h: fdd0, fdd1, hdd, hdd2
+extern const char *host_disk_images[4];
+typedef enum {
+    DISK_BACKEND_STDIO, // buffered file access behind the block cache
+    DISK_BACKEND_MMAP, // image mapped shared, writes go to the file
+    DISK_BACKEND_MMAP_OVERLAY, // image mapped copy-on-write, writes are dropped on eject or exit
+} disk_backend_t;
+// Backend for the images inserted next, the mapped ones are not available on Windows
+extern disk_backend_t host_disk_backend;
+// Copy-on-write overlay files of the images, NULL to write to the image itself
+extern const char *host_disk_overlays[4];
+// Writes the dirty blocks of the disk cache back to the images
+extern void disk_flush();
+// Overlay commands by host_disk_images index, 0 when the drive has no overlay or the files cannot be accessed
+extern uint8_t disk_overlay_discard(uint8_t drivenum); // back to the base image
+extern uint8_t disk_overlay_merge(uint8_t drivenum); // writes the overlay into the base image and empties it
+extern uint8_t disk_overlay_snapshot(uint8_t drivenum, const char *path); // copies the overlay to `path`
+extern uint8_t disk_overlay_restore(uint8_t drivenum, const char *path); // such a copy becomes the overlay, also before boot
+// Maps DOS drive `letter` of the network redirector to the host directory `path`, NULL unmaps it.
+// H: is mapped to a default directory until changed, MAPDRIVE.COM registers the letters with DOS
+extern uint8_t redirector_map(char letter, const char *path);
 #endif
 #ifdef HARDWARE_SOUND
 #define SOUND_FREQUENCY (44100)
@@ -155,6 +176,31 @@ uint16_t cga_portin(uint16_t portnum);
 extern uint32_t vga_plane_offset;
 extern uint8_t vga_planar_mode;
 
+// Converts count planar VIDEORAM entries ([P3|P2|P1|P0] per uint32_t) into 8 * count 4-bit colour indices,
+// one byte per pixel, left to right. indices must be 4-byte aligned.
+void planar_to_indexed(const uint32_t *planes, uint8_t *indices, int count);
+
+// Builds the tables of the kernels that use them, before the first planar_to_indexed() call
+void planar_init(void);
+
+#if !PICO_ON_DEVICE
+// One bit per 256 VIDEORAM entries written since the host renderer last drew them,
+// and one per 1024 entries (4 KB) written since the last rewind snapshot
+#define VIDEORAM_DIRTY_SHIFT 8
+#define VIDEORAM_SNAPSHOT_SHIFT 10
+#define VIDEORAM_DIRTY_WORDS ((VIDEORAM_SIZE >> VIDEORAM_DIRTY_SHIFT) / 32)
+extern uint32_t videoram_dirty[VIDEORAM_DIRTY_WORDS];
+extern uint64_t videoram_snapshot_dirty;
+#define videoram_mark_dirty(index) \
+    (videoram_dirty[((index) & (VIDEORAM_SIZE - 1)) >> VIDEORAM_DIRTY_SHIFT >> 5] |= \
+     1u << (((index) & (VIDEORAM_SIZE - 1)) >> VIDEORAM_DIRTY_SHIFT & 31), \
+     videoram_snapshot_dirty |= 1ull << (((index) & (VIDEORAM_SIZE - 1)) >> VIDEORAM_SNAPSHOT_SHIFT))
+#define videoram_mark_all_dirty() (memset(videoram_dirty, 0xFF, sizeof(videoram_dirty)), videoram_snapshot_dirty = ~0ull)
+#else
+#define videoram_mark_dirty(index) ((void) 0)
+#define videoram_mark_all_dirty() ((void) 0)
+#endif
+
 #if PICO_ON_DEVICE
     extern bool ega_vga_enabled;
 #else
@@ -176,6 +222,34 @@ extern read86dw_t readdw86;
 extern write86_t write86;
 extern write86w_t writew86;
 extern write86dw_t writedw86;
+
+// 4 KB page table over the first 1 MB + HMA
+#define MEMORY_PAGE_SHIFT 12
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_MASK (MEMORY_PAGE_SIZE - 1)
+#define MEMORY_PAGES (0x110000 >> MEMORY_PAGE_SHIFT)
+extern const uint8_t *memory_read_pages[MEMORY_PAGES];
+extern uint8_t *memory_write_pages[MEMORY_PAGES];
+
+#define memory_read_page(address) ((address) < (MEMORY_PAGES << MEMORY_PAGE_SHIFT) ? memory_read_pages[(address) >> MEMORY_PAGE_SHIFT] : NULL)
+#define memory_write_page(address) ((address) < (MEMORY_PAGES << MEMORY_PAGE_SHIFT) ? memory_write_pages[(address) >> MEMORY_PAGE_SHIFT] : NULL)
+// With A20 off a store above 1 MB lands in low memory, where the decode cache has to see it
+#define memory_a20_alias(address) ((address) >= HMA_START && !a20_enabled ? (address) - HMA_START : (address))
+
+extern void memory_map_rebuild();
+
+extern void memory_map_a20();
+
+extern void memory_map_ems();
+
+#if !PICO_ON_DEVICE
+// Snapshot write tracking: with protection on, the first write to a page since the last snapshot marks it.
+// Code writing guest memory behind the page table calls memory_write_track() for the guest range it writes
+void memory_write_protect(uint8_t protect);
+void memory_write_track(uint32_t address, uint32_t length);
+#else
+#define memory_write_track(address, length) ((void) 0)
+#endif
 // on-board (butter) psram
 void write86_ob(const uint32_t address, const uint8_t value);
 void writew86_ob(uint32_t address, uint16_t value);
@@ -216,8 +290,44 @@ extern void exec86(uint32_t execloops);
 
 extern void reset86();
 
+// Decoded instruction cache, keyed by CS:IP linear address
+#if PICO_RP2040
+#define CPU_NO_DECODE_CACHE
+#endif
+#ifndef CPU_NO_DECODE_CACHE
+#define DECODE_CACHE_BLOCK_SHIFT 8
+#define DECODE_CACHE_BLOCKS ((HMA_END + 0xFF) >> DECODE_CACHE_BLOCK_SHIFT)
+extern uint8_t decode_cache_code_blocks[DECODE_CACHE_BLOCKS];
+
+extern void decode_cache_invalidate_block(uint32_t block);
+
+extern void decode_cache_invalidate(uint32_t address, uint32_t length);
+
+extern void decode_cache_flush();
+
+// Called by the write86* paths for every store into guest memory
+#define decode_cache_write(address) do { \
+        const uint32_t _address = (uint32_t) (address); \
+        const uint32_t _block = memory_a20_alias(_address) >> DECODE_CACHE_BLOCK_SHIFT; \
+        if (unlikely(_block < DECODE_CACHE_BLOCKS && decode_cache_code_blocks[_block])) \
+            decode_cache_invalidate_block(_block); \
+    } while (0)
+#else
+#define decode_cache_write(address)
+#define decode_cache_invalidate(address, length)
+#define decode_cache_flush()
+#endif
+
 // i8253
 #include "i8253.h"
+#include "scheduler.h"
+#include "timing.h"
+#if !PICO_ON_DEVICE
+#include "savestate.h"
+#include "snapshot.h"
+#endif
+#include "stats.h"
+#include "profiler.h"
 
 // Mouse
 extern void sermouseevent(uint8_t buttons, int8_t xrel, int8_t yrel);
@@ -291,24 +401,41 @@ extern int16_t covox_sample;
 #define ALING(x, y) y __attribute__((aligned(x)))
 #endif
 #endif
-static INLINE int16_t speaker_sample() {
-    if (!speakerenabled) return 0;
-    static uint32_t speakerfullstep, speakerhalfstep, speakercurstep = 0;
-    int16_t speakervalue;
-    speakerfullstep = SOUND_FREQUENCY / i8253_frequency(2);
-    if (speakerfullstep < 2)
-        speakerfullstep = 2;
-    speakerhalfstep = speakerfullstep >> 1;
-    if (speakercurstep < speakerhalfstep) {
-        speakervalue = 4096;
-    } else {
-        speakervalue = -4096;
-    }
-    speakercurstep = (speakercurstep + 1) % speakerfullstep;
-    return speakervalue;
-}
+// PC speaker level of the next sound frame. Called every frame, so gate and PIT channel 2 changes
+// are heard at once, as PWM playback needs
+extern int16_t speaker_sample();
 
 extern void get_sound_sample(int16_t other_sample, int16_t *samples);
+
+// Largest block get_sound_samples() mixes at once, ~1.5 ms at 44.1 kHz so register writes stay close to their time
+#define SOUND_BLOCK_SAMPLES 64
+
+// Mixes count (at most SOUND_BLOCK_SAMPLES) stereo frames into samples. other holds one sample per frame
+// from the sources taken every sample tick: Disney Sound Source, LPT DAC (covox_sample), Sound Blaster DMA
+// and speaker_sample(). The synths are rendered for the whole block from their registers.
+extern void get_sound_samples(const int16_t *other, int16_t *samples, int count);
+
+#if !PICO_ON_DEVICE
+// Sources get_sound_stems() also renders alone, for capturing them to files of their own
+typedef enum {
+    SOUND_STEM_OPL,
+    SOUND_STEM_SB,
+    SOUND_STEM_SPEAKER,
+    SOUND_STEM_SN76489,
+    SOUND_STEM_CMS,
+    SOUND_STEM_DSS, // Disney Sound Source and the LPT DAC
+    SOUND_STEM_MIDI,
+    SOUND_STEMS
+} sound_stem_t;
+
+extern const char *const sound_stem_names[SOUND_STEMS];
+
+// get_sound_samples() with the Disney Sound Source and LPT DAC, Sound Blaster and speaker samples apart, which
+// also writes count stereo frames of every source alone to stems[source]. The stems add up to the mix before it
+// is saturated.
+extern void get_sound_stems(const int16_t *dss, const int16_t *sb, const int16_t *speaker, int16_t *samples,
+                            int16_t *const stems[SOUND_STEMS], int count);
+#endif
 #ifdef __cplusplus
 }
 #endif
@@ -339,5 +466,8 @@ static INLINE uint32_t read32psram(uint32_t address) {
 void vga_init(void);
 void vga_mem_write(uint32_t address, uint8_t cpu_data);
 void vga_mem_write16(uint32_t address, uint16_t cpu_data_x2);
+void vga_mem_fill(uint32_t address, uint16_t cpu_data_x2, uint32_t length);
+void vga_mem_copy(uint32_t address, const uint8_t *source, uint32_t length);
+void vga_mem_move(uint32_t address, uint32_t source, uint32_t length, uint8_t size);
 uint8_t vga_mem_read(uint32_t address);
 uint16_t vga_mem_read16(uint32_t address);
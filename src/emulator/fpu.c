@@ -85,6 +85,12 @@ extern uint32_t ea;
 
 static struct MachineFpu fpu;
 
+#if !PICO_ON_DEVICE
+void fpu_savestate(savestate_t *state) {
+    savestate_chunk(state, "FPU ", &fpu, sizeof(fpu));
+}
+#endif
+
 u64 Read64(u32 addr) {
     return (u64) readdw86(addr) | ((u64) readdw86(addr + 4) << 32);
 }
@@ -40,6 +40,20 @@ extern uint8_t i8237_byte_flipflop;
 #ifndef I8237_MEMORY_WRITE
 #define I8237_MEMORY_WRITE(address, value) write86((address), (value))
 #endif
+// Host memory of the page holding address, NULL where reads go through I8237_MEMORY_READ. Without the
+// emulator's page table, as in the standalone tests, every read does
+#ifndef I8237_MEMORY_PAGE
+#ifdef MEMORY_PAGE_SIZE
+#define I8237_MEMORY_PAGE(address) memory_read_page(address)
+#else
+#define I8237_MEMORY_PAGE(address) ((const uint8_t *) NULL)
+#endif
+#endif
+#ifdef MEMORY_PAGE_SIZE
+#define I8237_PAGE_SIZE MEMORY_PAGE_SIZE
+#else
+#define I8237_PAGE_SIZE 4096u
+#endif
 
 static inline void i8237_reset(void) {
     memset(dma_channels, 0, sizeof(dma_channels));
@@ -201,6 +215,50 @@ static inline uint8_t i8237_read(const uint8_t channel) {
     return data;
 }
 
+// Copies up to length bytes of a transfer into buffer, the same bytes i8237_read would return one by one,
+// without moving the channel on. A block ends at the terminal count and where the address wraps around its
+// 64 KB page. Returns the bytes copied, 0 while the channel is masked
+static inline uint16_t i8237_peek_block(const uint8_t channel, uint8_t *buffer, const uint16_t length) {
+    dma_channel_s *dma = &dma_channels[channel];
+    if (dma->masked) {
+        return 0;
+    }
+    const uint8_t up = dma->address_increase == 1;
+    const uint32_t remaining = (uint32_t)dma->count + 1;
+    const uint32_t room = up ? 0x10000u - dma->address : dma->address + 1;
+    uint32_t total = length < remaining ? length : remaining;
+    if (total > room) total = room;
+
+    // Runs within a page come straight from its host memory
+    uint32_t address = dma->page + dma->address;
+    for (uint32_t done = 0; done < total;) {
+        const uint32_t offset = address & (I8237_PAGE_SIZE - 1);
+        uint32_t run = up ? I8237_PAGE_SIZE - offset : offset + 1;
+        if (run > total - done) run = total - done;
+        const uint8_t *page = I8237_MEMORY_PAGE(address);
+        if (page && up) {
+            memcpy(buffer + done, page + offset, run);
+        } else {
+            for (uint32_t i = 0; i < run; i++) {
+                buffer[done + i] = page ? page[offset - i] : I8237_MEMORY_READ(up ? address + i : address - i);
+            }
+        }
+        done += run;
+        address = up ? address + run : address - run;
+    }
+    return (uint16_t)total;
+}
+
+// i8237_peek_block that moves the channel on past the bytes read. The terminal count reloads an auto-init
+// channel and masks any other
+static inline uint16_t i8237_read_block(const uint8_t channel, uint8_t *buffer, const uint16_t length) {
+    const uint16_t total = i8237_peek_block(channel, buffer, length);
+    if (total) {
+        i8237_update_count(&dma_channels[channel], total);
+    }
+    return total;
+}
+
 static inline void i8237_write(const uint8_t channel, const uint8_t value) {
     if (dma_channels[channel].masked) {
         return;
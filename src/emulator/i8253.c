@@ -1,9 +1,5 @@
 #if PICO_ON_DEVICE
 #include <pico/time.h>
-#elif defined(_WIN32)
-#include <windows.h>
-#else
-#include <time.h>
 #endif
 
 #include "emulator.h"
@@ -19,22 +15,47 @@ i8253_s i8253 = {
 int speakerenabled = 0;
 int timer_period = 54925;
 
-uint64_t i8253_now_us(void) {
+// Elapsed PIT input clock ticks
+uint64_t i8253_now(void) {
 #if PICO_ON_DEVICE
-    return time_us_64();
-#elif defined(_WIN32)
-    LARGE_INTEGER counter;
-    LARGE_INTEGER frequency;
-    QueryPerformanceCounter(&counter);
-    QueryPerformanceFrequency(&frequency);
-    return (uint64_t)((counter.QuadPart * 1000000ULL) / frequency.QuadPart);
+    return time_us_64() * PIT_FREQUENCY / 1000000ULL;
 #else
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000ULL;
+    return scheduler_now / 12;
 #endif
 }
 
+#if !PICO_ON_DEVICE
+static scheduler_event_t irq0_event;
+
+static void irq0_tick(void) {
+    doirq(0);
+}
+
+// Channel 0 output drives IRQ0, restart it in phase with the counter whenever the channel is reloaded
+void i8253_irq0_reload(const uint32_t divisor) {
+    scheduler_start(&irq0_event, irq0_tick, (uint64_t) divisor * 12, 1);
+}
+
+// Channels keep how long ago they were loaded instead of the absolute tick
+void i8253_savestate(savestate_t *state) {
+    const uint64_t now = i8253_now();
+    i8253_s saved = i8253;
+    for (uint8_t channel = 0; channel < 3; ++channel) {
+        saved.channels[channel].start_tick = now - i8253.channels[channel].start_tick;
+    }
+    savestate_chunk(state, "PIT ", &saved, sizeof(saved));
+    savestate_chunk(state, "SPKR", &speakerenabled, sizeof(speakerenabled));
+    savestate_chunk(state, "PITP", &timer_period, sizeof(timer_period));
+    scheduler_savestate(state, "IRQ0", &irq0_event, irq0_tick);
+    if (savestate_loading(state)) {
+        i8253 = saved;
+        for (uint8_t channel = 0; channel < 3; ++channel) {
+            i8253.channels[channel].start_tick = now - saved.channels[channel].start_tick;
+        }
+    }
+}
+#endif
+
 void init8253(void) {
     memset(&i8253, 0, sizeof(i8253));
     for (uint8_t channel = 0; channel < 3; ++channel) {
@@ -20,7 +20,7 @@ typedef struct {
     uint8_t active;
     uint8_t latch_mode;
     uint16_t latched_value;
-    uint64_t start_timestamp_us;
+    uint64_t start_tick;
     uint8_t operating_mode;
 } i8253_channel_s;
 
@@ -34,7 +34,10 @@ extern int timer_period;
 extern int speakerenabled;
 
 void init8253(void);
-uint64_t i8253_now_us(void);
+uint64_t i8253_now(void);
+#if !PICO_ON_DEVICE
+void i8253_irq0_reload(uint32_t divisor);
+#endif
 
 static inline uint32_t i8253_divisor(const i8253_channel_s *channel) {
     return channel->reload_value ? channel->reload_value : 65536u;
@@ -46,8 +49,7 @@ static inline uint32_t i8253_frequency(const uint8_t channel) {
 
 static inline uint16_t i8253_get_current_count(const i8253_channel_s *channel) {
     const uint32_t reload = i8253_divisor(channel);
-    const uint64_t ticks =
-        ((i8253_now_us() - channel->start_timestamp_us) * PIT_FREQUENCY) / 1000000ULL;
+    const uint64_t ticks = i8253_now() - channel->start_tick;
 
     if ((channel->operating_mode & 7) == 0) {
         if (!channel->active || ticks >= reload) {
@@ -102,7 +104,7 @@ static inline void i8253_write(const uint16_t port_number, const uint8_t data) {
         }
 
         channel->active = 1;
-        channel->start_timestamp_us = i8253_now_us();
+        channel->start_tick = i8253_now();
 
         if (channel_index == 0) {
             const uint32_t divisor = i8253_divisor(channel);
@@ -114,6 +116,7 @@ static inline void i8253_write(const uint16_t port_number, const uint8_t data) {
             }
 #else
             timer_period = (int)(PIT_FREQUENCY / divisor);
+            i8253_irq0_reload(divisor);
 #endif
         } else if (channel_index == 2) {
 #if I2S_SOUND || HARDWARE_SOUND || !PICO_ON_DEVICE
@@ -147,6 +150,6 @@ static inline void i8253_write(const uint16_t port_number, const uint8_t data) {
         channel->active = 0;
         channel->latch_mode = 0;
         channel->byte_toggle = 0;
-        channel->start_timestamp_us = 0;
+        channel->start_tick = 0;
     }
 }
@@ -4,3 +4,9 @@ i8259_s i8259 = {
     .interrupt_mask_register = 0xFF,
     .interrupt_vector_offset = 0x08,
 };
+
+#if !PICO_ON_DEVICE
+void i8259_savestate(savestate_t *state) {
+    savestate_chunk(state, "PIC ", &i8259, sizeof(i8259));
+}
+#endif
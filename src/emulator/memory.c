@@ -21,8 +21,119 @@ write86_t write86;
 write86w_t writew86;
 write86dw_t writedw86;
 
+// Host pointer for every 4 KB guest page. NULL sends the access down the range checks (VGA planes, ROM writes, open bus)
+const uint8_t *memory_read_pages[MEMORY_PAGES];
+uint8_t *memory_write_pages[MEMORY_PAGES];
+
+#ifdef EMULATOR_STATS
+uint64_t stats_memory[STATS_MEMORY_HANDLERS][2];
+#endif
+
+#if !PICO_ON_DEVICE
+// Writable host page behind every guest page. While snapshots track writes the page is left out of
+// memory_write_pages until its first write goes down the slow path and marks it
+static uint8_t *memory_write_targets[MEMORY_PAGES];
+static bool memory_write_protected = false;
+#endif
+
+static INLINE void memory_map_range(const uint32_t start, const uint32_t end, uint8_t *host, const bool writable) {
+    for (uint32_t page = start >> MEMORY_PAGE_SHIFT; page < end >> MEMORY_PAGE_SHIFT; page++) {
+        memory_read_pages[page] = host;
+#if !PICO_ON_DEVICE
+        memory_write_targets[page] = writable ? host : NULL;
+        memory_write_pages[page] = writable && !memory_write_protected ? host : NULL;
+#else
+        memory_write_pages[page] = writable ? host : NULL;
+#endif
+        if (host) host += MEMORY_PAGE_SIZE;
+    }
+}
+
+#if !PICO_ON_DEVICE
+void memory_write_protect(const uint8_t protect) {
+    memory_write_protected = protect;
+    for (uint32_t page = 0; page < MEMORY_PAGES; page++) {
+        memory_write_pages[page] = protect ? NULL : memory_write_targets[page];
+    }
+}
+
+void memory_write_track(const uint32_t address, const uint32_t length) {
+    if (!memory_write_protected || !length) return;
+    const uint32_t last = (address + length - 1) >> MEMORY_PAGE_SHIFT;
+    for (uint32_t page = address >> MEMORY_PAGE_SHIFT; page <= last && page < MEMORY_PAGES; page++) {
+        uint8_t *host = memory_write_targets[page];
+        if (host && !memory_write_pages[page]) {
+            memory_write_pages[page] = host;
+            snapshot_mark(host, MEMORY_PAGE_SIZE);
+        }
+    }
+}
+#endif
+
+// Pages of 0xC0000-0xCFFFF follow the EMS page registers
+void memory_map_ems() {
+    for (int i = 0; i < 4; i++) {
+        const uint32_t window = EMS_START + i * 0x4000;
+        const uint32_t offset = ems_pages[i] * 0x4000;
+        memory_map_range(window, window + 0x4000,
+                         butter_psram_size && offset < EMS_MEMORY_SIZE ? &EMS[offset] : NULL, true);
+    }
+}
+
+// HMA pages are backed by HMA or wrap to low memory depending on A20
+void memory_map_a20() {
+    if (a20_enabled) {
+        memory_map_range(HMA_START, HMA_END & ~MEMORY_PAGE_MASK, butter_psram_size ? HMA : NULL, true);
+        // last page is only partially backed by HMA
+        memory_map_range(HMA_END & ~MEMORY_PAGE_MASK, MEMORY_PAGES << MEMORY_PAGE_SHIFT, NULL, false);
+    } else {
+#if PICO_ON_DEVICE
+        memory_map_range(HMA_START, MEMORY_PAGES << MEMORY_PAGE_SHIFT, butter_psram_size ? RAM : PSRAM_AVAILABLE ? SRAM : NULL, true);
+#else
+        memory_map_range(HMA_START, MEMORY_PAGES << MEMORY_PAGE_SHIFT, RAM, true);
+#endif
+    }
+}
+
+void memory_map_rebuild() {
+    memory_map_range(0, MEMORY_PAGES << MEMORY_PAGE_SHIFT, NULL, false);
+    if (butter_psram_size) {
+        memory_map_range(0, RAM_SIZE, RAM, true);
+        memory_map_range(UMB_START, UMB_END, UMB, true);
+    }
+#if PICO_ON_DEVICE
+    else if (PSRAM_AVAILABLE) {
+        memory_map_range(0, SRAM_BLOCK_SIZE, SRAM, true);
+    }
+#endif
+    memory_map_range(BIOS_START, HMA_START, (uint8_t *) BIOS, false);
+    memory_map_ems();
+    memory_map_a20();
+}
+
+#if !PICO_ON_DEVICE
+// The page table is rebuilt once the whole state is in
+void memory_savestate(savestate_t *state) {
+    savestate_memory(state, "RAM ", RAM, sizeof(RAM));
+    savestate_memory(state, "UMB ", UMB, sizeof(UMB));
+    savestate_memory(state, "HMA ", HMA, sizeof(HMA));
+    savestate_memory(state, "VRAM", VIDEORAM, sizeof(VIDEORAM));
+    savestate_memory(state, "EMS ", EMS, sizeof(EMS));
+    savestate_chunk(state, "EMSP", ems_pages, sizeof(ems_pages));
+}
+#endif
+
 // Writes a byte to the virtual memory
 void write86_ob(const uint32_t address, const uint8_t value) {
+    decode_cache_write(address);
+    uint8_t *page = memory_write_page(address);
+    if (likely(page)) {
+        stats_memory_hit(STATS_WRITE8, STATS_PAGE);
+        page[address & MEMORY_PAGE_MASK] = value;
+        return;
+    }
+    stats_memory_hit(STATS_WRITE8, STATS_SLOW);
+    memory_write_track(address, 1);
     if (address < RAM_SIZE) {
         RAM[address] = value;
     } else if (address >= VIDEORAM_START && address < VIDEORAM_END) {
@@ -46,6 +157,15 @@ void write86_ob(const uint32_t address, const uint8_t value) {
 
 // Writes a word to the virtual memory
 void writew86_ob(const uint32_t address, const uint16_t value) {
+    decode_cache_write(address);
+    uint8_t *page = memory_write_page(address);
+    if (likely(page && !(address & 1))) {
+        stats_memory_hit(STATS_WRITE16, STATS_PAGE);
+        *(uint16_t *) &page[address & MEMORY_PAGE_MASK] = value;
+        return;
+    }
+    stats_memory_hit(STATS_WRITE16, STATS_SLOW);
+    memory_write_track(address, 2);
     if (address & 1) {
         write86(address, (uint8_t) (value & 0xFF));
         write86(address + 1, (uint8_t) ((value >> 8) & 0xFF));
@@ -71,6 +191,16 @@ void writew86_ob(const uint32_t address, const uint16_t value) {
 }
 
 void writedw86_ob(const uint32_t address, const uint32_t value) {
+    decode_cache_write(address);
+    decode_cache_write(address + 3);
+    uint8_t *page = memory_write_page(address);
+    if (likely(page && !(address & 3))) {
+        stats_memory_hit(STATS_WRITE32, STATS_PAGE);
+        *(uint32_t *) &page[address & MEMORY_PAGE_MASK] = value;
+        return;
+    }
+    stats_memory_hit(STATS_WRITE32, STATS_SLOW);
+    memory_write_track(address, 4);
     if (address & 1) {
         write86(address, (uint8_t) (value & 0xFF));
         write86(address + 1, (uint8_t) ((value >> 8) & 0xFF));
@@ -102,6 +232,12 @@ void writedw86_ob(const uint32_t address, const uint32_t value) {
 
 // Reads a byte from the virtual memory
 uint8_t read86_ob(const uint32_t address) {
+    const uint8_t *page = memory_read_page(address);
+    if (likely(page)) {
+        stats_memory_hit(STATS_READ8, STATS_PAGE);
+        return page[address & MEMORY_PAGE_MASK];
+    }
+    stats_memory_hit(STATS_READ8, STATS_SLOW);
     if (address < RAM_SIZE) {
         return RAM[address];
     }
@@ -137,6 +273,12 @@ uint8_t read86_ob(const uint32_t address) {
 
 // Reads a word from the virtual memory
 uint16_t readw86_ob(const uint32_t address) {
+    const uint8_t *page = memory_read_page(address);
+    if (likely(page && !(address & 1))) {
+        stats_memory_hit(STATS_READ16, STATS_PAGE);
+        return *(uint16_t *) &page[address & MEMORY_PAGE_MASK];
+    }
+    stats_memory_hit(STATS_READ16, STATS_SLOW);
     if (address & 1) {
         return (uint16_t) read86(address) | ((uint16_t) read86(address + 1) << 8);
     }
@@ -171,6 +313,12 @@ uint16_t readw86_ob(const uint32_t address) {
 }
 
 uint32_t readdw86_ob(const uint32_t address) {
+    const uint8_t *page = memory_read_page(address);
+    if (likely(page && !(address & 3))) {
+        stats_memory_hit(STATS_READ32, STATS_PAGE);
+        return *(uint32_t *) &page[address & MEMORY_PAGE_MASK];
+    }
+    stats_memory_hit(STATS_READ32, STATS_SLOW);
     if (address & 3) {
         return (uint32_t) read86(address)
                | ((uint32_t) read86(address + 1) << 8)
@@ -216,6 +364,12 @@ uint32_t readdw86_ob(const uint32_t address) {
 
 // Writes a byte to the virtual memory
 void write86_mp(const uint32_t address, const uint8_t value) {
+    decode_cache_write(address);
+    uint8_t *page = memory_write_page(address);
+    if (likely(page)) {
+        page[address & MEMORY_PAGE_MASK] = value;
+        return;
+    }
     if (address < LO_MEM) {
         SRAM[address] = value;
     } else if (address < VIDEORAM_START) {
@@ -241,6 +395,12 @@ void write86_mp(const uint32_t address, const uint8_t value) {
 
 // Writes a word to the virtual memory
 void writew86_mp(const uint32_t address, const uint16_t value) {
+    decode_cache_write(address);
+    uint8_t *page = memory_write_page(address);
+    if (likely(page && !(address & 1))) {
+        *(uint16_t *) &page[address & MEMORY_PAGE_MASK] = value;
+        return;
+    }
     if (address & 1) {
         write86(address, (uint8_t) (value & 0xFF));
         write86(address + 1, (uint8_t) ((value >> 8) & 0xFF));
@@ -269,6 +429,13 @@ void writew86_mp(const uint32_t address, const uint16_t value) {
 }
 
 void writedw86_mp(const uint32_t address, const uint32_t value) {
+    decode_cache_write(address);
+    decode_cache_write(address + 3);
+    uint8_t *page = memory_write_page(address);
+    if (likely(page && !(address & 3))) {
+        *(uint32_t *) &page[address & MEMORY_PAGE_MASK] = value;
+        return;
+    }
     if (address & 1) {
         write86(address, (uint8_t) (value & 0xFF));
         write86(address + 1, (uint8_t) ((value >> 8) & 0xFF));
@@ -302,6 +469,10 @@ void writedw86_mp(const uint32_t address, const uint32_t value) {
 
 // Reads a byte from the virtual memory
 uint8_t read86_mp(const uint32_t address) {
+    const uint8_t *page = memory_read_page(address);
+    if (likely(page)) {
+        return page[address & MEMORY_PAGE_MASK];
+    }
     if (address < LO_MEM) {
         return SRAM[address];
     }
@@ -340,6 +511,10 @@ uint8_t read86_mp(const uint32_t address) {
 
 // Reads a word from the virtual memory
 uint16_t readw86_mp(const uint32_t address) {
+    const uint8_t *page = memory_read_page(address);
+    if (likely(page && !(address & 1))) {
+        return *(uint16_t *) &page[address & MEMORY_PAGE_MASK];
+    }
     if (address & 1) {
         return (uint16_t) read86_mp(address) | ((uint16_t) read86_mp(address + 1) << 8);
     }
@@ -377,6 +552,10 @@ uint16_t readw86_mp(const uint32_t address) {
 }
 
 uint32_t readdw86_mp(const uint32_t address) {
+    const uint8_t *page = memory_read_page(address);
+    if (likely(page && !(address & 3))) {
+        return *(uint32_t *) &page[address & MEMORY_PAGE_MASK];
+    }
     if (address & 3) {
         return (uint32_t) read86_mp(address)
                | ((uint32_t) read86_mp(address + 1) << 8)
@@ -420,6 +599,7 @@ uint32_t readdw86_mp(const uint32_t address) {
 
 // Writes a byte to the virtual memory
 void write86_sw(const uint32_t address, const uint8_t value) {
+    decode_cache_write(address);
     if (address < VIDEORAM_START) {
         swap_write(address, value);
     } else if (address >= VIDEORAM_START && address < VIDEORAM_END) {
@@ -443,6 +623,7 @@ void write86_sw(const uint32_t address, const uint8_t value) {
 
 // Writes a word to the virtual memory
 void writew86_sw(const uint32_t address, const uint16_t value) {
+    decode_cache_write(address);
     if (address & 1) {
         write86(address, (uint8_t) (value & 0xFF));
         write86(address + 1, (uint8_t) ((value >> 8) & 0xFF));
@@ -469,6 +650,8 @@ void writew86_sw(const uint32_t address, const uint16_t value) {
 }
 
 void writedw86_sw(const uint32_t address, const uint32_t value) {
+    decode_cache_write(address);
+    decode_cache_write(address + 3);
     if (address & 1) {
         write86(address, (uint8_t) (value & 0xFF));
         write86(address + 1, (uint8_t) ((value >> 8) & 0xFF));
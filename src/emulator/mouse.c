@@ -7,6 +7,12 @@ static struct sermouse_s {
     int base_port_address;
 } serial_mouse;
 
+#if !PICO_ON_DEVICE
+void mouse_savestate(savestate_t *state) {
+    savestate_chunk(state, "MOUS", &serial_mouse, sizeof(serial_mouse));
+}
+#endif
+
 
 static inline void bufsermousedata(uint8_t data_byte) {
     // Prevent buffer overflow
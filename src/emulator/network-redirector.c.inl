@@ -3,6 +3,9 @@
 #pragma once
 // #define DEBUG_2F
 #include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <sys/stat.h>
 #if WIN32
 // Host filesystem passthrough base directory
@@ -21,14 +24,112 @@
 
 // Maximum number of open files
 #define MAX_FILES 32
-FILE *open_files[MAX_FILES] = {0};
+
+// Open host files. Reads are served from a per-handle block buffer, the block after it is read ahead on the
+// I/O thread. Writes are gathered in a write-behind buffer that the I/O thread writes out once it is full or a
+// write does not continue it, commit, close and flush wait for it. A failed write-behind is reported by the
+// next commit or close, the write itself has already returned.
+#define REDIRECTOR_BLOCK_SIZE (32 << 10)
+
+typedef enum {
+    REDIRECTOR_IDLE,
+    REDIRECTOR_READ_AHEAD,
+    REDIRECTOR_WRITE_BEHIND,
+} redirector_job_t;
+
+typedef struct {
+    FILE *file;
+    uint32_t size; // gathered writes included
+    uint8_t *buffers;
+    uint8_t *read, *ahead, *write, *behind; // REDIRECTOR_BLOCK_SIZE each out of buffers, swapped in pairs
+    uint32_t read_offset, read_length;
+    uint32_t ahead_offset, ahead_length;
+    uint32_t write_offset, write_length;
+    uint32_t behind_offset, behind_length;
+    redirector_job_t job; // the I/O thread owns file, ahead and behind until it is back to idle
+    uint8_t written; // since the last commit
+    uint8_t failed;
+} redirector_file_t;
+
+static redirector_file_t *open_files[MAX_FILES] = {0};
+
+#ifndef WIN32
+#include <pthread.h>
+static pthread_mutex_t redirector_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t redirector_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t redirector_finished = PTHREAD_COND_INITIALIZER;
+// every file has at most one job in flight
+static redirector_file_t *redirector_queue[MAX_FILES];
+static uint8_t redirector_queue_head = 0, redirector_queue_count = 0;
+static uint8_t redirector_thread_running = 0;
+#endif
+
+// Host paths by guest path. Changing a current directory or anything on the host starts a new generation,
+// aliases of names that show up outside the emulator are picked up within a second
+#define REDIRECTOR_PATH_CACHE 64
+typedef struct {
+    uint32_t generation;
+    time_t checked;
+    char guest[128];
+    char host[256];
+} redirector_path_t;
+static redirector_path_t redirector_paths[REDIRECTOR_PATH_CACHE];
+static uint32_t redirector_path_generation = 1;
+
+// stat() results by host path. Anything the redirector changes on the host starts a new generation,
+// changes made outside the emulator show up within a second
+#define REDIRECTOR_STAT_CACHE 64
+typedef struct {
+    uint32_t generation;
+    time_t checked;
+    int result;
+    struct stat info;
+    char path[256];
+} redirector_stat_t;
+static redirector_stat_t redirector_stats[REDIRECTOR_STAT_CACHE];
+static uint32_t redirector_stat_generation = 1;
 
 #ifdef WIN32
 #define mkdir(path, mode) mkdir(path)
 #endif
 
-// Current working directory for the remote drive (relative to HOST_BASE_DIR)
-char current_remote_dir[256] = "";
+// Host directories mapped to DOS drive letters, H: starts out mapped to HOST_BASE_DIR.
+// MAPDRIVE.COM registers the letters with DOS
+typedef struct {
+    char root[256]; // empty when the letter is not mapped
+    char current[256]; // current directory of the drive, relative to its root
+} redirector_drive_t;
+static redirector_drive_t redirector_drives[26] = { ['H' - 'A'] = { HOST_BASE_DIR } };
+
+// Swappable data area of DOS, set by the installation check
+static uint32_t sda_addr = 0;
+
+uint8_t redirector_map(char letter, const char *path) {
+    letter = toupper((uint8_t) letter);
+    if (letter < 'A' || letter > 'Z' || (path && strlen(path) >= sizeof(redirector_drives[0].root))) return 0;
+    redirector_drive_t *drive = &redirector_drives[letter - 'A'];
+    strcpy(drive->root, path ? path : "");
+    drive->current[0] = '\0';
+    redirector_path_generation++;
+    return 1;
+}
+
+// Drive of a guest path: its letter, or for a path without one the drive of the current CDS. NULL when not mapped
+static redirector_drive_t *redirector_drive(const char *guest_path) {
+    uint8_t letter = guest_path[0] && guest_path[1] == ':' ? guest_path[0] : 'H';
+    if (guest_path[1] != ':' && sda_addr) {
+        // DOS 4+ keeps a far pointer to the current CDS at SDA+282h, the CDS starts with the path of its drive
+        const uint32_t cds = (*(uint16_t *) &RAM[sda_addr + 0x284] << 4) + *(uint16_t *) &RAM[sda_addr + 0x282];
+        if (cds < RAM_SIZE && RAM[cds + 1] == ':') letter = RAM[cds];
+    }
+    letter = toupper(letter);
+    if (letter < 'A' || letter > 'Z' || !redirector_drives[letter - 'A'].root[0]) return NULL;
+    return &redirector_drives[letter - 'A'];
+}
+
+static INLINE char redirector_letter(const char *guest_path) {
+    return (char) ('A' + (redirector_drive(guest_path) - redirector_drives));
+}
 
 // Helper function to get a free file handle
 static inline int8_t get_free_handle() {
@@ -40,43 +141,233 @@ static inline int8_t get_free_handle() {
     return -1; // No free handles
 }
 
-// Helper to get full path from guest path
-static void get_full_path(char *dest, const char *guest_path) {
-    if (guest_path[1] == ':') {
-        // Absolute path with drive letter (e.g., "H:\file.txt" or "H:\TOOLS\file.txt")
-        const char *path_part = guest_path + 2; // Skip "H:"
-        if (path_part[0] == '\\') {
-            path_part++; // Skip leading backslash, so "\TOOLS\file.txt" becomes "TOOLS\file.txt"
-        }
-        if (strlen(path_part) > 0) {
-            sprintf(dest, HOST_BASE_DIR "\\%s", path_part);
-        } else {
-            sprintf(dest, HOST_BASE_DIR);
+static INLINE uint32_t redirector_hash(const char *string) {
+    uint32_t hash = 2166136261u;
+    while (*string) hash = (hash ^ (uint8_t) *string++) * 16777619u;
+    return hash;
+}
+
+static void redirector_run(redirector_file_t *file) {
+    if (file->job == REDIRECTOR_READ_AHEAD) {
+        file->ahead_length = fseek(file->file, file->ahead_offset, SEEK_SET)
+                                 ? 0
+                                 : fread(file->ahead, 1, REDIRECTOR_BLOCK_SIZE, file->file);
+    } else if (file->job == REDIRECTOR_WRITE_BEHIND) {
+        if (fseek(file->file, file->behind_offset, SEEK_SET) ||
+            fwrite(file->behind, 1, file->behind_length, file->file) != file->behind_length) {
+            file->failed = 1;
         }
-    } else if (guest_path[0] == '\\') {
-        // Root-relative path (e.g., "\subdir\file.txt")
-        sprintf(dest, HOST_BASE_DIR "%s", guest_path);
+        file->behind_length = 0;
+    }
+}
+
+#ifndef WIN32
+static void *redirector_io_thread(void *unused) {
+    pthread_mutex_lock(&redirector_mutex);
+    for (;;) {
+        while (!redirector_queue_count) pthread_cond_wait(&redirector_queued, &redirector_mutex);
+        redirector_file_t *file = redirector_queue[redirector_queue_head];
+        redirector_queue_head = (redirector_queue_head + 1) % MAX_FILES;
+        redirector_queue_count--;
+        pthread_mutex_unlock(&redirector_mutex);
+        redirector_run(file);
+        pthread_mutex_lock(&redirector_mutex);
+        file->job = REDIRECTOR_IDLE;
+        pthread_cond_broadcast(&redirector_finished);
+    }
+    return unused;
+}
+#endif
+
+// Hands a job to the I/O thread, or runs it in place where there is none
+static void redirector_submit(redirector_file_t *file, const redirector_job_t job) {
+    file->job = job;
+#ifndef WIN32
+    pthread_mutex_lock(&redirector_mutex);
+    if (!redirector_thread_running) {
+        pthread_t thread;
+        redirector_thread_running = !pthread_create(&thread, NULL, redirector_io_thread, NULL);
+        if (redirector_thread_running) pthread_detach(thread);
+    }
+    if (redirector_thread_running) {
+        redirector_queue[(redirector_queue_head + redirector_queue_count++) % MAX_FILES] = file;
+        pthread_cond_signal(&redirector_queued);
+        pthread_mutex_unlock(&redirector_mutex);
+        return;
+    }
+    pthread_mutex_unlock(&redirector_mutex);
+#endif
+    redirector_run(file);
+    file->job = REDIRECTOR_IDLE;
+}
+
+static void redirector_wait(redirector_file_t *file) {
+#ifndef WIN32
+    pthread_mutex_lock(&redirector_mutex);
+    while (file->job != REDIRECTOR_IDLE) pthread_cond_wait(&redirector_finished, &redirector_mutex);
+    pthread_mutex_unlock(&redirector_mutex);
+#endif
+}
+
+// Waits for a read ahead only, a write behind in flight keeps going. The job is read under the lock like above
+static void redirector_wait_read_ahead(redirector_file_t *file) {
+#ifndef WIN32
+    pthread_mutex_lock(&redirector_mutex);
+    while (file->job == REDIRECTOR_READ_AHEAD) pthread_cond_wait(&redirector_finished, &redirector_mutex);
+    pthread_mutex_unlock(&redirector_mutex);
+#endif
+}
+
+static redirector_file_t *redirector_open(const char *path, const char *mode) {
+    FILE *host = fopen(path, mode);
+    if (!host) return NULL;
+    redirector_file_t *file = calloc(1, sizeof(redirector_file_t));
+    uint8_t *buffers = malloc(4 * REDIRECTOR_BLOCK_SIZE);
+    if (!file || !buffers) {
+        fclose(host);
+        free(file);
+        free(buffers);
+        return NULL;
+    }
+    // The blocks are the only buffering
+    setvbuf(host, NULL, _IONBF, 0);
+    file->file = host;
+    file->buffers = buffers;
+    file->read = buffers;
+    file->ahead = buffers + REDIRECTOR_BLOCK_SIZE;
+    file->write = buffers + 2 * REDIRECTOR_BLOCK_SIZE;
+    file->behind = buffers + 3 * REDIRECTOR_BLOCK_SIZE;
+    fseek(host, 0, SEEK_END);
+    const long size = ftell(host);
+    file->size = size > 0 ? (uint32_t) size : 0;
+    return file;
+}
+
+// Hands the gathered writes to the I/O thread
+static void redirector_write_behind(redirector_file_t *file) {
+    redirector_wait(file);
+    uint8_t *buffer = file->behind;
+    file->behind = file->write;
+    file->behind_offset = file->write_offset;
+    file->behind_length = file->write_length;
+    file->write = buffer;
+    file->write_length = 0;
+    redirector_submit(file, REDIRECTOR_WRITE_BEHIND);
+}
+
+// Writes everything gathered so far to the host file, 0 when some of it could not be written
+static uint8_t redirector_commit(redirector_file_t *file) {
+    if (file->write_length) redirector_write_behind(file);
+    redirector_wait(file);
+    if (file->written) {
+        fflush(file->file);
+        file->written = 0;
+        redirector_stat_generation++;
+    }
+    const uint8_t committed = !file->failed;
+    file->failed = 0;
+    return committed;
+}
+
+static void redirector_commit_all() {
+    for (int i = 0; i < MAX_FILES; i++) {
+        if (open_files[i]) redirector_commit(open_files[i]);
+    }
+}
+
+static uint8_t redirector_close(const int handle) {
+    redirector_file_t *file = open_files[handle];
+    const uint8_t committed = redirector_commit(file);
+    fclose(file->file);
+    free(file->buffers);
+    free(file);
+    open_files[handle] = NULL;
+    return committed;
+}
+
+// Makes `position` part of the read block, 0 at the end of the file
+static uint8_t redirector_fill(redirector_file_t *file, const uint32_t position) {
+    if (file->write_length) redirector_write_behind(file);
+    redirector_wait(file);
+    if (file->ahead_length && position >= file->ahead_offset && position < file->ahead_offset + file->ahead_length) {
+        uint8_t *buffer = file->read;
+        file->read = file->ahead;
+        file->read_offset = file->ahead_offset;
+        file->read_length = file->ahead_length;
+        file->ahead = buffer;
     } else {
-        // Relative path (e.g., "file.txt" or "subdir\file.txt")
-        if (strlen(current_remote_dir) > 0) {
-            sprintf(dest, HOST_BASE_DIR "\\%s\\%s", current_remote_dir, guest_path);
-        } else {
-            sprintf(dest, HOST_BASE_DIR "\\%s", guest_path);
+        file->read_offset = position;
+        file->read_length = fseek(file->file, position, SEEK_SET)
+                                ? 0
+                                : fread(file->read, 1, REDIRECTOR_BLOCK_SIZE, file->file);
+    }
+    file->ahead_length = 0;
+    if (file->read_length == REDIRECTOR_BLOCK_SIZE) {
+        file->ahead_offset = file->read_offset + REDIRECTOR_BLOCK_SIZE;
+        redirector_submit(file, REDIRECTOR_READ_AHEAD);
+    }
+    return position >= file->read_offset && position < file->read_offset + file->read_length;
+}
+
+static uint32_t redirector_read(redirector_file_t *file, uint32_t position, uint8_t *destination, const uint32_t count) {
+    uint32_t done = 0;
+    while (done < count) {
+        if ((position < file->read_offset || position >= file->read_offset + file->read_length) &&
+            !redirector_fill(file, position)) {
+            break;
         }
+        uint32_t chunk = file->read_offset + file->read_length - position;
+        if (chunk > count - done) chunk = count - done;
+        memcpy(destination + done, file->read + (position - file->read_offset), chunk);
+        done += chunk;
+        position += chunk;
     }
-#ifndef WIN32
-    for (char *p = dest; *p; p++) {
-        if (*p == '\\') {
-            *p = '/';
+    return done;
+}
+
+static uint32_t redirector_write(redirector_file_t *file, uint32_t position, const uint8_t *source, const uint32_t count) {
+    // Blocks read so far may hold what is overwritten now
+    redirector_wait_read_ahead(file);
+    file->read_length = 0;
+    file->ahead_length = 0;
+
+    uint32_t done = 0;
+    while (done < count) {
+        if (file->write_length &&
+            (position != file->write_offset + file->write_length || file->write_length == REDIRECTOR_BLOCK_SIZE)) {
+            redirector_write_behind(file);
         }
+        if (!file->write_length) file->write_offset = position;
+        uint32_t chunk = REDIRECTOR_BLOCK_SIZE - file->write_length;
+        if (chunk > count - done) chunk = count - done;
+        memcpy(file->write + file->write_length, source + done, chunk);
+        file->write_length += chunk;
+        done += chunk;
+        position += chunk;
     }
-    char *p = strstr(dest, "????????.???");
-    if (p) {
-        p[0] = '*';
-        p[1] = '\0';
+    if (position > file->size) file->size = position;
+    if (count) file->written = 1;
+    return done;
+}
+
+static int redirector_stat(const char *path, struct stat *info) {
+    redirector_stat_t *entry = &redirector_stats[redirector_hash(path) % REDIRECTOR_STAT_CACHE];
+    const time_t now = time(NULL);
+    if (entry->generation != redirector_stat_generation || now - entry->checked > 1 || strcmp(entry->path, path)) {
+        if (strlen(path) >= sizeof(entry->path)) return stat(path, info);
+        entry->result = stat(path, &entry->info);
+        entry->generation = redirector_stat_generation;
+        entry->checked = now;
+        strcpy(entry->path, path);
     }
-#endif
-    // printf("Path conversion: guest='%s', current_dir='%s' -> host='%s'\n", guest_path, current_remote_dir, dest);
+    *info = entry->info;
+    return entry->result;
+}
+
+// Something on the host changed, cached stat() results and host paths are stale
+static INLINE void redirector_changed() {
+    redirector_stat_generation++;
+    redirector_path_generation++;
 }
 
 // Convert filename to DOS 8.3 format
@@ -110,14 +401,14 @@ static void to_dos_name(const char *input, char *output) {
     }
 }
 
-typedef struct {
+typedef struct __attribute__((packed)) {
     unsigned char fname[11];
     unsigned char fattr; /* (1=RO 2=HID 4=SYS 8=VOL 16=DIR 32=ARCH 64=DEVICE) */
     unsigned char f1[10];
     unsigned short time_lstupd; /* 16 bits: hhhhhmmm mmmsssss */
     unsigned short date_lstupd; /* 16 bits: YYYYYYYM MMMDDDDD */
     unsigned short start_clstr; /* (optional) */
-    unsigned long fsize;
+    uint32_t fsize; /* 32 bits in the directory entry, whatever the host long is */
 } foundfilestruct;
 
 /* called 'srchrec' in phantom.c */
@@ -127,7 +418,7 @@ typedef struct __attribute__((packed, aligned)) {
     unsigned char srch_attr;
     unsigned short dir_entry;
     unsigned short par_clstr;
-    unsigned char f1[4];
+    uint32_t f1;
     foundfilestruct foundfile;
 } sdbstruct;
 
@@ -154,6 +445,592 @@ typedef struct __attribute__((packed)) {
 } sftstruct;
 
 #define FIRST_FILENAME_OFFSET 0x9e
+#define SEARCH_ATTRIBUTES_OFFSET 0x24d
+
+// Host directories as the guest sees them, every entry with its 8.3 alias. Host names that are no valid DOS name,
+// or whose DOS name is taken, get a PROGRA~1 style one. Aliases are kept in a hash table, so resolving a guest path
+// costs one lookup per component. They stay with their host name when a directory is listed again, new names take
+// the lowest free number. Path resolution lists a directory again when its mtime moved or a name is missing a second
+// after the listing, searches also when the redirector has written something since or the listing is a second old.
+// A directory listed again after it was evicted gets the same aliases as long as its contents are the same.
+// Searches return the entries sorted by alias, whatever order the host lists them in.
+#define REDIRECTOR_DIRECTORIES 64
+
+typedef struct {
+    char name[11]; // FCB style alias, name[0] is 0 until it is assigned
+    uint8_t attributes;
+    uint16_t time, date;
+    uint32_t size;
+    uint32_t host; // offset of the host name in names
+} redirector_entry_t;
+
+typedef struct {
+    char path[256];
+    uint32_t hash;
+    uint8_t root; // of a drive, without . and .. entries
+    uint8_t relist; // something was removed or renamed
+    time_t mtime, listed;
+    uint32_t generation;
+    uint32_t used; // for replacing the least recently used directory
+    redirector_entry_t *entries; // in host order
+    uint32_t count, capacity;
+    uint32_t *order; // entry indices sorted by alias, for searches
+    uint32_t sorted; // entries order covers, an entry added since has it sorted again
+    char *names;
+    uint32_t names_length, names_capacity;
+    uint32_t *aliases; // entry index + 1 by alias hash, at most half full
+    uint32_t aliases_mask;
+} redirector_directory_t;
+
+static redirector_directory_t redirector_directories[REDIRECTOR_DIRECTORIES];
+static uint32_t redirector_directories_used = 0;
+
+// Searches in progress, the SDB holds the number of one. A search goes on after the alias it returned last, so
+// a listing built again in between, with entries the guest removed or created, has it neither skip nor repeat any.
+// The oldest of them is taken over once all are in use.
+#define REDIRECTOR_SEARCHES 64
+#define REDIRECTOR_SEARCH_DONE 0xFFFF
+
+typedef struct {
+    uint16_t number;
+    char name[11]; // returned last, name[0] is 0 before the first
+} redirector_search_t;
+
+static redirector_search_t redirector_searches[REDIRECTOR_SEARCHES];
+static uint16_t redirector_search_number = 0;
+
+static INLINE uint32_t redirector_alias_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 11; i++) hash = (hash ^ (uint8_t) name[i]) * 16777619u;
+    return hash;
+}
+
+static redirector_entry_t *redirector_lookup(const redirector_directory_t *directory, const char *name) {
+    if (!directory->aliases) return NULL;
+    for (uint32_t slot = redirector_alias_hash(name) & directory->aliases_mask;;
+         slot = (slot + 1) & directory->aliases_mask) {
+        const uint32_t index = directory->aliases[slot];
+        if (!index) return NULL;
+        if (!memcmp(directory->entries[index - 1].name, name, 11)) return &directory->entries[index - 1];
+    }
+}
+
+static void redirector_index(redirector_directory_t *directory, const uint32_t index) {
+    uint32_t slot = redirector_alias_hash(directory->entries[index].name) & directory->aliases_mask;
+    while (directory->aliases[slot]) slot = (slot + 1) & directory->aliases_mask;
+    directory->aliases[slot] = index + 1;
+}
+
+// Makes room in the alias table for `count` entries, 0 when out of memory
+static uint8_t redirector_reserve(redirector_directory_t *directory, const uint32_t count) {
+    if (directory->aliases && count * 2 <= directory->aliases_mask + 1) return 1;
+    uint32_t size = 64;
+    while (size < count * 2) size *= 2;
+    uint32_t *aliases = calloc(size, sizeof(uint32_t));
+    if (!aliases) return 0;
+    free(directory->aliases);
+    directory->aliases = aliases;
+    directory->aliases_mask = size - 1;
+    for (uint32_t i = 0; i < directory->count; i++) {
+        if (directory->entries[i].name[0]) redirector_index(directory, i);
+    }
+    return 1;
+}
+
+static redirector_entry_t *redirector_append(redirector_directory_t *directory, const char *host) {
+    const uint32_t length = (uint32_t) strlen(host) + 1;
+    if (directory->count == directory->capacity) {
+        const uint32_t capacity = directory->capacity ? directory->capacity * 2 : 64;
+        redirector_entry_t *entries = realloc(directory->entries, capacity * sizeof(redirector_entry_t));
+        if (!entries) return NULL;
+        directory->entries = entries;
+        directory->capacity = capacity;
+    }
+    if (directory->names_length + length > directory->names_capacity) {
+        uint32_t capacity = directory->names_capacity ? directory->names_capacity : 4096;
+        while (capacity < directory->names_length + length) capacity *= 2;
+        char *names = realloc(directory->names, capacity);
+        if (!names) return NULL;
+        directory->names = names;
+        directory->names_capacity = capacity;
+    }
+    redirector_entry_t *entry = &directory->entries[directory->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->host = directory->names_length;
+    memcpy(directory->names + directory->names_length, host, length);
+    directory->names_length += length;
+    return entry;
+}
+
+static INLINE uint8_t redirector_dos_char(const char c) {
+    return c > ' ' && c < 0x7F && (isalnum((uint8_t) c) || strchr("!#$%&'()-@^_`{}~", c));
+}
+
+// Uppercased host name as an FCB style name, 0 when it is no valid 8.3 name
+static uint8_t redirector_short_name(const char *host, char *name) {
+    memset(name, ' ', 11);
+    const char *dot = strchr(host, '.');
+    const size_t length = dot ? (size_t) (dot - host) : strlen(host);
+    if (!length || length > 8 || (dot && (!dot[1] || strlen(dot + 1) > 3 || strchr(dot + 1, '.')))) return 0;
+    for (size_t i = 0; i < length; i++) {
+        if (!redirector_dos_char(host[i])) return 0;
+        name[i] = toupper((uint8_t) host[i]);
+    }
+    for (int i = 0; dot && dot[i + 1]; i++) {
+        if (!redirector_dos_char(dot[i + 1])) return 0;
+        name[8 + i] = toupper((uint8_t) dot[i + 1]);
+    }
+    return 1;
+}
+
+// Alias number `number` of a host name: its first characters without the invalid ones, ~number and the extension
+static void redirector_long_name(const char *host, const uint32_t number, char *name) {
+    memset(name, ' ', 11);
+    const char *dot = strrchr(host, '.');
+    if (dot == host) dot = NULL; // a leading dot starts no extension
+    char suffix[12];
+    const int suffix_length = snprintf(suffix, sizeof(suffix), "~%u", number);
+    int length = 0;
+    for (const char *c = host; *c && c != dot && length < 8 - suffix_length; c++) {
+        if (*c == '.' || *c == ' ') continue;
+        name[length++] = redirector_dos_char(*c) ? toupper((uint8_t) *c) : '_';
+    }
+    memcpy(name + length, suffix, suffix_length);
+    for (int i = 0; dot && *++dot && i < 3;) {
+        if (*dot == '.' || *dot == ' ') continue;
+        name[8 + i++] = redirector_dos_char(*dot) ? toupper((uint8_t) *dot) : '_';
+    }
+}
+
+static void redirector_assign(redirector_directory_t *directory, redirector_entry_t *entry, const char *name) {
+    memcpy(entry->name, name, 11);
+    redirector_index(directory, (uint32_t) (entry - directory->entries));
+}
+
+// Gives an entry its own DOS name when that is valid and free, else the first free alias number
+static void redirector_name(redirector_directory_t *directory, redirector_entry_t *entry) {
+    char name[11];
+    const char *host = directory->names + entry->host;
+    if (!strcmp(host, ".") || !strcmp(host, "..")) {
+        to_dos_name(host, name);
+    } else if (!redirector_short_name(host, name) || redirector_lookup(directory, name)) {
+        uint32_t number = 1;
+        do {
+            redirector_long_name(host, number++, name);
+        } while (redirector_lookup(directory, name));
+    }
+    redirector_assign(directory, entry, name);
+}
+
+static void redirector_attributes(redirector_entry_t *entry, const struct _finddata_t *info) {
+    const uint8_t dots = !strcmp(info->name, ".") || !strcmp(info->name, "..");
+    entry->attributes = info->attrib & (0x01 | 0x02 | 0x04 | 0x10);
+    if (!(entry->attributes & 0x10)) entry->attributes |= 0x20;
+    if (info->name[0] == '.' && !dots) entry->attributes |= 0x02; // host dot files are hidden
+    entry->size = entry->attributes & 0x10 ? 0 : (uint32_t) info->size;
+    const time_t mtime = info->time_write;
+    const struct tm *tm = localtime(&mtime);
+    entry->time = tm ? tm->tm_hour << 11 | tm->tm_min << 5 | tm->tm_sec / 2 : 0;
+    entry->date = tm && tm->tm_year >= 80 ? (tm->tm_year - 80) << 9 | (tm->tm_mon + 1) << 5 | tm->tm_mday : 0x21;
+}
+
+// `name` in the host directory `directory`, a root keeps its trailing separator
+static void redirector_join(char *path, const size_t size, const char *directory, const char *name) {
+    const size_t length = strlen(directory);
+    const uint8_t separator = length && (directory[length - 1] == '/' || directory[length - 1] == '\\');
+    snprintf(path, size, "%s%s%s", directory, separator ? "" : "/", name);
+}
+
+static const redirector_directory_t *redirector_sorting;
+
+static int redirector_host_compare(const void *a, const void *b) {
+    const redirector_entry_t *entries = redirector_sorting->entries;
+    return strcmp(redirector_sorting->names + entries[*(const uint32_t *) a].host,
+                  redirector_sorting->names + entries[*(const uint32_t *) b].host);
+}
+
+static uint8_t redirector_list(redirector_directory_t *directory) {
+    // The previous listing hands its aliases on by host name
+    redirector_entry_t *previous = directory->entries;
+    char *previous_names = directory->names;
+    const uint32_t previous_count = directory->count;
+    uint32_t *previous_hosts = NULL, previous_mask = 0;
+    if (previous_count) {
+        previous_mask = 64;
+        while (previous_mask < previous_count * 2) previous_mask *= 2;
+        previous_hosts = calloc(previous_mask--, sizeof(uint32_t));
+        for (uint32_t i = 0; previous_hosts && i < previous_count; i++) {
+            uint32_t slot = redirector_hash(previous_names + previous[i].host) & previous_mask;
+            while (previous_hosts[slot]) slot = (slot + 1) & previous_mask;
+            previous_hosts[slot] = i + 1;
+        }
+    }
+    free(directory->aliases);
+    free(directory->order);
+    directory->entries = NULL;
+    directory->names = NULL;
+    directory->aliases = NULL;
+    directory->order = NULL;
+    directory->count = directory->capacity = directory->sorted = 0;
+    directory->names_length = directory->names_capacity = 0;
+
+    char pattern[260];
+    struct _finddata_t info;
+    uint8_t listed = 1;
+    redirector_join(pattern, sizeof(pattern), directory->path, "*");
+    const intptr_t handle = _findfirst(pattern, &info);
+    if (handle != -1) {
+        do {
+            // the drive root has no . and .. entries
+            if (directory->root && (!strcmp(info.name, ".") || !strcmp(info.name, ".."))) continue;
+            redirector_entry_t *entry = redirector_append(directory, info.name);
+            if (!entry) {
+                listed = 0;
+                break;
+            }
+            redirector_attributes(entry, &info);
+        } while (_findnext(handle, &info) == 0);
+        _findclose(handle);
+    }
+    listed = listed && redirector_reserve(directory, directory->count);
+
+    // New aliases are handed out in host name order, which does not depend on the order the host lists them in
+    uint32_t *order = listed ? malloc((directory->count + 1) * sizeof(uint32_t)) : NULL;
+    listed = listed && order;
+    for (uint32_t i = 0; listed && i < directory->count; i++) order[i] = i;
+    if (listed) {
+        redirector_sorting = directory;
+        qsort(order, directory->count, sizeof(uint32_t), redirector_host_compare);
+    }
+    for (uint32_t pass = 0; listed && pass < 3; pass++) {
+        for (uint32_t i = 0; i < directory->count; i++) {
+            redirector_entry_t *entry = &directory->entries[order[i]];
+            const char *host = directory->names + entry->host;
+            char name[11];
+            if (entry->name[0]) continue;
+            if (pass == 0) {
+                // aliases the guest may already know
+                if (!previous_hosts) break;
+                uint32_t slot = redirector_hash(host) & previous_mask;
+                for (; previous_hosts[slot]; slot = (slot + 1) & previous_mask) {
+                    const redirector_entry_t *known = &previous[previous_hosts[slot] - 1];
+                    if (strcmp(previous_names + known->host, host)) continue;
+                    if (known->name[0] && !redirector_lookup(directory, known->name)) {
+                        redirector_assign(directory, entry, known->name);
+                    }
+                    break;
+                }
+            } else if (pass == 1) {
+                // then DOS names of their own, ahead of aliases that could take them
+                if (redirector_short_name(host, name) && !redirector_lookup(directory, name)) {
+                    redirector_assign(directory, entry, name);
+                }
+            } else {
+                redirector_name(directory, entry);
+            }
+        }
+    }
+    free(order);
+    free(previous);
+    free(previous_names);
+    free(previous_hosts);
+    return listed;
+}
+
+static redirector_directory_t *redirector_cached(const char *path) {
+    const uint32_t hash = redirector_hash(path);
+    for (int i = 0; i < REDIRECTOR_DIRECTORIES; i++) {
+        redirector_directory_t *directory = &redirector_directories[i];
+        if (directory->hash == hash && directory->path[0] && !strcmp(directory->path, path)) return directory;
+    }
+    return NULL;
+}
+
+// Index of the host directory `path`, NULL when it is no directory. A search wants up to date attributes
+static redirector_directory_t *redirector_directory(const char *path, const uint8_t root, const uint8_t search) {
+    struct stat info;
+    if (redirector_stat(path, &info) || !S_ISDIR(info.st_mode)) return NULL;
+    const time_t now = time(NULL);
+    redirector_directory_t *directory = redirector_cached(path);
+    if (!directory) {
+        if (strlen(path) >= sizeof(directory->path)) return NULL;
+        directory = redirector_directories;
+        for (int i = 1; i < REDIRECTOR_DIRECTORIES; i++) {
+            if (redirector_directories[i].used < directory->used) directory = &redirector_directories[i];
+        }
+        free(directory->entries);
+        free(directory->names);
+        free(directory->aliases);
+        free(directory->order);
+        memset(directory, 0, sizeof(*directory));
+        strcpy(directory->path, path);
+        directory->hash = redirector_hash(path);
+        directory->root = root;
+        directory->relist = 1;
+    }
+    if (directory->relist || directory->mtime != info.st_mtime ||
+        (search && (directory->generation != redirector_stat_generation || now - directory->listed >= 1))) {
+        directory->relist = 0;
+        directory->mtime = info.st_mtime;
+        directory->listed = now;
+        directory->generation = redirector_stat_generation;
+        if (!redirector_list(directory)) {
+            directory->path[0] = '\0';
+            return NULL;
+        }
+    }
+    directory->used = ++redirector_directories_used;
+    return directory;
+}
+
+// Splits a host path into its directory and name, 0 when it has no directory part
+static uint8_t redirector_split(const char *path, char *directory, const char **name) {
+    const char *slash = strrchr(path, '/');
+#ifdef WIN32
+    const char *backslash = strrchr(path, '\\');
+    if (!slash || (backslash && backslash > slash)) slash = backslash;
+#endif
+    if (!slash || (size_t) (slash - path) >= 256) return 0;
+    // a root keeps its separator
+    const size_t length = slash == path || slash[-1] == ':' ? slash - path + 1 : slash - path;
+    memcpy(directory, path, length);
+    directory[length] = '\0';
+    *name = slash + 1;
+    return 1;
+}
+
+// The redirector created `path`, its directory gets the new entry without being listed again
+static void redirector_added(const char *path) {
+    char parent[256], name[11];
+    const char *host;
+    if (!redirector_split(path, parent, &host)) return;
+    redirector_directory_t *directory = redirector_cached(parent);
+    struct stat info;
+    if (!directory || directory->relist) return;
+    if (redirector_stat(parent, &info)) {
+        directory->relist = 1;
+        return;
+    }
+    directory->mtime = info.st_mtime;
+    // a host name that is no valid DOS name was reached through its alias, so it is listed already
+    if (!redirector_short_name(host, name)) return;
+    const redirector_entry_t *known = redirector_lookup(directory, name);
+    if (known && !strcmp(directory->names + known->host, host)) return;
+    redirector_entry_t *entry = redirector_reserve(directory, directory->count + 1)
+                                    ? redirector_append(directory, host)
+                                    : NULL;
+    if (!entry) {
+        directory->relist = 1;
+        return;
+    }
+    // a fresh entry, searches list the directory again for its size and time once it is written
+    entry->attributes = redirector_stat(path, &info) == 0 && S_ISDIR(info.st_mode) ? 0x10 : 0x20;
+    redirector_name(directory, entry);
+}
+
+// The redirector removed or renamed `path`, its directory is listed again
+static void redirector_removed(const char *path) {
+    char parent[256];
+    const char *host;
+    if (!redirector_split(path, parent, &host)) return;
+    redirector_directory_t *directory = redirector_cached(parent);
+    if (directory) directory->relist = 1;
+}
+
+// FCB style template of the last component of a guest path, * fills the rest of the name or extension with ?
+static void redirector_template(const char *name, char *template) {
+    memset(template, ' ', 11);
+    if (!strcmp(name, ".") || !strcmp(name, "..")) {
+        memcpy(template, name, strlen(name));
+        return;
+    }
+    int field = 0, length = 8;
+    for (; *name; name++) {
+        if (*name == '.') {
+            field = 8;
+            length = 3;
+            continue;
+        }
+        if (length <= 0) continue;
+        if (*name == '*') {
+            memset(&template[field], '?', length);
+            field += length;
+            length = 0;
+            continue;
+        }
+        template[field++] = toupper((uint8_t) *name);
+        length--;
+    }
+}
+
+static INLINE uint8_t redirector_match(const char *template, const char *name) {
+    for (int i = 0; i < 11; i++) {
+        if (template[i] != '?' && template[i] != name[i]) return 0;
+    }
+    return 1;
+}
+
+static int redirector_alias_compare(const void *a, const void *b) {
+    const redirector_entry_t *entries = redirector_sorting->entries;
+    return memcmp(entries[*(const uint32_t *) a].name, entries[*(const uint32_t *) b].name, 11);
+}
+
+// Sorts the entries by alias, 0 when out of memory
+static uint8_t redirector_sort(redirector_directory_t *directory) {
+    if (directory->sorted == directory->count) return 1;
+    uint32_t *order = realloc(directory->order, (directory->count + 1) * sizeof(uint32_t));
+    if (!order) return 0;
+    directory->order = order;
+    for (uint32_t i = 0; i < directory->count; i++) order[i] = i;
+    redirector_sorting = directory;
+    qsort(order, directory->count, sizeof(uint32_t), redirector_alias_compare);
+    directory->sorted = directory->count;
+    return 1;
+}
+
+static redirector_search_t *redirector_search_start(sdbstruct *sdb) {
+    if (++redirector_search_number == REDIRECTOR_SEARCH_DONE) redirector_search_number = 0;
+    redirector_search_t *search = &redirector_searches[redirector_search_number % REDIRECTOR_SEARCHES];
+    search->number = redirector_search_number;
+    search->name[0] = '\0';
+    sdb->dir_entry = search->number;
+    return search;
+}
+
+// Search of a FindNext, NULL when it is done or was taken over
+static redirector_search_t *redirector_search(const sdbstruct *sdb) {
+    redirector_search_t *search = &redirector_searches[sdb->dir_entry % REDIRECTOR_SEARCHES];
+    return sdb->dir_entry != REDIRECTOR_SEARCH_DONE && search->number == sdb->dir_entry ? search : NULL;
+}
+
+static uint8_t redirector_found(sdbstruct *sdb, redirector_search_t *search, const redirector_entry_t *entry) {
+    // hidden, system and directory entries only show up when asked for
+    if (entry->attributes & (0x02 | 0x04 | 0x10) & ~sdb->srch_attr) return 0;
+    if (!redirector_match((const char *) sdb->srch_tmpl, entry->name)) return 0;
+    memcpy(sdb->foundfile.fname, entry->name, 11);
+    sdb->foundfile.fattr = entry->attributes;
+    sdb->foundfile.time_lstupd = entry->time;
+    sdb->foundfile.date_lstupd = entry->date;
+    sdb->foundfile.start_clstr = 0;
+    sdb->foundfile.fsize = entry->size;
+    memcpy(search->name, entry->name, 11);
+    return 1;
+}
+
+// Fills the found file of `sdb` from the first match after the alias the search returned last, 0 once it is done
+static uint8_t redirector_find(redirector_directory_t *directory, sdbstruct *sdb, redirector_search_t *search) {
+    const char *template = (const char *) sdb->srch_tmpl;
+    if (!memchr(template, '?', 11)) {
+        // a plain name is looked up, at most one entry matches
+        const redirector_entry_t *entry = search->name[0] ? NULL : redirector_lookup(directory, template);
+        if (entry && redirector_found(sdb, search, entry)) return 1;
+    } else if (redirector_sort(directory)) {
+        uint32_t index = 0;
+        if (search->name[0]) {
+            uint32_t high = directory->count;
+            while (index < high) {
+                const uint32_t middle = (index + high) / 2;
+                if (memcmp(directory->entries[directory->order[middle]].name, search->name, 11) <= 0) {
+                    index = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+        }
+        for (; index < directory->count; index++) {
+            if (redirector_found(sdb, search, &directory->entries[directory->order[index]])) return 1;
+        }
+    }
+    sdb->dir_entry = REDIRECTOR_SEARCH_DONE;
+    return 0;
+}
+
+// Host path of a guest path. Each component is looked up among the aliases of its directory, names that are not
+// there yet are taken as they are. 0 when the drive is not mapped or the path gets too long
+static uint8_t resolve_full_path(char *dest, const char *guest_path) {
+    const redirector_drive_t *drive = redirector_drive(guest_path);
+    if (!drive) return 0;
+    if (guest_path[0] && guest_path[1] == ':') guest_path += 2;
+    char relative[256];
+    if (guest_path[0] == '\\') {
+        // Root-relative path (e.g., "\subdir\file.txt")
+        snprintf(relative, sizeof(relative), "%s", guest_path + 1);
+    } else if (drive->current[0]) {
+        // Relative path (e.g., "file.txt" or "subdir\file.txt")
+        snprintf(relative, sizeof(relative), "%s\\%s", drive->current, guest_path);
+    } else {
+        snprintf(relative, sizeof(relative), "%s", guest_path);
+    }
+
+    size_t length = strlen(drive->root);
+    strcpy(dest, drive->root);
+    while (length > 1 && (dest[length - 1] == '/' || dest[length - 1] == '\\') && dest[length - 2] != ':') {
+        dest[--length] = '\0';
+    }
+    const size_t root_length = length;
+    for (char *component = strtok(relative, "\\"); component; component = strtok(NULL, "\\")) {
+        if (!strcmp(component, ".")) continue;
+        if (!strcmp(component, "..")) {
+            char *slash = strrchr(dest, '/');
+            if (slash && (size_t) (slash - dest) >= root_length) {
+                *slash = '\0';
+                length = slash - dest;
+            }
+            continue;
+        }
+        const char *host = component;
+        if (!strpbrk(component, "?*")) {
+            char name[11];
+            to_dos_name(component, name);
+            redirector_directory_t *directory = redirector_directory(dest, length == root_length, 0);
+            const redirector_entry_t *entry = directory ? redirector_lookup(directory, name) : NULL;
+            if (directory && !entry && time(NULL) - directory->listed >= 1) {
+                // it may have shown up on the host since
+                directory->relist = 1;
+                directory = redirector_directory(dest, length == root_length, 0);
+                entry = directory ? redirector_lookup(directory, name) : NULL;
+            }
+            if (entry) host = directory->names + entry->host;
+        }
+        if (length + 1 + strlen(host) >= 256) return 0;
+        const uint8_t separator = dest[length - 1] == '/' || dest[length - 1] == '\\';
+        length += snprintf(dest + length, 256 - length, "%s%s", separator ? "" : "/", host);
+    }
+    return 1;
+}
+
+static uint8_t get_full_path(char *dest, const char *guest_path) {
+    // Relative paths depend on the drive DOS is on, only qualified ones are cached
+    const uint8_t qualified = guest_path[0] && guest_path[1] == ':';
+    redirector_path_t *entry = &redirector_paths[redirector_hash(guest_path) % REDIRECTOR_PATH_CACHE];
+    const time_t now = time(NULL);
+    if (qualified && entry->generation == redirector_path_generation && now - entry->checked <= 1 &&
+        !strcmp(entry->guest, guest_path)) {
+        strcpy(dest, entry->host);
+        return 1;
+    }
+    if (!resolve_full_path(dest, guest_path)) return 0;
+    if (qualified && strlen(guest_path) < sizeof(entry->guest)) {
+        entry->generation = redirector_path_generation;
+        entry->checked = now;
+        strcpy(entry->guest, guest_path);
+        strcpy(entry->host, dest);
+    }
+    return 1;
+}
+
+// Guest structures the handler fills in. They are written behind the page table, so the pages are marked here
+static INLINE sftstruct *redirector_sft() {
+    const uint32_t address = ((uint32_t) CPU_ES << 4) + CPU_DI;
+    memory_write_track(address, sizeof(sftstruct));
+    return (sftstruct *) &RAM[address];
+}
+
+static INLINE sdbstruct *redirector_sdb() {
+    const uint32_t address = (*(uint16_t *) &RAM[sda_addr + 14] << 4) + *(uint16_t *) &RAM[sda_addr + 12];
+    memory_write_track(address, sizeof(sdbstruct));
+    return (sdbstruct *) &RAM[address];
+}
 
 static inline bool redirector_handler() {
     char path[256];
@@ -170,10 +1047,6 @@ static inline bool redirector_handler() {
  * Extended open mode          2E1h    Not supported
  */
 
-    static uint32_t sda_addr = 0;
-    static sdbstruct *dta_ptr;
-    static intptr_t handle = -1;
-
     switch (CPU_AX) {
         // Check if network redirector is installed
         case 0x1100:
@@ -187,11 +1060,17 @@ static inline bool redirector_handler() {
 
         // Remove Remote Directory
         case 0x1101: {
-            get_full_path(path, &RAM[sda_addr + FIRST_FILENAME_OFFSET]);
+            if (!get_full_path(path, &RAM[sda_addr + FIRST_FILENAME_OFFSET])) {
+                CPU_AX = 3; // Path not found, the drive is not mapped
+                CPU_FL_CF = 1;
+                break;
+            }
             debug_log("Removing directory %s\n", path);
 
             const int result = rmdir(path); // TODO recursive remove
             if (result == 0) {
+                redirector_changed();
+                redirector_removed(path);
                 CPU_AX = 0;
                 CPU_FL_CF = 0;
             } else {
@@ -203,10 +1082,16 @@ static inline bool redirector_handler() {
 
         // Create Remote Directory
         case 0x1103: {
-            get_full_path(path, &RAM[sda_addr + FIRST_FILENAME_OFFSET]);
+            if (!get_full_path(path, &RAM[sda_addr + FIRST_FILENAME_OFFSET])) {
+                CPU_AX = 3; // Path not found, the drive is not mapped
+                CPU_FL_CF = 1;
+                break;
+            }
             debug_log("Creating directory %s\n", path);
             const int result = mkdir(path, 0777);
             if (result == 0) {
+                redirector_changed();
+                redirector_added(path);
                 CPU_AX = 0;
                 CPU_FL_CF = 0;
             } else {
@@ -220,37 +1105,49 @@ static inline bool redirector_handler() {
         case 0x1105: {
             const char *dos_path = &RAM[sda_addr + FIRST_FILENAME_OFFSET];
             debug_log("Change directory to: '%s'\n", dos_path);
+            redirector_drive_t *drive = redirector_drive(dos_path);
+            if (!drive) {
+                CPU_AX = 3; // Path not found, the drive is not mapped
+                CPU_FL_CF = 1;
+                break;
+            }
+            if (dos_path[0] && dos_path[1] == ':') dos_path += 2;
 
             // Handle different path formats
             if (dos_path[0] == '\\' && dos_path[1] == '\0') {
                 // Root directory "\"
-                strcpy(current_remote_dir, "");
+                strcpy(drive->current, "");
             } else if (dos_path[0] == '\\') {
                 // Absolute path from root, remove leading backslash
-                strcpy(current_remote_dir, dos_path + 1);
+                snprintf(drive->current, sizeof(drive->current), "%s", dos_path + 1);
             } else {
                 // Relative path
-                strcpy(current_remote_dir, dos_path);
+                snprintf(drive->current, sizeof(drive->current), "%s", dos_path);
             }
 
-            debug_log("Current remote dir set to: '%s'\n", current_remote_dir);
+            redirector_path_generation++;
+            debug_log("Current remote dir set to: '%s'\n", drive->current);
             CPU_AX = 0;
             CPU_FL_CF = 0;
         }
         break;
 
-        // Commit Remote File
-        case 0x1107:
         // Close Remote File
-        case 0x1106: {
-            sftstruct *sftptr = (sftstruct *) &RAM[((uint32_t) CPU_ES << 4) + CPU_DI];
+        case 0x1106:
+        // Commit Remote File
+        case 0x1107: {
+            sftstruct *sftptr = redirector_sft();
             const uint16_t file_handle = sftptr->file_handle;
             if (file_handle < MAX_FILES && open_files[file_handle]) {
-                fclose(open_files[file_handle]);
-                sftptr->total_handles = 0xffff;
-                open_files[file_handle] = NULL;
-                CPU_AX = 0;
-                CPU_FL_CF = 0;
+                uint8_t committed;
+                if (CPU_AX == 0x1106) {
+                    committed = redirector_close(file_handle);
+                    sftptr->total_handles = 0xffff;
+                } else {
+                    committed = redirector_commit(open_files[file_handle]);
+                }
+                CPU_AX = committed ? 0 : 0x1D; // Write fault of an earlier write-behind
+                CPU_FL_CF = !committed;
             } else {
                 CPU_AX = 6; // Invalid handle
                 CPU_FL_CF = 1;
@@ -261,22 +1158,23 @@ static inline bool redirector_handler() {
 
         // Read Remote File
         case 0x1108: {
-            sftstruct *sftptr = (sftstruct *) &RAM[((uint32_t) CPU_ES << 4) + CPU_DI];
+            sftstruct *sftptr = redirector_sft();
             const uint16_t file_handle = sftptr->file_handle; // We store our handle here
             if (file_handle < MAX_FILES && open_files[file_handle]) {
                 uint16_t bytes_to_read = CPU_CX;
                 debug_log("HANDLE COUNT %X %i (file_pos: %ld)\n", file_handle, bytes_to_read, sftptr->file_position);
 
-                // Ensure file pointer is at the correct position
-                if (fseek(open_files[file_handle], sftptr->file_position, SEEK_SET) != 0) {
-                    debug_log("Seek error to position %ld\n", sftptr->file_position);
-                    CPU_AX = 6; // Invalid handle or seek error
+                const uint32_t dta_addr = (*(uint16_t *) &RAM[sda_addr + 14] << 4) + *(uint16_t *) &RAM[sda_addr + 12];
+                if (dta_addr >= RAM_SIZE) {
+                    CPU_AX = 5; // Access denied, the DTA is outside conventional memory
                     CPU_FL_CF = 1;
                     break;
                 }
-
-                const uint32_t dta_addr = (*(uint16_t *) &RAM[sda_addr + 14] << 4) + *(uint16_t *) &RAM[sda_addr + 12];
-                size_t bytes_read = fread(&RAM[dta_addr], 1, bytes_to_read, open_files[file_handle]);
+                if (bytes_to_read > RAM_SIZE - dta_addr) bytes_to_read = RAM_SIZE - dta_addr;
+                const uint32_t bytes_read = redirector_read(open_files[file_handle], sftptr->file_position,
+                                                            &RAM[dta_addr], bytes_to_read);
+                memory_write_track(dta_addr, bytes_read);
+                decode_cache_invalidate(dta_addr, bytes_read);
                 debug_log("bytes read %i at offset %ld -> %x\n", (int) bytes_read, sftptr->file_position, dta_addr);
 
                 // Update file position in SFT
@@ -293,28 +1191,27 @@ static inline bool redirector_handler() {
 
         // Write Remote File
         case 0x1109: {
-            sftstruct *sftptr = (sftstruct *) &RAM[((uint32_t) CPU_ES << 4) + CPU_DI];
+            sftstruct *sftptr = redirector_sft();
             uint16_t file_handle = sftptr->file_handle; // We store our handle here
 
             if (file_handle < MAX_FILES && open_files[file_handle]) {
                 uint16_t bytes_to_write = CPU_CX;
                 debug_log("WRITE HANDLE %X %i (file_pos: %ld)\n", file_handle, bytes_to_write, sftptr->file_position);
 
-                // Ensure file pointer is at the correct position
-                if (fseek(open_files[file_handle], sftptr->file_position, SEEK_SET) != 0) {
-                    debug_log("Write seek error to position %ld\n", sftptr->file_position);
-                    CPU_AX = 6; // Invalid handle or seek error
+                const uint32_t dta_addr = (*(uint16_t *) &RAM[sda_addr + 14] << 4) + *(uint16_t *) &RAM[sda_addr + 12];
+                if (dta_addr >= RAM_SIZE) {
+                    CPU_AX = 5; // Access denied, the DTA is outside conventional memory
                     CPU_FL_CF = 1;
                     break;
                 }
-
-                const uint32_t dta_addr = (*(uint16_t *) &RAM[sda_addr + 14] << 4) + *(uint16_t *) &RAM[sda_addr + 12];
-                size_t bytes_written = fwrite(&RAM[dta_addr], 1, bytes_to_write, open_files[file_handle]);
+                if (bytes_to_write > RAM_SIZE - dta_addr) bytes_to_write = RAM_SIZE - dta_addr;
+                const uint32_t bytes_written = redirector_write(open_files[file_handle], sftptr->file_position,
+                                                               &RAM[dta_addr], bytes_to_write);
                 debug_log("bytes written %i at offset %ld\n", (int) bytes_written, sftptr->file_position);
 
-                // Update file position in SFT and force write to disk
+                // Update file position in SFT, the data reaches the host file on commit or close
                 sftptr->file_position += bytes_written;
-                fflush(open_files[file_handle]); // Ensure data is written to disk
+                if (sftptr->file_position > sftptr->file_size) sftptr->file_size = sftptr->file_position;
                 CPU_CX = bytes_written; // RBIL6: return bytes written in CX, not AX
                 CPU_FL_CF = 0;
             } else {
@@ -329,16 +1226,28 @@ static inline bool redirector_handler() {
             char old_path[256], new_path[256];
 
             // Get old filename from first filename buffer in SDA
-            get_full_path(old_path, &RAM[sda_addr + FIRST_FILENAME_OFFSET]);
+            if (!get_full_path(old_path, &RAM[sda_addr + FIRST_FILENAME_OFFSET])) {
+                CPU_AX = 3; // Path not found, the drive is not mapped
+                CPU_FL_CF = 1;
+                break;
+            }
 
             // Get new filename from second filename buffer in SDA (offset 0x16A for DOS 4+)
             // For DOS 3.x it's at offset 0x15E, but we'll use DOS 4+ layout
-            get_full_path(new_path, &RAM[sda_addr + 0x16A]);
+            if (!get_full_path(new_path, &RAM[sda_addr + 0x16A])) {
+                CPU_AX = 3; // Path not found, the drive is not mapped
+                CPU_FL_CF = 1;
+                break;
+            }
 
             debug_log("Renaming '%s' to '%s'\n", old_path, new_path);
 
+            redirector_commit_all();
             int result = rename(old_path, new_path);
             if (result == 0) {
+                redirector_changed();
+                redirector_removed(old_path);
+                redirector_removed(new_path);
                 CPU_AX = 0;
                 CPU_FL_CF = 0;
             } else {
@@ -350,9 +1259,16 @@ static inline bool redirector_handler() {
 
         // Delete Remote File
         case 0x1113: {
-            get_full_path(path, &RAM[sda_addr + FIRST_FILENAME_OFFSET]);
+            if (!get_full_path(path, &RAM[sda_addr + FIRST_FILENAME_OFFSET])) {
+                CPU_AX = 3; // Path not found, the drive is not mapped
+                CPU_FL_CF = 1;
+                break;
+            }
+            redirector_commit_all();
             int result = unlink(path);
             if (result == 0) {
+                redirector_changed();
+                redirector_removed(path);
                 CPU_AX = 0;
                 CPU_FL_CF = 0;
             } else {
@@ -365,24 +1281,27 @@ static inline bool redirector_handler() {
         // Open Existing File
         case 0x1116: {
             const char *dos_path = &RAM[sda_addr + FIRST_FILENAME_OFFSET];
-            get_full_path(path, dos_path);
+            if (!get_full_path(path, dos_path)) {
+                CPU_AX = 3; // Path not found, the drive is not mapped
+                CPU_FL_CF = 1;
+                break;
+            }
             debug_log("Opening %s %s\n", dos_path, path);
 
+            // Another handle may still be gathering writes to the same file
+            redirector_commit_all();
             const int8_t file_handle = get_free_handle();
             if (file_handle != -1) {
-                open_files[file_handle] = fopen(path, "rb+");
+                open_files[file_handle] = redirector_open(path, "rb+");
                 if (!open_files[file_handle]) {
                     // Try read-only mode if read-write fails
-                    open_files[file_handle] = fopen(path, "rb");
+                    open_files[file_handle] = redirector_open(path, "rb");
                     debug_log("Tried rb+ failed, trying rb: %s\n", open_files[file_handle] ? "SUCCESS" : "FAILED");
                 }
                 if (open_files[file_handle]) {
-                    // Get file size
-                    fseek(open_files[file_handle], 0, SEEK_END);
-                    const size_t file_size = ftell(open_files[file_handle]);
-                    rewind(open_files[file_handle]);
+                    const uint32_t file_size = open_files[file_handle]->size;
 
-                    sftstruct *sftptr = (sftstruct *) &RAM[((uint32_t) CPU_ES << 4) + CPU_DI];
+                    sftstruct *sftptr = redirector_sft();
 
                     // Extract just the filename from the path for SFT
                     const char *filename = strrchr(dos_path, '\\');
@@ -398,7 +1317,7 @@ static inline bool redirector_handler() {
                     sftptr->open_mode |= 0xff02;
 
                     sftptr->attribute = 0x8;
-                    sftptr->device_info = 0x8040 | 'H';
+                    sftptr->device_info = 0x8040 | redirector_letter(dos_path);
                     sftptr->file_handle = file_handle; // Store our handle here
                     sftptr->file_size = file_size;
                     sftptr->file_time = 0x1000;
@@ -430,12 +1349,19 @@ static inline bool redirector_handler() {
             const int8_t file_handle = get_free_handle();
             if (file_handle != -1) {
                 const char *dos_path = &RAM[sda_addr + FIRST_FILENAME_OFFSET];
-                get_full_path(path, dos_path);
+                if (!get_full_path(path, dos_path)) {
+                    CPU_AX = 3; // Path not found, the drive is not mapped
+                    CPU_FL_CF = 1;
+                    break;
+                }
 
-                open_files[file_handle] = fopen(path, "wb+");
+                redirector_commit_all();
+                open_files[file_handle] = redirector_open(path, "wb+");
                 if (open_files[file_handle]) {
+                    redirector_changed();
+                    redirector_added(path);
                     // Initialize SFT structure
-                    sftstruct *sftptr = (sftstruct *) &RAM[((uint32_t) CPU_ES << 4) + CPU_DI];
+                    sftstruct *sftptr = redirector_sft();
 
                     // Extract just the filename from the path for SFT
                     const char *filename = strrchr(dos_path, '\\');
@@ -450,7 +1376,7 @@ static inline bool redirector_handler() {
                     sftptr->open_mode &= 0xff00;
                     sftptr->open_mode |= 0x0002; // Create/truncate file
                     sftptr->attribute = 0x08;
-                    sftptr->device_info = 0x8040 | 'H';
+                    sftptr->device_info = 0x8040 | redirector_letter(dos_path);
                     sftptr->file_handle = file_handle; // Store our handle here
                     sftptr->file_size = 0; // New file
                     sftptr->file_time = 0x1000;
@@ -503,11 +1429,16 @@ static inline bool redirector_handler() {
             // Input: AX=110Fh, SDA+9Eh → filename
             // Output: CF=0 if success with AX=attributes, BX:DI=file size, CX=time, DX=date
             //         CF=1 if error with AX=DOS error code
-            get_full_path(path, &RAM[sda_addr + FIRST_FILENAME_OFFSET]);
+            if (!get_full_path(path, &RAM[sda_addr + FIRST_FILENAME_OFFSET])) {
+                CPU_AX = 3; // Path not found, the drive is not mapped
+                CPU_FL_CF = 1;
+                break;
+            }
 
-            // Get file attributes
+            // Get file attributes, sizes include what open handles have gathered
+            redirector_commit_all();
             struct stat file_info;
-            if (stat(path, &file_info)) {
+            if (redirector_stat(path, &file_info)) {
                 CPU_AX = 2; // Not found
                 CPU_FL_CF = 1;
             } else {
@@ -536,31 +1467,37 @@ static inline bool redirector_handler() {
 
         // Find First File
         case 0x111B: {
-            struct _finddata_t fileinfo;
-            get_full_path(path, &RAM[sda_addr + FIRST_FILENAME_OFFSET]);
-            debug_log("find first file: '%s'\n", path);
-
-
-            if (handle) {
-                _findclose(handle);
+            const char *dos_path = &RAM[sda_addr + FIRST_FILENAME_OFFSET];
+            debug_log("find first file: '%s'\n", dos_path);
+            // Sizes include what open handles have gathered
+            redirector_commit_all();
+
+            // The listing is of the directory part, the last component is matched against it
+            char directory_path[256];
+            const char *host;
+            if (!get_full_path(path, dos_path) || !redirector_split(path, directory_path, &host)) {
+                CPU_AX = 3; // Path not found, the drive is not mapped
+                CPU_FL_CF = 1;
+                break;
             }
-
-            if ((handle = _findfirst(path, &fileinfo)) != -1) {
-                // Set actual DTA pointer
-
-                dta_ptr = (sdbstruct *) &RAM[(*(uint16_t *) &RAM[sda_addr + 14] << 4) + *(uint16_t *) &RAM[sda_addr + 12]];
-                dta_ptr->drive_letter = 'H' | 128; /* bit 7 set means 'network drive' (RBIL6 compliance) */
-
-                to_dos_name(fileinfo.name, dta_ptr->foundfile.fname);
-                dta_ptr->foundfile.fsize = fileinfo.size;
-                dta_ptr->foundfile.fattr = fileinfo.attrib;
-
-                // Other attributes can be set here if needed
+            const char *name = strrchr(dos_path, '\\');
+            name = name ? name + 1 : dos_path;
+            const uint8_t root = name - dos_path <= 3;
+            redirector_directory_t *directory = redirector_directory(directory_path, root, 1);
+
+            sdbstruct *sdb = redirector_sdb();
+            sdb->drive_letter = redirector_letter(dos_path) | 128; /* bit 7 set means 'network drive' (RBIL6 compliance) */
+            redirector_template(name, (char *) sdb->srch_tmpl);
+            sdb->srch_attr = RAM[sda_addr + SEARCH_ATTRIBUTES_OFFSET];
+            sdb->par_clstr = directory ? directory - redirector_directories : 0;
+            sdb->f1 = directory ? directory->hash : 0;
+            redirector_search_t *search = redirector_search_start(sdb);
+            if (directory && redirector_find(directory, sdb, search)) {
                 CPU_AX = 0;
                 CPU_FL_CF = 0;
             } else {
                 debug_log("error finding file: '%s'\n", path);
-                CPU_AX = 18; // No more files
+                CPU_AX = directory ? 18 : 3; // No more files, or path not found
                 CPU_FL_CF = 1;
             }
         }
@@ -572,19 +1509,23 @@ static inline bool redirector_handler() {
             // Input: AX=111Ch, DTA contains search data from Find First
             // Output: CF=0 if file found with DTA updated, CF=1 if no more files with AX=18
             //         Must preserve bit 7 in DTA first byte (RBIL6 requirement)
-            struct _finddata_t fileinfo;
-            if (handle != -1 && _findnext(handle, &fileinfo) == 0) {
-                dta_ptr->drive_letter |= 128; // Ensure bit 7 remains set (RBIL6 compliance)
-                to_dos_name(fileinfo.name, dta_ptr->foundfile.fname);
-                // Set file size
-                dta_ptr->foundfile.fattr = fileinfo.attrib;
-                dta_ptr->foundfile.fsize = fileinfo.size;
-                dta_ptr->foundfile.start_clstr = 0;
-
+            sdbstruct *sdb = redirector_sdb();
+            redirector_directory_t *directory = sdb->par_clstr < REDIRECTOR_DIRECTORIES
+                                                    ? &redirector_directories[sdb->par_clstr]
+                                                    : NULL;
+            // The slot may have been handed to another directory by now
+            if (directory && directory->hash == sdb->f1 && directory->path[0]) {
+                directory = redirector_directory(directory->path, directory->root, 0);
+            } else {
+                directory = NULL;
+            }
+            redirector_search_t *search = redirector_search(sdb);
+            if (directory && search && redirector_find(directory, sdb, search)) {
+                sdb->drive_letter |= 128; // Ensure bit 7 remains set (RBIL6 compliance)
                 CPU_AX = 0;
                 CPU_FL_CF = 0;
             } else {
-                debug_log("no more files for: '%s'\n", path);
+                debug_log("no more files\n");
                 CPU_AX = 18; // No more files
                 CPU_FL_CF = 1;
             }
@@ -593,18 +1534,14 @@ static inline bool redirector_handler() {
 
         // Flush All Remote Disk Buffers
         case 0x1120:
-            for (int i = 0; i < MAX_FILES; i++) {
-                if (open_files[i]) {
-                    fflush(open_files[i]);
-                }
-            }
+            redirector_commit_all();
             CPU_AX = 0;
             CPU_FL_CF = 0;
             break;
 
         // Seek from File End
         case 0x1121: {
-            sftstruct *sftptr = (sftstruct *) &RAM[((uint32_t) CPU_ES << 4) + CPU_DI];
+            sftstruct *sftptr = redirector_sft();
             const uint16_t file_handle = sftptr->file_handle;
 
             if (file_handle < MAX_FILES && open_files[file_handle]) {
@@ -613,35 +1550,14 @@ static inline bool redirector_handler() {
 
                 debug_log("Seek from end: handle %d, offset %ld\n", file_handle, offset_from_end);
 
-                // Get current file size
-                if (fseek(open_files[file_handle], 0, SEEK_END) != 0) {
-                    CPU_AX = 6; // Invalid handle
-                    CPU_FL_CF = 1;
-                    break;
-                }
-
-                long file_size = ftell(open_files[file_handle]);
-                if (file_size == -1) {
-                    CPU_AX = 6; // Invalid handle
-                    CPU_FL_CF = 1;
-                    break;
-                }
-
-                // Calculate new position: file_size + offset_from_end
-                long new_position = file_size + offset_from_end;
+                // Calculate new position: file_size + offset_from_end, the size includes gathered writes
+                long new_position = (long) open_files[file_handle]->size + offset_from_end;
 
                 // Ensure new position is not negative
                 if (new_position < 0) {
                     new_position = 0;
                 }
 
-                // Seek to new position
-                if (fseek(open_files[file_handle], new_position, SEEK_SET) != 0) {
-                    CPU_AX = 6; // Invalid handle
-                    CPU_FL_CF = 1;
-                    break;
-                }
-
                 // Update SFT position and return new position in DX:AX
                 sftptr->file_position = new_position;
                 CPU_DX = (new_position >> 16) & 0xFFFF; // High word
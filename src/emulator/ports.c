@@ -33,6 +33,45 @@ int sound_chips_clock = 0;
 static uint16_t adlibregmem[5], adlib_register = 0;
 static uint8_t adlibstatus = 0;
 
+#if !PICO_ON_DEVICE
+// OPL timer 1 counts 80 us steps, timer 2 320 us steps, both overflow at 256 and reload from registers 2/3
+static scheduler_event_t adlib_timer_events[2];
+
+static INLINE void adlib_timer_overflow(const uint8_t timer) {
+    if (!(adlibregmem[4] & (0x40 >> timer))) {
+        adlibstatus |= 0x80 | (0x40 >> timer);
+    }
+}
+
+static void adlib_timer1_overflow(void) {
+    adlib_timer_overflow(0);
+}
+
+static void adlib_timer2_overflow(void) {
+    adlib_timer_overflow(1);
+}
+
+static INLINE void adlib_timers_control(const uint8_t value) {
+    if (value & 0x80) {
+        // IRQ reset, the other bits are ignored
+        adlibstatus = 0;
+        return;
+    }
+    adlibregmem[4] = value;
+    for (uint8_t timer = 0; timer < 2; timer++) {
+        scheduler_event_t *event = &adlib_timer_events[timer];
+        if (!(value & (1 << timer))) {
+            scheduler_stop(event);
+        } else {
+            // every start loads the preset again, also into a running timer
+            const uint64_t step_us = timer ? 320 : 80;
+            scheduler_start(event, timer ? adlib_timer2_overflow : adlib_timer1_overflow,
+                            (256 - adlibregmem[2 + timer]) * step_us * SCHEDULER_CLOCK, 1000000);
+        }
+    }
+}
+#endif
+
 static int8_t joystick_tick;
 static INLINE void joystick_out() {
 #if PICO_ON_DEVICE
@@ -103,7 +142,7 @@ static INLINE uint8_t rtc_read(uint16_t addr) {
     return ret;
 }
 
-void portout(uint16_t portnum, uint16_t value) {
+static INLINE void portout_dispatch(const uint16_t portnum, const uint16_t value) {
     switch (portnum) {
         case 0x00:
         case 0x01:
@@ -165,6 +204,7 @@ void portout(uint16_t portnum, uint16_t value) {
 // A20 Gate
         case 0x92:
             a20_enabled = value & 1;
+            memory_map_a20();
             printf("A20 W: %d\n", a20_enabled);
             return;
 // Tandy 3-Voice Sound
@@ -258,6 +298,13 @@ if (sound_chips_clock) {
             adlib_register = value;
             break;
         case 0x389:
+#if !PICO_ON_DEVICE
+            if (adlib_register == 4) {
+                adlib_timers_control(value);
+            } else if (adlib_register < 4) {
+                adlibregmem[adlib_register] = value;
+            }
+#else
             if (adlib_register <= 4) {
                 adlibregmem[adlib_register] = value;
 
@@ -266,6 +313,7 @@ if (sound_chips_clock) {
                     adlibregmem[4] = 0;
                 }
             }
+#endif
 #if HARDWARE_SOUND
         if (!sound_chips_clock) {
             clock_init(CLOCK_PIN, CLOCK_FREQUENCY);
@@ -384,7 +432,16 @@ if (sound_chips_clock) {
     }
 }
 
-uint16_t portin(uint16_t portnum) {
+void portout(uint16_t portnum, uint16_t value) {
+#if !PICO_ON_DEVICE
+    scheduler_now += SCHEDULER_IO_TICKS;
+#endif
+    const uint64_t start = profiler_start();
+    portout_dispatch(portnum, value);
+    profiler_port(1, portnum, start);
+}
+
+static INLINE uint16_t portin_dispatch(const uint16_t portnum) {
     switch (portnum) {
         case 0x00:
         case 0x01:
@@ -496,6 +553,10 @@ uint16_t portin(uint16_t portnum) {
 // AdLib
         case 0x388:
         case 0x389:
+#if !PICO_ON_DEVICE
+            // the scheduler-driven timers set the status bits as they overflow
+            return adlibstatus;
+#else
             if (!adlibregmem[4])
                 adlibstatus = 0;
             else
@@ -503,6 +564,7 @@ uint16_t portin(uint16_t portnum) {
 
             adlibstatus = adlibstatus + (adlibregmem[4] & 1) * 0x40 + (adlibregmem[4] & 2) * 0x10;
             return adlibstatus;
+#endif
         case 0x3C1:
         case 0x3C2:
         case 0x3C7:
@@ -535,6 +597,16 @@ uint16_t portin(uint16_t portnum) {
     }
 }
 
+uint16_t portin(uint16_t portnum) {
+#if !PICO_ON_DEVICE
+    scheduler_now += SCHEDULER_IO_TICKS;
+#endif
+    const uint64_t start = profiler_start();
+    const uint16_t value = portin_dispatch(portnum);
+    profiler_port(0, portnum, start);
+    return value;
+}
+
 
 void portout16(uint16_t portnum, uint16_t value) {
     portout(portnum, (uint8_t) value);
@@ -545,16 +617,151 @@ uint16_t portin16(uint16_t portnum) {
     return portin(portnum) | portin(portnum + 1) << 8;
 }
 
+#if !PICO_ON_DEVICE
+// The OPL keeps host buffers, only its register file is saved and written back through OPL_writeReg.
+// Notes that were sounding restart from their attack.
+void ports_savestate(savestate_t *state) {
+    savestate_chunk(state, "CRTI", &crt_controller_idx, sizeof(crt_controller_idx));
+    savestate_chunk(state, "CRTC", crt_controller, sizeof(crt_controller));
+    savestate_chunk(state, "P60 ", &port60, sizeof(port60));
+    savestate_chunk(state, "P61 ", &port61, sizeof(port61));
+    savestate_chunk(state, "P64 ", &port64, sizeof(port64));
+    savestate_chunk(state, "CURS", &cursor_start, sizeof(cursor_start));
+    savestate_chunk(state, "CURE", &cursor_end, sizeof(cursor_end));
+    savestate_chunk(state, "VOFS", &vram_offset, sizeof(vram_offset));
+    savestate_chunk(state, "DMA ", dma_channels, sizeof(dma_channels));
+    savestate_chunk(state, "DMAF", &i8237_byte_flipflop, sizeof(i8237_byte_flipflop));
+    savestate_chunk(state, "JOY ", &joystick_tick, sizeof(joystick_tick));
+
+    savestate_chunk(state, "ADLM", adlibregmem, sizeof(adlibregmem));
+    savestate_chunk(state, "ADLR", &adlib_register, sizeof(adlib_register));
+    savestate_chunk(state, "ADLS", &adlibstatus, sizeof(adlibstatus));
+    scheduler_savestate(state, "ADT1", &adlib_timer_events[0], adlib_timer1_overflow);
+    scheduler_savestate(state, "ADT2", &adlib_timer_events[1], adlib_timer2_overflow);
+    uint8_t opl_registers[sizeof(emu8950_opl->reg)];
+    memcpy(opl_registers, emu8950_opl->reg, sizeof(opl_registers));
+    savestate_chunk(state, "OPL ", opl_registers, sizeof(opl_registers));
+    if (savestate_loading(state)) {
+        for (uint32_t opl_register = 0; opl_register < sizeof(opl_registers); opl_register++) {
+            OPL_writeReg(emu8950_opl, opl_register, opl_registers[opl_register]);
+        }
+    }
+
+    sn76489_savestate(state);
+    cms_savestate(state);
+    dss_savestate(state);
+    blaster_savestate(state);
+}
+#endif
+
+
+#if !HARDWARE_SOUND
+static INLINE int16_t sound_saturate(const int32_t sample) {
+    return sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : (int16_t) sample;
+}
+
+#if !PICO_ON_DEVICE
+const char *const sound_stem_names[SOUND_STEMS] = { "opl", "sb", "speaker", "sn76489", "cms", "dss", "midi" };
+
+static INLINE void sound_stem(int16_t *stem, const int32_t *source, const int count) {
+    for (int i = 0; i < count; i++) {
+        stem[i * 2] = stem[i * 2 + 1] = sound_saturate(source[i]);
+    }
+}
+#endif
+
+// Adds a mono source to mix, rendered alone into its stem first when stems are captured
+static INLINE void sound_add(void (*source)(int32_t *, int), int32_t *mix, int16_t *stem, const int count) {
+#if !PICO_ON_DEVICE
+    if (stem) {
+        int32_t alone[SOUND_BLOCK_SAMPLES] = { 0 };
+        source(alone, count);
+        sound_stem(stem, alone, count);
+        for (int i = 0; i < count; i++) {
+            mix[i] += alone[i];
+        }
+        return;
+    }
+#endif
+    source(mix, count);
+}
+
+// Every source renders the whole block into a 32-bit mix, which is saturated once at the end.
+// The samples taken every tick come summed in other, or with the Sound Blaster and speaker apart in sb and speaker.
+static INLINE void sound_mix(const int16_t *other, const int16_t *sb, const int16_t *speaker, int16_t *samples,
+                             int16_t *const *stems, const int count) {
+    int32_t mix[SOUND_BLOCK_SAMPLES];
+    int32_t stereo[SOUND_BLOCK_SAMPLES][2];
+
+    OPL_calc_buffer_linear(emu8950_opl, mix, count);
+#if !PICO_ON_DEVICE
+    if (stems) {
+        for (int i = 0; i < count; i++) {
+            stems[SOUND_STEM_OPL][i * 2] = stems[SOUND_STEM_OPL][i * 2 + 1] = (int16_t) mix[i];
+            stems[SOUND_STEM_SB][i * 2] = stems[SOUND_STEM_SB][i * 2 + 1] = sb[i];
+            stems[SOUND_STEM_SPEAKER][i * 2] = stems[SOUND_STEM_SPEAKER][i * 2 + 1] = speaker[i];
+            stems[SOUND_STEM_DSS][i * 2] = stems[SOUND_STEM_DSS][i * 2 + 1] = other[i];
+        }
+    }
+#endif
+    for (int i = 0; i < count; i++) {
+        mix[i] = (int16_t) mix[i] + other[i] + (sb ? sb[i] : 0) + (speaker ? speaker[i] : 0);
+    }
+    sound_add(sn76489_samples, mix, stems ? stems[SOUND_STEM_SN76489] : NULL, count);
+    sound_add(midi_samples, mix, stems ? stems[SOUND_STEM_MIDI] : NULL, count);
+
+    for (int i = 0; i < count; i++) {
+        stereo[i][0] = stereo[i][1] = mix[i];
+    }
+#if !PICO_ON_DEVICE
+    if (stems) {
+        int32_t alone[SOUND_BLOCK_SAMPLES][2] = { 0 };
+        cms_samples(alone, count);
+        for (int i = 0; i < count; i++) {
+            stems[SOUND_STEM_CMS][i * 2] = sound_saturate(alone[i][0]);
+            stems[SOUND_STEM_CMS][i * 2 + 1] = sound_saturate(alone[i][1]);
+            stereo[i][0] += alone[i][0];
+            stereo[i][1] += alone[i][1];
+        }
+    } else
+#endif
+    cms_samples(stereo, count);
+
+    for (int i = 0; i < count; i++) {
+        samples[i * 2] = sound_saturate(stereo[i][0]);
+        samples[i * 2 + 1] = sound_saturate(stereo[i][1]);
+    }
+}
+
+void get_sound_samples(const int16_t *other, int16_t *samples, const int count) {
+    sound_mix(other, NULL, NULL, samples, NULL, count);
+}
+
+#if !PICO_ON_DEVICE
+void get_sound_stems(const int16_t *dss, const int16_t *sb, const int16_t *speaker, int16_t *samples,
+                     int16_t *const stems[SOUND_STEMS], const int count) {
+    sound_mix(dss, sb, speaker, samples, stems, count);
+}
+#endif
+#endif
+
+int16_t speaker_sample() {
+    if (!speakerenabled) return 0;
+    static uint32_t speakercurstep = 0;
+    uint32_t speakerfullstep = SOUND_FREQUENCY / i8253_frequency(2);
+    if (speakerfullstep < 2)
+        speakerfullstep = 2;
+    const int16_t speakervalue = speakercurstep < speakerfullstep >> 1 ? 4096 : -4096;
+    speakercurstep = (speakercurstep + 1) % speakerfullstep;
+    return speakervalue;
+}
 
 void get_sound_sample(const int16_t other_sample, int16_t *samples) {
 #if HARDWARE_SOUND
-    const int32_t sample = (speaker_sample() + other_sample + covox_sample + midi_sample());
+    int32_t sample = other_sample;
+    midi_samples(&sample, 1);
     pwm_set_gpio_level(PCM_PIN, (uint16_t) ((int32_t) sample + 0x8000L) >> 4);
 #else
-    OPL_calc_buffer_linear(emu8950_opl, (int32_t *)samples, 1);
-
-    samples[1] = samples[0] += (int32_t)(speaker_sample() + other_sample + covox_sample + sn76489_sample() + midi_sample());
-    cms_samples(samples);
+    get_sound_samples(&other_sample, samples, 1);
 #endif
-
 }
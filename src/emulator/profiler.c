@@ -0,0 +1,154 @@
+#include "emulator.h"
+
+#ifdef EMULATOR_PROFILER
+profiler_counter_t profiler_opcodes[256];
+profiler_counter_t profiler_fpu[8][8];
+profiler_counter_t profiler_ports[2][PROFILER_PORTS];
+profiler_counter_t profiler_memory[2][PROFILER_REGIONS];
+profiler_counter_t profiler_interrupts[256];
+
+static const char *const profiler_region_names[PROFILER_REGIONS] = { "RAM", "VRAM", "EMS", "UMB", "BIOS", "HMA" };
+
+static read86_t profiled_read86;
+static read86w_t profiled_readw86;
+static read86dw_t profiled_readdw86;
+static write86_t profiled_write86;
+static write86w_t profiled_writew86;
+static write86dw_t profiled_writedw86;
+
+static INLINE uint8_t profiler_region(const uint32_t address) {
+    if (address < VIDEORAM_START) return PROFILER_RAM;
+    if (address < VIDEORAM_END) return PROFILER_VRAM;
+    if (address < EMS_END) return PROFILER_EMS;
+    if (address < UMB_END) return PROFILER_UMB;
+    if (address < HMA_START) return PROFILER_BIOS;
+    return PROFILER_HMA;
+}
+
+// Nested dispatches (unaligned or VRAM word accesses split into bytes) are counted on their own as well
+static uint8_t profiler_read86(const uint32_t address) {
+    const uint64_t start = profiler_cycles();
+    const uint8_t value = profiled_read86(address);
+    profiler_count(&profiler_memory[0][profiler_region(address)], start);
+    return value;
+}
+
+static uint16_t profiler_readw86(const uint32_t address) {
+    const uint64_t start = profiler_cycles();
+    const uint16_t value = profiled_readw86(address);
+    profiler_count(&profiler_memory[0][profiler_region(address)], start);
+    return value;
+}
+
+static uint32_t profiler_readdw86(const uint32_t address) {
+    const uint64_t start = profiler_cycles();
+    const uint32_t value = profiled_readdw86(address);
+    profiler_count(&profiler_memory[0][profiler_region(address)], start);
+    return value;
+}
+
+static void profiler_write86(const uint32_t address, const uint8_t value) {
+    const uint64_t start = profiler_cycles();
+    profiled_write86(address, value);
+    profiler_count(&profiler_memory[1][profiler_region(address)], start);
+}
+
+static void profiler_writew86(const uint32_t address, const uint16_t value) {
+    const uint64_t start = profiler_cycles();
+    profiled_writew86(address, value);
+    profiler_count(&profiler_memory[1][profiler_region(address)], start);
+}
+
+static void profiler_writedw86(const uint32_t address, const uint32_t value) {
+    const uint64_t start = profiler_cycles();
+    profiled_writedw86(address, value);
+    profiler_count(&profiler_memory[1][profiler_region(address)], start);
+}
+
+void profiler_attach(void) {
+    if (read86 == profiler_read86) return;
+    profiled_read86 = read86;
+    profiled_readw86 = readw86;
+    profiled_readdw86 = readdw86;
+    profiled_write86 = write86;
+    profiled_writew86 = writew86;
+    profiled_writedw86 = writedw86;
+    read86 = profiler_read86;
+    readw86 = profiler_readw86;
+    readdw86 = profiler_readdw86;
+    write86 = profiler_write86;
+    writew86 = profiler_writew86;
+    writedw86 = profiler_writedw86;
+}
+
+void profiler_reset(void) {
+    memset(profiler_opcodes, 0, sizeof(profiler_opcodes));
+    memset(profiler_fpu, 0, sizeof(profiler_fpu));
+    memset(profiler_ports, 0, sizeof(profiler_ports));
+    memset(profiler_memory, 0, sizeof(profiler_memory));
+    memset(profiler_interrupts, 0, sizeof(profiler_interrupts));
+}
+
+static void profiler_print(const char *name, const profiler_counter_t *counter) {
+    printf("%-12s %12llu %14llu %8llu\r\n", name, (unsigned long long) counter->count,
+           (unsigned long long) counter->cycles,
+           (unsigned long long) (counter->count ? counter->cycles / counter->count : 0));
+}
+
+#define PROFILER_TOP 16
+
+// Prints the opcodes with the most host cycles, then every port, region, FPU group and vector that was hit
+void profiler_dump(void) {
+    char name[16];
+    uint8_t shown[256] = { 0 };
+    uint64_t total = 0;
+
+    for (int i = 0; i < 256; i++) total += profiler_opcodes[i].cycles;
+    printf("[PROFILER] %llu cycles in opcodes\r\n", (unsigned long long) total);
+    printf("%-12s %12s %14s %8s\r\n", "", "count", "cycles", "avg");
+
+    for (int n = 0; n < PROFILER_TOP; n++) {
+        int top = -1;
+        for (int i = 0; i < 256; i++) {
+            if (!shown[i] && profiler_opcodes[i].count &&
+                (top < 0 || profiler_opcodes[i].cycles > profiler_opcodes[top].cycles)) {
+                top = i;
+            }
+        }
+        if (top < 0) break;
+        shown[top] = 1;
+        snprintf(name, sizeof(name), "op %02X", top);
+        profiler_print(name, &profiler_opcodes[top]);
+    }
+
+    for (int escape = 0; escape < 8; escape++) {
+        for (int group = 0; group < 8; group++) {
+            if (!profiler_fpu[escape][group].count) continue;
+            snprintf(name, sizeof(name), "fpu %02X /%d", 0xD8 + escape, group);
+            profiler_print(name, &profiler_fpu[escape][group]);
+        }
+    }
+
+    for (int out = 0; out < 2; out++) {
+        for (int port = 0; port < PROFILER_PORTS; port++) {
+            if (!profiler_ports[out][port].count) continue;
+            snprintf(name, sizeof(name), "%s %03X", out ? "out" : "in", port);
+            profiler_print(name, &profiler_ports[out][port]);
+        }
+    }
+
+    for (int write = 0; write < 2; write++) {
+        for (int region = 0; region < PROFILER_REGIONS; region++) {
+            if (!profiler_memory[write][region].count) continue;
+            snprintf(name, sizeof(name), "%s %s", write ? "wr" : "rd", profiler_region_names[region]);
+            profiler_print(name, &profiler_memory[write][region]);
+        }
+    }
+
+    for (int vector = 0; vector < 256; vector++) {
+        if (!profiler_interrupts[vector].count) continue;
+        snprintf(name, sizeof(name), "int %02X", vector);
+        profiler_print(name, &profiler_interrupts[vector]);
+    }
+}
+#endif
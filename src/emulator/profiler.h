@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+// Hot-path profiler (-DEMULATOR_PROFILER): executions and host cycles per opcode, FPU escape group,
+// I/O port, memory region and interrupt vector. Compiled out entirely unless enabled.
+enum {
+    PROFILER_RAM,
+    PROFILER_VRAM,
+    PROFILER_EMS,
+    PROFILER_UMB,
+    PROFILER_BIOS,
+    PROFILER_HMA,
+    PROFILER_REGIONS
+};
+
+#define PROFILER_PORTS 0x400 // ISA decodes 10 address bits
+
+typedef struct {
+    uint64_t count;
+    uint64_t cycles;
+} profiler_counter_t;
+
+#ifdef EMULATOR_PROFILER
+#if PICO_ON_DEVICE
+#include "hardware/timer.h"
+// No cycle counter on every core, microseconds are used instead
+#define profiler_cycles() ((uint64_t) time_us_32())
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define profiler_cycles() ((uint64_t) __rdtsc())
+#else
+#include <time.h>
+static inline uint64_t profiler_cycles() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+#endif
+
+extern profiler_counter_t profiler_opcodes[256];
+extern profiler_counter_t profiler_fpu[8][8]; // D8-DF by ModR/M reg field
+extern profiler_counter_t profiler_ports[2][PROFILER_PORTS]; // in, out
+extern profiler_counter_t profiler_memory[2][PROFILER_REGIONS]; // reads, writes
+extern profiler_counter_t profiler_interrupts[256];
+
+// Wraps the installed read86/write86 handlers, call after they are set
+void profiler_attach(void);
+void profiler_reset(void);
+void profiler_dump(void);
+
+static inline void profiler_count(profiler_counter_t *counter, const uint64_t start) {
+    counter->count++;
+    counter->cycles += profiler_cycles() - start;
+}
+
+#define profiler_start() profiler_cycles()
+#define profiler_opcode(opcode, modrm_reg, start) do { \
+        profiler_count(&profiler_opcodes[opcode], start); \
+        if (((opcode) & 0xF8) == 0xD8) profiler_count(&profiler_fpu[(opcode) & 7][modrm_reg], start); \
+    } while (0)
+#define profiler_port(out, port, start) profiler_count(&profiler_ports[out][(port) & (PROFILER_PORTS - 1)], start)
+#define profiler_interrupt(intnum, start) profiler_count(&profiler_interrupts[intnum], start)
+#else
+#define profiler_start() 0
+#define profiler_opcode(opcode, modrm_reg, start) ((void) (start))
+#define profiler_port(out, port, start) ((void) (start))
+#define profiler_interrupt(intnum, start) ((void) (start))
+#define profiler_attach() ((void) 0)
+#define profiler_reset() ((void) 0)
+#define profiler_dump() ((void) 0)
+#endif
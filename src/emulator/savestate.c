@@ -0,0 +1,266 @@
+#include "emulator.h"
+#if !PICO_ON_DEVICE
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAVESTATE_MAGIC "286STATE"
+
+typedef enum {
+    SAVESTATE_SAVE,
+    SAVESTATE_CHECK, // loading, chunks are only looked up so a bad state fails before anything is overwritten
+    SAVESTATE_LOAD,
+} savestate_mode_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunks;
+} savestate_header_t;
+
+// `stored` is below `size` for a chunk kept as a page bitmap and its non-zero pages
+typedef struct {
+    char id[4];
+    uint32_t size;
+    uint32_t stored;
+} savestate_chunk_t;
+
+struct savestate_s {
+    savestate_mode_t mode;
+    uint8_t memory; // 0 for snapshots, which keep guest memory page by page
+    uint8_t *buffer; // state being saved
+    size_t capacity;
+    uint32_t chunks;
+    const uint8_t *data; // state being loaded
+    size_t length;
+    uint8_t failed;
+};
+
+static const uint8_t savestate_zero_page[SAVESTATE_PAGE_SIZE];
+
+static INLINE size_t savestate_page_length(const size_t size, const size_t page) {
+    const size_t offset = page * SAVESTATE_PAGE_SIZE;
+    return size - offset < SAVESTATE_PAGE_SIZE ? size - offset : SAVESTATE_PAGE_SIZE;
+}
+
+static void savestate_append(savestate_t *state, const void *data, const size_t size) {
+    if (state->failed) return;
+    if (state->length + size > state->capacity) {
+        size_t capacity = state->capacity ? state->capacity : 64 << 10;
+        while (capacity < state->length + size) capacity *= 2;
+        uint8_t *buffer = realloc(state->buffer, capacity);
+        if (!buffer) {
+            state->failed = 1;
+            return;
+        }
+        state->buffer = buffer;
+        state->capacity = capacity;
+    }
+    memcpy(state->buffer + state->length, data, size);
+    state->length += size;
+}
+
+static void savestate_write(savestate_t *state, const char *id, const uint8_t *data, const size_t size) {
+    const size_t pages = (size + SAVESTATE_PAGE_SIZE - 1) / SAVESTATE_PAGE_SIZE;
+    const size_t bitmap_size = (pages + 7) / 8;
+    uint8_t *bitmap = size >= SAVESTATE_PAGE_SIZE ? calloc(bitmap_size, 1) : NULL;
+    size_t stored = size;
+    if (bitmap) {
+        stored = bitmap_size;
+        for (size_t page = 0; page < pages; page++) {
+            const size_t length = savestate_page_length(size, page);
+            if (memcmp(data + page * SAVESTATE_PAGE_SIZE, savestate_zero_page, length)) {
+                bitmap[page >> 3] |= 1 << (page & 7);
+                stored += length;
+            }
+        }
+        if (stored >= size) {
+            free(bitmap);
+            bitmap = NULL;
+            stored = size;
+        }
+    }
+
+    savestate_chunk_t chunk = { .size = (uint32_t) size, .stored = (uint32_t) stored };
+    memcpy(chunk.id, id, sizeof(chunk.id));
+    savestate_append(state, &chunk, sizeof(chunk));
+    if (!bitmap) {
+        savestate_append(state, data, size);
+    } else {
+        savestate_append(state, bitmap, bitmap_size);
+        for (size_t page = 0; page < pages; page++) {
+            if (!(bitmap[page >> 3] >> (page & 7) & 1)) continue;
+            savestate_append(state, data + page * SAVESTATE_PAGE_SIZE, savestate_page_length(size, page));
+        }
+        free(bitmap);
+    }
+    state->chunks++;
+}
+
+// Copies the header of chunk id into chunk and returns where its payload starts. Payloads have any size, so the
+// headers after the first are not aligned and are only ever read through a copy
+static const uint8_t *savestate_find(const savestate_t *state, const char *id, savestate_chunk_t *chunk) {
+    size_t offset = sizeof(savestate_header_t);
+    while (offset + sizeof(savestate_chunk_t) <= state->length) {
+        memcpy(chunk, state->data + offset, sizeof(savestate_chunk_t));
+        offset += sizeof(savestate_chunk_t);
+        if (chunk->stored > state->length - offset) break;
+        if (!memcmp(chunk->id, id, sizeof(chunk->id))) return state->data + offset;
+        offset += chunk->stored;
+    }
+    return NULL;
+}
+
+// Checks that the pages a bitmap marks as stored are all there
+static uint8_t savestate_valid(const savestate_chunk_t *chunk, const uint8_t *bitmap) {
+    if (chunk->stored >= chunk->size) return chunk->stored == chunk->size;
+    const size_t pages = (chunk->size + SAVESTATE_PAGE_SIZE - 1) / SAVESTATE_PAGE_SIZE;
+    const size_t bitmap_size = (pages + 7) / 8;
+    if (chunk->stored < bitmap_size) return 0;
+    size_t stored = bitmap_size;
+    for (size_t page = 0; page < pages; page++) {
+        if (bitmap[page >> 3] >> (page & 7) & 1) stored += savestate_page_length(chunk->size, page);
+    }
+    return stored == chunk->stored;
+}
+
+static void savestate_read(const savestate_chunk_t *chunk, const uint8_t *source, uint8_t *data) {
+    if (chunk->stored == chunk->size) {
+        memcpy(data, source, chunk->size);
+        return;
+    }
+    const size_t pages = (chunk->size + SAVESTATE_PAGE_SIZE - 1) / SAVESTATE_PAGE_SIZE;
+    const uint8_t *bitmap = source;
+    source += (pages + 7) / 8;
+    for (size_t page = 0; page < pages; page++) {
+        const size_t length = savestate_page_length(chunk->size, page);
+        uint8_t *destination = data + page * SAVESTATE_PAGE_SIZE;
+        if (bitmap[page >> 3] >> (page & 7) & 1) {
+            memcpy(destination, source, length);
+            source += length;
+        } else {
+            memset(destination, 0, length);
+        }
+    }
+}
+
+void savestate_chunk(savestate_t *state, const char *id, void *data, const size_t size) {
+    if (state->failed) return;
+    if (state->mode == SAVESTATE_SAVE) {
+        savestate_write(state, id, data, size);
+        return;
+    }
+    savestate_chunk_t chunk;
+    const uint8_t *payload = savestate_find(state, id, &chunk);
+    if (!payload || chunk.size != size || !savestate_valid(&chunk, payload)) {
+        printf("[STATE] Chunk %.4s is %s\n", id, payload ? "damaged or of another size" : "missing");
+        state->failed = 1;
+        return;
+    }
+    if (state->mode == SAVESTATE_LOAD) {
+        savestate_read(&chunk, payload, data);
+    }
+}
+
+void savestate_memory(savestate_t *state, const char *id, void *data, const size_t size) {
+    if (state->memory) savestate_chunk(state, id, data, size);
+}
+
+uint8_t savestate_loading(const savestate_t *state) {
+    return state->mode == SAVESTATE_LOAD;
+}
+
+static void savestate_machine(savestate_t *state) {
+    cpu_savestate(state);
+    fpu_savestate(state);
+    memory_savestate(state);
+    xms_savestate(state);
+    i8259_savestate(state);
+    i8253_savestate(state);
+    ports_savestate(state);
+    vga_savestate(state);
+    cga_savestate(state);
+    tga_savestate(state);
+    mouse_savestate(state);
+}
+
+uint8_t *savestate_store(size_t *length, const uint8_t memory) {
+    savestate_t state = { .mode = SAVESTATE_SAVE, .memory = memory };
+    savestate_header_t header = { .version = SAVESTATE_VERSION };
+    memcpy(header.magic, SAVESTATE_MAGIC, sizeof(header.magic));
+    savestate_append(&state, &header, sizeof(header));
+    savestate_machine(&state);
+    if (state.failed) {
+        free(state.buffer);
+        return NULL;
+    }
+    ((savestate_header_t *) state.buffer)->chunks = state.chunks;
+    *length = state.length;
+    return state.buffer;
+}
+
+uint8_t savestate_restore(const uint8_t *data, const size_t length, const uint8_t memory) {
+    // the state may sit anywhere in a file buffer
+    savestate_header_t header = { 0 };
+    if (length >= sizeof(header)) memcpy(&header, data, sizeof(header));
+    if (length < sizeof(header) || memcmp(header.magic, SAVESTATE_MAGIC, sizeof(header.magic))) {
+        printf("[STATE] Not a machine state\n");
+        return 0;
+    }
+    if (header.version != SAVESTATE_VERSION) {
+        printf("[STATE] State is version %u, this build reads version %u\n", header.version, SAVESTATE_VERSION);
+        return 0;
+    }
+
+    savestate_t state = { .mode = SAVESTATE_CHECK, .memory = memory, .data = data, .length = length };
+    savestate_machine(&state);
+    if (state.failed) return 0;
+    state.mode = SAVESTATE_LOAD;
+    savestate_machine(&state);
+    memory_map_rebuild();
+    decode_cache_flush();
+    videoram_mark_all_dirty();
+    if (memory) snapshot_reset();
+    return 1;
+}
+
+uint8_t savestate_save(const char *path) {
+    // The state refers to what the guest has written to its disks so far
+    disk_flush();
+
+    size_t length;
+    uint8_t *data = savestate_store(&length, 1);
+    FILE *file = data ? fopen(path, "wb") : NULL;
+    uint8_t written = file && fwrite(data, 1, length, file) == length;
+    if (file && fclose(file)) written = 0;
+    free(data);
+    if (!written) {
+        printf("[STATE] Cannot write %s\n", path);
+        if (file) remove(path);
+        return 0;
+    }
+    return 1;
+}
+
+uint8_t savestate_load(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("[STATE] Cannot open %s\n", path);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    const long length = ftell(file);
+    rewind(file);
+    uint8_t *data = length > 0 ? malloc(length) : NULL;
+    if (!data || fread(data, 1, length, file) != (size_t) length) {
+        printf("[STATE] Cannot read %s\n", path);
+        fclose(file);
+        free(data);
+        return 0;
+    }
+    fclose(file);
+
+    const uint8_t loaded = savestate_restore(data, length, 1);
+    free(data);
+    return loaded;
+}
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "scheduler.h"
+
+// Machine state of the host builds: a "286STATE" header followed by chunks, one or more per device.
+// Chunks of a page or more are stored as a bitmap of their non-zero 4 KB pages followed by those pages.
+// A state only loads into the build and version that wrote it, every chunk must be present with the same size.
+// The disk images are not part of it, the same images have to be attached when it is loaded.
+#define SAVESTATE_VERSION 2
+#define SAVESTATE_PAGE_SIZE 4096
+// Saved with CTRL + ALT + F9 and loaded with CTRL + ALT + F10 in the windowed front-ends, next to the disk images
+#define SAVESTATE_HOTKEY_FILE "../286.state"
+
+typedef struct savestate_s savestate_t;
+
+// 1 on success, the machine is left untouched when a state cannot be loaded
+uint8_t savestate_save(const char *path);
+uint8_t savestate_load(const char *path);
+
+// In-memory states, malloc'ed. Without `memory` they leave out guest memory, which snapshots keep page by page
+uint8_t *savestate_store(size_t *length, uint8_t memory);
+uint8_t savestate_restore(const uint8_t *data, size_t length, uint8_t memory);
+
+// The same call stores `size` bytes at `data` when saving and restores them when loading, `id` is 4 characters
+void savestate_chunk(savestate_t *state, const char *id, void *data, size_t size);
+
+// Guest memory arrays, tracked by the snapshots at page granularity
+void savestate_memory(savestate_t *state, const char *id, void *data, size_t size);
+
+// True in the pass that writes the loaded chunks back, derived state is rebuilt after it
+uint8_t savestate_loading(const savestate_t *state);
+
+// Event times are kept relative to the current tick, so a state resumes at any point of virtual time
+void scheduler_savestate(savestate_t *state, const char *id, scheduler_event_t *event, scheduler_callback_t callback);
+
+// Device hooks, called in this order
+void cpu_savestate(savestate_t *state);
+void fpu_savestate(savestate_t *state);
+void memory_savestate(savestate_t *state);
+void xms_savestate(savestate_t *state);
+void i8259_savestate(savestate_t *state);
+void i8253_savestate(savestate_t *state);
+void ports_savestate(savestate_t *state);
+void vga_savestate(savestate_t *state);
+void cga_savestate(savestate_t *state);
+void tga_savestate(savestate_t *state);
+void mouse_savestate(savestate_t *state);
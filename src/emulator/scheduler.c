@@ -0,0 +1,112 @@
+#include "emulator.h"
+
+uint64_t scheduler_now = 0;
+uint64_t scheduler_deadline = UINT64_MAX;
+
+static scheduler_event_t *scheduler_events[SCHEDULER_MAX_EVENTS];
+static uint8_t scheduler_events_count = 0;
+
+static INLINE void scheduler_update_deadline() {
+    uint64_t deadline = UINT64_MAX;
+    for (int i = 0; i < scheduler_events_count; i++) {
+        const scheduler_event_t *event = scheduler_events[i];
+        if (event->active && event->deadline < deadline) {
+            deadline = event->deadline;
+        }
+    }
+    scheduler_deadline = deadline;
+}
+
+static INLINE void scheduler_register(scheduler_event_t *event) {
+    if (event->registered) return;
+    if (scheduler_events_count == SCHEDULER_MAX_EVENTS) {
+        printf("[SCHEDULER] Too many events\r\n");
+        return;
+    }
+    scheduler_events[scheduler_events_count++] = event;
+    event->registered = 1;
+}
+
+static INLINE uint64_t scheduler_next_deadline(const scheduler_event_t *event) {
+    return event->start + (event->periods + 1ull) * event->period_ticks / event->period_divisor;
+}
+
+// Periodic event, the first one fires a full period from now
+void scheduler_start(scheduler_event_t *event, const scheduler_callback_t callback,
+                     const uint64_t period_ticks, const uint32_t period_divisor) {
+    scheduler_register(event);
+    event->callback = callback;
+    event->start = scheduler_now;
+    event->periods = 0;
+    event->period_ticks = period_ticks ? period_ticks : 1;
+    event->period_divisor = period_divisor ? period_divisor : 1;
+    event->deadline = scheduler_next_deadline(event);
+    event->oneshot = 0;
+    event->active = 1;
+    scheduler_update_deadline();
+}
+
+void scheduler_oneshot(scheduler_event_t *event, const scheduler_callback_t callback, const uint64_t delay_ticks) {
+    scheduler_start(event, callback, delay_ticks, 1);
+    event->oneshot = 1;
+}
+
+void scheduler_stop(scheduler_event_t *event) {
+    event->active = 0;
+    scheduler_update_deadline();
+}
+
+// Fires every event that is due, periods missed during a long instruction are caught up one by one
+void __not_in_flash() scheduler_run(void) {
+    for (int i = 0; i < scheduler_events_count; i++) {
+        scheduler_event_t *event = scheduler_events[i];
+        while (event->active && event->deadline <= scheduler_now) {
+            if (event->oneshot) {
+                event->active = 0;
+            } else if (++event->periods == event->period_divisor) {
+                event->start += event->period_ticks;
+                event->periods = 0;
+            }
+            event->deadline = scheduler_next_deadline(event);
+            event->callback();
+        }
+    }
+    scheduler_update_deadline();
+}
+
+#if !PICO_ON_DEVICE
+void scheduler_savestate(savestate_t *state, const char *id, scheduler_event_t *event,
+                         const scheduler_callback_t callback) {
+    struct {
+        uint64_t since_start;
+        uint64_t until_deadline;
+        uint64_t period_ticks;
+        uint32_t period_divisor;
+        uint32_t periods;
+        uint8_t active;
+        uint8_t oneshot;
+    } saved = {
+        scheduler_now - event->start, event->deadline - scheduler_now, event->period_ticks,
+        event->period_divisor, event->periods, event->active, event->oneshot,
+    };
+    savestate_chunk(state, id, &saved, sizeof(saved));
+    if (!savestate_loading(state)) return;
+
+    if (saved.active) {
+        scheduler_register(event);
+    }
+    event->callback = callback;
+    event->start = scheduler_now - saved.since_start;
+    event->deadline = scheduler_now + saved.until_deadline;
+    event->period_ticks = saved.period_ticks;
+    event->period_divisor = saved.period_divisor;
+    event->periods = saved.periods;
+    event->oneshot = saved.oneshot;
+    event->active = saved.active;
+    scheduler_update_deadline();
+}
+#endif
+
+uint64_t scheduler_elapsed_us(void) {
+    return scheduler_now / SCHEDULER_CLOCK * 1000000ull + scheduler_now % SCHEDULER_CLOCK * 1000000ull / SCHEDULER_CLOCK;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Virtual time of the host builds. exec86() advances it for every instruction and port access,
+// device events fire once their deadline has passed, so timing follows emulated work instead of the wall clock.
+// One tick is a period of the 14.318 MHz PC base oscillator, a PIT input tick is 12 of them.
+#define SCHEDULER_CLOCK (PIT_FREQUENCY * 12ull)
+#define SCHEDULER_MAX_EVENTS 16
+// ISA bus I/O cycle, ~1 us
+#define SCHEDULER_IO_TICKS 14
+
+typedef void (*scheduler_callback_t)(void);
+
+typedef struct {
+    scheduler_callback_t callback;
+    uint64_t start; // time the current run of periods started at
+    uint64_t deadline;
+    uint64_t period_ticks; // period is period_ticks / period_divisor, kept as a fraction so it never drifts
+    uint32_t period_divisor;
+    uint32_t periods; // periods fired since start
+    uint8_t active;
+    uint8_t oneshot;
+    uint8_t registered;
+} scheduler_event_t;
+
+extern uint64_t scheduler_now;
+extern uint64_t scheduler_deadline;
+
+void scheduler_start(scheduler_event_t *event, scheduler_callback_t callback, uint64_t period_ticks, uint32_t period_divisor);
+
+void scheduler_oneshot(scheduler_event_t *event, scheduler_callback_t callback, uint64_t delay_ticks);
+
+void scheduler_stop(scheduler_event_t *event);
+
+void scheduler_run(void);
+
+uint64_t scheduler_elapsed_us(void);
+
+#define scheduler_start_hz(event, callback, frequency) scheduler_start(event, callback, SCHEDULER_CLOCK, frequency)
+
+static inline void scheduler_advance(const uint32_t ticks) {
+    scheduler_now += ticks;
+    if (__builtin_expect(scheduler_now >= scheduler_deadline, 0)) {
+        scheduler_run();
+    }
+}
@@ -0,0 +1,267 @@
+#include "emulator.h"
+#if !PICO_ON_DEVICE
+#include <stdio.h>
+#include <stdlib.h>
+
+extern uint8_t EMS[EMS_MEMORY_SIZE];
+extern uint8_t XMS[XMS_MEMORY_SIZE];
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    uint32_t first; // index of its first page among all snapshot pages
+} snapshot_region_t;
+
+// Pages never straddle two regions, the last page of HMA is partial
+#define SNAPSHOT_REGION_PAGES(size) (((size) + SNAPSHOT_PAGE_SIZE - 1) / SNAPSHOT_PAGE_SIZE)
+#define SNAPSHOT_FIRST_UMB SNAPSHOT_REGION_PAGES(sizeof(RAM))
+#define SNAPSHOT_FIRST_HMA (SNAPSHOT_FIRST_UMB + SNAPSHOT_REGION_PAGES(sizeof(UMB)))
+#define SNAPSHOT_FIRST_VIDEORAM (SNAPSHOT_FIRST_HMA + SNAPSHOT_REGION_PAGES(sizeof(HMA)))
+#define SNAPSHOT_FIRST_EMS (SNAPSHOT_FIRST_VIDEORAM + SNAPSHOT_REGION_PAGES(sizeof(VIDEORAM)))
+#define SNAPSHOT_FIRST_XMS (SNAPSHOT_FIRST_EMS + SNAPSHOT_REGION_PAGES(sizeof(EMS)))
+#define SNAPSHOT_PAGES (SNAPSHOT_FIRST_XMS + SNAPSHOT_REGION_PAGES(sizeof(XMS)))
+// VIDEORAM pages come from videoram_snapshot_dirty, one bit each
+#define SNAPSHOT_VIDEORAM_PAGES (sizeof(VIDEORAM) >> (VIDEORAM_SNAPSHOT_SHIFT + 2))
+
+static const snapshot_region_t snapshot_regions[] = {
+    { RAM, sizeof(RAM), 0 },
+    { UMB, sizeof(UMB), SNAPSHOT_FIRST_UMB },
+    { HMA, sizeof(HMA), SNAPSHOT_FIRST_HMA },
+    { (uint8_t *) VIDEORAM, sizeof(VIDEORAM), SNAPSHOT_FIRST_VIDEORAM },
+    { EMS, sizeof(EMS), SNAPSHOT_FIRST_EMS },
+    { XMS, sizeof(XMS), SNAPSHOT_FIRST_XMS },
+};
+#define SNAPSHOT_REGIONS (sizeof(snapshot_regions) / sizeof(snapshot_region_t))
+
+typedef struct {
+    uint8_t *device; // save state without guest memory
+    size_t device_length;
+    uint32_t *pages; // pages written since the previous snapshot, ascending
+    uint8_t *data; // their contents at this snapshot
+    uint32_t count;
+} snapshot_t;
+
+uint64_t videoram_snapshot_dirty = 0;
+
+static uint64_t snapshot_dirty[(SNAPSHOT_PAGES + 63) / 64];
+static uint8_t *snapshot_base; // guest memory at the oldest snapshot
+static snapshot_t *snapshots; // one more than the slots, the new snapshot goes in before the oldest is dropped
+static uint32_t snapshot_slots = 0;
+static uint32_t snapshot_interval = 1;
+static uint32_t snapshot_oldest = 0;
+static uint32_t snapshot_taken = 0;
+static uint32_t snapshot_frames = 0;
+
+static INLINE snapshot_t *snapshot_at(const uint32_t index) {
+    return &snapshots[(snapshot_oldest + index) % (snapshot_slots + 1)];
+}
+
+static INLINE size_t snapshot_page_length(const snapshot_region_t *region, const uint32_t page) {
+    const size_t offset = (size_t) page * SNAPSHOT_PAGE_SIZE;
+    return region->size - offset < SNAPSHOT_PAGE_SIZE ? region->size - offset : SNAPSHOT_PAGE_SIZE;
+}
+
+static const snapshot_region_t *snapshot_region(const uint32_t page) {
+    const snapshot_region_t *region = snapshot_regions;
+    while (region + 1 < snapshot_regions + SNAPSHOT_REGIONS && page >= region[1].first) region++;
+    return region;
+}
+
+static void snapshot_free(snapshot_t *snapshot) {
+    free(snapshot->device);
+    free(snapshot->pages);
+    free(snapshot->data);
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+void snapshot_mark(const void *host, const size_t length) {
+    if (!snapshot_slots || !length) return;
+    const uint8_t *pointer = host;
+    for (size_t i = 0; i < SNAPSHOT_REGIONS; i++) {
+        const snapshot_region_t *region = &snapshot_regions[i];
+        if (pointer < region->data || pointer >= region->data + region->size) continue;
+        const size_t offset = pointer - region->data;
+        const size_t end = offset + length < region->size ? offset + length : region->size;
+        for (size_t page = offset / SNAPSHOT_PAGE_SIZE; page * SNAPSHOT_PAGE_SIZE < end; page++) {
+            const uint32_t index = region->first + (uint32_t) page;
+            snapshot_dirty[index >> 6] |= 1ull << (index & 63);
+        }
+        return;
+    }
+}
+
+static void snapshot_collect_videoram() {
+    for (uint32_t page = 0; page < SNAPSHOT_VIDEORAM_PAGES; page++) {
+        if (!(videoram_snapshot_dirty >> page & 1)) continue;
+        const uint32_t index = SNAPSHOT_FIRST_VIDEORAM + page;
+        snapshot_dirty[index >> 6] |= 1ull << (index & 63);
+    }
+    videoram_snapshot_dirty = 0;
+}
+
+static INLINE uint8_t snapshot_is_dirty(const uint32_t page) {
+    return snapshot_dirty[page >> 6] >> (page & 63) & 1;
+}
+
+// Starts tracking writes for the next delta
+static void snapshot_track() {
+    memset(snapshot_dirty, 0, sizeof(snapshot_dirty));
+    videoram_snapshot_dirty = 0;
+    memory_write_protect(1);
+}
+
+static void snapshot_copy_base() {
+    for (size_t i = 0; i < SNAPSHOT_REGIONS; i++) {
+        const snapshot_region_t *region = &snapshot_regions[i];
+        memcpy(&snapshot_base[(size_t) region->first * SNAPSHOT_PAGE_SIZE], region->data, region->size);
+    }
+}
+
+// Folds the delta of the second oldest snapshot into the base, which then holds its memory
+static void snapshot_drop_oldest() {
+    snapshot_t *next = snapshot_at(1);
+    for (uint32_t i = 0; i < next->count; i++) {
+        memcpy(&snapshot_base[(size_t) next->pages[i] * SNAPSHOT_PAGE_SIZE], &next->data[(size_t) i * SNAPSHOT_PAGE_SIZE],
+               SNAPSHOT_PAGE_SIZE);
+    }
+    free(next->pages);
+    free(next->data);
+    next->pages = NULL;
+    next->data = NULL;
+    next->count = 0;
+    snapshot_free(snapshot_at(0));
+    snapshot_oldest = (snapshot_oldest + 1) % (snapshot_slots + 1);
+    snapshot_taken--;
+}
+
+static uint8_t snapshot_take() {
+    snapshot_t snapshot = { 0 };
+    snapshot.device = savestate_store(&snapshot.device_length, 0);
+    if (!snapshot.device) return 0;
+
+    if (!snapshot_taken) {
+        if (!snapshot_base) snapshot_base = malloc((size_t) SNAPSHOT_PAGES * SNAPSHOT_PAGE_SIZE);
+        if (!snapshot_base) {
+            free(snapshot.device);
+            return 0;
+        }
+        snapshot_copy_base();
+    } else {
+        snapshot_collect_videoram();
+        uint32_t count = 0;
+        for (uint32_t page = 0; page < SNAPSHOT_PAGES; page++) {
+            count += snapshot_is_dirty(page);
+        }
+        snapshot.pages = malloc(count * sizeof(uint32_t) + 1);
+        snapshot.data = malloc((size_t) count * SNAPSHOT_PAGE_SIZE + 1);
+        if (!snapshot.pages || !snapshot.data) {
+            snapshot_free(&snapshot);
+            return 0;
+        }
+        for (uint32_t page = 0; page < SNAPSHOT_PAGES; page++) {
+            if (!snapshot_is_dirty(page)) continue;
+            const snapshot_region_t *region = snapshot_region(page);
+            const uint32_t offset = page - region->first;
+            uint8_t *data = &snapshot.data[(size_t) snapshot.count * SNAPSHOT_PAGE_SIZE];
+            const size_t length = snapshot_page_length(region, offset);
+            memcpy(data, &region->data[(size_t) offset * SNAPSHOT_PAGE_SIZE], length);
+            memset(data + length, 0, SNAPSHOT_PAGE_SIZE - length);
+            snapshot.pages[snapshot.count++] = page;
+        }
+    }
+
+    *snapshot_at(snapshot_taken++) = snapshot;
+    if (snapshot_taken > snapshot_slots) snapshot_drop_oldest();
+    snapshot_track();
+    return 1;
+}
+
+void snapshot_configure(const uint32_t slots, const uint32_t interval) {
+    snapshot_reset();
+    free(snapshots);
+    free(snapshot_base);
+    snapshots = NULL;
+    snapshot_base = NULL;
+    snapshot_slots = 0;
+    snapshot_interval = interval ? interval : 1;
+    if (slots) {
+        snapshots = calloc(slots + 1, sizeof(snapshot_t));
+        if (!snapshots) {
+            printf("[SNAPSHOT] Cannot allocate %u slots\n", slots);
+            return;
+        }
+        snapshot_slots = slots;
+    }
+}
+
+void snapshot_reset() {
+    for (uint32_t i = 0; i < snapshot_taken; i++) {
+        snapshot_free(snapshot_at(i));
+    }
+    snapshot_taken = 0;
+    snapshot_oldest = 0;
+    snapshot_frames = 0;
+    memory_write_protect(0);
+}
+
+void snapshot_frame() {
+    if (!snapshot_slots) return;
+    if (snapshot_taken && ++snapshot_frames < snapshot_interval) return;
+    snapshot_frames = 0;
+    if (!snapshot_take()) {
+        printf("[SNAPSHOT] Out of memory, snapshots are off\n");
+        snapshot_configure(0, snapshot_interval);
+    }
+}
+
+uint32_t snapshot_count() {
+    return snapshot_taken;
+}
+
+// Contents of `page` at snapshot `target`: its latest delta up to there, or the base
+static const uint8_t *snapshot_page_at(const uint32_t target, const uint32_t page) {
+    for (uint32_t index = target; index > 0; index--) {
+        const snapshot_t *snapshot = snapshot_at(index);
+        uint32_t low = 0, high = snapshot->count;
+        while (low < high) {
+            const uint32_t middle = (low + high) / 2;
+            if (snapshot->pages[middle] < page) low = middle + 1; else high = middle;
+        }
+        if (low < snapshot->count && snapshot->pages[low] == page) {
+            return &snapshot->data[(size_t) low * SNAPSHOT_PAGE_SIZE];
+        }
+    }
+    return &snapshot_base[(size_t) page * SNAPSHOT_PAGE_SIZE];
+}
+
+uint8_t snapshot_rewind(const uint32_t steps) {
+    if (steps >= snapshot_taken) return 0;
+    const uint32_t target = snapshot_taken - 1 - steps;
+    const snapshot_t *snapshot = snapshot_at(target);
+    if (!savestate_restore(snapshot->device, snapshot->device_length, 0)) return 0;
+
+    // Memory differs from the target only in pages written after it
+    snapshot_collect_videoram();
+    for (uint32_t index = target + 1; index < snapshot_taken; index++) {
+        const snapshot_t *newer = snapshot_at(index);
+        for (uint32_t i = 0; i < newer->count; i++) {
+            snapshot_dirty[newer->pages[i] >> 6] |= 1ull << (newer->pages[i] & 63);
+        }
+    }
+    for (uint32_t page = 0; page < SNAPSHOT_PAGES; page++) {
+        if (!snapshot_is_dirty(page)) continue;
+        const snapshot_region_t *region = snapshot_region(page);
+        const uint32_t offset = page - region->first;
+        memcpy(&region->data[(size_t) offset * SNAPSHOT_PAGE_SIZE], snapshot_page_at(target, page),
+               snapshot_page_length(region, offset));
+    }
+
+    while (snapshot_taken > target + 1) {
+        snapshot_free(snapshot_at(--snapshot_taken));
+    }
+    snapshot_frames = 0;
+    decode_cache_flush();
+    snapshot_track();
+    return 1;
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Rewind snapshots of the host builds. Every `interval` frames the machine is snapshotted into a ring of slots:
+// the device state as an in-memory save state without guest memory, and a delta of the 4 KB pages of
+// RAM, UMB, HMA, VIDEORAM, EMS and XMS written since the previous snapshot. The oldest snapshot keeps a full copy
+// of guest memory, its successor's delta is folded into it when the ring wraps.
+// Writes are found by write-protecting the page table after each snapshot, the first write to a page maps it back.
+// Disk images are not part of a snapshot, as with save states.
+#define SNAPSHOT_PAGE_SIZE 4096
+// The windowed front-ends keep 64 snapshots half a second apart, CTRL + ALT + F8 steps back through them
+#define SNAPSHOT_HOTKEY_SLOTS 64
+#define SNAPSHOT_HOTKEY_INTERVAL 30
+
+// 0 slots turns snapshots off and drops the ones taken
+void snapshot_configure(uint32_t slots, uint32_t interval);
+
+// Called once per emulated frame by the front-ends, between exec86() calls
+void snapshot_frame(void);
+
+// Snapshots that can be rewound to, the latest is 0
+uint32_t snapshot_count(void);
+
+// Restores the snapshot `steps` before the latest one and drops the newer ones, 1 on success
+uint8_t snapshot_rewind(uint32_t steps);
+
+// Drops all snapshots, the next frame takes a new full copy. For wholesale changes such as a loaded state
+void snapshot_reset(void);
+
+// Marks `length` bytes at `host`, inside one of the guest memory arrays, as written
+void snapshot_mark(const void *host, size_t length);
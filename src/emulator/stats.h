@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Execution counters for the headless benchmark build (-DEMULATOR_STATS), compiled out everywhere else
+enum {
+    STATS_READ8,
+    STATS_READ16,
+    STATS_READ32,
+    STATS_WRITE8,
+    STATS_WRITE16,
+    STATS_WRITE32,
+    STATS_MEMORY_HANDLERS
+};
+
+// Second index of stats_memory: access served by the page table or by the range checks behind it
+enum {
+    STATS_PAGE,
+    STATS_SLOW
+};
+
+#ifdef EMULATOR_STATS
+extern uint64_t stats_opcodes[256];
+extern uint64_t stats_memory[STATS_MEMORY_HANDLERS][2];
+extern uint64_t stats_decode_cache[2]; // hits, misses
+extern uint64_t stats_disk_cache[2]; // hits, misses
+
+#define stats_opcode(opcode) (stats_opcodes[opcode]++)
+#define stats_memory_hit(handler, path) (stats_memory[handler][path]++)
+#define stats_decode_cache_hit(hit) (stats_decode_cache[(hit) ? 0 : 1]++)
+#define stats_disk_cache_hit(hit) (stats_disk_cache[(hit) ? 0 : 1]++)
+#else
+#define stats_opcode(opcode) ((void) 0)
+#define stats_memory_hit(handler, path) ((void) 0)
+#define stats_decode_cache_hit(hit) ((void) 0)
+#define stats_disk_cache_hit(hit) ((void) 0)
+#endif
@@ -0,0 +1,144 @@
+#include "emulator.h"
+
+// Cycle counts from the Intel 8086 and 80286 programmer's references.
+// 8088 counts include the extra 4 cycles of every word transferred over its 8-bit bus.
+const cpu_timing_t timing_8088 = {
+    .base = {
+        /* 00 */ 3, 3, 3, 3, 4, 4, 14, 12, 3, 3, 3, 3, 4, 4, 14, 12,
+        /* 10 */ 3, 3, 3, 3, 4, 4, 14, 12, 3, 3, 3, 3, 4, 4, 14, 12,
+        /* 20 */ 3, 3, 3, 3, 4, 4, 2, 4, 3, 3, 3, 3, 4, 4, 2, 4,
+        /* 30 */ 3, 3, 3, 3, 4, 4, 2, 8, 3, 3, 3, 3, 4, 4, 2, 8,
+        /* 40 */ 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+        /* 50 */ 15, 15, 15, 15, 15, 15, 15, 15, 12, 12, 12, 12, 12, 12, 12, 12,
+        /* 60 */ 68, 83, 43, 2, 2, 2, 2, 2, 14, 25, 14, 25, 14, 18, 14, 18,
+        /* 70 */ 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        /* 80 */ 4, 4, 4, 4, 3, 3, 4, 4, 2, 2, 2, 2, 2, 2, 2, 12,
+        /* 90 */ 3, 3, 3, 3, 3, 3, 3, 3, 2, 5, 36, 4, 14, 12, 4, 4,
+        /* A0 */ 10, 14, 10, 14, 18, 26, 22, 30, 4, 4, 11, 15, 12, 16, 15, 19,
+        /* B0 */ 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        /* C0 */ 8, 8, 24, 20, 24, 24, 4, 4, 15, 8, 33, 34, 72, 71, 4, 44,
+        /* D0 */ 2, 2, 8, 8, 83, 60, 3, 11, 2, 2, 2, 2, 2, 2, 2, 2,
+        /* E0 */ 5, 6, 5, 6, 10, 14, 10, 14, 23, 15, 15, 15, 8, 12, 8, 12,
+        /* F0 */ 2, 2, 2, 2, 2, 2, 5, 5, 2, 2, 2, 2, 2, 2, 3, 2,
+    },
+    .memory = {
+        /* 00 */ 13, 21, 6, 10, 0, 0, 0, 0, 13, 21, 6, 10, 0, 0, 0, 0,
+        /* 10 */ 13, 21, 6, 10, 0, 0, 0, 0, 13, 21, 6, 10, 0, 0, 0, 0,
+        /* 20 */ 13, 21, 6, 10, 0, 0, 0, 0, 13, 21, 6, 10, 0, 0, 0, 0,
+        /* 30 */ 13, 21, 6, 10, 0, 0, 0, 0, 6, 10, 6, 10, 0, 0, 0, 0,
+        [0x69] = 6, [0x6B] = 6,
+        [0x80] = 13, 21, 13, 21, 6, 10, 13, 21, 7, 11, 6, 10, 11, 0, 10, 13,
+        [0xC0] = 13, [0xC1] = 21, [0xC6] = 6, [0xC7] = 10,
+        [0xD0] = 13, 21, 12, 20, 0, 0, 0, 0, 4, 4, 4, 4, 4, 4, 4, 4,
+        [0xF6] = 6, [0xF7] = 10, [0xFE] = 12, [0xFF] = 12,
+    },
+    .ea = {
+        { 7, 8, 8, 7, 5, 5, 6, 5 },
+        { 11, 12, 12, 11, 9, 9, 9, 9 },
+        { 11, 12, 12, 11, 9, 9, 9, 9 },
+    },
+    .group = {
+        { 5, 5, 3, 3, 77, 90, 90, 112 },
+        { 5, 5, 3, 3, 118, 128, 162, 184 },
+        { 3, 3, 3, 3, 3, 3, 3, 3 },
+        { 2, 2, 20, 41, 11, 20, 15, 15 },
+    },
+    .rep = { 0, 0, 0, 0, 17, 25, 22, 30, 0, 0, 10, 14, 13, 17, 15, 19 },
+    .shift_bit = 4,
+    .prefix = 2,
+    .branch_taken = 12,
+    .interrupt = 61,
+};
+
+// 286 effective addresses are free except base + index + displacement
+const cpu_timing_t timing_286 = {
+    .base = {
+        /* 00 */ 2, 2, 2, 2, 3, 3, 3, 5, 2, 2, 2, 2, 3, 3, 3, 10,
+        /* 10 */ 2, 2, 2, 2, 3, 3, 3, 5, 2, 2, 2, 2, 3, 3, 3, 5,
+        /* 20 */ 2, 2, 2, 2, 3, 3, 2, 3, 2, 2, 2, 2, 3, 3, 2, 3,
+        /* 30 */ 2, 2, 2, 2, 3, 3, 2, 3, 2, 2, 2, 2, 3, 3, 2, 3,
+        /* 40 */ 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+        /* 50 */ 3, 3, 3, 3, 3, 3, 3, 3, 5, 5, 5, 5, 5, 5, 5, 5,
+        /* 60 */ 17, 19, 13, 10, 2, 2, 2, 2, 3, 21, 3, 21, 5, 5, 5, 5,
+        /* 70 */ 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+        /* 80 */ 3, 3, 3, 3, 2, 2, 3, 3, 2, 2, 2, 2, 2, 3, 2, 5,
+        /* 90 */ 3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 13, 3, 3, 5, 2, 2,
+        /* A0 */ 5, 5, 3, 3, 5, 5, 8, 8, 3, 3, 3, 3, 5, 5, 7, 7,
+        /* B0 */ 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+        /* C0 */ 5, 5, 11, 11, 7, 7, 2, 2, 11, 5, 15, 15, 23, 23, 3, 17,
+        /* D0 */ 2, 2, 5, 5, 16, 14, 2, 5, 2, 2, 2, 2, 2, 2, 2, 2,
+        /* E0 */ 4, 4, 4, 4, 5, 5, 3, 3, 9, 9, 11, 9, 5, 5, 3, 3,
+        /* F0 */ 2, 2, 2, 2, 2, 2, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,
+    },
+    .memory = {
+        /* 00 */ 5, 5, 5, 5, 0, 0, 0, 0, 5, 5, 5, 5, 0, 0, 0, 0,
+        /* 10 */ 5, 5, 5, 5, 0, 0, 0, 0, 5, 5, 5, 5, 0, 0, 0, 0,
+        /* 20 */ 5, 5, 5, 5, 0, 0, 0, 0, 5, 5, 5, 5, 0, 0, 0, 0,
+        /* 30 */ 5, 5, 5, 5, 0, 0, 0, 0, 4, 4, 4, 4, 0, 0, 0, 0,
+        [0x63] = 1, [0x69] = 3, [0x6B] = 3,
+        [0x80] = 4, 4, 4, 4, 4, 4, 2, 2, 1, 1, 3, 3, 1, 0, 3, 0,
+        [0xC0] = 3, [0xC1] = 3, [0xC6] = 1, [0xC7] = 1,
+        [0xD0] = 5, 5, 3, 3,
+        [0xF6] = 3, [0xF7] = 3, [0xFE] = 5, [0xFF] = 4,
+    },
+    .ea = {
+        { 0, 0, 0, 0, 0, 0, 0, 0 },
+        { 1, 1, 1, 1, 0, 0, 0, 0 },
+        { 1, 1, 1, 1, 0, 0, 0, 0 },
+    },
+    .group = {
+        { 3, 3, 2, 2, 13, 13, 14, 17 },
+        { 3, 3, 2, 2, 21, 21, 22, 25 },
+        { 2, 2, 2, 2, 2, 2, 2, 2 },
+        { 2, 2, 7, 12, 7, 7, 1, 1 },
+    },
+    .rep = { 0, 0, 0, 0, 4, 4, 9, 9, 0, 0, 3, 3, 4, 4, 8, 8 },
+    .shift_bit = 1,
+    .prefix = 0,
+    .branch_taken = 6,
+    .interrupt = 26,
+};
+
+const uint8_t timing_modrm[32] = {
+    /* 00 */ 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
+    /* 40 */ 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0A, 0x00, 0x00,
+    /* 80 */ 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* C0 */ 0xF3, 0x00, 0x0F, 0xFF, 0x00, 0x00, 0xC0, 0xC0,
+};
+
+static const uint32_t cpu_clocks_hz[CPU_CLOCKS] = {
+    4772727, 8000000, 12000000, 12000000,
+};
+
+static const char *const cpu_clock_names[CPU_CLOCKS] = {
+    "8088 4.77 MHz", "286 8 MHz", "286 12 MHz", "286 unlimited",
+};
+
+cpu_clock_t cpu_clock = CPU_CLOCK_UNLIMITED;
+const cpu_timing_t *cpu_timing = &timing_286;
+uint32_t cpu_cycle_ticks = (uint32_t) ((SCHEDULER_CLOCK << 16) / 12000000);
+uint32_t cpu_cycles = 0;
+uint64_t cpu_cycles_total = 0;
+
+// The unlimited setting starts from the 12 MHz scale until cpu_clock_follow() has measured the host
+void cpu_set_clock(const cpu_clock_t clock) {
+    cpu_clock = clock < CPU_CLOCKS ? clock : CPU_CLOCK_UNLIMITED;
+    cpu_timing = cpu_clock == CPU_CLOCK_4_77MHZ ? &timing_8088 : &timing_286;
+    cpu_cycle_ticks = (uint32_t) ((SCHEDULER_CLOCK << 16) / cpu_clocks_hz[cpu_clock]);
+}
+
+uint32_t cpu_clock_hz(void) {
+    return (uint32_t) ((SCHEDULER_CLOCK << 16) / cpu_cycle_ticks);
+}
+
+const char *cpu_clock_name(const cpu_clock_t clock) {
+    return clock < CPU_CLOCKS ? cpu_clock_names[clock] : "unknown";
+}
+
+void cpu_clock_follow(const uint64_t host_us, const uint64_t cycles) {
+    if (cpu_clock != CPU_CLOCK_UNLIMITED || !host_us || !cycles) return;
+    uint64_t ticks = (host_us * SCHEDULER_CLOCK << 16) / 1000000ull / cycles;
+    // Settle over a few slices so a single slow one does not stall the guest
+    ticks = (cpu_cycle_ticks * 3ull + ticks) / 4;
+    cpu_cycle_ticks = ticks ? ticks < UINT32_MAX ? (uint32_t) ticks : UINT32_MAX : 1;
+}
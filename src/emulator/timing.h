@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+// Instruction timing of the host builds. exec86() charges every instruction its cycle count on the selected CPU,
+// including effective address calculation and per-element REP costs, and advances the scheduler by that many cycles
+// of the target clock. The device builds keep pacing exec86() by instruction count.
+typedef enum {
+    CPU_CLOCK_4_77MHZ, // 8088 timing
+    CPU_CLOCK_8MHZ, // 286 timing
+    CPU_CLOCK_12MHZ, // 286 timing
+    CPU_CLOCK_UNLIMITED, // 286 timing, the clock follows the host so emulated time keeps up with real time
+    CPU_CLOCKS
+} cpu_clock_t;
+
+typedef struct {
+    uint8_t base[256]; // register form, or the only form
+    uint8_t memory[256]; // added for a memory operand, effective address not included
+    uint8_t ea[3][8]; // effective address by ModR/M mod and r/m
+    uint8_t group[4][8]; // F6, F7, FE and FF register forms by ModR/M reg
+    uint8_t rep[16]; // per element of REP A0-AF
+    uint8_t shift_bit; // per bit of D2/D3 shifts by CL
+    uint8_t prefix;
+    uint8_t branch_taken; // added to the not taken cost of Jcc, LOOP and JCXZ
+    uint8_t interrupt; // hardware interrupt acknowledge and dispatch
+} cpu_timing_t;
+
+extern const cpu_timing_t timing_8088;
+extern const cpu_timing_t timing_286;
+
+// Bitmap of the one byte opcodes that take a ModR/M byte
+extern const uint8_t timing_modrm[32];
+
+extern cpu_clock_t cpu_clock;
+extern const cpu_timing_t *cpu_timing;
+extern uint32_t cpu_cycle_ticks; // scheduler ticks per cycle, 16.16 fixed point
+extern uint32_t cpu_cycles; // charged to the instruction being executed
+extern uint64_t cpu_cycles_total;
+
+void cpu_set_clock(cpu_clock_t clock);
+
+// Current clock, for the unlimited setting the one the host has been keeping up with
+uint32_t cpu_clock_hz(void);
+
+const char *cpu_clock_name(cpu_clock_t clock);
+
+// Unlimited clock: rescales the cycle so that `cycles` take `host_us` of emulated time
+void cpu_clock_follow(uint64_t host_us, uint64_t cycles);
+
+// Runs instructions until at least `cycles` cycles have been charged
+void exec86_cycles(uint32_t cycles);
+
+#define timing_has_modrm(opcode) (timing_modrm[(opcode) >> 3] >> ((opcode) & 7) & 1)
+
+#if !PICO_ON_DEVICE
+#define timing_interrupt() (cpu_cycles += cpu_timing->interrupt)
+#define timing_rep(opcode, count) (cpu_cycles += (count) * cpu_timing->rep[(opcode) & 15])
+#else
+#define timing_interrupt() ((void) 0)
+#define timing_rep(opcode, count) ((void) 0)
+#endif
@@ -107,6 +107,20 @@ uint32_t cga_composite_palette[3][16] = {
 };
 uint8_t color_burst = 0;
 
+#if !PICO_ON_DEVICE
+void cga_savestate(savestate_t *state) {
+    savestate_chunk(state, "CGAI", &cga_intensity, sizeof(cga_intensity));
+    savestate_chunk(state, "CGAS", &cga_colorset, sizeof(cga_colorset));
+    savestate_chunk(state, "CGAF", &cga_foreground_color, sizeof(cga_foreground_color));
+    savestate_chunk(state, "CGAB", &cga_blinking, sizeof(cga_blinking));
+    savestate_chunk(state, "CGAL", &cga_blinking_lock, sizeof(cga_blinking_lock));
+    savestate_chunk(state, "CGAH", &cga_hires, sizeof(cga_hires));
+    savestate_chunk(state, "CGAC", &color_burst, sizeof(color_burst));
+    savestate_chunk(state, "HERM", &hercules_mode, sizeof(hercules_mode));
+    savestate_chunk(state, "HERE", &hercules_enable, sizeof(hercules_enable));
+}
+#endif
+
 void cga_portout(uint16_t portnum, uint16_t value) {
     // https://www.youtube.com/watch?v=ttPhnUUxy94
     // https://www.youtube.com/watch?v=44eNkE1YoiI
@@ -186,9 +200,22 @@ void cga_portout(uint16_t portnum, uint16_t value) {
     }
 }
 
+#if !PICO_ON_DEVICE
+// 60 Hz frame of 525 lines: display enable toggles every line, vertical retrace starts at line 400
+#define CGA_FRAME_TICKS ((uint32_t) (SCHEDULER_CLOCK / 60))
+
+static INLINE uint8_t cga_retrace_status() {
+    const uint32_t line = (uint32_t) (scheduler_now % CGA_FRAME_TICKS) * 525 / CGA_FRAME_TICKS;
+    return (line >= 400 ? 8 : 0) | (line & 1);
+}
+#endif
+
 uint16_t cga_portin(uint16_t portnum) {
      // port3DA ^= 1;
      // if (!(port3DA & 1)) port3DA ^= 8;
      // return port3DA;
+#if !PICO_ON_DEVICE
+     port3DA = cga_retrace_status();
+#endif
      return hercules_mode ? 0xFF : port3DA;
 }
@@ -0,0 +1,116 @@
+// EGA/VGA planar to chunky conversion shared by every renderer.
+// Pixel i of an entry takes bit 7 - i of each plane byte, plane k giving bit k of the colour index.
+#include "emulator/emulator.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PLANAR_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__AVX2__) || defined(PLANAR_SSE2) || defined(__ARM_NEON)
+// The vector kernels need no tables
+void planar_init(void) {
+}
+
+static INLINE void planar_to_indexed_scalar(uint32_t planes, uint8_t *indices) {
+    for (int pixel = 0; pixel < 8; pixel++) {
+        const int bit = 7 - pixel;
+        indices[pixel] = (planes >> bit & 1) | (planes >> (bit + 8) & 1) << 1 |
+                         (planes >> (bit + 16) & 1) << 2 | (planes >> (bit + 24) & 1) << 3;
+    }
+}
+#endif
+
+#if defined(__AVX2__)
+// Two entries per 128-bit lane: every plane byte is broadcast over its 8 pixels and tested against the bit mask
+void planar_to_indexed(const uint32_t *planes, uint8_t *indices, int count) {
+    const __m256i mask = _mm256_set1_epi64x(0x0102040810204080LL);
+    for (; count >= 4; count -= 4, planes += 4, indices += 32) {
+        const __m256i entries = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *) planes)),
+            _mm_loadl_epi64((const __m128i *) (planes + 2)), 1);
+        const __m256i bytes = _mm256_unpacklo_epi8(entries, _mm256_srli_si256(entries, 4));
+        const __m256i pairs = _mm256_unpacklo_epi8(bytes, bytes);
+        const __m256i low = _mm256_unpacklo_epi16(pairs, pairs);
+        const __m256i high = _mm256_unpackhi_epi16(pairs, pairs);
+        const __m256i p0 = _mm256_unpacklo_epi32(low, low);
+        const __m256i p1 = _mm256_unpackhi_epi32(low, low);
+        const __m256i p2 = _mm256_unpacklo_epi32(high, high);
+        const __m256i p3 = _mm256_unpackhi_epi32(high, high);
+        __m256i result = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(p0, mask), mask), _mm256_set1_epi8(1));
+        result = _mm256_or_si256(result, _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(p1, mask), mask), _mm256_set1_epi8(2)));
+        result = _mm256_or_si256(result, _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(p2, mask), mask), _mm256_set1_epi8(4)));
+        result = _mm256_or_si256(result, _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(p3, mask), mask), _mm256_set1_epi8(8)));
+        _mm256_storeu_si256((__m256i *) indices, result);
+    }
+    for (; count--; indices += 8) planar_to_indexed_scalar(*planes++, indices);
+}
+#elif defined(PLANAR_SSE2)
+// Two entries per iteration: every plane byte is broadcast over its 8 pixels and tested against the bit mask
+void planar_to_indexed(const uint32_t *planes, uint8_t *indices, int count) {
+    const __m128i mask = _mm_set1_epi64x(0x0102040810204080LL);
+    for (; count >= 2; count -= 2, planes += 2, indices += 16) {
+        const __m128i entries = _mm_loadl_epi64((const __m128i *) planes);
+        const __m128i bytes = _mm_unpacklo_epi8(entries, _mm_srli_si128(entries, 4));
+        const __m128i pairs = _mm_unpacklo_epi8(bytes, bytes);
+        const __m128i low = _mm_unpacklo_epi16(pairs, pairs);
+        const __m128i high = _mm_unpackhi_epi16(pairs, pairs);
+        const __m128i p0 = _mm_unpacklo_epi32(low, low);
+        const __m128i p1 = _mm_unpackhi_epi32(low, low);
+        const __m128i p2 = _mm_unpacklo_epi32(high, high);
+        const __m128i p3 = _mm_unpackhi_epi32(high, high);
+        __m128i result = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(p0, mask), mask), _mm_set1_epi8(1));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(p1, mask), mask), _mm_set1_epi8(2)));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(p2, mask), mask), _mm_set1_epi8(4)));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(p3, mask), mask), _mm_set1_epi8(8)));
+        _mm_storeu_si128((__m128i *) indices, result);
+    }
+    if (count) planar_to_indexed_scalar(*planes, indices);
+}
+#elif defined(__ARM_NEON)
+// Two entries per iteration: every plane byte is broadcast over its 8 pixels and tested against the bit mask
+void planar_to_indexed(const uint32_t *planes, uint8_t *indices, int count) {
+    static const uint8_t bits[16] = { 0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, 0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1 };
+    const uint8x16_t mask = vld1q_u8(bits);
+    for (; count >= 2; count -= 2, planes += 2, indices += 16) {
+        const uint8x8_t entries = vld1_u8((const uint8_t *) planes);
+        uint8x16_t result = vandq_u8(vtstq_u8(vcombine_u8(vdup_lane_u8(entries, 0), vdup_lane_u8(entries, 4)), mask), vdupq_n_u8(1));
+        result = vorrq_u8(result, vandq_u8(vtstq_u8(vcombine_u8(vdup_lane_u8(entries, 1), vdup_lane_u8(entries, 5)), mask), vdupq_n_u8(2)));
+        result = vorrq_u8(result, vandq_u8(vtstq_u8(vcombine_u8(vdup_lane_u8(entries, 2), vdup_lane_u8(entries, 6)), mask), vdupq_n_u8(4)));
+        result = vorrq_u8(result, vandq_u8(vtstq_u8(vcombine_u8(vdup_lane_u8(entries, 3), vdup_lane_u8(entries, 7)), mask), vdupq_n_u8(8)));
+        vst1q_u8(indices, result);
+    }
+    if (count) planar_to_indexed_scalar(*planes, indices);
+}
+#else
+#include <string.h>
+
+// Cortex-M: one table lookup per plane byte gives its bit spread over the 8 pixel bytes (low and high word)
+static uint32_t planar_lut[256][2];
+
+void planar_init(void) {
+    memset(planar_lut, 0, sizeof(planar_lut));
+    for (int value = 0; value < 256; value++) {
+        for (int pixel = 0; pixel < 8; pixel++) {
+            planar_lut[value][pixel >> 2] |= (uint32_t) (value >> (7 - pixel) & 1) << ((pixel & 3) * 8);
+        }
+    }
+}
+
+void __not_in_flash() planar_to_indexed(const uint32_t *planes, uint8_t *indices, int count) {
+    uint32_t *output = (uint32_t *) indices;
+    while (count--) {
+        const uint32_t entry = *planes++;
+        const uint32_t *p0 = planar_lut[entry & 0xFF];
+        const uint32_t *p1 = planar_lut[entry >> 8 & 0xFF];
+        const uint32_t *p2 = planar_lut[entry >> 16 & 0xFF];
+        const uint32_t *p3 = planar_lut[entry >> 24];
+        *output++ = p0[0] | p1[0] << 1 | p2[0] << 2 | p3[0] << 3;
+        *output++ = p0[1] | p1[1] << 1 | p2[1] << 2 | p3[1] << 3;
+    }
+}
+#endif
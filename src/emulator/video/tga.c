@@ -26,6 +26,14 @@ uint32_t tga_palette[16] = {
 
 uint8_t tga_palette_map[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
 
+#if !PICO_ON_DEVICE
+void tga_savestate(savestate_t *state) {
+    savestate_chunk(state, "TGAO", &tga_offset, sizeof(tga_offset));
+    savestate_chunk(state, "TGAP", tga_palette, sizeof(tga_palette));
+    savestate_chunk(state, "TGAM", tga_palette_map, sizeof(tga_palette_map));
+}
+#endif
+
 void tga_portout(uint16_t portnum, uint16_t value) {
 // http://archives.oldskool.org/pub/tvdog/tandy1000/faxback/02506.pdf
 // https://ia803208.us.archive.org/15/items/Tandy_1000_Computer_Service_Manual_1985_Tandy/Tandy_1000_Computer_Service_Manual_1985_Tandy.pdf
@@ -151,6 +159,8 @@ void tga_draw_char(uint8_t ch, int x, int y, uint8_t color) {
         VIDEORAM[plane_offset++] = (((font_row >> 2) & 1) * color << 4) | ((font_row >> 3) & 1) * color;
         VIDEORAM[plane_offset++] = (((font_row >> 4) & 1) * color << 4) | ((font_row >> 5) & 1) * color;
         VIDEORAM[plane_offset]   = (((font_row >> 6) & 1) * color << 4) | ((font_row >> 7) & 1) * color;
+        videoram_mark_dirty(plane_offset - 3);
+        videoram_mark_dirty(plane_offset);
 
         if (row == 3) base_offset += 160;
     }
@@ -158,6 +168,7 @@ void tga_draw_char(uint8_t ch, int x, int y, uint8_t color) {
 
 void tga_draw_pixel(int x, int y, uint8_t color) {
     uint32_t * pixel = &VIDEORAM[tga_offset + (x >> 1) + ((y >> 2) << 13)];
+    videoram_mark_dirty(tga_offset + (x >> 1) + ((y >> 2) << 13));
     if (x & 1) {
         *pixel = (*pixel & 0xF0) | (color & 0x0F);
     } else {
@@ -14,6 +14,9 @@ static uint8_t graphics_control_register = 0;
 static uint8_t color_index = 0, read_color_index = 0, vga_register;
 uint32_t vga_plane_offset = 0;
 uint8_t vga_planar_mode = 0;
+#if !PICO_ON_DEVICE
+uint32_t videoram_dirty[VIDEORAM_DIRTY_WORDS];
+#endif
 
 // Latches (32-bit).
 static uint32_t vga_latch32 = 0;
@@ -165,24 +168,28 @@ static inline void vga_update_gc_cache(void) {
 
 // Read a byte from VGA memory (emulates CPU byte read from VGA window).
 // Performs latch update on read.
-uint8_t __not_in_flash() vga_mem_read(const uint32_t address) {
-    vga_latch32 = VIDEORAM[address & 0xFFFF];
-
+// Byte the CPU reads from the planes value just latched
+static inline uint8_t vga_read_value(const uint32_t latch32) {
     if (vga.read_mode == 0) {
         // return the selected byte from latch
         const uint32_t shift = (vga.read_map_select & 3u) << 3;
-        return (uint8_t) (vga_latch32 >> shift);
+        return (uint8_t) (latch32 >> shift);
     }
 
     // read mode 1: color compare against color_compare + color_dont_care
     // compute per-plane mismatches:
     // tmp32 = ((lat ^ color_compare32) & color_dontcare32)
-    const uint32_t tmp = ((vga_latch32 ^ vga.color_compare32) & vga.color_dontcare32);
+    const uint32_t tmp = ((latch32 ^ vga.color_compare32) & vga.color_dontcare32);
     // OR across plane-bytes into single byte: (tmp | tmp>>8 | tmp>>16 | tmp>>24) & 0xFF
     const uint32_t folded = (tmp | tmp >> 8 | tmp >> 16 | tmp >> 24) & 0xFFu;
     return (uint8_t)~folded;
 }
 
+uint8_t __not_in_flash() vga_mem_read(const uint32_t address) {
+    vga_latch32 = VIDEORAM[address & 0xFFFF];
+    return vga_read_value(vga_latch32);
+}
+
 uint16_t __not_in_flash() vga_mem_read16(uint32_t address) {
     address &= 0xFFFF;
 
@@ -309,19 +316,14 @@ void vga_mem_write_loop(uint32_t address, const uint8_t cpu_data) {
     VIDEORAM[address] = (~vga.map_mask32 & previous_data) | (vga.map_mask32 & new_data);
 }
 #endif
-// Core write implementation (CPU writes a byte to VGA memory)
-void __not_in_flash() vga_mem_write(const uint32_t address, const uint8_t cpu_data) {
+// Planes value produced by a CPU byte write, before the map mask merge into VRAM
+static inline uint32_t vga_write_planes(const uint8_t cpu_data) {
     uint32_t new_data;
 
-    const uint32_t map_mask32 = vga.map_mask32;
-    const uint32_t enable_set_reset32 = vga.enable_set_reset32;
-    const uint32_t set_reset32 = vga.set_reset32;
-    uint32_t *videoram_data = &VIDEORAM[address & 0xFFFF]; // current data pointer
-
     switch (vga.write_mode) {
         case 0: {
             // Mode 0: Normal write with set/reset + ALU
-            new_data = masked_merge_xor(expand_to_u32(ror8(cpu_data, vga.data_rotate_counter)), set_reset32, enable_set_reset32);
+            new_data = masked_merge_xor(expand_to_u32(ror8(cpu_data, vga.data_rotate_counter)), vga.set_reset32, vga.enable_set_reset32);
             break;
         }
         case 2: {
@@ -338,14 +340,11 @@ void __not_in_flash() vga_mem_write(const uint32_t address, const uint8_t cpu_da
         }
 
         case 1: // Mode 1: Write latch directly to enabled planes
-            *videoram_data = masked_merge_xor(*videoram_data, vga_latch32, map_mask32);
-            return;
+            return vga_latch32;
 
-        case 3: {
+        default: {
             // Mode 3: Transparent set/reset
-            new_data = expand_to_u32(ror8(cpu_data, vga.data_rotate_counter)) & set_reset32 | vga_latch32 & ~set_reset32;
-            *videoram_data = masked_merge_xor(*videoram_data, new_data, map_mask32);
-            return;
+            return expand_to_u32(ror8(cpu_data, vga.data_rotate_counter)) & vga.set_reset32 | vga_latch32 & ~vga.set_reset32;
         }
     }
 
@@ -359,9 +358,68 @@ void __not_in_flash() vga_mem_write(const uint32_t address, const uint8_t cpu_da
         new_data ^= vga_latch32;
     }
 
-    new_data = masked_merge_xor(vga_latch32, new_data, vga.bit_mask32);
+    return masked_merge_xor(vga_latch32, new_data, vga.bit_mask32);
+}
 
-    *videoram_data = masked_merge_xor(*videoram_data, new_data, map_mask32);
+// Core write implementation (CPU writes a byte to VGA memory)
+void __not_in_flash() vga_mem_write(const uint32_t address, const uint8_t cpu_data) {
+    uint32_t *videoram_data = &VIDEORAM[address & 0xFFFF]; // current data pointer
+    *videoram_data = masked_merge_xor(*videoram_data, vga_write_planes(cpu_data), vga.map_mask32);
+    videoram_mark_dirty(address);
+}
+
+static inline void vga_mark_range_dirty(const uint32_t address, const uint32_t length) {
+#if !PICO_ON_DEVICE
+    for (uint32_t i = 0; i < length; i += 1 << VIDEORAM_DIRTY_SHIFT) {
+        videoram_mark_dirty(address + i);
+    }
+    videoram_mark_dirty(address + length - 1);
+#endif
+}
+
+// REP STOS fast path: no reads happen in between, so the latch stays put and each byte lane is computed once
+void __not_in_flash() vga_mem_fill(const uint32_t address, const uint16_t cpu_data_x2, const uint32_t length) {
+    const uint32_t map_mask32 = vga.map_mask32;
+    const uint32_t planes[2] = {
+        vga_write_planes((uint8_t) (cpu_data_x2 & 0xFF)),
+        vga_write_planes((uint8_t) (cpu_data_x2 >> 8))
+    };
+
+    for (uint32_t i = 0; i < length; i++) {
+        uint32_t *videoram_data = &VIDEORAM[(address + i) & 0xFFFF];
+        *videoram_data = masked_merge_xor(*videoram_data, planes[i & 1], map_mask32);
+    }
+    vga_mark_range_dirty(address, length);
+}
+
+// REP MOVS from memory: the source is not VRAM, so the latch stays put as with a fill
+void __not_in_flash() vga_mem_copy(const uint32_t address, const uint8_t *source, const uint32_t length) {
+    const uint32_t map_mask32 = vga.map_mask32;
+    for (uint32_t i = 0; i < length; i++) {
+        uint32_t *videoram_data = &VIDEORAM[(address + i) & 0xFFFF];
+        *videoram_data = masked_merge_xor(*videoram_data, vga_write_planes(source[i]), map_mask32);
+    }
+    vga_mark_range_dirty(address, length);
+}
+
+// REP MOVS within VRAM, element by element as the CPU does it: all bytes of an element are read, which leaves
+// the latch at its last one, then written. In write mode 1 this copies all four planes at once
+void __not_in_flash() vga_mem_move(const uint32_t address, const uint32_t source, const uint32_t length,
+                                   const uint8_t size) {
+    const uint32_t map_mask32 = vga.map_mask32;
+    uint8_t values[2];
+    for (uint32_t i = 0; i < length; i += size) {
+        for (uint8_t j = 0; j < size; j++) {
+            vga_latch32 = VIDEORAM[(source + i + j) & 0xFFFF];
+            values[j] = vga_read_value(vga_latch32);
+        }
+        for (uint8_t j = 0; j < size; j++) {
+            uint32_t *videoram_data = &VIDEORAM[(address + i + j) & 0xFFFF];
+            const uint32_t planes = vga.write_mode == 1 ? vga_latch32 : vga_write_planes(values[j]);
+            *videoram_data = masked_merge_xor(*videoram_data, planes, map_mask32);
+        }
+    }
+    vga_mark_range_dirty(address, length);
 }
 
 // 16-bit fast path: write two consecutive addresses (address, address+1) with one setup
@@ -377,6 +435,8 @@ void __not_in_flash() vga_mem_write16(const uint32_t address, const uint16_t cpu
 
     uint32_t *p0 = &VIDEORAM[address & 0xFFFFu];
     uint32_t *p1 = p0 + 1;
+    videoram_mark_dirty(address);
+    videoram_mark_dirty(address + 1);
 
     if (wmode == 1) {
         // Mode 1: latch -> enabled planes
@@ -466,8 +526,25 @@ void vga_init(void) {
     vga_update_gc_cache();
     vga_latch32 = 0;
     sequencer_register = graphics_control_register = 0;
+    planar_init();
 }
 
+#if !PICO_ON_DEVICE
+// The derived masks of vga_cache_t are saved with the registers they come from
+void vga_savestate(savestate_t *state) {
+    savestate_chunk(state, "VGA ", &vga, sizeof(vga));
+    savestate_chunk(state, "VGAL", &vga_latch32, sizeof(vga_latch32));
+    savestate_chunk(state, "VGAS", &sequencer_register, sizeof(sequencer_register));
+    savestate_chunk(state, "VGAG", &graphics_control_register, sizeof(graphics_control_register));
+    savestate_chunk(state, "VGAC", &color_index, sizeof(color_index));
+    savestate_chunk(state, "VGAR", &read_color_index, sizeof(read_color_index));
+    savestate_chunk(state, "VGAA", &vga_register, sizeof(vga_register));
+    savestate_chunk(state, "VGAO", &vga_plane_offset, sizeof(vga_plane_offset));
+    savestate_chunk(state, "VGAM", &vga_planar_mode, sizeof(vga_planar_mode));
+    savestate_chunk(state, "VGAP", vga_palette, sizeof(vga_palette));
+}
+#endif
+
 
 void vga_portout(uint16_t portnum, uint16_t value) {
     //    http://www.techhelpmanual.com/900-video_graphics_array_i_o_ports.html
@@ -98,6 +98,18 @@ int a20_enabled = 0;
 
 uint8_t __attribute__((aligned (4), section(".psram"))) XMS[XMS_MEMORY_SIZE] = {0};
 
+#if !PICO_ON_DEVICE
+// Handles are only counted, the blocks themselves live in XMS
+void xms_savestate(savestate_t *state) {
+    savestate_memory(state, "XMS ", XMS, sizeof(XMS));
+    savestate_chunk(state, "XMSH", &xms_handles, sizeof(xms_handles));
+    savestate_chunk(state, "XMSA", &xms_available, sizeof(xms_available));
+    savestate_chunk(state, "A20 ", &a20_enabled, sizeof(a20_enabled));
+    savestate_chunk(state, "UMBB", umb_blocks, sizeof(umb_blocks));
+    savestate_chunk(state, "UMBA", &umb_blocks_allocated, sizeof(umb_blocks_allocated));
+}
+#endif
+
 void init_umb() {
     for (int i = 0; i < UMB_BLOCKS_COUNT; ++i) {
         umb_blocks[i].allocated_paragraphs = 0;
@@ -172,6 +184,9 @@ extern uint32_t butter_psram_size;
 static INLINE void xms_move_to(const register uint32_t destination, register uint32_t source, register uint32_t length) {
     if (butter_psram_size) {
         register uint16_t *dest_ptr = (uint16_t *) &XMS[destination];
+#if !PICO_ON_DEVICE
+        snapshot_mark(dest_ptr, length);
+#endif
         length /= 2;
         while (length--) {
             *dest_ptr++ = readw86(source);
@@ -258,6 +273,7 @@ uint8_t __not_in_flash() xms_handler() {
             CPU_AX = 1; // Success
             CPU_BL = 0;
             a20_enabled = 1;
+            memory_map_a20();
             break;
         }
         case GLOBAL_DISABLE_A20:
@@ -266,6 +282,7 @@ uint8_t __not_in_flash() xms_handler() {
             CPU_AX = 1; // Success
             CPU_BL = 0;
             a20_enabled = 0;
+            memory_map_a20();
             break;
         }
         case QUERY_A20: {
@@ -0,0 +1,530 @@
+// Host (Windows/Linux) frame renderer, shared by the host front-ends: draws the current video mode into SCREEN
+#include <atomic>
+#include "emulator/includes/font8x16.h"
+#include "emulator/includes/font8x8.h"
+
+// Front and back buffer, renderer_screen() is the last finished frame
+static uint32_t ALIGN(4, SCREEN[2][640 * 480]);
+uint8_t ALIGN(4, DEBUG_VRAM[80 * 10]) = {0};
+
+int cursor_blink_state = 0;
+
+// Video state the frame is drawn from, captured on the CPU thread at the frame boundary.
+// Any difference from the previous capture redraws the whole frame.
+typedef struct {
+    int videomode;
+    uint32_t vram_offset, tga_offset;
+    uint8_t cga_colorset, cga_intensity, cga_foreground_color, cga_blinking, vga_planar_mode;
+    uint8_t cursor_blink_state, cursor_x, cursor_y, cursor_start, cursor_end;
+    uint32_t vga_palette[256];
+    uint32_t tga_palette[16];
+    uint8_t tga_palette_map[16];
+    uint32_t cga_composite_palette[3][16];
+} renderer_state_t;
+
+static renderer_state_t frame;
+static uint32_t ALIGN(4, frame_vram[VIDEORAM_SIZE]); // VIDEORAM as of the capture
+static uint8_t frame_debug_vram[sizeof(DEBUG_VRAM)];
+
+// Each buffer last saw the frame before the previous one, so a line is only skipped when it is
+// clean in both captures
+static uint32_t renderer_dirty[VIDEORAM_DIRTY_WORDS];
+static uint16_t renderer_debug_rows; // DEBUG_VRAM text rows changed in the last two captures
+static bool renderer_full_redraw;
+
+static std::atomic<int> renderer_front{0};
+static std::atomic<bool> renderer_busy{false}; // a capture is waiting for or being drawn by the render thread
+static std::atomic<bool> renderer_running{true};
+
+static INLINE uint32_t *renderer_screen() {
+    return SCREEN[renderer_front.load(std::memory_order_acquire)];
+}
+
+// CPU thread: copies the video state and the VIDEORAM blocks written since the previous capture
+static INLINE void renderer_capture() {
+    static uint32_t previous_dirty[VIDEORAM_DIRTY_WORDS];
+    static uint16_t previous_debug_rows;
+    static bool previous_full_redraw;
+    renderer_state_t state;
+
+    if (videomode == 0x1e) vram_offset = 5;
+
+    memset(&state, 0, sizeof(state));
+    state.videomode = videomode;
+    state.vram_offset = vram_offset;
+    state.tga_offset = tga_offset;
+    state.cga_colorset = cga_colorset;
+    state.cga_intensity = cga_intensity;
+    state.cga_foreground_color = cga_foreground_color;
+    state.cga_blinking = cga_blinking;
+    state.vga_planar_mode = vga_planar_mode;
+    state.cursor_blink_state = cursor_blink_state;
+    state.cursor_x = CURSOR_X;
+    state.cursor_y = CURSOR_Y;
+    state.cursor_start = cursor_start;
+    state.cursor_end = cursor_end;
+    memcpy(state.vga_palette, vga_palette, sizeof(state.vga_palette));
+    memcpy(state.tga_palette, tga_palette, sizeof(state.tga_palette));
+    memcpy(state.tga_palette_map, tga_palette_map, sizeof(state.tga_palette_map));
+    memcpy(state.cga_composite_palette, cga_composite_palette, sizeof(state.cga_composite_palette));
+
+    const bool full_redraw = memcmp(&state, &frame, sizeof(state)) != 0;
+    renderer_full_redraw = full_redraw || previous_full_redraw;
+    previous_full_redraw = full_redraw;
+    memcpy(&frame, &state, sizeof(state));
+
+    for (int word = 0; word < VIDEORAM_DIRTY_WORDS; word++) {
+        const uint32_t dirty = videoram_dirty[word];
+        renderer_dirty[word] = dirty | previous_dirty[word];
+        previous_dirty[word] = dirty;
+        for (int bit = 0; bit < 32; bit++) {
+            if (!(dirty >> bit & 1)) continue;
+            const size_t block = word * 32 + bit;
+            memcpy(&frame_vram[block << VIDEORAM_DIRTY_SHIFT], &VIDEORAM[block << VIDEORAM_DIRTY_SHIFT],
+                   sizeof(uint32_t) << VIDEORAM_DIRTY_SHIFT);
+        }
+    }
+    memset(videoram_dirty, 0, sizeof(videoram_dirty));
+
+    uint16_t debug_rows = 0;
+    for (int row = 0; row < 10; row++) {
+        if (memcmp(&DEBUG_VRAM[row * 80], &frame_debug_vram[row * 80], 80) != 0) {
+            debug_rows |= 1 << row;
+        }
+    }
+    renderer_debug_rows = debug_rows | previous_debug_rows;
+    previous_debug_rows = debug_rows;
+    memcpy(frame_debug_vram, DEBUG_VRAM, sizeof(frame_debug_vram));
+}
+
+// True when no VIDEORAM block a line is drawn from changed since this buffer was last drawn
+static INLINE bool renderer_line_clean(const void *source, const size_t bytes) {
+    if (renderer_full_redraw) return false;
+    const size_t first = ((const uint8_t *) source - (const uint8_t *) frame_vram) / sizeof(uint32_t);
+    const size_t last = first + (bytes + sizeof(uint32_t) - 1) / sizeof(uint32_t) - 1;
+    for (size_t block = first >> VIDEORAM_DIRTY_SHIFT; block <= last >> VIDEORAM_DIRTY_SHIFT; block++) {
+        const size_t wrapped = block & ((VIDEORAM_SIZE >> VIDEORAM_DIRTY_SHIFT) - 1);
+        if (renderer_dirty[wrapped >> 5] & 1u << (wrapped & 31)) return false;
+    }
+    return true;
+}
+
+// Draws the last capture into the back buffer and makes it the front one
+static INLINE void renderer_draw() {
+    // http://www.techhelpmanual.com/114-video_modes.html
+    // http://www.techhelpmanual.com/89-video_memory_layouts.html
+    // https://mendelson.org/wpdos/videomodes.txt
+    static uint8_t v = 0;
+    if (v != frame.videomode) {
+        printf("videomode %x %x\n", frame.videomode, v);
+        v = frame.videomode;
+        //frame.vram_offset = 0;
+    }
+
+
+    //memcpy(localVRAM, frame_vram + 0x18000 + (frame.vram_offset << 1), VIDEORAM_SIZE);
+    uint8_t *vidramptr = (uint8_t *) (frame_vram + 0x8000 + ((frame.vram_offset & 0xffff) << 1));
+    uint8_t cols = 80;
+    const int back = renderer_front.load(std::memory_order_relaxed) ^ 1;
+    uint32_t *screen = SCREEN[back];
+    uint8_t ALIGN(4, line_indices[640]);
+    for (int y = 0; y < 480; y++) {
+        uint32_t *pixels = screen + y * 640;
+        if (y < 400)
+            switch (frame.videomode) {
+                case 0x00:
+                case 0x01: {
+                    uint16_t y_div_16 = y / 16; // Precompute y / 16
+                    uint8_t glyph_line = (y / 2) & 7; // Precompute y % 8 for font lookup
+                    // Calculate screen position
+                    uint32_t *text_buffer_line = &frame_vram[0x8000 + y_div_16 * 80];
+                    if (renderer_line_clean(text_buffer_line, 80 * sizeof(uint32_t))) break;
+
+                    for (int column = 0; column < 40; column++) {
+                        uint8_t glyph_pixels = font_8x8[(*text_buffer_line++ & 0xFF) * 8 + glyph_line]; // Glyph row from font
+                        uint8_t color = *text_buffer_line++; // Color attribute
+
+                        // Cursor blinking check
+                        uint8_t cursor_active = frame.cursor_blink_state &&
+                                                y_div_16 == frame.cursor_y && column == frame.cursor_x &&
+                                                glyph_line >= frame.cursor_start && glyph_line <= frame.cursor_end;
+
+                        for (uint8_t bit = 0; bit < 8; bit++) {
+                            uint8_t pixel_color;
+                            if (cursor_active) {
+                                pixel_color = color & 0x0F; // Cursor foreground color
+                            } else if (frame.cga_blinking && color >> 7 & 1) {
+                                pixel_color = frame.cursor_blink_state ? color >> 4 & 0x7 : color & 0x7; // Blinking background color
+                            } else {
+                                pixel_color = glyph_pixels >> bit & 1 ? color & 0x0f : color >> 4;
+                                // Foreground or background color
+                            }
+
+                            // Write the pixel twice (horizontal scaling)
+                            *pixels++ = *pixels++ = cga_palette[pixel_color];
+                        }
+                    }
+
+
+                    break;
+                }
+                case 0x02:
+                case 0x03: {
+                    uint16_t y_div_16 = y / 16; // Precompute y / 16
+                    uint8_t glyph_line = y & 15; // Precompute y % 8 for font lookup
+
+                    // Calculate screen position
+                    uint32_t *text_row = &frame_vram[0x8000 + y_div_16 * 160];
+                    if (renderer_line_clean(text_row, 160 * sizeof(uint32_t))) break;
+                    // printf("line start %x\n", 0x8000 + y_div_16 * 160);
+                    for (uint8_t column = 0; column < 80; column++) {
+                        // Access vidram and font data once per character
+                        uint8_t charcode = *text_row++ & 0xff;
+                        uint8_t color = *text_row++ & 0xff; // Color attribute
+                        // printf("%c", charcode);
+                        uint8_t glyph_row = font_8x16[charcode * 16 + glyph_line]; // Glyph row from font
+
+                        // Cursor blinking check
+                        uint8_t cursor_active =
+                                frame.cursor_blink_state && y_div_16 == frame.cursor_y && column == frame.cursor_x &&
+                                (frame.cursor_start > frame.cursor_end
+                                     ? !(glyph_line >= frame.cursor_end << 1 &&
+                                         glyph_line <= frame.cursor_start << 1)
+                                     : glyph_line >= frame.cursor_start << 1 && glyph_line <= frame.cursor_end << 1);
+
+                        // Unrolled bit loop: Write 8 pixels with scaling (2x horizontally)
+                        for (int bit = 0; bit < 8; bit++) {
+                            uint8_t pixel_color;
+                            if (cursor_active) {
+                                pixel_color = color & 0x0F; // Cursor foreground color
+                            } else if (frame.cga_blinking && color >> 7 & 1) {
+                                if (frame.cursor_blink_state) {
+                                    pixel_color = color >> 4 & 0x7; // Blinking background color
+                                } else {
+                                    pixel_color = glyph_row >> bit & 1 ? color & 0x0f : (color >> 4 & 0x7);
+                                }
+                            } else {
+                                // Foreground or background color
+                                pixel_color = glyph_row >> bit & 1 ? color & 0x0f : color >> 4;
+                            }
+
+                            *pixels++ = cga_palette[pixel_color];
+                        }
+                    }
+                    break;
+                }
+                case 0x04:
+                case 0x05: {
+                    uint32_t *cga_row = &frame_vram[0x8000 + ((y / 2 >> 1) * 80 + (y / 2 & 1) * 8192)]; // Precompute CGA row pointer
+                    if (renderer_line_clean(cga_row, 80 * sizeof(uint32_t))) break;
+                    uint8_t *current_cga_palette = (uint8_t *) cga_gfxpal[frame.cga_colorset][frame.cga_intensity];
+
+                    // Each byte containing 4 pixels
+                    for (int x = 320 / 4; x--;) {
+                        uint8_t cga_byte = *cga_row++ & 0xFF;
+
+                        // Extract all four 2-bit pixels from the CGA byte
+                        // and write each pixel twice for horizontal scaling
+                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 6 & 3
+                                                                ? current_cga_palette[cga_byte >> 6 & 3]
+                                                                : frame.cga_foreground_color];
+                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 4 & 3
+                                                                ? current_cga_palette[cga_byte >> 4 & 3]
+                                                                : frame.cga_foreground_color];
+                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 2 & 3
+                                                                ? current_cga_palette[cga_byte >> 2 & 3]
+                                                                : frame.cga_foreground_color];
+                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 0 & 3
+                                                                ? current_cga_palette[cga_byte >> 0 & 3]
+                                                                : frame.cga_foreground_color];
+                    }
+                    break;
+                }
+                case 0x06: {
+                    uint32_t *cga_row = &frame_vram[0x8000 + (y / 2 >> 1) * 80 + (y / 2 & 1) * 8192]; // Precompute row start
+                    if (renderer_line_clean(cga_row, 80 * sizeof(uint32_t))) break;
+
+                    // Each byte containing 8 pixels
+                    for (int x = 640 / 8; x--;) {
+                        uint8_t cga_byte = *cga_row++;
+
+                        *pixels++ = cga_palette[(cga_byte >> 7 & 1) * frame.cga_foreground_color];
+                        *pixels++ = cga_palette[(cga_byte >> 6 & 1) * frame.cga_foreground_color];
+                        *pixels++ = cga_palette[(cga_byte >> 5 & 1) * frame.cga_foreground_color];
+                        *pixels++ = cga_palette[(cga_byte >> 4 & 1) * frame.cga_foreground_color];
+                        *pixels++ = cga_palette[(cga_byte >> 3 & 1) * frame.cga_foreground_color];
+                        *pixels++ = cga_palette[(cga_byte >> 2 & 1) * frame.cga_foreground_color];
+                        *pixels++ = cga_palette[(cga_byte >> 1 & 1) * frame.cga_foreground_color];
+                        *pixels++ = cga_palette[(cga_byte >> 0 & 1) * frame.cga_foreground_color];
+                    }
+
+                    break;
+                }
+                case 0x1e:
+                    cols = 90;
+                    if (y >= 348) break;
+                case 0x07: {
+                    uint32_t *cga_row = &frame_vram[(y & 3) * 8192 + y / 4 * cols];
+                    if (renderer_line_clean(cga_row, 80 * sizeof(uint32_t))) break;
+                    // Each byte containing 8 pixels
+                    for (int x = 640 / 8; x--;) {
+                        uint8_t cga_byte = *cga_row++ & 0xFF;
+
+                        *pixels++ = cga_palette[(cga_byte >> 7 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 6 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 5 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 4 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 3 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 2 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 1 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 0 & 1) * 15];
+                    }
+
+                    break;
+                }
+
+                case 0x08:
+                case 0x74: /* 160x200x16    */
+                case 0x76: /* cga composite / tandy */ {
+                    uint32_t *palette;
+                    switch (frame.videomode) {
+                        case 0x08:
+                            palette = frame.tga_palette;
+                            break;
+                        case 0x74:
+                            palette = frame.cga_composite_palette[frame.cga_intensity << 1];
+                            break;
+                        case 0x76:
+                            palette = frame.cga_composite_palette[0];
+                            break;
+                    }
+
+                    uint32_t *tga_row = &frame_vram[frame.tga_offset + (y / 2 >> 1) * 80 + (y / 2 & 1) * 8192]; // Precompute row start
+                    if (renderer_line_clean(tga_row, 80 * sizeof(uint32_t))) break;
+
+                    // Each byte containing 28 pixels
+                    for (int x = 320 / 4; x--;) {
+                        uint8_t two_pixels = *tga_row++; // Fetch 2 pixels from TGA memory
+                        uint8_t pixel1_color = two_pixels >> 4;
+                        uint8_t pixel2_color = two_pixels & 15;
+
+                        if (!pixel1_color && frame.videomode == 0x8) pixel1_color = frame.cga_foreground_color;
+                        if (!pixel2_color && frame.videomode == 0x8) pixel2_color = frame.cga_foreground_color;
+
+                        *pixels++ = *pixels++ = *pixels++ = *pixels++ = palette[pixel1_color];
+                        *pixels++ = *pixels++ = *pixels++ = *pixels++ = palette[pixel2_color];
+                    }
+
+                    break;
+                }
+                case 0x09: /* tandy 320x200 16 color */ {
+                    uint32_t *tga_row = &frame_vram[frame.tga_offset + (y / 2 & 3) * 8192 + y / 8 * 160];
+                    if (renderer_line_clean(tga_row, 160 * sizeof(uint32_t))) break;
+                    //                  uint8_t *tga_row = &frame_vram[frame.tga_offset+(((y / 2) & 3) * 8192) + ((y / 8) * 160)];
+
+                    // Each byte containing 4 pixels
+                    for (int x = 320 / 2; x--;) {
+                        uint8_t tga_byte = *tga_row++ & 0xFF;
+                        *pixels++ = *pixels++ = frame.tga_palette[frame.tga_palette_map[tga_byte >> 4 & 15]];
+                        *pixels++ = *pixels++ = frame.tga_palette[frame.tga_palette_map[tga_byte & 15]];
+                    }
+                    break;
+                }
+                case 0x0a: /* tandy 640x200 16 color */ {
+                    uint32_t *tga_row =&frame_vram[y / 2 * 320];
+                    if (renderer_line_clean(tga_row, 320 * sizeof(uint32_t))) break;
+
+                    // Each byte contains 2 pixels
+                    for (int x = 640 / 2; x--;) {
+                        uint8_t tga_byte = *tga_row++;
+                        *pixels++ = frame.tga_palette[frame.tga_palette_map[tga_byte >> 4 & 15]];
+                        *pixels++ = frame.tga_palette[frame.tga_palette_map[tga_byte & 15]];
+                    }
+                    break;
+                }
+                case 0x0D: /* EGA 320x200 16-color */ {
+                    const uint32_t *ega_row = &frame_vram[(y / 2) * 40];
+                    if (renderer_line_clean(ega_row, 40 * sizeof(uint32_t))) break;
+                    planar_to_indexed(ega_row, line_indices, 40);
+                    for (int x = 0; x < 320; x++) {
+                        *pixels++ = *pixels++ = frame.vga_palette[line_indices[x]];
+                    }
+                    break;
+                }
+                case 0x0E: /* EGA 640x200 16-color */ {
+                    const uint32_t *ega_row = &frame_vram[(y / 2) * 80];
+                    if (renderer_line_clean(ega_row, 80 * sizeof(uint32_t))) break;
+                    planar_to_indexed(ega_row, line_indices, 80);
+                    for (int x = 0; x < 640; x++) {
+                        *pixels++ = frame.vga_palette[line_indices[x]];
+                    }
+                    break;
+                }
+                case 0x10: /* EGA 640x350 16-color */
+                    if (y >= 350) break;
+                case 0x12: /* VGA 640x480 16-color */ {
+                    const uint32_t *ega_row = &frame_vram[y * 80];
+                    if (renderer_line_clean(ega_row, 80 * sizeof(uint32_t))) break;
+                    planar_to_indexed(ega_row, line_indices, 80);
+                    for (int x = 0; x < 640; x++) {
+                        *pixels++ = frame.vga_palette[line_indices[x]];
+                    }
+                    break;
+                }
+                case 0x11: /* VGA 640x480 2-color */ {
+                    uint32_t *cga_row = &frame_vram[y * 80];
+                    if (renderer_line_clean(cga_row, 80 * sizeof(uint32_t))) break;
+                    // Each byte containing 8 pixels
+                    for (int x = 640 / 8; x--;) {
+                        uint8_t cga_byte = *cga_row++;
+
+                        *pixels++ = cga_palette[(cga_byte >> 7 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 6 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 5 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 4 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 3 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 2 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 1 & 1) * 15];
+                        *pixels++ = cga_palette[(cga_byte >> 0 & 1) * 15];
+                    }
+
+                    break;
+                }
+                case 0x13: {
+                    if (frame.vga_planar_mode) {
+                        uint32_t *vga_row = &frame_vram[frame.vram_offset + (y >> 1) * (320 / 4)];
+                        if (renderer_line_clean(vga_row, 320 / 4 * sizeof(uint32_t))) break;
+                        for (int x = 0; x < 320 / 4; x++) {
+                            uint32_t four_pixels = *vga_row++;
+                            *pixels++ = *pixels++ = frame.vga_palette[four_pixels & 0xFF];
+                            *pixels++ = *pixels++ = frame.vga_palette[four_pixels >> 8 & 0xFF];
+                            *pixels++ = *pixels++ = frame.vga_palette[four_pixels >> 16 & 0xFF];
+                            *pixels++ = *pixels++ = frame.vga_palette[four_pixels >> 24];
+                        }
+                    } else {
+                        uint32_t *vga_row = &frame_vram[frame.vram_offset + (y >> 1) * 320];
+                        if (renderer_line_clean(vga_row, 320 * sizeof(uint32_t))) break;
+                        for (int x = 0; x < 320; x++) {
+                            uint32_t four_pixels = *vga_row++;
+                            *pixels++ = *pixels++ = frame.vga_palette[four_pixels & 0xFF];
+                        }
+                    }
+
+                    break;
+                }
+                case 0x78: /* 80x100x16 textmode */
+                    cols = 40;
+                case 0x77: /* 160x100x16 textmode */ {
+                    uint16_t y_div_4 = y / 4; // Precompute y / 4
+                    uint8_t odd_even = y / 2 & 1;
+                    // Calculate screen position
+                    uint8_t *cga_row = (uint8_t *) (frame_vram + 0x8000 + y_div_4 * 160);
+                    if (renderer_line_clean(cga_row, cols * 2)) break;
+                    for (uint8_t column = 0; column < cols; column++) {
+                        // Access vidram and font data once per character
+                        uint8_t *charcode = cga_row + column * 2; // Character code
+                        uint8_t glyph_row = font_8x8[*charcode * 8 + odd_even]; // Glyph row from font
+                        uint8_t color = *++charcode;
+
+#pragma GCC unroll(8)
+                        for (uint8_t bit = 0; bit < 8; bit++) {
+                            *pixels++ = cga_palette[glyph_row >> bit & 1 ? color & 0x0f : color >> 4];
+                        }
+                    }
+                    break;
+                }
+                case 0x79: /* 80x200x16 textmode */ {
+                    int y_div_2 = y / 2; // Precompute y / 2
+                    // Calculate screen position
+                    uint8_t *cga_row = (uint8_t *) (frame_vram + 0x8000 + y_div_2 * 80 + (y_div_2 & 1 * 8192));
+                    if (renderer_line_clean(cga_row, 80)) break;
+                    for (int column = 0; column < 40; column++) {
+                        // Access vidram and font data once per character
+                        uint8_t *charcode = cga_row + column * 2; // Character code
+                        uint8_t glyph_row = font_8x8[*charcode * 8]; // Glyph row from font
+                        uint8_t color = *++charcode;
+
+#pragma GCC unroll(8)
+                        for (int bit = 0; bit < 8; bit++) {
+                            *pixels++ = *pixels++ = cga_palette[glyph_row >> bit & 1 ? color & 0x0f : color >> 4];
+                        }
+                    }
+                    break;
+                }
+                case 0x87: {
+                    /* 40x46 ??? */
+                    int y_div_2 = y / 8; // Precompute y / 2
+                    // Calculate screen position
+                    uint8_t *cga_row = (uint8_t *) (frame_vram + 0x8000 + y_div_2 * 80 + (y_div_2 & 1 * 8192));
+                    if (renderer_line_clean(cga_row, 80)) break;
+                    for (int column = 0; column < 40; column++) {
+                        // Access vidram and font data once per character
+                        uint8_t *charcode = cga_row + column * 2; // Character code
+                        uint8_t glyph_row = font_8x8[*charcode * 8 + (y_div_2 % 8)]; // Glyph row from font
+                        uint8_t color = *++charcode;
+
+#pragma GCC unroll(8)
+                        for (int bit = 0; bit < 8; bit++) {
+                            *pixels++ = *pixels++ = cga_palette[glyph_row >> bit & 1 ? color & 0x0f : color >> 4];
+                        }
+                    }
+                    break;
+                }
+                default:
+                    printf("Unsupported frame.videomode %x\n", frame.videomode);
+                    break;
+            }
+        else {
+            uint8_t ydebug = y - 400;
+            uint8_t y_div_8 = ydebug / 8;
+            uint8_t glyph_line = ydebug % 8;
+            if (!renderer_full_redraw && !(renderer_debug_rows >> y_div_8 & 1)) continue;
+
+            const uint8_t colors[4] = {0x0f, 0xf0, 10, 12};
+            //указатель откуда начать считывать символы
+            uint8_t *text_buffer_line = &frame_debug_vram[y_div_8 * 80];
+            for (uint8_t column = 80; column--;) {
+                const uint8_t character = *text_buffer_line++;
+                const uint8_t color = colors[character >> 6];
+                uint8_t glyph_pixels = font_8x8[(32 + (character & 63)) * 8 + glyph_line];
+                //считываем из быстрой палитры начало таблицы быстрого преобразования 2-битных комбинаций цветов пикселей
+                // Unrolled bit loop: Write 8 pixels with scaling (2x horizontally)
+                for (int bit = 0; bit < 8; bit++) {
+                    *pixels++ = cga_palette[glyph_pixels >> bit & 1 ? color & 0x0f : color >> 4];
+                }
+            }
+        }
+    }
+    renderer_front.store(back, std::memory_order_release);
+}
+
+// Synchronous capture and draw for front-ends without a render thread
+static INLINE void renderer() {
+    renderer_capture();
+    renderer_draw();
+}
+
+// CPU thread: hands the current frame to the render thread, false while it is still drawing the previous one
+static INLINE bool renderer_submit() {
+    if (renderer_busy.load(std::memory_order_acquire)) return false;
+    renderer_capture();
+    renderer_busy.store(true, std::memory_order_release);
+    renderer_busy.notify_one();
+    return true;
+}
+
+// Render thread body, returns after renderer_stop()
+static INLINE void renderer_thread() {
+    while (true) {
+        renderer_busy.wait(false, std::memory_order_acquire);
+        if (!renderer_running.load(std::memory_order_acquire)) break;
+        renderer_draw();
+        renderer_busy.store(false, std::memory_order_release);
+    }
+}
+
+static INLINE void renderer_stop() {
+    renderer_running.store(false, std::memory_order_release);
+    renderer_busy.store(true, std::memory_order_release);
+    renderer_busy.notify_one();
+}
@@ -2,11 +2,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <dlfcn.h>
+#include <stdatomic.h>
 
 // OSS headers
 #ifdef __linux__
@@ -22,108 +24,215 @@ static int (*pa_simple_write)(void*, const void*, size_t, int*) = NULL;
 static void (*pa_simple_free)(void*) = NULL;
 static char* (*pa_strerror)(int) = NULL;
 
+// ALSA PCM function pointers, handles and hw_params are opaque
+#define ALSA_PCM_STREAM_PLAYBACK 0
+#define ALSA_PCM_ACCESS_RW_INTERLEAVED 3
+#define ALSA_PCM_FORMAT_S16_LE 2
+static void* alsa_lib = NULL;
+static int (*snd_pcm_open)(void**, const char*, int, int) = NULL;
+static int (*snd_pcm_close)(void*) = NULL;
+static int (*snd_pcm_hw_params_malloc)(void**) = NULL;
+static void (*snd_pcm_hw_params_free)(void*) = NULL;
+static int (*snd_pcm_hw_params_any)(void*, void*) = NULL;
+static int (*snd_pcm_hw_params_set_access)(void*, void*, int) = NULL;
+static int (*snd_pcm_hw_params_set_format)(void*, void*, int) = NULL;
+static int (*snd_pcm_hw_params_set_channels)(void*, void*, unsigned int) = NULL;
+static int (*snd_pcm_hw_params_set_rate)(void*, void*, unsigned int, int) = NULL;
+static int (*snd_pcm_hw_params_set_period_size_near)(void*, void*, unsigned long*, int*) = NULL;
+static int (*snd_pcm_hw_params_set_buffer_size_near)(void*, void*, unsigned long*) = NULL;
+static int (*snd_pcm_hw_params)(void*, void*) = NULL;
+static long (*snd_pcm_writei)(void*, const void*, unsigned long) = NULL;
+static int (*snd_pcm_recover)(void*, int, int) = NULL;
+static const char* (*snd_strerror)(int) = NULL;
+
+// Set by linux_audio_configure, survive linux_audio_close
+static linux_audio_backend_t g_audio_backend = LINUX_AUDIO_NONE;
+static char g_audio_device[128] = "";
+static int g_audio_period_frames = 0;
+
 static linux_audio_context_t g_audio_ctx = {0};
 
+// Single-producer/single-consumer ring of interleaved frames between the emulation thread and the
+// audio thread. Each side only advances its own free-running index and publishes it with a release
+// store, so neither side ever takes a lock or waits for the other
+typedef struct {
+    int16_t* data;
+    uint32_t mask;              // ring_frames - 1
+    _Atomic uint32_t write;     // advanced by linux_audio_write
+    _Atomic uint32_t read;      // advanced by the audio thread
+} audio_ring_t;
+
+static audio_ring_t g_audio_ring = {0};
+
+#define AUDIO_MAX_CHANNELS 2
+// The audio thread reads the ring up to 0.5% faster or slower than the sample rate, which is not
+// heard as a pitch change, so that its fill stays at the latency target however the emulator and
+// the device clocks drift apart
+#define AUDIO_RATE_MAX_ADJUST 0.005
+// Weight of each period in the smoothed fill, about 20 periods worth of history
+#define AUDIO_RATE_SMOOTHING 0.05
+// The accumulated error takes over a steady drift from the proportional part, which alone would
+// settle away from the target
+#define AUDIO_RATE_INTEGRAL 0.002
+
+// Linear interpolation state of the audio thread, output frames lie between previous and next
+typedef struct {
+    int16_t previous[AUDIO_MAX_CHANNELS];
+    int16_t next[AUDIO_MAX_CHANNELS];
+    double phase;
+    double fill;                // smoothed ring fill in frames
+    double drift;               // accumulated fill error
+    int playing;                // else silence until the ring has filled up again
+} audio_rate_t;
+
+static audio_rate_t g_audio_rate = {0};
+static int16_t* g_audio_period = NULL;
+
+// File backend, the output and optionally each source on its own
+#define AUDIO_MAX_STEMS 16
+typedef struct {
+    FILE* file;
+    int wav;                    // header sizes are filled in on close
+    uint32_t data_bytes;
+} audio_file_t;
+
+static audio_file_t g_audio_file = {0};
+static audio_file_t g_audio_stems[AUDIO_MAX_STEMS];
+static int g_audio_stem_count = 0;
+
 // Forward declarations
 static int oss_init(linux_audio_context_t* ctx);
 static int pulse_init(linux_audio_context_t* ctx);
+static int alsa_init(linux_audio_context_t* ctx);
+static int file_init(linux_audio_context_t* ctx);
 static void* audio_thread_func(void* arg);
 static int setup_oss_format(int fd, linux_audio_config_t* config);
 static int load_pulse_library();
+static int load_alsa_library();
+static void close_backend(linux_audio_context_t* ctx);
 
-int linux_audio_init(int sample_rate, int channels, int buffer_size) {
+static void free_buffers() {
+    free(g_audio_ring.data);
+    free(g_audio_period);
+    g_audio_ring.data = NULL;
+    g_audio_period = NULL;
+}
+
+void linux_audio_configure(linux_audio_backend_t backend, const char* device, int period_frames) {
+    g_audio_backend = backend;
+    snprintf(g_audio_device, sizeof(g_audio_device), "%s", device ? device : "");
+    g_audio_period_frames = period_frames > 0 ? period_frames : 0;
+}
+
+static int open_backend(linux_audio_context_t* ctx, linux_audio_backend_t backend) {
+    switch (backend) {
+        case LINUX_AUDIO_PULSE: return pulse_init(ctx);
+        case LINUX_AUDIO_ALSA: return alsa_init(ctx);
+        case LINUX_AUDIO_OSS: return oss_init(ctx);
+        case LINUX_AUDIO_NONE:
+        default: return -1;
+    }
+}
+
+int linux_audio_init(int sample_rate, int channels, int latency_frames) {
     if (g_audio_ctx.initialized) {
         return 0; // Already initialized
     }
     
-    memset(&g_audio_ctx, 0, sizeof(g_audio_ctx));
-    
-    // Set up configuration
-    g_audio_ctx.config.sample_rate = sample_rate;
-    g_audio_ctx.config.channels = channels;
-    g_audio_ctx.config.bits_per_sample = 16;
-    g_audio_ctx.config.buffer_size = buffer_size;
-    g_audio_ctx.config.num_buffers = 4;
-    
-    // Initialize synchronization
-    if (pthread_mutex_init(&g_audio_ctx.mutex, NULL) != 0) {
-        printf("Failed to initialize audio mutex\n");
+    if (channels < 1 || channels > AUDIO_MAX_CHANNELS || latency_frames < 16) {
+        fprintf(stderr, "Audio: Unsupported format (%d channels, %d frames latency)\n", channels, latency_frames);
         return -1;
     }
     
-    if (pthread_cond_init(&g_audio_ctx.cond, NULL) != 0) {
-        printf("Failed to initialize audio condition\n");
-        pthread_mutex_destroy(&g_audio_ctx.mutex);
-        return -1;
-    }
-    
-    if (pthread_cond_init(&g_audio_ctx.ready_cond, NULL) != 0) {
-        printf("Failed to initialize ready condition\n");
-        pthread_mutex_destroy(&g_audio_ctx.mutex);
-        pthread_cond_destroy(&g_audio_ctx.cond);
-        return -1;
-    }
+    memset(&g_audio_ctx, 0, sizeof(g_audio_ctx));
     
-    // Allocate audio buffers
-    for (int i = 0; i < g_audio_ctx.config.num_buffers; i++) {
-        size_t buffer_bytes = buffer_size * channels * sizeof(int16_t);
-        g_audio_ctx.buffers[i].data = malloc(buffer_bytes);
-        if (!g_audio_ctx.buffers[i].data) {
-            printf("Failed to allocate audio buffer %d\n", i);
-            // Clean up previously allocated buffers
-            for (int j = 0; j < i; j++) {
-                free(g_audio_ctx.buffers[j].data);
-            }
-            pthread_mutex_destroy(&g_audio_ctx.mutex);
-            pthread_cond_destroy(&g_audio_ctx.cond);
-            pthread_cond_destroy(&g_audio_ctx.ready_cond);
+    // The file backend needs neither ring nor thread, linux_audio_write writes to it
+    if (g_audio_backend == LINUX_AUDIO_FILE) {
+        g_audio_ctx.config.sample_rate = sample_rate;
+        g_audio_ctx.config.channels = channels;
+        g_audio_ctx.config.bits_per_sample = 16;
+        if (file_init(&g_audio_ctx) != 0) {
             return -1;
         }
-        g_audio_ctx.buffers[i].size = buffer_bytes;
-        g_audio_ctx.buffers[i].ready = 0;
-        memset(g_audio_ctx.buffers[i].data, 0, buffer_bytes);
-    }
-    
-    // Try PulseAudio first
-    if (pulse_init(&g_audio_ctx) == 0) {
-        g_audio_ctx.backend = LINUX_AUDIO_PULSE;
+        g_audio_ctx.backend = LINUX_AUDIO_FILE;
         g_audio_ctx.initialized = 1;
-        printf("Audio: PulseAudio backend initialized (%d Hz, %d channels)\n", 
-               sample_rate, channels);
+        fprintf(stderr, "Audio: Writing %s (%d Hz, %d channels)\n", g_audio_device, sample_rate, channels);
         return 0;
     }
     
-    // Try to initialize OSS as fallback
-    if (oss_init(&g_audio_ctx) == 0) {
-        g_audio_ctx.backend = LINUX_AUDIO_OSS;
-        g_audio_ctx.initialized = 1;
-        printf("Audio: OSS backend initialized (%d Hz, %d channels)\n", 
-               sample_rate, channels);
-        return 0;
+    // Set up configuration: the device gets a period at a time, a quarter of the latency
+    if (g_audio_period_frames) {
+        latency_frames = g_audio_period_frames * 4;
+    }
+    g_audio_ctx.config.sample_rate = sample_rate;
+    g_audio_ctx.config.channels = channels;
+    g_audio_ctx.config.bits_per_sample = 16;
+    g_audio_ctx.config.latency_frames = latency_frames;
+    g_audio_ctx.config.period_frames = latency_frames / 4;
+    
+    // Open the configured backend, or PulseAudio first with ALSA and OSS as fallbacks
+    static const linux_audio_backend_t fallbacks[] = { LINUX_AUDIO_PULSE, LINUX_AUDIO_ALSA, LINUX_AUDIO_OSS };
+    for (size_t i = 0; i < sizeof(fallbacks) / sizeof(fallbacks[0]); i++) {
+        const linux_audio_backend_t backend = g_audio_backend != LINUX_AUDIO_NONE ? g_audio_backend : fallbacks[i];
+        if (open_backend(&g_audio_ctx, backend) == 0) {
+            g_audio_ctx.backend = backend;
+            break;
+        }
+        if (g_audio_backend != LINUX_AUDIO_NONE) {
+            break;
+        }
     }
     
-    // If OSS fails, clean up and return error
-    printf("Audio: No working backend found\n");
-    for (int i = 0; i < g_audio_ctx.config.num_buffers; i++) {
-        free(g_audio_ctx.buffers[i].data);
+    if (g_audio_ctx.backend == LINUX_AUDIO_NONE) {
+        fprintf(stderr, "Audio: No working backend found\n");
+        return -1;
     }
-    pthread_mutex_destroy(&g_audio_ctx.mutex);
-    pthread_cond_destroy(&g_audio_ctx.cond);
-    pthread_cond_destroy(&g_audio_ctx.ready_cond);
     
-    return -1;
+    // ALSA may have rounded the period to what the device supports, the latency stays four of them.
+    // The ring has room for four times the latency so that a late audio thread does not drop frames
+    g_audio_ctx.config.latency_frames = g_audio_ctx.config.period_frames * 4;
+    g_audio_ctx.config.ring_frames = 1;
+    while (g_audio_ctx.config.ring_frames < g_audio_ctx.config.latency_frames * 4) {
+        g_audio_ctx.config.ring_frames <<= 1;
+    }
+    g_audio_ring.data = calloc((size_t)g_audio_ctx.config.ring_frames * channels, sizeof(int16_t));
+    g_audio_period = calloc((size_t)g_audio_ctx.config.period_frames * channels, sizeof(int16_t));
+    if (!g_audio_ring.data || !g_audio_period) {
+        fprintf(stderr, "Audio: Failed to allocate the audio ring\n");
+        close_backend(&g_audio_ctx);
+        free_buffers();
+        return -1;
+    }
+    g_audio_ring.mask = g_audio_ctx.config.ring_frames - 1;
+    atomic_init(&g_audio_ring.write, 0);
+    atomic_init(&g_audio_ring.read, 0);
+    
+    g_audio_ctx.initialized = 1;
+    fprintf(stderr, "Audio: %s backend initialized (%d Hz, %d channels, %d frame periods)\n",
+           linux_audio_get_backend_name(), g_audio_ctx.config.sample_rate, channels,
+           g_audio_ctx.config.period_frames);
+    return 0;
 }
 
 static int oss_init(linux_audio_context_t* ctx) {
-    // Try to open OSS device
-    ctx->audio_fd = open("/dev/dsp", O_WRONLY | O_NONBLOCK);
+    // Open the configured device
+    if (g_audio_device[0]) {
+        ctx->audio_fd = open(g_audio_device, O_WRONLY | O_NONBLOCK);
+        if (ctx->audio_fd < 0) {
+            fprintf(stderr, "Audio: Failed to open OSS device %s: %s\n", g_audio_device, strerror(errno));
+            return -1;
+        }
+    } else {
+        // Try to open OSS device
+        ctx->audio_fd = open("/dev/dsp", O_WRONLY | O_NONBLOCK);
+    }
     if (ctx->audio_fd < 0) {
         // Try alternative OSS devices
         ctx->audio_fd = open("/dev/dsp0", O_WRONLY | O_NONBLOCK);
         if (ctx->audio_fd < 0) {
             ctx->audio_fd = open("/dev/audio", O_WRONLY | O_NONBLOCK);
             if (ctx->audio_fd < 0) {
-                printf("Audio: Failed to open OSS device: %s\n", strerror(errno));
+                fprintf(stderr, "Audio: Failed to open OSS device: %s\n", strerror(errno));
                 return -1;
             }
         }
@@ -146,27 +255,37 @@ static int oss_init(linux_audio_context_t* ctx) {
 static int setup_oss_format(int fd, linux_audio_config_t* config) {
     int format, channels, sample_rate;
     
+    // Ask for four period sized fragments, the device then buffers about the latency target on top
+    // of the ring. Has to come before the format, drivers that cannot do it keep their default
+    int fragment_bytes = config->period_frames * config->channels * (int)sizeof(int16_t);
+    int fragment_shift = 4;
+    while ((1 << (fragment_shift + 1)) <= fragment_bytes) {
+        fragment_shift++;
+    }
+    int fragment = (4 << 16) | fragment_shift;
+    ioctl(fd, SNDCTL_DSP_SETFRAGMENT, &fragment);
+    
     // Set sample format (16-bit signed)
     format = AFMT_S16_LE;
     if (ioctl(fd, SNDCTL_DSP_SETFMT, &format) < 0) {
-        printf("Audio: Failed to set sample format: %s\n", strerror(errno));
+        fprintf(stderr, "Audio: Failed to set sample format: %s\n", strerror(errno));
         return -1;
     }
     
     if (format != AFMT_S16_LE) {
-        printf("Audio: Device doesn't support 16-bit signed format\n");
+        fprintf(stderr, "Audio: Device doesn't support 16-bit signed format\n");
         return -1;
     }
     
     // Set number of channels
     channels = config->channels;
     if (ioctl(fd, SNDCTL_DSP_CHANNELS, &channels) < 0) {
-        printf("Audio: Failed to set channels: %s\n", strerror(errno));
+        fprintf(stderr, "Audio: Failed to set channels: %s\n", strerror(errno));
         return -1;
     }
     
     if (channels != config->channels) {
-        printf("Audio: Device doesn't support %d channels (got %d)\n", 
+        fprintf(stderr, "Audio: Device doesn't support %d channels (got %d)\n", 
                config->channels, channels);
         return -1;
     }
@@ -174,20 +293,20 @@ static int setup_oss_format(int fd, linux_audio_config_t* config) {
     // Set sample rate
     sample_rate = config->sample_rate;
     if (ioctl(fd, SNDCTL_DSP_SPEED, &sample_rate) < 0) {
-        printf("Audio: Failed to set sample rate: %s\n", strerror(errno));
+        fprintf(stderr, "Audio: Failed to set sample rate: %s\n", strerror(errno));
         return -1;
     }
     
     // Allow some tolerance in sample rate
     if (abs(sample_rate - config->sample_rate) > config->sample_rate * 0.05) {
-        printf("Audio: Sample rate mismatch: requested %d, got %d\n", 
+        fprintf(stderr, "Audio: Sample rate mismatch: requested %d, got %d\n", 
                config->sample_rate, sample_rate);
         return -1;
     }
     
     config->sample_rate = sample_rate; // Update with actual rate
     
-    printf("Audio: OSS format configured - %d Hz, %d channels, 16-bit\n",
+    fprintf(stderr, "Audio: OSS format configured - %d Hz, %d channels, 16-bit\n",
            sample_rate, channels);
     
     return 0;
@@ -198,7 +317,7 @@ static int load_pulse_library() {
     if (!pulse_lib) {
         pulse_lib = dlopen("libpulse-simple.so", RTLD_LAZY);
         if (!pulse_lib) {
-            printf("Audio: Failed to load PulseAudio library: %s\n", dlerror());
+            fprintf(stderr, "Audio: Failed to load PulseAudio library: %s\n", dlerror());
             return -1;
         }
     }
@@ -209,7 +328,7 @@ static int load_pulse_library() {
     pa_strerror = dlsym(pulse_lib, "pa_strerror");
     
     if (!pa_simple_new || !pa_simple_write || !pa_simple_free || !pa_strerror) {
-        printf("Audio: Failed to load PulseAudio functions\n");
+        fprintf(stderr, "Audio: Failed to load PulseAudio functions\n");
         dlclose(pulse_lib);
         pulse_lib = NULL;
         return -1;
@@ -234,137 +353,417 @@ static int pulse_init(linux_audio_context_t* ctx) {
         .channels = ctx->config.channels
     };
     
+    // Keep the server side buffer at the latency target instead of its default of about two seconds
+    const uint32_t frame_bytes = ctx->config.channels * sizeof(int16_t);
+    struct {
+        uint32_t maxlength;
+        uint32_t tlength;
+        uint32_t prebuf;
+        uint32_t minreq;
+        uint32_t fragsize;
+    } buffer_attr = {
+        .maxlength = (uint32_t)-1,
+        .tlength = ctx->config.latency_frames * frame_bytes,
+        .prebuf = (uint32_t)-1,
+        .minreq = ctx->config.period_frames * frame_bytes,
+        .fragsize = (uint32_t)-1
+    };
+    
     int error;
     ctx->pulse_simple = pa_simple_new(
         NULL,                   // server
         "Pico-286 Emulator",    // name
         1,                      // PA_STREAM_PLAYBACK = 1
-        NULL,                   // device
+        g_audio_device[0] ? g_audio_device : NULL, // device
         "Audio Output",         // stream description
         &sample_spec,           // sample spec
         NULL,                   // channel map
-        NULL,                   // buffer attributes (use defaults)
+        &buffer_attr,           // buffer attributes
         &error                  // error code
     );
     
     if (!ctx->pulse_simple) {
-        printf("Audio: Failed to create PulseAudio stream: %s\n", pa_strerror(error));
+        fprintf(stderr, "Audio: Failed to create PulseAudio stream: %s\n", pa_strerror(error));
         dlclose(pulse_lib);
         pulse_lib = NULL;
         return -1;
     }
     
-    printf("Audio: PulseAudio stream created (%d Hz, %d channels)\n",
+    fprintf(stderr, "Audio: PulseAudio stream created (%d Hz, %d channels)\n",
            ctx->config.sample_rate, ctx->config.channels);
     
     return 0;
 }
 
+static int load_alsa_library() {
+    alsa_lib = dlopen("libasound.so.2", RTLD_LAZY);
+    if (!alsa_lib) {
+        alsa_lib = dlopen("libasound.so", RTLD_LAZY);
+        if (!alsa_lib) {
+            fprintf(stderr, "Audio: Failed to load ALSA library: %s\n", dlerror());
+            return -1;
+        }
+    }
+    
+    snd_pcm_open = dlsym(alsa_lib, "snd_pcm_open");
+    snd_pcm_close = dlsym(alsa_lib, "snd_pcm_close");
+    snd_pcm_hw_params_malloc = dlsym(alsa_lib, "snd_pcm_hw_params_malloc");
+    snd_pcm_hw_params_free = dlsym(alsa_lib, "snd_pcm_hw_params_free");
+    snd_pcm_hw_params_any = dlsym(alsa_lib, "snd_pcm_hw_params_any");
+    snd_pcm_hw_params_set_access = dlsym(alsa_lib, "snd_pcm_hw_params_set_access");
+    snd_pcm_hw_params_set_format = dlsym(alsa_lib, "snd_pcm_hw_params_set_format");
+    snd_pcm_hw_params_set_channels = dlsym(alsa_lib, "snd_pcm_hw_params_set_channels");
+    snd_pcm_hw_params_set_rate = dlsym(alsa_lib, "snd_pcm_hw_params_set_rate");
+    snd_pcm_hw_params_set_period_size_near = dlsym(alsa_lib, "snd_pcm_hw_params_set_period_size_near");
+    snd_pcm_hw_params_set_buffer_size_near = dlsym(alsa_lib, "snd_pcm_hw_params_set_buffer_size_near");
+    snd_pcm_hw_params = dlsym(alsa_lib, "snd_pcm_hw_params");
+    snd_pcm_writei = dlsym(alsa_lib, "snd_pcm_writei");
+    snd_pcm_recover = dlsym(alsa_lib, "snd_pcm_recover");
+    snd_strerror = dlsym(alsa_lib, "snd_strerror");
+    
+    if (!snd_pcm_open || !snd_pcm_close || !snd_pcm_hw_params_malloc || !snd_pcm_hw_params_free ||
+        !snd_pcm_hw_params_any || !snd_pcm_hw_params_set_access || !snd_pcm_hw_params_set_format ||
+        !snd_pcm_hw_params_set_channels || !snd_pcm_hw_params_set_rate ||
+        !snd_pcm_hw_params_set_period_size_near || !snd_pcm_hw_params_set_buffer_size_near ||
+        !snd_pcm_hw_params || !snd_pcm_writei || !snd_pcm_recover || !snd_strerror) {
+        fprintf(stderr, "Audio: Failed to load ALSA functions\n");
+        dlclose(alsa_lib);
+        alsa_lib = NULL;
+        return -1;
+    }
+    
+    return 0;
+}
+
+// Sets the period nearest to `period_frames`, then a buffer of three of the period the device settled on
+static int alsa_set_period(void* pcm, void* params, unsigned long* period_frames, unsigned long* buffer_frames) {
+    int direction = 0;
+    const int error = snd_pcm_hw_params_set_period_size_near(pcm, params, period_frames, &direction);
+    if (error < 0) {
+        return error;
+    }
+    *buffer_frames = *period_frames * 3;
+    return snd_pcm_hw_params_set_buffer_size_near(pcm, params, buffer_frames);
+}
+
+static int alsa_init(linux_audio_context_t* ctx) {
+    if (load_alsa_library() != 0) {
+        return -1;
+    }
+    
+    const char* device = g_audio_device[0] ? g_audio_device : "default";
+    int error = snd_pcm_open(&ctx->alsa_pcm, device, ALSA_PCM_STREAM_PLAYBACK, 0);
+    if (error < 0) {
+        fprintf(stderr, "Audio: Failed to open ALSA device %s: %s\n", device, snd_strerror(error));
+        ctx->alsa_pcm = NULL;
+        dlclose(alsa_lib);
+        alsa_lib = NULL;
+        return -1;
+    }
+    
+    // Interleaved writes of a period at a time into a buffer of three periods, the period size
+    // is the device's nearest to the one asked for
+    unsigned long period_frames = ctx->config.period_frames;
+    unsigned long buffer_frames = 0;
+    void* params = NULL;
+    const char* step = "allocate parameters";
+    if ((error = snd_pcm_hw_params_malloc(&params)) >= 0) {
+        if ((error = snd_pcm_hw_params_any(ctx->alsa_pcm, params)) < 0) {
+            step = "query parameters";
+        } else if ((error = snd_pcm_hw_params_set_access(ctx->alsa_pcm, params, ALSA_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+            step = "set interleaved access";
+        } else if ((error = snd_pcm_hw_params_set_format(ctx->alsa_pcm, params, ALSA_PCM_FORMAT_S16_LE)) < 0) {
+            step = "set 16-bit signed format";
+        } else if ((error = snd_pcm_hw_params_set_channels(ctx->alsa_pcm, params, ctx->config.channels)) < 0) {
+            step = "set channels";
+        } else if ((error = snd_pcm_hw_params_set_rate(ctx->alsa_pcm, params, ctx->config.sample_rate, 0)) < 0) {
+            step = "set sample rate";
+        } else if ((error = alsa_set_period(ctx->alsa_pcm, params, &period_frames, &buffer_frames)) < 0) {
+            step = "set period and buffer size";
+        } else if ((error = snd_pcm_hw_params(ctx->alsa_pcm, params)) < 0) {
+            step = "apply parameters";
+        }
+        snd_pcm_hw_params_free(params);
+    }
+    
+    if (error < 0) {
+        fprintf(stderr, "Audio: Failed to %s: %s\n", step, snd_strerror(error));
+        snd_pcm_close(ctx->alsa_pcm);
+        ctx->alsa_pcm = NULL;
+        dlclose(alsa_lib);
+        alsa_lib = NULL;
+        return -1;
+    }
+    
+    ctx->config.period_frames = (int)period_frames;
+    
+    fprintf(stderr, "Audio: ALSA device %s opened (%lu frame periods, %lu frame buffer)\n",
+           device, period_frames, buffer_frames);
+    
+    return 0;
+}
+
+static void audio_put(uint8_t* at, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        at[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static void audio_file_header(audio_file_t* file, const linux_audio_config_t* config) {
+    const uint32_t frame_bytes = config->channels * sizeof(int16_t);
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    audio_put(header + 4, 36 + file->data_bytes, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    audio_put(header + 16, 16, 4);                  // fmt chunk size
+    audio_put(header + 20, 1, 2);                   // PCM
+    audio_put(header + 22, config->channels, 2);
+    audio_put(header + 24, config->sample_rate, 4);
+    audio_put(header + 28, config->sample_rate * frame_bytes, 4);
+    audio_put(header + 32, frame_bytes, 2);
+    audio_put(header + 34, 16, 2);                  // bits per sample
+    memcpy(header + 36, "data", 4);
+    audio_put(header + 40, file->data_bytes, 4);
+    fwrite(header, 1, sizeof(header), file->file);
+}
+
+static int audio_file_open(audio_file_t* file, const char* path, const linux_audio_config_t* config) {
+    file->file = fopen(path, "wb");
+    if (!file->file) {
+        fprintf(stderr, "Audio: Failed to create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    const char* extension = strrchr(path, '.');
+    file->wav = extension && !strcasecmp(extension, ".wav");
+    file->data_bytes = 0;
+    if (file->wav) {
+        audio_file_header(file, config);
+    }
+    return 0;
+}
+
+// Samples are stored as they are, which is little endian on the hosts this runs on
+static void audio_file_write(audio_file_t* file, const int16_t* frames, size_t count, int channels) {
+    const size_t bytes = count * channels * sizeof(int16_t);
+    if (file->file && fwrite(frames, 1, bytes, file->file) == bytes) {
+        file->data_bytes += (uint32_t)bytes;
+    }
+}
+
+static void audio_file_close(audio_file_t* file, const linux_audio_config_t* config) {
+    if (!file->file) {
+        return;
+    }
+    if (file->wav) {
+        fseek(file->file, 0, SEEK_SET);
+        audio_file_header(file, config);
+    }
+    fclose(file->file);
+    file->file = NULL;
+}
+
+static int file_init(linux_audio_context_t* ctx) {
+    if (!g_audio_device[0]) {
+        fprintf(stderr, "Audio: The file backend needs a file name\n");
+        return -1;
+    }
+    return audio_file_open(&g_audio_file, g_audio_device, &ctx->config);
+}
+
+int linux_audio_open_stems(const char* const* names, int count) {
+    if (g_audio_ctx.backend != LINUX_AUDIO_FILE || count > AUDIO_MAX_STEMS) {
+        return -1;
+    }
+    
+    // out.wav gives out-opl.wav, out-sb.wav...
+    const char* slash = strrchr(g_audio_device, '/');
+    const char* extension = strrchr(g_audio_device, '.');
+    if (!extension || (slash && extension < slash)) {
+        extension = g_audio_device + strlen(g_audio_device);
+    }
+    for (int i = 0; i < count; i++) {
+        char path[sizeof(g_audio_device) + 32];
+        snprintf(path, sizeof(path), "%.*s-%s%s", (int)(extension - g_audio_device), g_audio_device, names[i], extension);
+        if (audio_file_open(&g_audio_stems[i], path, &g_audio_ctx.config) != 0) {
+            return -1;
+        }
+        g_audio_stem_count = i + 1;
+    }
+    return 0;
+}
+
+void linux_audio_write_stem(int stem, const int16_t* frames, size_t count) {
+    if (g_audio_ctx.running && stem >= 0 && stem < g_audio_stem_count) {
+        audio_file_write(&g_audio_stems[stem], frames, count, g_audio_ctx.config.channels);
+    }
+}
+
 int linux_audio_start() {
     if (!g_audio_ctx.initialized || g_audio_ctx.running) {
         return -1;
     }
     
+    if (g_audio_ctx.backend == LINUX_AUDIO_FILE) {
+        g_audio_ctx.running = 1;
+        fprintf(stderr, "Audio: Started\n");
+        return 0;
+    }
+    
+    memset(&g_audio_rate, 0, sizeof(g_audio_rate));
+    atomic_store(&g_audio_ring.read, atomic_load(&g_audio_ring.write));
     g_audio_ctx.running = 1;
-    g_audio_ctx.current_buffer = 0;
-    g_audio_ctx.write_buffer = 0;
     
     // Start audio thread
     if (pthread_create(&g_audio_ctx.audio_thread, NULL, audio_thread_func, NULL) != 0) {
-        printf("Failed to create audio thread\n");
+        fprintf(stderr, "Failed to create audio thread\n");
         g_audio_ctx.running = 0;
         return -1;
     }
     
-    printf("Audio: Started\n");
+    fprintf(stderr, "Audio: Started\n");
     return 0;
 }
 
+// Fills a period from the ring, resampled by the ratio that steers the ring fill towards the latency target
+static void audio_rate_period(linux_audio_context_t* ctx, int16_t* out) {
+    audio_rate_t* rate = &g_audio_rate;
+    const int channels = ctx->config.channels;
+    const int frames = ctx->config.period_frames;
+    const double target = ctx->config.latency_frames;
+    const uint32_t write = atomic_load_explicit(&g_audio_ring.write, memory_order_acquire);
+    uint32_t read = atomic_load_explicit(&g_audio_ring.read, memory_order_relaxed);
+    uint32_t available = write - read;
+    
+    // Past twice the target the rate control would take many seconds to catch up, after the thread
+    // stalled for instance, so the oldest frames are skipped instead
+    if (available > 2 * (uint32_t)target) {
+        read += available - (uint32_t)target;
+        available = (uint32_t)target;
+        rate->fill = target;
+    }
+    
+    // Start, and restart after running dry, only once the ring holds the latency target
+    if (!rate->playing) {
+        if (available < (uint32_t)target) {
+            memset(out, 0, (size_t)frames * channels * sizeof(int16_t));
+            return;
+        }
+        memcpy(rate->next, &g_audio_ring.data[(read & g_audio_ring.mask) * channels], channels * sizeof(int16_t));
+        memcpy(rate->previous, rate->next, sizeof(rate->previous));
+        read++;
+        rate->phase = 0;
+        rate->fill = available;
+        rate->playing = 1;
+    }
+    
+    rate->fill += ((double)available - rate->fill) * AUDIO_RATE_SMOOTHING;
+    const double error = (rate->fill - target) / target;
+    rate->drift += error * AUDIO_RATE_INTEGRAL;
+    if (rate->drift > 1) rate->drift = 1;
+    if (rate->drift < -1) rate->drift = -1;
+    double adjust = error + rate->drift;
+    if (adjust > 1) adjust = 1;
+    if (adjust < -1) adjust = -1;
+    const double step = 1.0 + AUDIO_RATE_MAX_ADJUST * adjust;
+    
+    for (int frame = 0; frame < frames; frame++) {
+        for (int channel = 0; channel < channels; channel++) {
+            const int previous = rate->previous[channel];
+            out[frame * channels + channel] =
+                (int16_t)(previous + (int)((rate->next[channel] - previous) * rate->phase));
+        }
+        rate->phase += step;
+        while (rate->phase >= 1.0) {
+            rate->phase -= 1.0;
+            memcpy(rate->previous, rate->next, sizeof(rate->previous));
+            if (read == write) {
+                // Ran dry, hold the last frame for the rest of the period
+                if (rate->playing) {
+                    ctx->underruns++;
+                    rate->playing = 0;
+                }
+                rate->phase = 0;
+                break;
+            }
+            memcpy(rate->next, &g_audio_ring.data[(read & g_audio_ring.mask) * channels], channels * sizeof(int16_t));
+            read++;
+        }
+    }
+    
+    atomic_store_explicit(&g_audio_ring.read, read, memory_order_release);
+}
+
 static void* audio_thread_func(void* arg) {
     linux_audio_context_t* ctx = &g_audio_ctx;
+    const size_t period_bytes = (size_t)ctx->config.period_frames * ctx->config.channels * sizeof(int16_t);
     
+    // The blocking device write paces this loop at the device clock
     while (ctx->running) {
-        pthread_mutex_lock(&ctx->mutex);
+        audio_rate_period(ctx, g_audio_period);
         
-        // Wait for a buffer to be ready
-        while (ctx->running && !ctx->buffers[ctx->current_buffer].ready) {
-            pthread_cond_wait(&ctx->cond, &ctx->mutex);
-        }
-        
-        if (!ctx->running) {
-            pthread_mutex_unlock(&ctx->mutex);
-            break;
-        }
-        
-        // Get current buffer
-        linux_audio_buffer_t* buffer = &ctx->buffers[ctx->current_buffer];
-        
-        pthread_mutex_unlock(&ctx->mutex);
-        
-        // Write to audio device (blocking)
         if (ctx->backend == LINUX_AUDIO_OSS) {
-            ssize_t written = write(ctx->audio_fd, buffer->data, buffer->size);
+            ssize_t written = write(ctx->audio_fd, g_audio_period, period_bytes);
             if (written < 0) {
                 if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                    printf("Audio write error: %s\n", strerror(errno));
+                    fprintf(stderr, "Audio write error: %s\n", strerror(errno));
                 }
             }
         } else if (ctx->backend == LINUX_AUDIO_PULSE) {
             int error;
-            if (pa_simple_write(ctx->pulse_simple, buffer->data, buffer->size, &error) < 0) {
-                printf("Audio write error: %s\n", pa_strerror(error));
+            if (pa_simple_write(ctx->pulse_simple, g_audio_period, period_bytes, &error) < 0) {
+                fprintf(stderr, "Audio write error: %s\n", pa_strerror(error));
+            }
+        } else if (ctx->backend == LINUX_AUDIO_ALSA) {
+            const int16_t* frames = g_audio_period;
+            long remaining = ctx->config.period_frames;
+            while (remaining > 0 && ctx->running) {
+                long written = snd_pcm_writei(ctx->alsa_pcm, frames, remaining);
+                if (written < 0) {
+                    // Underrun or suspend, recovering prepares the device again
+                    if (snd_pcm_recover(ctx->alsa_pcm, (int)written, 1) < 0) {
+                        fprintf(stderr, "Audio write error: %s\n", snd_strerror((int)written));
+                        break;
+                    }
+                    continue;
+                }
+                frames += written * ctx->config.channels;
+                remaining -= written;
             }
         }
-        
-        // Mark buffer as processed
-        pthread_mutex_lock(&ctx->mutex);
-        buffer->ready = 0;
-        ctx->current_buffer = (ctx->current_buffer + 1) % ctx->config.num_buffers;
-        
-        // Signal that a buffer is now available
-        pthread_cond_signal(&ctx->ready_cond);
-        pthread_mutex_unlock(&ctx->mutex);
     }
     
     return NULL;
 }
 
-int linux_audio_write(const int16_t* buffer, size_t samples) {
-    if (!g_audio_ctx.initialized || !g_audio_ctx.running) {
-        return -1;
-    }
-    
-    pthread_mutex_lock(&g_audio_ctx.mutex);
-    
-    // Wait for a buffer to be available
-    while (g_audio_ctx.running && g_audio_ctx.buffers[g_audio_ctx.write_buffer].ready) {
-        pthread_cond_wait(&g_audio_ctx.ready_cond, &g_audio_ctx.mutex);
-    }
-    
+size_t linux_audio_write(const int16_t* frames, size_t count) {
     if (!g_audio_ctx.running) {
-        pthread_mutex_unlock(&g_audio_ctx.mutex);
-        return -1;
+        return 0;
     }
     
-    // Copy data to buffer
-    linux_audio_buffer_t* audio_buf = &g_audio_ctx.buffers[g_audio_ctx.write_buffer];
-    size_t bytes_to_copy = samples * g_audio_ctx.config.channels * sizeof(int16_t);
-    
-    if (bytes_to_copy > audio_buf->size) {
-        bytes_to_copy = audio_buf->size;
+    if (g_audio_ctx.backend == LINUX_AUDIO_FILE) {
+        audio_file_write(&g_audio_file, frames, count, g_audio_ctx.config.channels);
+        return count;
     }
     
-    memcpy(audio_buf->data, buffer, bytes_to_copy);
-    audio_buf->ready = 1;
+    const int channels = g_audio_ctx.config.channels;
+    const uint32_t write = atomic_load_explicit(&g_audio_ring.write, memory_order_relaxed);
+    const uint32_t read = atomic_load_explicit(&g_audio_ring.read, memory_order_acquire);
+    const size_t space = g_audio_ring.mask + 1 - (write - read);
     
-    // Move to next buffer
-    g_audio_ctx.write_buffer = (g_audio_ctx.write_buffer + 1) % g_audio_ctx.config.num_buffers;
+    // Frames that do not fit are dropped, the rate control slows the audio thread down the other way
+    if (count > space) {
+        g_audio_ctx.overruns++;
+        count = space;
+    }
     
-    // Signal audio thread
-    pthread_cond_signal(&g_audio_ctx.cond);
-    pthread_mutex_unlock(&g_audio_ctx.mutex);
+    // Copy in at most two pieces, around the end of the ring
+    const uint32_t offset = write & g_audio_ring.mask;
+    const size_t first = count < g_audio_ring.mask + 1 - offset ? count : g_audio_ring.mask + 1 - offset;
+    memcpy(&g_audio_ring.data[offset * channels], frames, first * channels * sizeof(int16_t));
+    memcpy(g_audio_ring.data, frames + first * channels, (count - first) * channels * sizeof(int16_t));
     
-    return 0;
+    atomic_store_explicit(&g_audio_ring.write, write + (uint32_t)count, memory_order_release);
+    return count;
 }
 
 void linux_audio_stop() {
@@ -374,51 +773,59 @@ void linux_audio_stop() {
     
     g_audio_ctx.running = 0;
     
-    // Wake up audio thread
-    pthread_cond_broadcast(&g_audio_ctx.cond);
-    
-    // Wait for thread to finish
-    pthread_join(g_audio_ctx.audio_thread, NULL);
+    // Wait for thread to finish its last period
+    if (g_audio_ctx.backend != LINUX_AUDIO_FILE) {
+        pthread_join(g_audio_ctx.audio_thread, NULL);
+    }
     
-    printf("Audio: Stopped\n");
+    fprintf(stderr, "Audio: Stopped\n");
 }
 
-void linux_audio_close() {
-    if (!g_audio_ctx.initialized) {
-        return;
-    }
-    
-    linux_audio_stop();
-    
+static void close_backend(linux_audio_context_t* ctx) {
     // Close audio device
-    if (g_audio_ctx.backend == LINUX_AUDIO_OSS && g_audio_ctx.audio_fd >= 0) {
-        close(g_audio_ctx.audio_fd);
-        g_audio_ctx.audio_fd = -1;
-    } else if (g_audio_ctx.backend == LINUX_AUDIO_PULSE && g_audio_ctx.pulse_simple) {
-        pa_simple_free(g_audio_ctx.pulse_simple);
-        g_audio_ctx.pulse_simple = NULL;
+    if (ctx->backend == LINUX_AUDIO_OSS && ctx->audio_fd >= 0) {
+        close(ctx->audio_fd);
+        ctx->audio_fd = -1;
+    } else if (ctx->backend == LINUX_AUDIO_PULSE && ctx->pulse_simple) {
+        pa_simple_free(ctx->pulse_simple);
+        ctx->pulse_simple = NULL;
         if (pulse_lib) {
             dlclose(pulse_lib);
             pulse_lib = NULL;
         }
+    } else if (ctx->backend == LINUX_AUDIO_FILE) {
+        audio_file_close(&g_audio_file, &ctx->config);
+        for (int i = 0; i < g_audio_stem_count; i++) {
+            audio_file_close(&g_audio_stems[i], &ctx->config);
+        }
+        g_audio_stem_count = 0;
+    } else if (ctx->backend == LINUX_AUDIO_ALSA && ctx->alsa_pcm) {
+        snd_pcm_close(ctx->alsa_pcm);
+        ctx->alsa_pcm = NULL;
+        if (alsa_lib) {
+            dlclose(alsa_lib);
+            alsa_lib = NULL;
+        }
+    }
+}
+
+void linux_audio_close() {
+    if (!g_audio_ctx.initialized) {
+        return;
     }
     
-    // Free buffers
-    for (int i = 0; i < g_audio_ctx.config.num_buffers; i++) {
-        if (g_audio_ctx.buffers[i].data) {
-            free(g_audio_ctx.buffers[i].data);
-            g_audio_ctx.buffers[i].data = NULL;
-        }
+    linux_audio_stop();
+    close_backend(&g_audio_ctx);
+    
+    if (g_audio_ctx.underruns || g_audio_ctx.overruns) {
+        fprintf(stderr, "Audio: %u underruns, %u overruns\n", g_audio_ctx.underruns, g_audio_ctx.overruns);
     }
     
-    // Destroy synchronization objects
-    pthread_mutex_destroy(&g_audio_ctx.mutex);
-    pthread_cond_destroy(&g_audio_ctx.cond);
-    pthread_cond_destroy(&g_audio_ctx.ready_cond);
+    free_buffers();
     
     memset(&g_audio_ctx, 0, sizeof(g_audio_ctx));
     
-    printf("Audio: Closed\n");
+    fprintf(stderr, "Audio: Closed\n");
 }
 
 linux_audio_backend_t linux_audio_get_backend() {
@@ -430,6 +837,7 @@ const char* linux_audio_get_backend_name() {
         case LINUX_AUDIO_OSS: return "OSS";
         case LINUX_AUDIO_PULSE: return "PulseAudio";
         case LINUX_AUDIO_ALSA: return "ALSA";
+        case LINUX_AUDIO_FILE: return "File";
         case LINUX_AUDIO_NONE: 
         default: return "None";
     }
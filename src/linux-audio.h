@@ -1,6 +1,7 @@
 #ifndef LINUX_AUDIO_H
 #define LINUX_AUDIO_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <pthread.h>
 
@@ -13,7 +14,8 @@ typedef enum {
     LINUX_AUDIO_NONE = 0,
     LINUX_AUDIO_OSS,
     LINUX_AUDIO_PULSE,
-    LINUX_AUDIO_ALSA
+    LINUX_AUDIO_ALSA,
+    LINUX_AUDIO_FILE
 } linux_audio_backend_t;
 
 // Audio configuration
@@ -21,17 +23,11 @@ typedef struct {
     int sample_rate;
     int channels;
     int bits_per_sample;
-    int buffer_size;
-    int num_buffers;
+    int latency_frames;  // ring fill the rate control holds
+    int period_frames;   // frames handed to the device per write
+    int ring_frames;     // ring capacity, a power of two
 } linux_audio_config_t;
 
-// Audio buffer management
-typedef struct {
-    int16_t* data;
-    size_t size;
-    int ready;
-} linux_audio_buffer_t;
-
 // Main audio context
 typedef struct {
     linux_audio_backend_t backend;
@@ -43,30 +39,47 @@ typedef struct {
     // PulseAudio specific
     void* pulse_simple;
     
-    // Buffer management
-    linux_audio_buffer_t buffers[4];
-    int current_buffer;
-    int write_buffer;
+    // ALSA specific
+    void* alsa_pcm;
     
     // Threading
     pthread_t audio_thread;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
-    pthread_cond_t ready_cond;
     
     // Control
-    int running;
+    volatile int running;
     int initialized;
     
+    // Statistics
+    unsigned int underruns;  // the ring ran dry, counted by the audio thread
+    unsigned int overruns;   // the ring was full, counted by the producer
+    
 } linux_audio_context_t;
 
 // Audio API functions
-int linux_audio_init(int sample_rate, int channels, int buffer_size);
+// Selects the backend linux_audio_init opens, LINUX_AUDIO_NONE tries PulseAudio, ALSA and OSS in turn.
+// device is the PulseAudio sink, ALSA PCM or OSS device node, NULL for the default one. period_frames
+// is what the device gets per write, 0 keeps a quarter of the latency. The latency is then the ring
+// target of four periods, which the rate control steers the ring fill to, and the ALSA device buffer
+// of three periods comes on top of it, both counted in the period ALSA rounded to.
+// LINUX_AUDIO_FILE writes to the file named by device instead, a WAV file if it ends in .wav and raw
+// 16-bit little endian samples otherwise. linux_audio_write then writes every frame synchronously,
+// without the ring or rate control, so the emulator can run at any speed
+void linux_audio_configure(linux_audio_backend_t backend, const char* device, int period_frames);
+// latency_frames is how much audio the ring between the emulator and the device holds
+int linux_audio_init(int sample_rate, int channels, int latency_frames);
 int linux_audio_start();
-int linux_audio_write(const int16_t* buffer, size_t samples);
+// Queues interleaved frames without blocking, single producer. Returns the frames queued,
+// fewer than given when the ring is full
+size_t linux_audio_write(const int16_t* frames, size_t count);
 void linux_audio_stop();
 void linux_audio_close();
 
+// File backend only: also writes each of count sources to a file of its own, named like the output file
+// with -name before the extension
+int linux_audio_open_stems(const char* const* names, int count);
+// Writes frames of the stem at index in the names given to linux_audio_open_stems
+void linux_audio_write_stem(int stem, const int16_t* frames, size_t count);
+
 // Get current backend
 linux_audio_backend_t linux_audio_get_backend();
 const char* linux_audio_get_backend_name();
@@ -1,27 +1,23 @@
 #include <pthread.h>
 #include <unistd.h>
+#include <atomic>
 #include <cstring>
 #include <signal.h>
 #include <sys/time.h>
 #include <cstdio>
+#include <cstdlib>
 #include "MiniFB.h"
 #include "emulator/emulator.h"
-#include "emulator/includes/font8x16.h"
-#include "emulator/includes/font8x8.h"
 #include "emu8950.h"
 #include "linux-audio.h"
+#include "host-renderer.cpp.inl"
 
-static uint32_t ALIGN(4, SCREEN[640 * 480]);
-uint8_t ALIGN(4, DEBUG_VRAM[80 * 10]) = {0};
-
-int cursor_blink_state = 0;
 uint8_t log_debug = 0;
 
 extern OPL *emu8950_opl;
 
-#define AUDIO_BUFFER_LENGTH ((SOUND_FREQUENCY / 10))
-static int16_t audio_buffer[AUDIO_BUFFER_LENGTH * 2] = {};
-static int sample_index = 0;
+// Audio queued between the emulator and the device, the rate control keeps it at 40 ms
+#define AUDIO_LATENCY_FRAMES ((SOUND_FREQUENCY / 25))
 
 extern "C" void adlib_getsample(int16_t *sndptr, intptr_t numsamples);
 
@@ -55,432 +51,40 @@ extern "C" void _putchar(char character) {
     }
 }
 
-static inline void renderer() {
-    static uint8_t v = 0;
-    if (v != videomode) {
-        printf("videomode %x %x\n", videomode, v);
-        v = videomode;
-    }
-
-    uint8_t *vidramptr = VIDEORAM + 0x8000 + ((vram_offset & 0xffff) << 1);
-    uint8_t cols = 80;
-    for (int y = 0; y < 480; y++) {
-        if (y >= 399)
-            port3DA = 8;
-        else
-            port3DA = 0;
-
-        if (y & 1)
-            port3DA |= 1;
-
-        uint32_t *pixels = SCREEN + y * 640;
-
-        if (y < 400)
-            switch (videomode) {
-                case 0x00:
-                case 0x01: {
-                    uint16_t y_div_16 = y / 16; // Precompute y / 16
-                    uint8_t glyph_line = (y / 2) % 8; // Precompute y % 8 for font lookup
-                    // Calculate screen position
-                    uint8_t *text_buffer_line = vidramptr + y_div_16 * 80;
-
-                    for (int column = 0; column < 40; column++) {
-                        uint8_t glyph_pixels = font_8x8[*text_buffer_line++ * 8 + glyph_line]; // Glyph row from font
-                        uint8_t color = *text_buffer_line++; // Color attribute
-
-                        // Cursor blinking check
-                        uint8_t cursor_active = cursor_blink_state &&
-                                                y_div_16 == CURSOR_Y && column == CURSOR_X &&
-                                                glyph_line >= cursor_start && glyph_line <= cursor_end;
-
-                        for (uint8_t bit = 0; bit < 8; bit++) {
-                            uint8_t pixel_color;
-                            if (cursor_active) {
-                                pixel_color = color & 0x0F; // Cursor foreground color
-                            } else if (cga_blinking && color >> 7 & 1) {
-                                pixel_color = cursor_blink_state ? color >> 4 & 0x7 : color & 0x7; // Blinking background color
-                            } else {
-                                pixel_color = glyph_pixels >> bit & 1 ? color & 0x0f : color >> 4;
-                                // Foreground or background color
-                            }
-
-                            // Write the pixel twice (horizontal scaling)
-                            *pixels++ = *pixels++ = cga_palette[pixel_color];
-                        }
-                    }
-
-
-                    break;
-                }
-                case 0x02:
-                case 0x03: {
-                    uint16_t y_div_16 = y / 16; // Precompute y / 16
-                    uint8_t glyph_line = y % 16; // Precompute y % 8 for font lookup
-
-                    // Calculate screen position
-                    uint8_t *text_row = vidramptr + y_div_16 * 160;
-                    for (uint8_t column = 0; column < 80; column++) {
-                        // Access vidram and font data once per character
-                        uint8_t *charcode = text_row + column * 2; // Character code
-                        uint8_t glyph_row = font_8x16[*charcode * 16 + glyph_line]; // Glyph row from font
-                        uint8_t color = *++charcode; // Color attribute
-
-                        // Cursor blinking check
-                        uint8_t cursor_active =
-                                cursor_blink_state && y_div_16 == CURSOR_Y && column == CURSOR_X &&
-                                (cursor_start > cursor_end
-                                     ? !(glyph_line >= cursor_end << 1 &&
-                                         glyph_line <= cursor_start << 1)
-                                     : glyph_line >= cursor_start << 1 && glyph_line <= cursor_end << 1);
-
-                        // Unrolled bit loop: Write 8 pixels with scaling (2x horizontally)
-                        for (int bit = 0; bit < 8; bit++) {
-                            uint8_t pixel_color;
-                            if (cursor_active) {
-                                pixel_color = color & 0x0F; // Cursor foreground color
-                            } else if (cga_blinking && color >> 7 & 1) {
-                                if (cursor_blink_state) {
-                                    pixel_color = color >> 4 & 0x7; // Blinking background color
-                                } else {
-                                    pixel_color = glyph_row >> bit & 1 ? color & 0x0f : (color >> 4 & 0x7);
-                                }
-                            } else {
-                                // Foreground or background color
-                                pixel_color = glyph_row >> bit & 1 ? color & 0x0f : color >> 4;
-                            }
-
-                            *pixels++ = cga_palette[pixel_color];
-                        }
-                    }
-                    break;
-                }
-                case 0x04:
-                case 0x05: {
-                    uint8_t *cga_row = vidramptr + ((y / 2 >> 1) * 80 + (y / 2 & 1) * 8192); // Precompute CGA row pointer
-                    uint8_t *current_cga_palette = (uint8_t *) cga_gfxpal[cga_colorset][cga_intensity];
-
-                    // Each byte containing 4 pixels
-                    for (int x = 320 / 4; x--;) {
-                        uint8_t cga_byte = *cga_row++;
-
-                        // Extract all four 2-bit pixels from the CGA byte
-                        // and write each pixel twice for horizontal scaling
-                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 6 & 3
-                                                                ? current_cga_palette[cga_byte >> 6 & 3]
-                                                                : cga_foreground_color];
-                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 4 & 3
-                                                                ? current_cga_palette[cga_byte >> 4 & 3]
-                                                                : cga_foreground_color];
-                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 2 & 3
-                                                                ? current_cga_palette[cga_byte >> 2 & 3]
-                                                                : cga_foreground_color];
-                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 0 & 3
-                                                                ? current_cga_palette[cga_byte >> 0 & 3]
-                                                                : cga_foreground_color];
-                    }
-                    break;
-                }
-                case 0x06: {
-                    uint8_t *cga_row = vidramptr + (y / 2 >> 1) * 80 + (y / 2 & 1) * 8192; // Precompute row start
-
-                    // Each byte containing 8 pixels
-                    for (int x = 640 / 8; x--;) {
-                        uint8_t cga_byte = *cga_row++;
-
-                        *pixels++ = cga_palette[(cga_byte >> 7 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 6 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 5 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 4 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 3 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 2 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 1 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 0 & 1) * cga_foreground_color];
-                    }
-
-                    break;
-                }
-                case 0x1e:
-                    cols = 90;
-                    vram_offset = 5;
-                    if (y >= 348) break;
-                case 0x7: {
-                    uint8_t *cga_row = vram_offset + VIDEORAM + (y & 3) * 8192 + y / 4 * cols;
-                    // Each byte containing 8 pixels
-                    for (int x = 640 / 8; x--;) {
-                        uint8_t cga_byte = *cga_row++;
-
-                        *pixels++ = cga_palette[(cga_byte >> 7 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 6 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 5 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 4 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 3 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 2 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 1 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 0 & 1) * 15];
-                    }
-
-                    break;
-                }
-
-                case 0x8:
-                case 0x74: /* 160x200x16    */
-                case 0x76: /* cga composite / tandy */ {
-                    uint32_t *palette;
-                    switch (videomode) {
-                        case 0x08:
-                            palette = tga_palette;
-                            break;
-                        case 0x74:
-                            palette = cga_composite_palette[cga_intensity << 1];
-                            break;
-                        case 0x76:
-                            palette = cga_composite_palette[0];
-                            break;
-                    }
-
-                    uint8_t *cga_row = tga_offset + VIDEORAM + (y / 2 >> 1) * 80 + (y / 2 & 1) * 8192; // Precompute row start
-
-                    // Each byte containing 8 pixels
-                    for (int x = 640 / 8; x--;) {
-                        uint8_t cga_byte = *cga_row++; // Fetch 8 pixels from TGA memory
-                        uint8_t color1 = cga_byte >> 4 & 15;
-                        uint8_t color2 = cga_byte & 15;
-
-                        if (!color1 && videomode == 0x8) color1 = cga_foreground_color;
-                        if (!color2 && videomode == 0x8) color2 = cga_foreground_color;
-
-                        *pixels++ = *pixels++ = *pixels++ = *pixels++ = palette[color1];
-                        *pixels++ = *pixels++ = *pixels++ = *pixels++ = palette[color2];
-                    }
-
-                    break;
-                }
-                case 0x09: /* tandy 320x200 16 color */ {
-                    uint8_t *tga_row = tga_offset + VIDEORAM + (y / 2 & 3) * 8192 + y / 8 * 160;
-                    //                  uint8_t *tga_row = &VIDEORAM[tga_offset+(((y / 2) & 3) * 8192) + ((y / 8) * 160)];
-
-                    // Each byte containing 4 pixels
-                    for (int x = 320 / 2; x--;) {
-                        uint8_t tga_byte = *tga_row++;
-                        *pixels++ = *pixels++ = tga_palette[tga_palette_map[tga_byte >> 4 & 15]];
-                        *pixels++ = *pixels++ = tga_palette[tga_palette_map[tga_byte & 15]];
-                    }
-                    break;
-                }
-                case 0x0a: /* tandy 640x200 16 color */ {
-                    uint8_t *tga_row = VIDEORAM + y / 2 * 320;
-
-                    // Each byte contains 2 pixels
-                    for (int x = 640 / 2; x--;) {
-                        uint8_t tga_byte = *tga_row++;
-                        *pixels++ = tga_palette[tga_palette_map[tga_byte >> 4 & 15]];
-                        *pixels++ = tga_palette[tga_palette_map[tga_byte & 15]];
-                    }
-                    break;
-                }
-                case 0x0D: /* EGA 320x200 16-color */ {
-                    if (y >= 400) break;
-                    uint32_t* vram_ptr = &VIDEORAM[(y / 2) * (320 / 8)];
-                    for (int i = 0; i < (320 / 8); ++i) {
-                        uint32_t eight_pixels = vram_ptr[i];
-                        uint8_t plane0 =  eight_pixels        & 0xFF;
-                        uint8_t plane1 = (eight_pixels >> 8)  & 0xFF;
-                        uint8_t plane2 = (eight_pixels >> 16) & 0xFF;
-                        uint8_t plane3 = (eight_pixels >> 24) & 0xFF;
-
-                        for (int bit = 7; bit >= 0; --bit) {
-                            uint8_t color_index = ((plane0 >> bit) & 1)
-                                                | (((plane1 >> bit) & 1) << 1)
-                                                | (((plane2 >> bit) & 1) << 2)
-                                                | (((plane3 >> bit) & 1) << 3);
-                            uint32_t color = vga_palette[color_index];
-                            *pixels++ = color;
-                            *pixels++ = color;
-                        }
-                    }
-                    break;
-                }
-                case 0x0E: /* EGA 640x200 16-color */ {
-                    if (y >= 400) break;
-                    uint32_t* vram_ptr = &VIDEORAM[(y / 2) * (640 / 8)];
-                    for (int i = 0; i < (640 / 8); ++i) {
-                        uint32_t eight_pixels = vram_ptr[i];
-                        uint8_t plane0 =  eight_pixels        & 0xFF;
-                        uint8_t plane1 = (eight_pixels >> 8)  & 0xFF;
-                        uint8_t plane2 = (eight_pixels >> 16) & 0xFF;
-                        uint8_t plane3 = (eight_pixels >> 24) & 0xFF;
-
-                        for (int bit = 7; bit >= 0; --bit) {
-                            uint8_t color_index = ((plane0 >> bit) & 1)
-                                                | (((plane1 >> bit) & 1) << 1)
-                                                | (((plane2 >> bit) & 1) << 2)
-                                                | (((plane3 >> bit) & 1) << 3);
-                            *pixels++ = vga_palette[color_index];
-                        }
-                    }
-                    break;
-                }
-                case 0x10: /* EGA 640x350 16-color */ {
-                    if (y >= 350) break;
-                    uint32_t* vram_ptr = &VIDEORAM[y * (640 / 8)];
-                    for (int i = 0; i < (640 / 8); ++i) {
-                        uint32_t eight_pixels = vram_ptr[i];
-                        uint8_t plane0 =  eight_pixels        & 0xFF;
-                        uint8_t plane1 = (eight_pixels >> 8)  & 0xFF;
-                        uint8_t plane2 = (eight_pixels >> 16) & 0xFF;
-                        uint8_t plane3 = (eight_pixels >> 24) & 0xFF;
-
-                        for (int bit = 7; bit >= 0; --bit) {
-                            uint8_t color_index = ((plane0 >> bit) & 1)
-                                                | (((plane1 >> bit) & 1) << 1)
-                                                | (((plane2 >> bit) & 1) << 2)
-                                                | (((plane3 >> bit) & 1) << 3);
-                            *pixels++ = vga_palette[color_index];
-                        }
-                    }
-                    break;
-                }
-                case 0x11: /* VGA 640x480 2-color */ {
-                    uint8_t *cga_row = (uint8_t *) (VIDEORAM + y * 80);
-                    // Each byte containing 8 pixels
-                    for (int x = 640 / 8; x--;) {
-                        uint8_t cga_byte = *cga_row++;
-
-                        *pixels++ = cga_palette[(cga_byte >> 7 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 6 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 5 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 4 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 3 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 2 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 1 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 0 & 1) * 15];
-                    }
-
-                    break;
-                }
-                case 0x12: /* VGA 640x480 16-color */ {
-                    if (y >= 480) break;
-                    uint32_t* vram_ptr = &VIDEORAM[y * (640 / 8)];
-                    for (int i = 0; i < (640 / 8); ++i) {
-                        uint32_t eight_pixels = vram_ptr[i];
-                        uint8_t plane0 =  eight_pixels        & 0xFF;
-                        uint8_t plane1 = (eight_pixels >> 8)  & 0xFF;
-                        uint8_t plane2 = (eight_pixels >> 16) & 0xFF;
-                        uint8_t plane3 = (eight_pixels >> 24) & 0xFF;
-
-                        for (int bit = 7; bit >= 0; --bit) {
-                            uint8_t color_index = ((plane0 >> bit) & 1)
-                                                | (((plane1 >> bit) & 1) << 1)
-                                                | (((plane2 >> bit) & 1) << 2)
-                                                | (((plane3 >> bit) & 1) << 3);
-                            *pixels++ = vga_palette[color_index];
-                        }
-                    }
-                    break;
-                }
-                case 0x13: {
-                    if (vga_planar_mode) {
-                        for (int x = 0; x < 320; x++) {
-                            uint32_t ptr = x + (y >> 1) * 320;
-                            ptr = (ptr >> 2) + (x & 3) * vga_plane_size;
-                            ptr += vram_offset;
-                            uint32_t color = vga_palette[VIDEORAM[ptr]];
-                            *pixels++ = *pixels++ = color;
-                        }
-                    } else {
-                        uint8_t *vga_row = VIDEORAM + (y >> 1) * 320;
-                        for (int x = 0; x < 320; x++) {
-                            uint32_t color = vga_palette[*vga_row++];
-                            *pixels++ = *pixels++ = color;
-                        }
-                    }
-
-                    break;
-                }
-                case 0x78: /* 80x100x16 textmode */
-                    cols = 40;
-                case 0x77: /* 160x100x16 textmode */ {
-                    uint16_t y_div_4 = y / 4; // Precompute y / 4
-                    uint8_t odd_even = y / 2 & 1;
-                    // Calculate screen position
-                    uint8_t *cga_row = VIDEORAM + 0x8000 + y_div_4 * 160;
-                    for (uint8_t column = 0; column < cols; column++) {
-                        // Access vidram and font data once per character
-                        uint8_t *charcode = cga_row + column * 2; // Character code
-                        uint8_t glyph_row = font_8x8[*charcode * 8 + odd_even]; // Glyph row from font
-                        uint8_t color = *++charcode;
-
-#pragma GCC unroll(8)
-                        for (uint8_t bit = 0; bit < 8; bit++) {
-                            *pixels++ = cga_palette[glyph_row >> bit & 1 ? color & 0x0f : color >> 4];
-                        }
-                    }
-                    break;
-                }
-                case 0x79: /* 80x200x16 textmode */ {
-                    int y_div_2 = y / 2; // Precompute y / 2
-                    // Calculate screen position
-                    uint8_t *cga_row = VIDEORAM + 0x8000 + y_div_2 * 80 + (y_div_2 & 1 * 8192);
-                    for (int column = 0; column < 40; column++) {
-                        // Access vidram and font data once per character
-                        uint8_t *charcode = cga_row + column * 2; // Character code
-                        uint8_t glyph_row = font_8x8[*charcode * 8]; // Glyph row from font
-                        uint8_t color = *++charcode;
-
-#pragma GCC unroll(8)
-                        for (int bit = 0; bit < 8; bit++) {
-                            *pixels++ = *pixels++ = cga_palette[glyph_row >> bit & 1 ? color & 0x0f : color >> 4];
-                        }
-                    }
-                    break;
-                }
-                case 0x87: {
-                    /* 40x46 ??? */
-                    int y_div_2 = y / 8; // Precompute y / 2
-                    // Calculate screen position
-                    uint8_t *cga_row = VIDEORAM + 0x8000 + y_div_2 * 80 + (y_div_2 & 1 * 8192);
-                    for (int column = 0; column < 40; column++) {
-                        // Access vidram and font data once per character
-                        uint8_t *charcode = cga_row + column * 2; // Character code
-                        uint8_t glyph_row = font_8x8[*charcode * 8 + (y_div_2 % 8)]; // Glyph row from font
-                        uint8_t color = *++charcode;
-
-#pragma GCC unroll(8)
-                        for (int bit = 0; bit < 8; bit++) {
-                            *pixels++ = *pixels++ = cga_palette[glyph_row >> bit & 1 ? color & 0x0f : color >> 4];
-                        }
-                    }
-                    break;
-                }
-                default:
-                    printf("Unsupported videomode %x\n", videomode);
-                    break;
-            }
-        else {
-            uint8_t ydebug = y - 400;
-            uint8_t y_div_8 = ydebug / 8;
-            uint8_t glyph_line = ydebug % 8;
-
-            const uint8_t colors[4] = {0x0f, 0xf0, 10, 12};
-            //указатель откуда начать считывать символы
-            uint8_t *text_buffer_line = &DEBUG_VRAM[y_div_8 * 80];
-            for (uint8_t column = 80; column--;) {
-                const uint8_t character = *text_buffer_line++;
-                const uint8_t color = colors[character >> 6];
-                uint8_t glyph_pixels = font_8x8[(32 + (character & 63)) * 8 + glyph_line];
-                //считываем из быстрой палитры начало таблицы быстрого преобразования 2-битных комбинаций цветов пикселей
-                // Unrolled bit loop: Write 8 pixels with scaling (2x horizontally)
-                for (int bit = 0; bit < 8; bit++) {
-                    *pixels++ = cga_palette[glyph_pixels >> bit & 1 ? color & 0x0f : color >> 4];
-                }
-            }
-        }
-    }
-}
-
 extern "C" void HandleInput(unsigned int keycode, int isKeyDown) {
     // Convert X11 keycode to PC scancode
     unsigned char scancode = 0;
+    static bool ctrl_down = false, alt_down = false;
+    if (keycode == 17) ctrl_down = isKeyDown;
+    if (keycode == 18) alt_down = isKeyDown;
+    // CTRL + ALT + F11 switches the emulated CPU clock
+    if (keycode == 122 && isKeyDown && ctrl_down && alt_down) {
+        cpu_set_clock((cpu_clock_t) ((cpu_clock + 1) % CPU_CLOCKS));
+        printf("CPU: %s\n", cpu_clock_name(cpu_clock));
+        return;
+    }
+    // CTRL + ALT + F9 saves the machine, CTRL + ALT + F10 restores it
+    if (keycode == 120 && isKeyDown && ctrl_down && alt_down) {
+        if (savestate_save(SAVESTATE_HOTKEY_FILE)) printf("State saved to %s\n", SAVESTATE_HOTKEY_FILE);
+        return;
+    }
+    if (keycode == 121 && isKeyDown && ctrl_down && alt_down) {
+        if (savestate_load(SAVESTATE_HOTKEY_FILE)) printf("State loaded from %s\n", SAVESTATE_HOTKEY_FILE);
+        return;
+    }
+    // CTRL + ALT + F8 rewinds to the previous snapshot
+    if (keycode == 119 && isKeyDown && ctrl_down && alt_down) {
+        if (snapshot_rewind(snapshot_count() > 1 ? 1 : 0)) printf("Rewound, %u snapshots left\n", snapshot_count());
+        return;
+    }
+#ifdef EMULATOR_PROFILER
+    // CTRL + ALT + F12 dumps and restarts the profiler
+    if (keycode == 123 && isKeyDown && ctrl_down && alt_down) {
+        profiler_dump();
+        profiler_reset();
+        return;
+    }
+#endif
 
     switch (keycode) {
         case 27: scancode = 0x01;
@@ -640,117 +244,104 @@ void signal_handler(int sig) {
     running = 0;
 }
 
-pthread_mutex_t update_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t update_cond = PTHREAD_COND_INITIALIZER;
-volatile int update_ready = 0;
-
-void *sound_thread(void *arg) {
-    while (running) {
-        pthread_mutex_lock(&update_mutex);
-        while (!update_ready && running) {
-            pthread_cond_wait(&update_cond, &update_mutex);
-        }
-        if (!running) {
-            pthread_mutex_unlock(&update_mutex);
-            break;
-        }
-        update_ready = 0;
-        pthread_mutex_unlock(&update_mutex);
-
-        // Send audio buffer to Linux audio system
-        if (linux_audio_write(audio_buffer, AUDIO_BUFFER_LENGTH) != 0) {
-            // Audio write failed, but continue running
-            // printf("Audio write failed!\n");
-            // usleep(1000); // 1ms delay
-        }
-    }
+void *render_thread(void *arg) {
+    renderer_thread();
     return NULL;
 }
 
-void *ticks_thread(void *arg) {
-    struct timespec start, current;
-    clock_gettime(CLOCK_MONOTONIC, &start);
-
-    uint64_t elapsed_system_timer = 0;
-    uint64_t elapsed_blink_tics = 0;
-    uint64_t elapsed_frame_tics = 0;
-    uint64_t last_dss_tick = 0;
-    uint64_t last_sb_tick = 0;
-    uint64_t last_sound_tick = 0;
-
-    int16_t last_dss_sample = 0;
-    int16_t last_sb_sample = 0;
-
-    const uint64_t hostfreq = 1000000000; // nanoseconds
-
-    while (running) {
-        clock_gettime(CLOCK_MONOTONIC, &current);
+// Timed device events run on the emulated clock from inside exec86()
+static scheduler_event_t dss_event, sb_event, sound_event, blink_event, frame_event;
+static int16_t last_dss_sample = 0;
+static int16_t last_sb_sample = 0;
+static uint64_t sb_event_rate = 0;
+static volatile int frame_ready = 0;
+static int frames_elapsed = 0;
 
-        uint64_t elapsedTime = (current.tv_sec - start.tv_sec) * hostfreq + (current.tv_nsec - start.tv_nsec);
+extern "C" uint64_t sb_samplerate;
 
-        // Timer interrupt (~18.2 Hz)
-        if (elapsedTime - elapsed_system_timer >= hostfreq / timer_period) {
-            doirq(0);
-            elapsed_system_timer = elapsedTime;
-        }
+static void dss_tick() {
+    last_dss_sample = dss_sample();
+}
 
-        // Disney Sound Source frequency ~7KHz
-        if (elapsedTime - last_dss_tick >= hostfreq / 7000) {
-            last_dss_sample = dss_sample();
-            last_dss_tick = elapsedTime;
-        }
+static void sb_tick() {
+    last_sb_sample = blaster_sample();
+    if (sb_event_rate != sb_samplerate) {
+        sb_event_rate = sb_samplerate;
+        scheduler_start_hz(&sb_event, sb_tick, sb_event_rate);
+    }
+}
 
-        // Sound Blaster
-        if (elapsedTime - last_sb_tick >= hostfreq / 22050) {
-            last_sb_sample = blaster_sample();
-            last_sb_tick = elapsedTime;
-        }
+// Collects the host-clocked sources every sample, the synths are mixed a block at a time
+// and queued straight into the audio ring, which never blocks the emulation
+static void sound_tick() {
+    static int16_t other_samples[SOUND_BLOCK_SAMPLES];
+    static int16_t samples[SOUND_BLOCK_SAMPLES * 2];
+    static int other_count = 0;
 
-        // Audio samples
-        if (elapsedTime - last_sound_tick >= hostfreq / SOUND_FREQUENCY) {
-            get_sound_sample(last_dss_sample + last_sb_sample, &audio_buffer[sample_index]);
-            sample_index += 2;
-            
-
-            if (sample_index >= AUDIO_BUFFER_LENGTH * 2) {
-                pthread_mutex_lock(&update_mutex);
-                update_ready = 1;
-                pthread_cond_signal(&update_cond);
-                pthread_mutex_unlock(&update_mutex);
-                sample_index = 0;
-            }
+    other_samples[other_count++] = last_dss_sample + covox_sample + last_sb_sample + speaker_sample();
+    if (other_count < SOUND_BLOCK_SAMPLES) return;
 
-            last_sound_tick = elapsedTime;
-        }
+    get_sound_samples(other_samples, samples, other_count);
+    linux_audio_write(samples, other_count);
+    other_count = 0;
+}
 
-        // Cursor blink
-        if (elapsedTime - elapsed_blink_tics >= 333333333) {
-            // ~3Hz
-            cursor_blink_state ^= 1;
-            elapsed_blink_tics = elapsedTime;
-        }
+static void blink_tick() {
+    cursor_blink_state ^= 1;
+}
 
-        // Frame rendering (60 FPS)
-        if (elapsedTime - elapsed_frame_tics >= 16666666) {
-            // ~60Hz
-            renderer();
-            elapsed_frame_tics = elapsedTime;
-        }
+static void frame_tick() {
+    frame_ready = 1;
+    frames_elapsed++;
+}
 
-        // No sleep - let the timing be controlled by clock precision
-    }
-    return NULL;
+static uint64_t host_time_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000ULL + (uint64_t) now.tv_nsec / 1000ULL;
 }
 
-int main() {
+int main(int argc, char **argv) {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
+    // --map X=directory makes a host directory network drive X: of the guest
+    // --audio pulse|alsa|oss|file, --audio-device name and --audio-period frames pick the sound output
+    linux_audio_backend_t audio_backend = LINUX_AUDIO_NONE;
+    const char *audio_device = NULL;
+    int audio_period = 0;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (!strcmp(argv[i], "--map")) {
+            const char *value = argv[++i];
+            if (!value[0] || value[1] != '=' || !redirector_map(value[0], value + 2)) {
+                printf("Cannot map %s\n", value);
+            }
+        } else if (!strcmp(argv[i], "--audio")) {
+            const char *value = argv[++i];
+            if (!strcmp(value, "pulse")) audio_backend = LINUX_AUDIO_PULSE;
+            else if (!strcmp(value, "alsa")) audio_backend = LINUX_AUDIO_ALSA;
+            else if (!strcmp(value, "oss")) audio_backend = LINUX_AUDIO_OSS;
+            else if (!strcmp(value, "file")) audio_backend = LINUX_AUDIO_FILE;
+            else printf("Unknown audio backend %s\n", value);
+        } else if (!strcmp(argv[i], "--audio-device")) {
+            audio_device = argv[++i];
+        } else if (!strcmp(argv[i], "--audio-period")) {
+            audio_period = atoi(argv[++i]);
+        }
+    }
+    linux_audio_configure(audio_backend, audio_device, audio_period);
+
     if (!mfb_open("Pico-286 Emulator", 640, 480, 1)) {
         printf("Failed to open window\n");
         return -1;
     }
 
+    write86 = write86_ob;
+    writew86 = writew86_ob;
+    writedw86 = writedw86_ob;
+    read86 = read86_ob;
+    readw86 = readw86_ob;
+    readdw86 = readdw86_ob;
     memset(SCREEN, 0, sizeof(SCREEN));
     emu8950_opl = OPL_new(3579552, SOUND_FREQUENCY);
     blaster_reset();
@@ -758,7 +349,7 @@ int main() {
     reset86();
 
     // Initialize audio system
-    if (linux_audio_init(SOUND_FREQUENCY, 2, AUDIO_BUFFER_LENGTH) == 0) {
+    if (linux_audio_init(SOUND_FREQUENCY, 2, AUDIO_LATENCY_FRAMES) == 0) {
         if (linux_audio_start() == 0) {
             printf("Audio: %s backend started\n", linux_audio_get_backend_name());
         } else {
@@ -768,22 +359,51 @@ int main() {
         printf("Audio: Failed to initialize, continuing without audio\n");
     }
 
-    pthread_t sound_tid, ticks_tid;
-    pthread_create(&sound_tid, NULL, sound_thread, NULL);
-    pthread_create(&ticks_tid, NULL, ticks_thread, NULL);
+    pthread_t render_tid;
+    pthread_create(&render_tid, NULL, render_thread, NULL);
+
+    scheduler_start_hz(&dss_event, dss_tick, 7000); // Disney Sound Source frequency ~7KHz
+    sb_event_rate = sb_samplerate;
+    scheduler_start_hz(&sb_event, sb_tick, sb_event_rate);
+    scheduler_start_hz(&sound_event, sound_tick, SOUND_FREQUENCY);
+    scheduler_start_hz(&blink_event, blink_tick, 3); // Cursor blink ~3Hz
+    scheduler_start_hz(&frame_event, frame_tick, 60);
+    snapshot_configure(SNAPSHOT_HOTKEY_SLOTS, SNAPSHOT_HOTKEY_INTERVAL);
 
+    const uint64_t start_us = host_time_us() - scheduler_elapsed_us();
+    uint64_t slice_us = host_time_us();
     while (running) {
-        exec86(32768);  // Reduced from 32768 to allow more frequent audio updates
-        if (mfb_update(SCREEN, 0) < 0) {
+        const uint64_t slice_cycles = cpu_cycles_total;
+        exec86_cycles(cpu_clock_hz() / 500); // 2 ms of the target clock
+        if (frame_ready && renderer_submit()) {
+            frame_ready = 0;
+        }
+        // Snapshots are taken between slices, never from inside a scheduler callback
+        for (; frames_elapsed; frames_elapsed--) {
+            snapshot_frame();
+        }
+        if (mfb_update(renderer_screen(), 0) < 0) {
             running = 0;
             break;
         }
+
+        // Unlimited clock: a cycle takes as long as the host needed for one
+        const uint64_t now_us = host_time_us();
+        cpu_clock_follow(now_us - slice_us, cpu_cycles_total - slice_cycles);
+        slice_us = now_us;
+
+        // Keep the emulated clock in step with real time
+        const uint64_t emulated_us = scheduler_elapsed_us();
+        const uint64_t host_us = host_time_us() - start_us;
+        if (emulated_us > host_us + 1000) {
+            usleep(emulated_us - host_us);
+        }
     }
 
-    pthread_cancel(sound_tid);
-    pthread_cancel(ticks_tid);
-    pthread_join(sound_tid, NULL);
-    pthread_join(ticks_tid, NULL);
+    disk_flush();
+
+    renderer_stop();
+    pthread_join(render_tid, NULL);
 
     // Clean up audio
     linux_audio_close();
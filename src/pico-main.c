@@ -306,8 +306,24 @@ void __time_critical_func() second_core(void) {
 
         // Audio output at configured sample rate
         if (tick > last_sound_tick + (1000000 / SOUND_FREQUENCY)) {
+            // The LPT DAC and the speaker are taken every sample, like the DSS and Sound Blaster
+            const int16_t other_sample = last_dss_sample + covox_sample + last_sb_sample + speaker_sample();
+#if HARDWARE_SOUND
             int16_t samples[2];
-            get_sound_sample(last_dss_sample + last_sb_sample, samples);
+            get_sound_sample(other_sample, samples);
+#else
+            // Plays the previous block while the DSS/Sound Blaster samples for the next one are collected
+            static int16_t sound_block[SOUND_BLOCK_SAMPLES * 2];
+            static int16_t other_samples[SOUND_BLOCK_SAMPLES];
+            static int sound_index = 0;
+
+            int16_t samples[2] = { sound_block[sound_index * 2], sound_block[sound_index * 2 + 1] };
+            other_samples[sound_index] = other_sample;
+            if (++sound_index == SOUND_BLOCK_SAMPLES) {
+                get_sound_samples(other_samples, sound_block, SOUND_BLOCK_SAMPLES);
+                sound_index = 0;
+            }
+#endif
 
 #if I2S_SOUND
             i2s_dma_write(&i2s_config, samples);
@@ -1,16 +1,12 @@
 #include <windows.h>
 #include <cwchar>
+#include <cstring>
+#include <atomic>
 #include "MiniFB.h"
 #include "emulator/emulator.h"
-#include "emulator/includes/font8x16.h"
-#include "emulator/includes/font8x8.h"
 #include "emu8950.h"
+#include "host-renderer.cpp.inl"
 
-static uint32_t ALIGN(4, SCREEN[640 * 480]);
-uint8_t ALIGN(4, DEBUG_VRAM[80 * 10]) = {0};
-
-
-int cursor_blink_state = 0;
 uint8_t log_debug = 0;
 
 HANDLE hComm;
@@ -24,440 +20,6 @@ static int sample_index = 0;
 
 extern "C" void adlib_getsample(int16_t *sndptr, intptr_t numsamples);
 
-// Merge 4 plane bytes (packed in a uint32_t: [P3|P2|P1|P0]) into 8 nibbles (packed in uint32_t),
-// where each nibble is a pixel color index: bit0 from P0, bit1 from P1, bit2 from P2, bit3 from P3.
-// Layout matches existing usage: top nibble is leftmost pixel (pixel 0), then next nibble (pixel 1), etc.
-// Merge 4 plane bytes into 8 nibbles, each nibble is a 4-bit pixel index.
-// Spread 8 bits of a byte into positions 0,4,8,...28
-static inline uint32_t spread8(uint32_t plane) {
-    plane = (plane | (plane << 12)) & 0x000F000Fu;
-    plane = (plane | (plane <<  6)) & 0x03030303u;
-    plane = (plane | (plane <<  3)) & 0x11111111u;
-    return plane;
-}
-
-// Merge 4 plane bytes [P3|P2|P1|P0] into 8 nibbles (pixel color indices).
-static inline uint32_t ega_pack8_from_planes(const uint32_t ega_planes) {
-    const uint32_t pixel1 = spread8(ega_planes        & 0xFFu);
-    const uint32_t pixel2 = spread8((ega_planes >> 8) & 0xFFu);
-    const uint32_t pixel3 = spread8((ega_planes >>16) & 0xFFu);
-    const uint32_t pixel4 = spread8(ega_planes >>24);
-
-    return pixel1 | pixel2 << 1 | pixel3 << 2 | pixel4 << 3;
-}
-
-
-static INLINE void renderer() {
-    // http://www.techhelpmanual.com/114-video_modes.html
-    // http://www.techhelpmanual.com/89-video_memory_layouts.html
-    // https://mendelson.org/wpdos/videomodes.txt
-    static uint8_t v = 0;
-    if (v != videomode) {
-        printf("videomode %x %x\n", videomode, v);
-        v = videomode;
-        //vram_offset = 0;
-    }
-
-
-    //memcpy(localVRAM, VIDEORAM + 0x18000 + (vram_offset << 1), VIDEORAM_SIZE);
-    uint8_t *vidramptr = (uint8_t *) (VIDEORAM + 0x8000 + ((vram_offset & 0xffff) << 1));
-    uint8_t cols = 80;
-    for (int y = 0; y < 480; y++) {
-        if (y >= 399)
-            port3DA = 8;
-        else
-            port3DA = 0;
-
-        if (y & 1)
-            port3DA |= 1;
-
-        uint32_t *pixels = SCREEN + y * 640;
-        if (y < 400)
-            switch (videomode) {
-                case 0x00:
-                case 0x01: {
-                    uint16_t y_div_16 = y / 16; // Precompute y / 16
-                    uint8_t glyph_line = (y / 2) & 7; // Precompute y % 8 for font lookup
-                    // Calculate screen position
-                    uint32_t *text_buffer_line = &VIDEORAM[0x8000 + y_div_16 * 80];
-
-                    for (int column = 0; column < 40; column++) {
-                        uint8_t glyph_pixels = font_8x8[(*text_buffer_line++ & 0xFF) * 8 + glyph_line]; // Glyph row from font
-                        uint8_t color = *text_buffer_line++; // Color attribute
-
-                        // Cursor blinking check
-                        uint8_t cursor_active = cursor_blink_state &&
-                                                y_div_16 == CURSOR_Y && column == CURSOR_X &&
-                                                glyph_line >= cursor_start && glyph_line <= cursor_end;
-
-                        for (uint8_t bit = 0; bit < 8; bit++) {
-                            uint8_t pixel_color;
-                            if (cursor_active) {
-                                pixel_color = color & 0x0F; // Cursor foreground color
-                            } else if (cga_blinking && color >> 7 & 1) {
-                                pixel_color = cursor_blink_state ? color >> 4 & 0x7 : color & 0x7; // Blinking background color
-                            } else {
-                                pixel_color = glyph_pixels >> bit & 1 ? color & 0x0f : color >> 4;
-                                // Foreground or background color
-                            }
-
-                            // Write the pixel twice (horizontal scaling)
-                            *pixels++ = *pixels++ = cga_palette[pixel_color];
-                        }
-                    }
-
-
-                    break;
-                }
-                case 0x02:
-                case 0x03: {
-                    uint16_t y_div_16 = y / 16; // Precompute y / 16
-                    uint8_t glyph_line = y & 15; // Precompute y % 8 for font lookup
-
-                    // Calculate screen position
-                    uint32_t *text_row = &VIDEORAM[0x8000 + y_div_16 * 160];
-                    // printf("line start %x\n", 0x8000 + y_div_16 * 160);
-                    for (uint8_t column = 0; column < 80; column++) {
-                        // Access vidram and font data once per character
-                        uint8_t charcode = *text_row++ & 0xff;
-                        uint8_t color = *text_row++ & 0xff; // Color attribute
-                        // printf("%c", charcode);
-                        uint8_t glyph_row = font_8x16[charcode * 16 + glyph_line]; // Glyph row from font
-
-                        // Cursor blinking check
-                        uint8_t cursor_active =
-                                cursor_blink_state && y_div_16 == CURSOR_Y && column == CURSOR_X &&
-                                (cursor_start > cursor_end
-                                     ? !(glyph_line >= cursor_end << 1 &&
-                                         glyph_line <= cursor_start << 1)
-                                     : glyph_line >= cursor_start << 1 && glyph_line <= cursor_end << 1);
-
-                        // Unrolled bit loop: Write 8 pixels with scaling (2x horizontally)
-                        for (int bit = 0; bit < 8; bit++) {
-                            uint8_t pixel_color;
-                            if (cursor_active) {
-                                pixel_color = color & 0x0F; // Cursor foreground color
-                            } else if (cga_blinking && color >> 7 & 1) {
-                                if (cursor_blink_state) {
-                                    pixel_color = color >> 4 & 0x7; // Blinking background color
-                                } else {
-                                    pixel_color = glyph_row >> bit & 1 ? color & 0x0f : (color >> 4 & 0x7);
-                                }
-                            } else {
-                                // Foreground or background color
-                                pixel_color = glyph_row >> bit & 1 ? color & 0x0f : color >> 4;
-                            }
-
-                            *pixels++ = cga_palette[pixel_color];
-                        }
-                    }
-                    break;
-                }
-                case 0x04:
-                case 0x05: {
-                    uint32_t *cga_row = &VIDEORAM[0x8000 + ((y / 2 >> 1) * 80 + (y / 2 & 1) * 8192)]; // Precompute CGA row pointer
-                    uint8_t *current_cga_palette = (uint8_t *) cga_gfxpal[cga_colorset][cga_intensity];
-
-                    // Each byte containing 4 pixels
-                    for (int x = 320 / 4; x--;) {
-                        uint8_t cga_byte = *cga_row++ & 0xFF;
-
-                        // Extract all four 2-bit pixels from the CGA byte
-                        // and write each pixel twice for horizontal scaling
-                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 6 & 3
-                                                                ? current_cga_palette[cga_byte >> 6 & 3]
-                                                                : cga_foreground_color];
-                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 4 & 3
-                                                                ? current_cga_palette[cga_byte >> 4 & 3]
-                                                                : cga_foreground_color];
-                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 2 & 3
-                                                                ? current_cga_palette[cga_byte >> 2 & 3]
-                                                                : cga_foreground_color];
-                        *pixels++ = *pixels++ = cga_palette[cga_byte >> 0 & 3
-                                                                ? current_cga_palette[cga_byte >> 0 & 3]
-                                                                : cga_foreground_color];
-                    }
-                    break;
-                }
-                case 0x06: {
-                    uint32_t *cga_row = &VIDEORAM[0x8000 + (y / 2 >> 1) * 80 + (y / 2 & 1) * 8192]; // Precompute row start
-
-                    // Each byte containing 8 pixels
-                    for (int x = 640 / 8; x--;) {
-                        uint8_t cga_byte = *cga_row++;
-
-                        *pixels++ = cga_palette[(cga_byte >> 7 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 6 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 5 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 4 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 3 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 2 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 1 & 1) * cga_foreground_color];
-                        *pixels++ = cga_palette[(cga_byte >> 0 & 1) * cga_foreground_color];
-                    }
-
-                    break;
-                }
-                case 0x1e:
-                    cols = 90;
-                    vram_offset = 5;
-                    if (y >= 348) break;
-                case 0x07: {
-                    uint32_t *cga_row = &VIDEORAM[(y & 3) * 8192 + y / 4 * cols];
-                    // Each byte containing 8 pixels
-                    for (int x = 640 / 8; x--;) {
-                        uint8_t cga_byte = *cga_row++ & 0xFF;
-
-                        *pixels++ = cga_palette[(cga_byte >> 7 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 6 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 5 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 4 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 3 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 2 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 1 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 0 & 1) * 15];
-                    }
-
-                    break;
-                }
-
-                case 0x08:
-                case 0x74: /* 160x200x16    */
-                case 0x76: /* cga composite / tandy */ {
-                    uint32_t *palette;
-                    switch (videomode) {
-                        case 0x08:
-                            palette = tga_palette;
-                            break;
-                        case 0x74:
-                            palette = cga_composite_palette[cga_intensity << 1];
-                            break;
-                        case 0x76:
-                            palette = cga_composite_palette[0];
-                            break;
-                    }
-
-                    uint32_t *tga_row = &VIDEORAM[tga_offset + (y / 2 >> 1) * 80 + (y / 2 & 1) * 8192]; // Precompute row start
-
-                    // Each byte containing 28 pixels
-                    for (int x = 320 / 4; x--;) {
-                        uint8_t two_pixels = *tga_row++; // Fetch 2 pixels from TGA memory
-                        uint8_t pixel1_color = two_pixels >> 4;
-                        uint8_t pixel2_color = two_pixels & 15;
-
-                        if (!pixel1_color && videomode == 0x8) pixel1_color = cga_foreground_color;
-                        if (!pixel2_color && videomode == 0x8) pixel2_color = cga_foreground_color;
-
-                        *pixels++ = *pixels++ = *pixels++ = *pixels++ = palette[pixel1_color];
-                        *pixels++ = *pixels++ = *pixels++ = *pixels++ = palette[pixel2_color];
-                    }
-
-                    break;
-                }
-                case 0x09: /* tandy 320x200 16 color */ {
-                    uint32_t *tga_row = &VIDEORAM[tga_offset + (y / 2 & 3) * 8192 + y / 8 * 160];
-                    //                  uint8_t *tga_row = &VIDEORAM[tga_offset+(((y / 2) & 3) * 8192) + ((y / 8) * 160)];
-
-                    // Each byte containing 4 pixels
-                    for (int x = 320 / 2; x--;) {
-                        uint8_t tga_byte = *tga_row++ & 0xFF;
-                        *pixels++ = *pixels++ = tga_palette[tga_palette_map[tga_byte >> 4 & 15]];
-                        *pixels++ = *pixels++ = tga_palette[tga_palette_map[tga_byte & 15]];
-                    }
-                    break;
-                }
-                case 0x0a: /* tandy 640x200 16 color */ {
-                    uint32_t *tga_row =&VIDEORAM[y / 2 * 320];
-
-                    // Each byte contains 2 pixels
-                    for (int x = 640 / 2; x--;) {
-                        uint8_t tga_byte = *tga_row++;
-                        *pixels++ = tga_palette[tga_palette_map[tga_byte >> 4 & 15]];
-                        *pixels++ = tga_palette[tga_palette_map[tga_byte & 15]];
-                    }
-                    break;
-                }
-                case 0x0D: /* EGA 320x200 16-color */ {
-                    const uint32_t *ega_row = &VIDEORAM[(y / 2) * 40];
-                    for (int i = 0; i < 40; i++) {
-                        uint32_t ega_planes = *ega_row++;
-
-                        // Build 8 color nibbles packed into a 32-bit word
-                        uint32_t eight_pixels = ega_pack8_from_planes(ega_planes);
-
-                        // Unroll writing 8 pixels, duplicating horizontally
-                        *pixels++ = *pixels++ = vga_palette[eight_pixels >> 28];
-                        *pixels++ = *pixels++ = vga_palette[eight_pixels >> 24 & 0xF];
-                        *pixels++ = *pixels++ = vga_palette[eight_pixels >> 20 & 0xF];
-                        *pixels++ = *pixels++ = vga_palette[eight_pixels >> 16 & 0xF];
-                        *pixels++ = *pixels++ = vga_palette[eight_pixels >> 12 & 0xF];
-                        *pixels++ = *pixels++ = vga_palette[eight_pixels >> 8 & 0xF];
-                        *pixels++ = *pixels++ = vga_palette[eight_pixels >> 4 & 0xF];
-                        *pixels++ = *pixels++ = vga_palette[eight_pixels & 0xF];
-                    }
-                    break;
-                }
-                case 0x0E: /* EGA 640x200 16-color */ {
-                    const uint32_t *ega_row = &VIDEORAM[(y / 2) * 80];
-                    for (int i = 0; i < 80; i++) {
-                        uint32_t ega_planes = *ega_row++;
-
-                        // Build 8 color nibbles packed into a 32-bit word
-                        uint32_t eight_pixels = ega_pack8_from_planes(ega_planes);
-
-                        // Unroll writing 8 pixels, duplicating horizontally
-                        *pixels++ = vga_palette[eight_pixels >> 28];
-                        *pixels++ = vga_palette[eight_pixels >> 24 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels >> 20 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels >> 16 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels >> 12 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels >> 8 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels >> 4 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels & 0xF];
-                    }
-                    break;
-                }
-                case 0x10: /* EGA 640x350 16-color */
-                    if (y >= 350) break;
-                case 0x12: /* VGA 640x480 16-color */ {
-                    const uint32_t *ega_row = &VIDEORAM[y * 80];
-                    for (int i = 0; i < 80; i++) {
-                        uint32_t ega_planes = *ega_row++;
-
-                        // Build 8 color nibbles packed into a 32-bit word
-                        uint32_t eight_pixels = ega_pack8_from_planes(ega_planes);
-
-                        // Unroll writing 8 pixels, duplicating horizontally
-                        *pixels++ = vga_palette[eight_pixels >> 28];
-                        *pixels++ = vga_palette[eight_pixels >> 24 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels >> 20 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels >> 16 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels >> 12 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels >> 8 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels >> 4 & 0xF];
-                        *pixels++ = vga_palette[eight_pixels & 0xF];
-                    }
-                    break;
-                }
-                case 0x11: /* VGA 640x480 2-color */ {
-                    uint32_t *cga_row = &VIDEORAM[y * 80];
-                    // Each byte containing 8 pixels
-                    for (int x = 640 / 8; x--;) {
-                        uint8_t cga_byte = *cga_row++;
-
-                        *pixels++ = cga_palette[(cga_byte >> 7 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 6 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 5 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 4 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 3 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 2 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 1 & 1) * 15];
-                        *pixels++ = cga_palette[(cga_byte >> 0 & 1) * 15];
-                    }
-
-                    break;
-                }
-                case 0x13: {
-                    if (vga_planar_mode) {
-                        uint32_t *vga_row = &VIDEORAM[vram_offset + (y >> 1) * (320 / 4)];
-                        for (int x = 0; x < 320 / 4; x++) {
-                            uint32_t four_pixels = *vga_row++;
-                            *pixels++ = *pixels++ = vga_palette[four_pixels & 0xFF];
-                            *pixels++ = *pixels++ = vga_palette[four_pixels >> 8 & 0xFF];
-                            *pixels++ = *pixels++ = vga_palette[four_pixels >> 16 & 0xFF];
-                            *pixels++ = *pixels++ = vga_palette[four_pixels >> 24];
-                        }
-                    } else {
-                        uint32_t *vga_row = &VIDEORAM[vram_offset + (y >> 1) * 320];
-                        for (int x = 0; x < 320; x++) {
-                            uint32_t four_pixels = *vga_row++;
-                            *pixels++ = *pixels++ = vga_palette[four_pixels & 0xFF];
-                        }
-                    }
-
-                    break;
-                }
-                case 0x78: /* 80x100x16 textmode */
-                    cols = 40;
-                case 0x77: /* 160x100x16 textmode */ {
-                    uint16_t y_div_4 = y / 4; // Precompute y / 4
-                    uint8_t odd_even = y / 2 & 1;
-                    // Calculate screen position
-                    uint8_t *cga_row = (uint8_t *) (VIDEORAM + 0x8000 + y_div_4 * 160);
-                    for (uint8_t column = 0; column < cols; column++) {
-                        // Access vidram and font data once per character
-                        uint8_t *charcode = cga_row + column * 2; // Character code
-                        uint8_t glyph_row = font_8x8[*charcode * 8 + odd_even]; // Glyph row from font
-                        uint8_t color = *++charcode;
-
-#pragma GCC unroll(8)
-                        for (uint8_t bit = 0; bit < 8; bit++) {
-                            *pixels++ = cga_palette[glyph_row >> bit & 1 ? color & 0x0f : color >> 4];
-                        }
-                    }
-                    break;
-                }
-                case 0x79: /* 80x200x16 textmode */ {
-                    int y_div_2 = y / 2; // Precompute y / 2
-                    // Calculate screen position
-                    uint8_t *cga_row = (uint8_t *) (VIDEORAM + 0x8000 + y_div_2 * 80 + (y_div_2 & 1 * 8192));
-                    for (int column = 0; column < 40; column++) {
-                        // Access vidram and font data once per character
-                        uint8_t *charcode = cga_row + column * 2; // Character code
-                        uint8_t glyph_row = font_8x8[*charcode * 8]; // Glyph row from font
-                        uint8_t color = *++charcode;
-
-#pragma GCC unroll(8)
-                        for (int bit = 0; bit < 8; bit++) {
-                            *pixels++ = *pixels++ = cga_palette[glyph_row >> bit & 1 ? color & 0x0f : color >> 4];
-                        }
-                    }
-                    break;
-                }
-                case 0x87: {
-                    /* 40x46 ??? */
-                    int y_div_2 = y / 8; // Precompute y / 2
-                    // Calculate screen position
-                    uint8_t *cga_row = (uint8_t *) (VIDEORAM + 0x8000 + y_div_2 * 80 + (y_div_2 & 1 * 8192));
-                    for (int column = 0; column < 40; column++) {
-                        // Access vidram and font data once per character
-                        uint8_t *charcode = cga_row + column * 2; // Character code
-                        uint8_t glyph_row = font_8x8[*charcode * 8 + (y_div_2 % 8)]; // Glyph row from font
-                        uint8_t color = *++charcode;
-
-#pragma GCC unroll(8)
-                        for (int bit = 0; bit < 8; bit++) {
-                            *pixels++ = *pixels++ = cga_palette[glyph_row >> bit & 1 ? color & 0x0f : color >> 4];
-                        }
-                    }
-                    break;
-                }
-                default:
-                    printf("Unsupported videomode %x\n", videomode);
-                    break;
-            }
-        else {
-            uint8_t ydebug = y - 400;
-            uint8_t y_div_8 = ydebug / 8;
-            uint8_t glyph_line = ydebug % 8;
-
-            const uint8_t colors[4] = {0x0f, 0xf0, 10, 12};
-            //указатель откуда начать считывать символы
-            uint8_t *text_buffer_line = &DEBUG_VRAM[y_div_8 * 80];
-            for (uint8_t column = 80; column--;) {
-                const uint8_t character = *text_buffer_line++;
-                const uint8_t color = colors[character >> 6];
-                uint8_t glyph_pixels = font_8x8[(32 + (character & 63)) * 8 + glyph_line];
-                //считываем из быстрой палитры начало таблицы быстрого преобразования 2-битных комбинаций цветов пикселей
-                // Unrolled bit loop: Write 8 pixels with scaling (2x horizontally)
-                for (int bit = 0; bit < 8; bit++) {
-                    *pixels++ = cga_palette[glyph_pixels >> bit & 1 ? color & 0x0f : color >> 4];
-                }
-            }
-        }
-    }
-}
-
 extern "C" uint64_t sb_samplerate;
 HANDLE updateEvent;
 
@@ -517,76 +79,66 @@ DWORD WINAPI SoundThread(LPVOID lpParam) {
 
 extern uint16_t timeconst;
 
-DWORD WINAPI TicksThread(LPVOID lpParam) {
-    LARGE_INTEGER start, current, queryperf;
-
-
-    QueryPerformanceFrequency(&queryperf);
-    uint32_t hostfreq = (uint32_t) queryperf.QuadPart;
-
-    QueryPerformanceCounter(&start); // Get the starting time
+// Timed device events run on the emulated clock from inside exec86()
+static scheduler_event_t dss_event, sb_event, sound_event, blink_event, frame_event;
+static int16_t last_dss_sample = 0;
+static int16_t last_sb_sample = 0;
+static uint64_t sb_event_rate = 0;
+static volatile int frame_ready = 0;
+static int frames_elapsed = 0;
 
-    uint32_t elapsed_system_timer = 0;
-    uint32_t elapsed_blink_tics = 0;
-    uint32_t elapsed_frame_tics = 0;
-    uint32_t last_dss_tick = 0;
-    uint32_t last_sb_tick = 0;
-    uint32_t last_cms_tick = 0;
-    uint32_t last_sound_tick = 0;
-
-    int16_t last_dss_sample = 0;
-    int16_t last_sb_sample = 0;
-    int16_t last_cms_samples[2];
-
-
-    updateEvent = CreateEvent(NULL, 1, 1, NULL);
-    while (true) {
-        QueryPerformanceCounter(&current); // Get the current time
+static void dss_tick() {
+    last_dss_sample = dss_sample();
+}
 
-        // Calculate elapsed time in ticks since the start
-        uint32_t elapsedTime = (uint32_t) (current.QuadPart - start.QuadPart);
+static void sb_tick() {
+    last_sb_sample = blaster_sample();
+    if (sb_event_rate != sb_samplerate) {
+        sb_event_rate = sb_samplerate;
+        scheduler_start_hz(&sb_event, sb_tick, sb_event_rate);
+    }
+}
 
-        if (elapsedTime - elapsed_system_timer >= hostfreq / timer_period) {
-            doirq(0);
-            elapsed_system_timer = elapsedTime; // Reset the tick counter for 1Hz
-        }
+// Collects the host-clocked sources every sample, the synths are mixed a block at a time
+static void sound_tick() {
+    static int16_t other_samples[SOUND_BLOCK_SAMPLES];
+    static int other_count = 0;
 
-        // Disney Sound Source frequency ~7KHz
-        if (elapsedTime - last_dss_tick >= hostfreq / 7000) {
-            last_dss_sample = dss_sample();
-            last_dss_tick = elapsedTime;
-        }
+    other_samples[other_count++] = last_dss_sample + covox_sample + last_sb_sample + speaker_sample();
+    if (other_count < SOUND_BLOCK_SAMPLES && sample_index + other_count * 2 < AUDIO_BUFFER_LENGTH) return;
 
-        // Sound Blaster
-        if (elapsedTime - last_sb_tick >= hostfreq / sb_samplerate) {
+    get_sound_samples(other_samples, &audio_buffer[sample_index], other_count);
+    sample_index += other_count * 2;
+    other_count = 0;
 
-            last_sb_sample = blaster_sample();
-            last_sb_tick = elapsedTime;
-        }
-
-        if (elapsedTime - last_sound_tick >= hostfreq / SOUND_FREQUENCY) {
-            get_sound_sample(last_dss_sample + last_sb_sample, &audio_buffer[sample_index]);
-            sample_index += 2;
+    if (sample_index >= AUDIO_BUFFER_LENGTH) {
+        SetEvent(updateEvent);
+        sample_index = 0;
+    }
+}
 
-            if (sample_index >= AUDIO_BUFFER_LENGTH) {
-                SetEvent(updateEvent);
-                sample_index = 0;
-            }
+static void blink_tick() {
+    cursor_blink_state ^= 1;
+}
 
-            last_sound_tick = elapsedTime;
-        }
+static void frame_tick() {
+    frame_ready = 1;
+    frames_elapsed++;
+}
 
-        if (elapsedTime - elapsed_blink_tics >= 333'333'3) {
-            cursor_blink_state ^= 1;
-            elapsed_blink_tics = elapsedTime;
-        }
+DWORD WINAPI RenderThread(LPVOID lpParam) {
+    renderer_thread();
+    return 0;
+}
 
-        if (elapsedTime - elapsed_frame_tics >= 16'666) {
-            renderer();
-            elapsed_frame_tics = elapsedTime;
-        }
-        //        _sleep(1);
-    }
+static uint64_t host_time_us() {
+    static LARGE_INTEGER queryperf = {};
+    LARGE_INTEGER now;
+    if (!queryperf.QuadPart)
+        QueryPerformanceFrequency(&queryperf);
+    QueryPerformanceCounter(&now);
+    return (uint64_t) now.QuadPart / queryperf.QuadPart * 1000000ULL +
+           (uint64_t) now.QuadPart % queryperf.QuadPart * 1000000ULL / queryperf.QuadPart;
 }
 
 
@@ -617,6 +169,38 @@ extern "C" void HandleInput(WPARAM wParam, BOOL isKeyDown) {
             //            log_debug = !log_debug;
         }
     }
+    // CTRL + ALT + F11 switches the emulated CPU clock
+    if (wParam == VK_F11 && isKeyDown &&
+        (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_MENU) & 0x8000)) {
+        cpu_set_clock((cpu_clock_t) ((cpu_clock + 1) % CPU_CLOCKS));
+        printf("CPU: %s\n", cpu_clock_name(cpu_clock));
+        return;
+    }
+    // CTRL + ALT + F9 saves the machine, CTRL + ALT + F10 restores it
+    if ((wParam == VK_F9 || wParam == VK_F10) && isKeyDown &&
+        (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_MENU) & 0x8000)) {
+        if (wParam == VK_F9) {
+            if (savestate_save(SAVESTATE_HOTKEY_FILE)) printf("State saved to %s\n", SAVESTATE_HOTKEY_FILE);
+        } else if (savestate_load(SAVESTATE_HOTKEY_FILE)) {
+            printf("State loaded from %s\n", SAVESTATE_HOTKEY_FILE);
+        }
+        return;
+    }
+    // CTRL + ALT + F8 rewinds to the previous snapshot
+    if (wParam == VK_F8 && isKeyDown &&
+        (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_MENU) & 0x8000)) {
+        if (snapshot_rewind(snapshot_count() > 1 ? 1 : 0)) printf("Rewound, %u snapshots left\n", snapshot_count());
+        return;
+    }
+#ifdef EMULATOR_PROFILER
+    // CTRL + ALT + F12 dumps and restarts the profiler
+    if (wParam == VK_F12 && isKeyDown &&
+        (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_MENU) & 0x8000)) {
+        profiler_dump();
+        profiler_reset();
+        return;
+    }
+#endif
     switch (wParam) {
         // Row 1
         case VK_ESCAPE:
@@ -1127,6 +711,16 @@ extern "C" void _putchar(char character) {
 int main(int argc, char **argv) {
     int scale = 2;
 
+    // --map X=directory makes a host directory network drive X: of the guest
+    for (int i = 1; i + 1 < argc; i++) {
+        if (!strcmp(argv[i], "--map")) {
+            const char *value = argv[++i];
+            if (!value[0] || value[1] != '=' || !redirector_map(value[0], value + 2)) {
+                printf("Cannot map %s\n", value);
+            }
+        }
+    }
+
     if (!mfb_open("PC", 640, 480, scale))
         return 1;
 
@@ -1213,13 +807,46 @@ int main(int argc, char **argv) {
     sn76489_reset();
     reset86();
 
+    updateEvent = CreateEvent(NULL, 1, 1, NULL);
     CreateThread(NULL, 0, SoundThread, NULL, 0, NULL);
-    CreateThread(NULL, 0, TicksThread, NULL, 0, NULL);
-
+    CreateThread(NULL, 0, RenderThread, NULL, 0, NULL);
+
+    scheduler_start_hz(&dss_event, dss_tick, 7000); // Disney Sound Source frequency ~7KHz
+    sb_event_rate = sb_samplerate;
+    scheduler_start_hz(&sb_event, sb_tick, sb_event_rate);
+    scheduler_start_hz(&sound_event, sound_tick, SOUND_FREQUENCY);
+    scheduler_start_hz(&blink_event, blink_tick, 3); // Cursor blink ~3Hz
+    scheduler_start_hz(&frame_event, frame_tick, 60);
+    snapshot_configure(SNAPSHOT_HOTKEY_SLOTS, SNAPSHOT_HOTKEY_INTERVAL);
+
+    const uint64_t start_us = host_time_us() - scheduler_elapsed_us();
+    uint64_t slice_us = host_time_us();
     while (true) {
-        exec86(32768);
-        if (mfb_update(SCREEN, 0) == -1)
+        const uint64_t slice_cycles = cpu_cycles_total;
+        exec86_cycles(cpu_clock_hz() / 500); // 2 ms of the target clock
+        if (frame_ready && renderer_submit()) {
+            frame_ready = 0;
+        }
+        // Snapshots are taken between slices, never from inside a scheduler callback
+        for (; frames_elapsed; frames_elapsed--) {
+            snapshot_frame();
+        }
+        if (mfb_update(renderer_screen(), 0) == -1) {
+            disk_flush();
             exit(1);
+        }
+
+        // Unlimited clock: a cycle takes as long as the host needed for one
+        const uint64_t now_us = host_time_us();
+        cpu_clock_follow(now_us - slice_us, cpu_cycles_total - slice_cycles);
+        slice_us = now_us;
+
+        // Keep the emulated clock in step with real time
+        const uint64_t emulated_us = scheduler_elapsed_us();
+        const uint64_t host_us = host_time_us() - start_us;
+        if (emulated_us > host_us + 1000) {
+            Sleep((DWORD) ((emulated_us - host_us) / 1000));
+        }
     }
     // Wait for the thread to finish
     //    WaitForSingleObject(hThread, INFINITE);
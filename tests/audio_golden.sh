@@ -0,0 +1,56 @@
+#!/bin/sh
+# Captures the sound of a disk image with 286-bench and compares the mix and its stems with golden files.
+#   tests/audio_golden.sh ./286-bench hdd.img golden/             compares with golden/out*.wav
+#   UPDATE=1 tests/audio_golden.sh ./286-bench hdd.img golden/    writes golden/ from this build
+# The capture follows emulated time, so it is run twice and both have to be the same. RUN_SECONDS sets how much
+# emulated time is captured, 10 seconds by default.
+set -e
+bench=$1
+image=$2
+golden=$3
+if [ ! -x "$bench" ] || [ ! -f "$image" ] || [ -z "$golden" ]; then
+    echo "usage: $0 286-bench image golden-dir" >&2
+    exit 2
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# every run starts from the same image, whatever the guest writes to it
+capture() {
+    mkdir "$work/$1"
+    cp "$image" "$work/$1/image.img"
+    "$bench" --hdd "$work/$1/image.img" --seconds "${RUN_SECONDS:-10}" \
+        --audio-capture "$work/$1/out.wav" --audio-stems yes > "$work/$1/stats.json"
+}
+
+capture first
+capture second
+for file in "$work"/first/out*.wav; do
+    name=$(basename "$file")
+    if ! cmp -s "$file" "$work/second/$name"; then
+        echo "$name differs between two runs of the same build"
+        exit 1
+    fi
+done
+
+if [ -n "$UPDATE" ]; then
+    mkdir -p "$golden"
+    cp "$work"/first/out*.wav "$golden"/
+    echo "updated $golden"
+    exit 0
+fi
+
+failed=0
+for file in "$work"/first/out*.wav; do
+    name=$(basename "$file")
+    if [ ! -f "$golden/$name" ]; then
+        echo "$name: no golden file"
+        failed=1
+    elif ! cmp -s "$file" "$golden/$name"; then
+        echo "$name differs from $golden/$name"
+        failed=1
+    fi
+done
+[ "$failed" = 0 ] && echo OK
+exit "$failed"
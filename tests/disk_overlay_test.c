@@ -0,0 +1,191 @@
+// Checks the copy-on-write disk overlays and the block cache in front of them.
+//   cc -Isrc -Isrc/emulator tests/disk_overlay_test.c && ./a.out
+#include <assert.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/emulator/disks-win32.c.inl"
+
+// Everything the disk code reaches outside of the image files
+uint8_t RAM[RAM_SIZE];
+uint8_t *memory_write_pages[MEMORY_PAGES];
+const uint8_t *memory_read_pages[MEMORY_PAGES];
+read86_t read86;
+write86_t write86;
+uint32_t dwordregs[8];
+x86_flags_t x86_flags;
+uint8_t lazy_flags_op;
+
+void lazy_flags_materialize() { }
+
+void decode_cache_invalidate(uint32_t address, uint32_t length) { }
+void memory_write_track(uint32_t address, uint32_t length) { }
+static void redirector_commit_all() { }
+
+int printf_(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int length = vfprintf(stdout, format, args);
+    va_end(args);
+    return length;
+}
+
+#define TEST_IMAGE "disk_overlay_test.img"
+#define TEST_OVERLAY "disk_overlay_test.ovl"
+#define TEST_SNAPSHOT "disk_overlay_test.snap"
+#define TEST_SECTORS 4096 // 2 MB, a hard disk of 4 cylinders
+#define TEST_DRIVE 2
+
+static void test_fill(uint8_t *sector, const uint32_t number, const uint8_t version) {
+    for (int i = 0; i < 512; i++) {
+        sector[i] = (uint8_t) (number * 7 + i + version * 31);
+    }
+}
+
+static void test_create_image(void) {
+    uint8_t sector[512];
+    FILE *image = fopen(TEST_IMAGE, "wb");
+    assert(image);
+    for (uint32_t number = 0; number < TEST_SECTORS; number++) {
+        test_fill(sector, number, 0);
+        assert(fwrite(sector, 512, 1, image) == 1);
+    }
+    fclose(image);
+    remove(TEST_OVERLAY);
+}
+
+static void test_insert(void) {
+    host_disk_backend = DISK_BACKEND_STDIO;
+    host_disk_overlays[TEST_DRIVE] = TEST_OVERLAY;
+    assert(insertdisk(0x80, TEST_IMAGE));
+    assert(disk[TEST_DRIVE].overlayfile);
+}
+
+static void test_write(const uint32_t number, const uint8_t version) {
+    uint8_t *sector = disk_sector(TEST_DRIVE, (size_t) number * 512, true);
+    assert(sector);
+    test_fill(sector, number, version);
+}
+
+static void test_expect(const uint32_t number, const uint8_t version) {
+    uint8_t expected[512];
+    const uint8_t *sector = disk_sector(TEST_DRIVE, (size_t) number * 512, false);
+    test_fill(expected, number, version);
+    assert(sector && !memcmp(sector, expected, 512));
+}
+
+static void test_expect_image(const uint32_t number, const uint8_t version) {
+    uint8_t expected[512], sector[512];
+    FILE *image = fopen(TEST_IMAGE, "rb");
+    assert(image);
+    fseek(image, (long) number * 512, SEEK_SET);
+    assert(fread(sector, 512, 1, image) == 1);
+    fclose(image);
+    test_fill(expected, number, version);
+    assert(!memcmp(sector, expected, 512));
+}
+
+// Writes land in the overlay, the image stays as it was and the cache gets them back after a reinsert
+static void test_copy_on_write(void) {
+    test_create_image();
+    test_insert();
+    test_write(9, 1);
+    test_write(2000, 1);
+    test_write(4095, 1);
+    disk_flush();
+    assert(disk[TEST_DRIVE].overlay_used == 3);
+    test_expect_image(9, 0);
+    test_expect_image(4095, 0);
+
+    ejectdisk(0x80);
+    test_insert();
+    test_expect(9, 1);
+    test_expect(10, 0);
+    test_expect(2000, 1);
+    test_expect(4095, 1);
+    ejectdisk(0x80);
+}
+
+// The header only counts the slots on sync, the index is what tells which slots are taken
+static void test_stale_header(void) {
+    test_create_image();
+    test_insert();
+    test_write(100, 1);
+    test_write(200, 1);
+    disk_flush();
+    // as if the process died before the next sync
+    disk_overlay_write_header(disk[TEST_DRIVE].overlayfile, disk_overlay_blocks(disk[TEST_DRIVE].filesize), 0);
+    fflush(disk[TEST_DRIVE].overlayfile);
+    FILE *file = disk[TEST_DRIVE].overlayfile;
+    disk[TEST_DRIVE].overlayfile = NULL;
+    ejectdisk(0x80);
+    fclose(file);
+
+    test_insert();
+    assert(disk[TEST_DRIVE].overlay_used == 2);
+    // a new block gets a slot of its own rather than one of the two above
+    test_write(300, 1);
+    disk_flush();
+    assert(disk[TEST_DRIVE].overlay_used == 3);
+    ejectdisk(0x80);
+    test_insert();
+    test_expect(100, 1);
+    test_expect(200, 1);
+    test_expect(300, 1);
+    ejectdisk(0x80);
+}
+
+// A snapshot brings the overlay back to the writes made before it, also before the image is attached
+static void test_snapshot_restore(void) {
+    test_create_image();
+    test_insert();
+    test_write(50, 1);
+    assert(disk_overlay_snapshot(TEST_DRIVE, TEST_SNAPSHOT));
+    test_write(50, 2);
+    test_write(60, 2);
+    assert(disk_overlay_restore(TEST_DRIVE, TEST_SNAPSHOT));
+    test_expect(50, 1);
+    test_expect(60, 0);
+
+    test_write(60, 3);
+    ejectdisk(0x80);
+    assert(disk_overlay_restore(TEST_DRIVE, TEST_SNAPSHOT));
+    test_insert();
+    test_expect(50, 1);
+    test_expect(60, 0);
+    ejectdisk(0x80);
+}
+
+// Merging writes the overlay into the image and empties it, discarding only empties it
+static void test_merge_discard(void) {
+    test_create_image();
+    test_insert();
+    test_write(70, 1);
+    test_write(4000, 1);
+    assert(disk_overlay_merge(TEST_DRIVE));
+    assert(disk[TEST_DRIVE].overlay_used == 0);
+    test_expect_image(70, 1);
+    test_expect_image(4000, 1);
+    test_expect(70, 1);
+
+    test_write(80, 1);
+    assert(disk_overlay_discard(TEST_DRIVE));
+    test_expect(80, 0);
+    test_expect(70, 1);
+    ejectdisk(0x80);
+    test_expect_image(80, 0);
+}
+
+int main(void) {
+    test_copy_on_write();
+    test_stale_header();
+    test_snapshot_restore();
+    test_merge_discard();
+    remove(TEST_IMAGE);
+    remove(TEST_OVERLAY);
+    remove(TEST_SNAPSHOT);
+    printf("OK\n");
+    return 0;
+}
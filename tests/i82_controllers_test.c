@@ -9,6 +9,7 @@
 static uint8_t test_memory[1u << 20];
 #define I8237_MEMORY_READ(address) test_memory[(address) & 0xFFFFFu]
 #define I8237_MEMORY_WRITE(address, value) (test_memory[(address) & 0xFFFFFu] = (value))
+#define I8237_MEMORY_PAGE(address) (&test_memory[(address) & 0xFF000u])
 
 #include "../src/emulator/i8259.h"
 #include "../src/emulator/i8253.h"
@@ -22,8 +23,14 @@ uint8_t port61;
 int speakerenabled;
 int timer_period;
 
-uint64_t i8253_now_us(void) {
-    return 1000000;
+static uint32_t irq0_divisor;
+
+uint64_t i8253_now(void) {
+    return 1193182;
+}
+
+void i8253_irq0_reload(uint32_t divisor) {
+    irq0_divisor = divisor;
 }
 
 static void test_i8259(void) {
@@ -58,6 +65,8 @@ static void test_i8253(void) {
     assert(i8253.channels[0].reload_value == 0x1234);
     assert(i8253.channels[0].operating_mode == 3);
     assert(timer_period == PIT_FREQUENCY / 0x1234);
+    assert(irq0_divisor == 0x1234);
+    assert(i8253.channels[0].start_tick == 1193182);
 }
 
 static void test_i8237(void) {
@@ -96,9 +105,79 @@ static void test_i8237(void) {
     assert(i8237_readport(DMA_STATUS_REGISTER) == 0);
 }
 
+// Reads a transfer with i8237_read_block in blocks of `block` bytes and one byte at a time with i8237_read,
+// from the same channel state. Both have to give the same bytes and leave the channel the same
+static void test_i8237_block(const dma_channel_s *start, const uint32_t length, const uint16_t block) {
+    static uint8_t single[1024], blocks[1024];
+    assert(length <= sizeof(single));
+    dma_channels[1] = *start;
+    for (uint32_t i = 0; i < length; i++) {
+        single[i] = i8237_read(1);
+    }
+    const dma_channel_s after = dma_channels[1];
+
+    dma_channels[1] = *start;
+    uint32_t done = 0;
+    while (done < length) {
+        const uint16_t want = length - done < block ? (uint16_t)(length - done) : block;
+        uint8_t peeked[256];
+        const dma_channel_s before = dma_channels[1];
+        const uint16_t peek = i8237_peek_block(1, peeked, want);
+        assert(!memcmp(&before, &dma_channels[1], sizeof(before)));
+        const uint16_t read = i8237_read_block(1, blocks + done, want);
+        assert(read && read == peek && read <= want);
+        assert(!memcmp(peeked, blocks + done, read));
+        done += read;
+    }
+    assert(!memcmp(single, blocks, length));
+    assert(!memcmp(&after, &dma_channels[1], sizeof(after)));
+}
+
+static void test_i8237_read_block(void) {
+    for (uint32_t i = 0; i < sizeof(test_memory); i++) {
+        test_memory[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+    dma_channel_s start;
+    memset(&start, 0, sizeof(start));
+    start.page = 0x30000;
+    start.address_increase = 1;
+    start.auto_init = 1;
+
+    // up across a 4 KB page, the terminal count reloading the channel twice
+    start.address = start.reload_address = 0x0F80;
+    start.count = start.reload_count = 0x00FF;
+    test_i8237_block(&start, 600, 64);
+    test_i8237_block(&start, 600, 200);
+
+    // up to the end of the 64 KB page, where the address wraps around within it
+    start.address = start.reload_address = 0xFFC0;
+    start.count = start.reload_count = 0x0100;
+    test_i8237_block(&start, 200, 64);
+
+    // down across a 4 KB page and through address 0
+    start.address_increase = UINT32_MAX;
+    start.address = start.reload_address = 0x1010;
+    start.count = start.reload_count = 0x0030;
+    test_i8237_block(&start, 100, 64);
+    start.address = start.reload_address = 0x0010;
+    test_i8237_block(&start, 100, 64);
+
+    // single cycle, the channel masks itself at the terminal count and reads nothing more
+    start.address_increase = 1;
+    start.auto_init = 0;
+    start.address = start.reload_address = 0x2000;
+    start.count = start.reload_count = 0x0040;
+    test_i8237_block(&start, 0x41, 64);
+    assert(dma_channels[1].masked);
+    uint8_t none[4];
+    assert(i8237_read_block(1, none, sizeof(none)) == 0);
+    assert(i8237_peek_block(1, none, sizeof(none)) == 0);
+}
+
 int main(void) {
     test_i8259();
     test_i8253();
     test_i8237();
+    test_i8237_read_block();
     return 0;
 }
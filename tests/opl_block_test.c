@@ -0,0 +1,116 @@
+// Checks that OPL_calc_buffer_linear() renders a block exactly like the same samples rendered one call at a time.
+//   DEFS="-DUSE_EMU8950_OPL -DEMU8950_SLOT_RENDER=1 -DEMU8950_NO_RATECONV=1 -DEMU8950_NO_WAVE_TABLE_MAP=1 -DEMU8950_NO_TLL=1 \
+//         -DEMU8950_NO_FLOAT=1 -DEMU8950_NO_TIMER=1 -DEMU8950_NO_TEST_FLAG=1 -DEMU8950_SIMPLER_NOISE=1 \
+//         -DEMU8950_SHORT_NOISE_UPDATE_CHECK=1 -DEMU8950_LINEAR_SKIP=1 -DEMU8950_LINEAR_END_OF_NOTE_OPTIMIZATION \
+//         -DEMU8950_NO_PERCUSSION_MODE=1 -DEMU8950_LINEAR=1"
+//   gcc -O2 -fms-extensions $DEFS -Isrc/emu8950 -c src/emu8950/emu8950.c tests/opl_block_test.c
+//   g++ -O2 -std=c++20 -fms-extensions $DEFS -Isrc/emu8950 -c src/emu8950/slot_render.cpp
+//   g++ emu8950.o slot_render.o opl_block_test.o && ./a.out
+// Every slot_render.cpp kernel built in and run by the CPU (scalar, SSE4.1, AVX2, NEON) has to give the same checksum.
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emu8950.h"
+
+#define OPL_TEST_BLOCK 64
+#define OPL_TEST_BLOCKS 20000
+
+static uint32_t test_random_state = 12345;
+
+static uint32_t test_random(void) {
+    test_random_state = test_random_state * 1103515245 + 12345;
+    return test_random_state >> 8;
+}
+
+static void test_write(OPL *block, OPL *single, uint32_t reg, uint8_t value) {
+    OPL_writeReg(block, reg, value);
+    OPL_writeReg(single, reg, value);
+}
+
+// Register traffic biased towards short notes with fast release, so carriers mute in the middle of a block
+static void test_traffic(OPL *block, OPL *single) {
+    static const uint8_t slot_registers[] = { 0x20, 0x40, 0x60, 0x80, 0xe0 };
+    static const uint8_t slot_offsets[] = { 0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, 16, 17, 18, 19, 20, 21 };
+    uint32_t writes = test_random() % 4;
+    while (writes--) {
+        uint32_t channel = test_random() % 9;
+        switch (test_random() % 6) {
+            case 0:
+            case 1: {
+                const uint8_t reg = slot_registers[test_random() % sizeof(slot_registers)];
+                uint8_t value = test_random();
+                if (reg == 0x60) value |= 0x88;
+                if (reg == 0x80) value |= 0x0c;
+                test_write(block, single, reg + slot_offsets[test_random() % sizeof(slot_offsets)], value);
+                break;
+            }
+            case 2:
+                test_write(block, single, 0xc0 + channel, test_random() & 0x0f);
+                break;
+            case 3:
+                test_write(block, single, 0xa0 + channel, test_random());
+                break;
+            default:
+                test_write(block, single, 0xb0 + channel, test_random() & 0x3f);
+                break;
+        }
+    }
+    if (test_random() % 16 == 0) test_write(block, single, 0xbd, test_random() & 0xc0);
+}
+
+// Renders the same traffic with the current kernel, 0 after a mismatch, else the checksum of the output
+static uint32_t test_render(void) {
+    OPL *block = OPL_new(3579552, 49716);
+    OPL *single = OPL_new(3579552, 49716);
+    int32_t block_buffer[OPL_TEST_BLOCK], single_buffer[OPL_TEST_BLOCK];
+    uint32_t audible = 0, checksum = 0;
+
+    test_random_state = 12345;
+    test_write(block, single, 0x01, 0x20);
+    for (uint32_t count = 0; count < OPL_TEST_BLOCKS; count++) {
+        test_traffic(block, single);
+        OPL_calc_buffer_linear(block, block_buffer, OPL_TEST_BLOCK);
+        for (uint32_t sample = 0; sample < OPL_TEST_BLOCK; sample++) {
+            OPL_calc_buffer_linear(single, single_buffer + sample, 1);
+        }
+        for (uint32_t sample = 0; sample < OPL_TEST_BLOCK; sample++) {
+            if (block_buffer[sample] != single_buffer[sample]) {
+                printf("block %u sample %u: %d in a block, %d one at a time\n", count, sample,
+                       block_buffer[sample], single_buffer[sample]);
+                return 0;
+            }
+            audible += block_buffer[sample] != 0;
+            checksum = checksum * 31 + (uint32_t) block_buffer[sample];
+        }
+    }
+    // the traffic has to keep notes sounding, or the comparison proves nothing
+    assert(audible > OPL_TEST_BLOCKS * OPL_TEST_BLOCK / 4);
+
+    OPL_delete(block);
+    OPL_delete(single);
+    return checksum;
+}
+
+int main(void) {
+    static const char *names[] = { "scalar", "sse4.1", "avx2", "neon" };
+    uint32_t scalar = 0;
+    // the first OPL_new picks a kernel, every one built in then has to give what the scalar one gives
+    OPL_delete(OPL_new(3579552, 49716));
+    for (int kernel = SLOT_RENDER_KERNEL_SCALAR; kernel <= SLOT_RENDER_KERNEL_NEON; kernel++) {
+        if (!slot_render_select(kernel)) continue;
+        const uint32_t checksum = test_render();
+        printf("%s %08x\n", names[kernel], checksum);
+        if (!checksum) return 1;
+        if (kernel == SLOT_RENDER_KERNEL_SCALAR) {
+            scalar = checksum;
+        } else if (checksum != scalar) {
+            printf("%s differs from the scalar kernel\n", names[kernel]);
+            return 1;
+        }
+    }
+    printf("OK %08x\n", scalar);
+    return 0;
+}
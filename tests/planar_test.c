@@ -0,0 +1,63 @@
+// Checks the planar_to_indexed() kernel of the build against a bit by bit conversion.
+//   cc -O2 -Isrc tests/planar_test.c && ./a.out            SSE2, or NEON on ARM
+//   cc -O2 -mavx2 -Isrc tests/planar_test.c && ./a.out     AVX2
+//   cc -O2 -mno-sse2 -Isrc tests/planar_test.c && ./a.out  the table kernel of the Cortex-M builds
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/emulator/video/planar.c"
+
+#define PLANAR_TEST_ENTRIES 83
+
+static void planar_reference(const uint32_t *planes, uint8_t *indices, int count) {
+    for (int entry = 0; entry < count; entry++) {
+        for (int pixel = 0; pixel < 8; pixel++) {
+            uint8_t index = 0;
+            for (int plane = 0; plane < 4; plane++) {
+                index |= (planes[entry] >> (plane * 8 + 7 - pixel) & 1) << plane;
+            }
+            indices[entry * 8 + pixel] = index;
+        }
+    }
+}
+
+static void test_planar_pixels(void) {
+    // plane 0 only, leftmost pixel first
+    const uint32_t planes[2] = { 0x00000080, 0x0F0F0F0F };
+    uint32_t indices[4];
+    planar_to_indexed(planes, (uint8_t *) indices, 2);
+    const uint8_t *pixels = (const uint8_t *) indices;
+    assert(pixels[0] == 1);
+    for (int pixel = 1; pixel < 8; pixel++) assert(pixels[pixel] == 0);
+    for (int pixel = 8; pixel < 12; pixel++) assert(pixels[pixel] == 0);
+    for (int pixel = 12; pixel < 16; pixel++) assert(pixels[pixel] == 15);
+}
+
+static void test_planar_random(void) {
+    uint32_t planes[PLANAR_TEST_ENTRIES];
+    uint32_t indices[PLANAR_TEST_ENTRIES * 2 + 1];
+    uint8_t expected[PLANAR_TEST_ENTRIES * 8];
+    srand(286);
+    for (int round = 0; round < 2000; round++) {
+        for (int entry = 0; entry < PLANAR_TEST_ENTRIES; entry++) {
+            planes[entry] = (uint32_t) rand() << 16 ^ (uint32_t) rand();
+        }
+        // every count, so the vector loops end on each possible remainder
+        const int count = round % (PLANAR_TEST_ENTRIES + 1);
+        memset(indices, 0xEE, sizeof(indices));
+        planar_reference(planes, expected, count);
+        planar_to_indexed(planes, (uint8_t *) indices, count);
+        assert(!memcmp(indices, expected, count * 8));
+        // nothing is written past the last entry
+        assert(((const uint8_t *) indices)[count * 8] == 0xEE);
+    }
+}
+
+int main(void) {
+    planar_init();
+    test_planar_pixels();
+    test_planar_random();
+    return 0;
+}
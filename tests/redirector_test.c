@@ -0,0 +1,295 @@
+// Checks the network redirector against a host directory, driving it like DOS does through INT 2Fh AX=11xx.
+//   cc -Isrc -Isrc/emulator -Ifindfirst tests/redirector_test.c src/emulator/snapshot.c src/printf/printf.c \
+//      findfirst/findfirst.c findfirst/spec.c -lpthread && ./a.out   (add -fsanitize=thread for the I/O thread)
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "emulator.h"
+#include "cpu.h"
+#include "../src/emulator/network-redirector.c.inl"
+
+// Everything the redirector and the snapshots reach outside of the host files
+uint8_t RAM[RAM_SIZE];
+uint8_t UMB[UMB_END - UMB_START];
+uint8_t HMA[HMA_END - HMA_START];
+uint32_t VIDEORAM[VIDEORAM_SIZE];
+uint8_t EMS[EMS_MEMORY_SIZE];
+uint8_t XMS[XMS_MEMORY_SIZE];
+uint32_t dwordregs[8];
+uint32_t segregs32[6];
+x86_flags_t x86_flags;
+uint8_t lazy_flags_op;
+
+void lazy_flags_materialize() { }
+void decode_cache_invalidate(uint32_t address, uint32_t length) { }
+void decode_cache_flush() { }
+
+uint8_t *savestate_store(size_t *length, uint8_t memory) {
+    *length = 1;
+    return malloc(1);
+}
+
+uint8_t savestate_restore(const uint8_t *data, size_t length, uint8_t memory) { return 1; }
+
+void _putchar(char character) { putchar(character); }
+
+// Ranges the redirector marked, handed on to the snapshots as memory.c does for conventional memory
+#define TEST_TRACKED 16
+static uint32_t tracked_address[TEST_TRACKED], tracked_length[TEST_TRACKED], tracked = 0;
+static uint8_t write_protected = 0;
+
+void memory_write_protect(uint8_t protect) {
+    write_protected = protect;
+}
+
+void memory_write_track(uint32_t address, uint32_t length) {
+    assert(tracked < TEST_TRACKED);
+    tracked_address[tracked] = address;
+    tracked_length[tracked++] = length;
+    if (write_protected && length) snapshot_mark(&RAM[address], length);
+}
+
+#define TEST_SDA 0x10000
+#define TEST_DTA 0x20000
+#define TEST_SFT 0x30000
+#define TEST_BUFFER 0x40000
+
+static char test_root[64];
+
+static void test_call(const uint16_t function) {
+    tracked = 0;
+    CPU_AX = function;
+    assert(redirector_handler());
+}
+
+static void test_file(const char *name, const uint32_t size) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", test_root, name);
+    FILE *file = fopen(path, "wb");
+    assert(file);
+    for (uint32_t i = 0; i < size; i++) fputc((uint8_t) i, file);
+    fclose(file);
+}
+
+static void test_setup(void) {
+    strcpy(test_root, "/tmp/redirector_testXXXXXX");
+    assert(mkdtemp(test_root));
+    redirector_map('H', test_root);
+    // the installation check hands over the SDA
+    CPU_BX = TEST_SDA >> 4;
+    CPU_DX = 0;
+    test_call(0x1100);
+    *(uint16_t *) &RAM[TEST_SDA + 12] = 0;
+    *(uint16_t *) &RAM[TEST_SDA + 14] = TEST_DTA >> 4;
+    RAM[TEST_SDA + SEARCH_ATTRIBUTES_OFFSET] = 0;
+}
+
+static void test_path(const char *path) {
+    strcpy((char *) &RAM[TEST_SDA + FIRST_FILENAME_OFFSET], path);
+}
+
+static uint8_t test_in(const uint32_t address, const uint32_t length, const uint32_t start, const uint32_t size) {
+    return address >= start && address + length <= start + size;
+}
+
+// Only the structures the handler fills in are marked, not the whole of conventional memory
+static void test_tracking(void) {
+    test_file("TRACK.BIN", 1000);
+
+    test_path("H:\\*.*");
+    test_call(0x111B);
+    assert(!CPU_FL_CF);
+    assert(!memcmp(((sdbstruct *) &RAM[TEST_DTA])->foundfile.fname, "TRACK   BIN", 11));
+    assert(tracked == 1 && tracked_address[0] == TEST_DTA && tracked_length[0] == sizeof(sdbstruct));
+
+    test_path("H:\\TRACK.BIN");
+    CPU_ES = TEST_SFT >> 4;
+    CPU_DI = 0;
+    test_call(0x1116);
+    assert(!CPU_FL_CF);
+    assert(tracked == 1 && tracked_address[0] == TEST_SFT && tracked_length[0] == sizeof(sftstruct));
+
+    // a read marks the SFT it moves on and the bytes that landed in the buffer
+    ((sftstruct *) &RAM[TEST_SFT])->file_position = 100;
+    *(uint16_t *) &RAM[TEST_SDA + 14] = TEST_BUFFER >> 4;
+    CPU_CX = 300;
+    test_call(0x1108);
+    assert(!CPU_FL_CF && CPU_CX == 300);
+    assert(RAM[TEST_BUFFER] == 100 && RAM[TEST_BUFFER + 299] == (uint8_t) 399);
+    for (uint32_t i = 0; i < tracked; i++) {
+        assert(test_in(tracked_address[i], tracked_length[i], TEST_SFT, sizeof(sftstruct)) ||
+               test_in(tracked_address[i], tracked_length[i], TEST_BUFFER, 300));
+    }
+    uint32_t buffer = 0;
+    for (uint32_t i = 0; i < tracked; i++) {
+        if (tracked_address[i] == TEST_BUFFER) buffer = tracked_length[i];
+    }
+    assert(buffer == 300);
+    *(uint16_t *) &RAM[TEST_SDA + 14] = TEST_DTA >> 4;
+
+    test_call(0x1106);
+    assert(!CPU_FL_CF);
+}
+
+static void test_open(const char *path) {
+    test_path(path);
+    CPU_ES = TEST_SFT >> 4;
+    CPU_DI = 0;
+    test_call(0x1116);
+    assert(!CPU_FL_CF);
+}
+
+static void test_transfer(const uint16_t function, const uint32_t position, const uint16_t count) {
+    ((sftstruct *) &RAM[TEST_SFT])->file_position = position;
+    *(uint16_t *) &RAM[TEST_SDA + 14] = TEST_BUFFER >> 4;
+    CPU_CX = count;
+    test_call(function);
+    assert(!CPU_FL_CF && CPU_CX == count);
+    *(uint16_t *) &RAM[TEST_SDA + 14] = TEST_DTA >> 4;
+}
+
+// A write over the block being read ahead waits for it, reads then see the new bytes
+static void test_write_over_read_ahead(void) {
+    test_file("AHEAD.BIN", 4 * REDIRECTOR_BLOCK_SIZE);
+    for (int round = 0; round < 100; round++) {
+        test_open("H:\\AHEAD.BIN");
+        test_transfer(0x1108, 0, 16);
+        memset(&RAM[TEST_BUFFER], round, 256);
+        test_transfer(0x1109, REDIRECTOR_BLOCK_SIZE + 100, 256);
+        memset(&RAM[TEST_BUFFER], 0xFF, 256);
+        test_transfer(0x1108, REDIRECTOR_BLOCK_SIZE + 100, 256);
+        for (int i = 0; i < 256; i++) assert(RAM[TEST_BUFFER + i] == round);
+        test_call(0x1106);
+        assert(!CPU_FL_CF);
+    }
+}
+
+static void test_directory(const char *name) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", test_root, name);
+    assert(mkdir(path, 0755) == 0);
+}
+
+// Next name a search finds, NULL once it is done
+static const char *test_find(const uint16_t function) {
+    static char name[12];
+    test_call(function);
+    if (CPU_FL_CF) {
+        assert(CPU_AX == 18);
+        return NULL;
+    }
+    memcpy(name, ((sdbstruct *) &RAM[TEST_DTA])->foundfile.fname, 11);
+    name[11] = '\0';
+    return name;
+}
+
+// Creates and closes a file the way a DOS program does
+static void test_create(const char *path) {
+    test_path(path);
+    CPU_ES = TEST_SFT >> 4;
+    CPU_DI = 0;
+    test_call(0x1117);
+    assert(!CPU_FL_CF);
+    test_call(0x1106);
+    assert(!CPU_FL_CF);
+}
+
+// Searches return the aliases in order, and go on after the last one when the directory changed in between
+static void test_find_next(void) {
+    static const char *names[] = { "ALPHA   TXT", "BRAVO   TXT", "CHARLIE TXT", "DELTA   TXT", "ECHO    TXT" };
+    test_directory("FIND");
+    test_file("FIND/delta.txt", 1);
+    test_file("FIND/Alpha.txt", 1);
+    test_file("FIND/echo.txt", 1);
+    test_file("FIND/charlie.txt", 1);
+    test_file("FIND/bravo.txt", 1);
+
+    test_path("H:\\FIND\\*.TXT");
+    const char *name = test_find(0x111B);
+    for (int i = 0; i < 5; i++) {
+        assert(name && !strcmp(name, names[i]));
+        name = test_find(0x111C);
+    }
+    assert(!name);
+
+    // deleting what was found, as DEL *.* does, skips nothing
+    uint32_t found = 0;
+    test_path("H:\\FIND\\*.TXT");
+    for (name = test_find(0x111B); name; name = test_find(0x111C)) {
+        char path[32];
+        const sdbstruct search = *(sdbstruct *) &RAM[TEST_DTA];
+        snprintf(path, sizeof(path), "H:\\FIND\\%.8s", name);
+        *strchr(path, ' ') = '\0';
+        strcat(path, ".TXT");
+        test_path(path);
+        test_call(0x1113);
+        assert(!CPU_FL_CF);
+        // DOS keeps the SDB in the DTA of the program in between
+        *(sdbstruct *) &RAM[TEST_DTA] = search;
+        found++;
+    }
+    assert(found == 5);
+
+    // entries created during a search before its position do not bring back the ones it returned already
+    test_create("H:\\FIND\\B.TXT");
+    test_create("H:\\FIND\\D.TXT");
+    test_path("H:\\FIND\\*.TXT");
+    assert(!strcmp(test_find(0x111B), "B       TXT"));
+    const sdbstruct search = *(sdbstruct *) &RAM[TEST_DTA];
+    test_create("H:\\FIND\\A.TXT");
+    test_create("H:\\FIND\\C.TXT");
+    test_path("H:\\FIND\\A.TXT");
+    assert(!strcmp(test_find(0x111B), "A       TXT"));
+    *(sdbstruct *) &RAM[TEST_DTA] = search;
+    assert(!strcmp(test_find(0x111C), "C       TXT"));
+    assert(!strcmp(test_find(0x111C), "D       TXT"));
+    assert(!test_find(0x111C));
+}
+
+// A rewind brings back what the guest had before a remote read overwrote it
+static void test_rewind(void) {
+    test_file("REWIND.BIN", 8192);
+    snapshot_configure(4, 1);
+    memset(&RAM[TEST_BUFFER], 0xAA, 8192);
+    snapshot_frame();
+
+    test_path("H:\\REWIND.BIN");
+    CPU_ES = TEST_SFT >> 4;
+    CPU_DI = 0;
+    test_call(0x1116);
+    assert(!CPU_FL_CF);
+    *(uint16_t *) &RAM[TEST_SDA + 14] = TEST_BUFFER >> 4;
+    CPU_CX = 8192;
+    test_call(0x1108);
+    assert(!CPU_FL_CF && CPU_CX == 8192 && RAM[TEST_BUFFER + 1] == 1);
+    *(uint16_t *) &RAM[TEST_SDA + 14] = TEST_DTA >> 4;
+    test_call(0x1106);
+    snapshot_frame();
+    assert(snapshot_count() == 2);
+
+    assert(snapshot_rewind(1));
+    for (uint32_t i = 0; i < 8192; i++) assert(RAM[TEST_BUFFER + i] == 0xAA);
+    snapshot_configure(0, 1);
+}
+
+static void test_cleanup(void) {
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", test_root);
+    assert(system(command) == 0);
+}
+
+int main(void) {
+    test_setup();
+    test_tracking();
+    test_write_over_read_ahead();
+    test_find_next();
+    test_rewind();
+    test_cleanup();
+    printf("OK\n");
+    return 0;
+}
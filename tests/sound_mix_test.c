@@ -0,0 +1,224 @@
+// Checks the sound mixer against what the front-ends feed it every sample tick.
+//   cc -Isrc -Isrc/emulator -Isrc/emu8950 tests/sound_mix_test.c && ./a.out
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/emulator/ports.c"
+
+// Everything ports.c reaches outside of the sound sources, the OPL stays silent
+i8259_s i8259;
+i8253_s i8253;
+int speakerenabled;
+int timer_period;
+int videomode;
+int a20_enabled;
+uint8_t cga_hires;
+uint64_t scheduler_now;
+const uint8_t *memory_read_pages[MEMORY_PAGES];
+read86_t read86;
+write86_t write86;
+
+uint64_t i8253_now(void) { return 0; }
+void i8253_irq0_reload(uint32_t divisor) { }
+void scheduler_start(scheduler_event_t *event, scheduler_callback_t callback, uint64_t period_ticks,
+                     uint32_t period_divisor) { }
+void scheduler_stop(scheduler_event_t *event) { }
+void scheduler_savestate(savestate_t *state, const char *id, scheduler_event_t *event,
+                         scheduler_callback_t callback) { }
+void savestate_chunk(savestate_t *state, const char *id, void *data, size_t size) { }
+uint8_t savestate_loading(const savestate_t *state) { return 0; }
+void memory_map_a20() { }
+void out_ems(uint16_t port, uint8_t data) { }
+void cga_portout(uint16_t portnum, uint16_t value) { }
+uint16_t cga_portin(uint16_t portnum) { return 0xFF; }
+void tga_portout(uint16_t portnum, uint16_t value) { }
+void vga_portout(uint16_t portnum, uint16_t value) { }
+uint16_t vga_portin(uint16_t portnum) { return 0xFF; }
+void mouse_portout(uint16_t portnum, uint8_t value) { }
+uint8_t mouse_portin(uint16_t portnum) { return 0xFF; }
+int printf_(const char *format, ...) { return 0; }
+void OPL_writeReg(OPL *opl, uint32_t reg, uint8_t val) { }
+void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
+    memset(buffer, 0, nsamples * sizeof(int32_t));
+}
+
+// One frame as the front-ends take it, besides the DSS and Sound Blaster
+static int16_t sound_tick_sample(void) {
+    return covox_sample + speaker_sample();
+}
+
+// The LPT DAC changes on every frame of a block, each frame plays its own value
+static void test_covox(void) {
+    int16_t other[SOUND_BLOCK_SAMPLES];
+    int16_t samples[SOUND_BLOCK_SAMPLES * 2];
+    for (int i = 0; i < SOUND_BLOCK_SAMPLES; i++) {
+        portout(0x278, (uint16_t) (i * 4));
+        other[i] = sound_tick_sample();
+    }
+    get_sound_samples(other, samples, SOUND_BLOCK_SAMPLES);
+    for (int i = 0; i < SOUND_BLOCK_SAMPLES; i++) {
+        assert(samples[i * 2] == (i * 4 - 128) * 64);
+        assert(samples[i * 2 + 1] == samples[i * 2]);
+    }
+    portout(0x278, 128);
+    assert(covox_sample == 0);
+}
+
+// Speaker gate and PIT channel 2 changes in the middle of a block are heard from the next frame
+static void test_speaker(void) {
+    int16_t other[SOUND_BLOCK_SAMPLES];
+    int16_t samples[SOUND_BLOCK_SAMPLES * 2];
+    // a square wave of about SOUND_FREQUENCY / 8
+    const uint16_t divisor = (uint16_t) (PIT_FREQUENCY * 8 / SOUND_FREQUENCY);
+    portout(0x43, 0xB6);
+    portout(0x42, divisor & 0xFF);
+    portout(0x42, divisor >> 8);
+    const int period = SOUND_FREQUENCY / i8253_frequency(2);
+    assert(period >= 4);
+    for (int i = 0; i < SOUND_BLOCK_SAMPLES; i++) {
+        if (i == 10) portout(0x61, 3);
+        if (i == 50) portout(0x61, 0);
+        other[i] = sound_tick_sample();
+    }
+    get_sound_samples(other, samples, SOUND_BLOCK_SAMPLES);
+    for (int i = 0; i < SOUND_BLOCK_SAMPLES; i++) {
+        if (i < 10 || i >= 50) {
+            assert(samples[i * 2] == 0);
+        } else {
+            assert(samples[i * 2] == ((i - 10) % period < period / 2 ? 4096 : -4096));
+        }
+    }
+}
+
+// Stems as the capture front-end takes them: the DSS stem gets the LPT DAC of every tick, and the stems add up
+// to the mix. The SN76489 plays a tone so that a rendered synth is part of the sum
+static void test_stems(void) {
+    int16_t dss[SOUND_BLOCK_SAMPLES], sb[SOUND_BLOCK_SAMPLES], speaker[SOUND_BLOCK_SAMPLES];
+    int16_t samples[SOUND_BLOCK_SAMPLES * 2];
+    int16_t stem_samples[SOUND_STEMS][SOUND_BLOCK_SAMPLES * 2];
+    int16_t *const stems[SOUND_STEMS] = {
+        stem_samples[0], stem_samples[1], stem_samples[2], stem_samples[3], stem_samples[4], stem_samples[5],
+        stem_samples[6]
+    };
+    sn76489_reset();
+    portout(0xC0, 0x80 | 0x08);
+    portout(0xC0, 0x04);
+    portout(0xC0, 0x90);
+    int tone = 0;
+    // the tone takes a few blocks to toggle
+    for (int block = 0; block < 8; block++) {
+        for (int i = 0; i < SOUND_BLOCK_SAMPLES; i++) {
+            portout(0x278, (uint16_t) (i * 2 + block));
+            dss[i] = covox_sample;
+            sb[i] = (int16_t) (i * 16);
+            speaker[i] = i & 1 ? 1000 : -1000;
+        }
+        get_sound_stems(dss, sb, speaker, samples, stems, SOUND_BLOCK_SAMPLES);
+
+        for (int i = 0; i < SOUND_BLOCK_SAMPLES; i++) {
+            assert(stems[SOUND_STEM_DSS][i * 2] == (i * 2 + block - 128) * 64);
+            assert(stems[SOUND_STEM_SB][i * 2] == sb[i]);
+            assert(stems[SOUND_STEM_SPEAKER][i * 2] == speaker[i]);
+            for (int channel = 0; channel < 2; channel++) {
+                int32_t sum = 0;
+                for (int stem = 0; stem < SOUND_STEMS; stem++) {
+                    sum += stems[stem][i * 2 + channel];
+                }
+                assert(samples[i * 2 + channel] == sum);
+            }
+            tone |= stems[SOUND_STEM_SN76489][i * 2] != 0;
+        }
+    }
+    assert(tone);
+    portout(0xC0, 0x9F);
+    portout(0x278, 128);
+}
+
+// Sound Blaster DMA is fetched a block at a time, but the DMA controller counts the bytes as they are played, so
+// a guest polling it for the playing position sees each one. A channel programmed anew is followed at once
+static void test_blaster_dma(void) {
+    static uint8_t page[MEMORY_PAGE_SIZE];
+    for (int i = 0; i < MEMORY_PAGE_SIZE; i++) page[i] = (uint8_t) i;
+    memory_read_pages[0x1000 >> MEMORY_PAGE_SHIFT] = page;
+    // channel 1 reads 256 bytes from 0x1000
+    portout(0x0C, 0);
+    portout(0x02, 0x00);
+    portout(0x02, 0x10);
+    portout(0x03, 0xFF);
+    portout(0x03, 0x00);
+    portout(0x0B, 0x49);
+    portout(0x0A, 0x01);
+    // speaker on, a 200 byte 8-bit single cycle transfer
+    portout(0x22C, 0xD1);
+    portout(0x22C, 0x14);
+    portout(0x22C, 199);
+    portout(0x22C, 0);
+
+    for (int i = 0; i < 100; i++) {
+        assert(blaster_sample() == (i - 128) << 6);
+        assert(dma_channels[1].address == 0x1000 + i + 1);
+        assert(dma_channels[1].count == 254 - i);
+    }
+    portout(0x0C, 0);
+    const uint8_t low = portin(0x03);
+    assert((portin(0x03) << 8 | low) == 155);
+
+    portout(0x0C, 0);
+    portout(0x02, 0x80);
+    portout(0x02, 0x10);
+    assert(blaster_sample() == (0x80 - 128) << 6);
+    assert(dma_channels[1].address == 0x1081);
+    memory_read_pages[0x1000 >> MEMORY_PAGE_SHIFT] = NULL;
+}
+
+// Plays count bytes of an auto-init transfer with no DSP block left, each from where the channel points
+static void test_blaster_without_block(const int first, const int count) {
+    for (int i = first; i < first + count; i++) {
+        assert(blaster_sample() == (i - 128) << 6);
+        assert(dma_channels[1].address == 0x1000 + i + 1);
+        assert(sound_blaster.dma_fifo_position <= sound_blaster.dma_fifo_length);
+    }
+}
+
+// An auto-init transfer with no block size, or one set below what was already played, still plays the channel
+static void test_blaster_dma_no_block(void) {
+    static uint8_t page[MEMORY_PAGE_SIZE];
+    for (int i = 0; i < MEMORY_PAGE_SIZE; i++) page[i] = (uint8_t) i;
+    memory_read_pages[0x1000 >> MEMORY_PAGE_SHIFT] = page;
+    portout(0x0C, 0);
+    portout(0x02, 0x00);
+    portout(0x02, 0x10);
+    portout(0x03, 0xFF);
+    portout(0x03, 0x00);
+    portout(0x0B, 0x49);
+    portout(0x0A, 0x01);
+
+    // straight after a reset, without 0x48
+    portout(0x226, 1);
+    portout(0x226, 0);
+    portout(0x22C, 0xD1);
+    portout(0x22C, 0x1C);
+    test_blaster_without_block(0, 100);
+
+    // a 100 byte block cut down to the 50 bytes played of it
+    portout(0x22C, 0x48);
+    portout(0x22C, 99);
+    portout(0x22C, 0);
+    portout(0x22C, 0x1C);
+    for (int i = 100; i < 150; i++) assert(blaster_sample() == (i - 128) << 6);
+    portout(0x22C, 0x48);
+    portout(0x22C, 49);
+    portout(0x22C, 0);
+    test_blaster_without_block(150, 100);
+    memory_read_pages[0x1000 >> MEMORY_PAGE_SHIFT] = NULL;
+}
+
+int main(void) {
+    test_covox();
+    test_speaker();
+    test_stems();
+    test_blaster_dma();
+    test_blaster_dma_no_block();
+    return 0;
+}
@@ -1,8 +1,10 @@
-; MapDrive - A utility to map a host drive in the Pico-286 emulator.
+; MapDrive - A utility to map host drives in the Pico-286 emulator.
 ;
 ; This program interfaces with the emulator's built-in network redirector
-; (INT 2Fh, Function 11h) to make a host directory available as a DOS drive.
-; By default, it maps drive H: to the host's shared directory.
+; (INT 2Fh, Function 11h) to make host directories available as DOS drives.
+; It maps the drive letters given on the command line, e.g. MAPDRIVE H I J,
+; and drive H: when none are given. The emulator decides which host
+; directory each letter stands for.
 ;
 ; This allows for seamless file access between the DOS environment and the
 ; host system, simplifying file transfers and development workflows.
@@ -15,8 +17,7 @@
     use16
 
     ; Constants
-    DRIVE_LETTER         equ 'H'
-    DRIVE_NUMBER         equ 7         ; H = 7
+    DRIVE_LETTER         equ 'H'       ; mapped when no letters are given
     CDS_ENTRY_SIZE       equ 058h      ; DOS 4+ CDS entry size
     CDS_OFF_FLAGS        equ 043h      ; offset of flags within CDS entry
     ; Flags
@@ -32,6 +33,7 @@
         ; Get LASTDRIVE at ES:[BX+21h] (DOS 3.1+)
         mov si, 021h
         mov dl, byte [es:bx+si]    ; DL = lastdrive
+        mov [lastdrive], dl
 
         ; Get CDS base pointer (far) at ES:[BX+16h] (offset:segment)
         mov si, 016h
@@ -45,29 +47,8 @@
         je .error_cds
 
     .cds_ok:
-        ; Check drive <= lastdrive
-        mov al, DRIVE_NUMBER
-        cmp al, dl
-        jg .error_lastdrive
-
-    .drive_ok:
-        ; DI = CDS entry = BX + drive * 58h (use MUL instead of many SHLs)
-        mov di, bx                 ; DI = CDS base offset
-        xor ax, ax
-        mov al, DRIVE_NUMBER       ; AL = drive (0..25)
-        mov bl, CDS_ENTRY_SIZE     ; BL = 88 (0x58)
-        mul bl                     ; AX = AL * BL
-        add di, ax                 ; DI = CDS base + drive * 58h (entry address)
-
-    .drive_free:
-        ; Set flags = NET|PHY (C000h)
-        mov word [es:di+CDS_OFF_FLAGS], CDSFLAG_NET_PHY
-
-        ; Set current_path = "H:\"
-        mov byte [es:di+0], DRIVE_LETTER
-        mov byte [es:di+1], ':'
-        mov byte [es:di+2], '\'
-        mov byte [es:di+3], 0
+        mov [cds_base], bx
+        mov [cds_base+2], es
 
         ; Get SDA pointer: INT 21h, AX=5D06h -> DS:SI
         mov ax, 5D06h
@@ -84,29 +65,87 @@
         mov ax, 1100h
         int 2Fh
 
-        ; Success message
-        mov dx, msg_ok
-        mov ah, 09h
-        int 21h
-
+        ; Every letter of the command tail at 81h is a drive to map
+        mov si, 081h
+        xor cx, cx                 ; CX = drives mapped
+    .next_letter:
+        lodsb
+        cmp al, 0Dh
+        je .tail_done
+        and al, 0DFh               ; upper case
+        cmp al, 'A'
+        jb .next_letter
+        cmp al, 'Z'
+        ja .next_letter
+        call map_drive
+        inc cx
+        jmp .next_letter
+
+    .tail_done:
+        test cx, cx
+        jnz exit
+        mov al, DRIVE_LETTER
+        call map_drive
         jmp exit
 
     .error_cds:
         mov dx, err_cds_fail
         mov ah, 09h
         int 21h
-        jmp exit
+
+    exit:
+        mov ax, 4C00h
+        int 21h
+
+    ; Maps the drive of letter AL, preserves SI and CX
+    map_drive:
+        push si
+        push cx
+        mov [msg_ok_letter], al
+        mov [err_lastdrive_letter], al
+
+        ; Check drive < lastdrive
+        sub al, 'A'                ; AL = drive (0..25)
+        cmp al, [lastdrive]
+        jae .error_lastdrive
+
+        ; DI = CDS entry = CDS base + drive * 58h
+        les di, [cds_base]
+        mov bl, CDS_ENTRY_SIZE     ; BL = 88 (0x58)
+        mul bl                     ; AX = AL * BL
+        add di, ax                 ; DI = CDS base + drive * 58h (entry address)
+
+        ; Set flags = NET|PHY (C000h)
+        mov word [es:di+CDS_OFF_FLAGS], CDSFLAG_NET_PHY
+
+        ; Set current_path = "X:\"
+        mov al, [msg_ok_letter]
+        mov byte [es:di+0], al
+        mov byte [es:di+1], ':'
+        mov byte [es:di+2], '\'
+        mov byte [es:di+3], 0
+
+        ; Success message
+        mov dx, msg_ok
+        jmp .print
 
     .error_lastdrive:
         mov dx, err_lastdrive
-        mov ah, 09h
-        int 21h
 
-    exit:
-        mov ax, 4C00h
+    .print:
+        mov ah, 09h
         int 21h
+        pop cx
+        pop si
+        ret
 
     ; Data
-    err_cds_fail  db 'Error: Could not get CDS for drive H:.',13,10,'$'
-    err_lastdrive db 'Your LASTDRIVE setting in CONFIG.SYS might be set to H',13,10,'$'
-    msg_ok        db 'Drive H: successfully mapped as a host drive.',13,10,'$'
\ No newline at end of file
+    err_cds_fail  db 'Error: Could not get the CDS.',13,10,'$'
+    err_lastdrive db 'Drive '
+    err_lastdrive_letter db 'H'
+                  db ': is beyond your LASTDRIVE setting in CONFIG.SYS',13,10,'$'
+    msg_ok        db 'Drive '
+    msg_ok_letter db 'H'
+                  db ': successfully mapped as a host drive.',13,10,'$'
+    lastdrive     db 0
+    cds_base      dd 0